@@ -38,9 +38,32 @@ public:
         return 0;
     }
 
+    // Client IPv4 address (in network byte order) - false if not known
+    // IPv6 peers may be given a 32 bit key derived from the address instead (e.g. for rate limiting)
+    virtual bool getClientIPAddr(uint32_t& ipAddr)
+    {
+        return false;
+    }
+
     // Write
     virtual RdWebConnSendRetVal write(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxRetryMs);
 
+    // Write header and payload from separate buffers - bytesWritten is set to the number of bytes
+    // accepted (which may be part of the total when EAGAIN is returned)
+    virtual RdWebConnSendRetVal writev(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t maxRetryMs, uint32_t& bytesWritten)
+    {
+        bytesWritten = 0;
+        RdWebConnSendRetVal retVal = write(pHdr, hdrLen, maxRetryMs);
+        if (retVal != RdWebConnSendRetVal::WEB_CONN_SEND_OK)
+            return retVal;
+        bytesWritten = hdrLen;
+        retVal = write(pBuf, bufLen, maxRetryMs);
+        if (retVal == RdWebConnSendRetVal::WEB_CONN_SEND_OK)
+            bytesWritten += bufLen;
+        return retVal;
+    }
+
     // Setup
     virtual void setup(bool blocking);
 
@@ -24,6 +24,15 @@ public:
         return (uint32_t) _client;
     }
 
+    // Client IPv4 address
+    virtual bool getClientIPAddr(uint32_t& ipAddr) override final
+    {
+        if (!_client)
+            return false;
+        ipAddr = (uint32_t) _client->remoteIP();
+        return true;
+    }
+
     // Write
     virtual RdWebConnSendRetVal write(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxRetryMs) override final;
 
@@ -34,6 +34,34 @@ void RdClientConnNetconn::setup(bool blocking)
        netconn_set_recvtimeout(_client, 1);
 }
 
+bool RdClientConnNetconn::getClientIPAddr(uint32_t& ipAddr)
+{
+    ip_addr_t peerAddr;
+    u16_t peerPort = 0;
+    if (netconn_peer(_client, &peerAddr, &peerPort) != ERR_OK)
+        return false;
+#if LWIP_IPV6
+    if (IP_IS_V6(&peerAddr))
+    {
+        // IPv4-mapped addresses use the IPv4 address - others are hashed (FNV-1a) to form the key
+        const ip6_addr_t* pIP6Addr = ip_2_ip6(&peerAddr);
+        if (ip6_addr_isipv4mappedip6(pIP6Addr))
+        {
+            ipAddr = pIP6Addr->addr[3];
+            return true;
+        }
+        uint32_t hash = 2166136261u;
+        const uint8_t* pAddrBytes = (const uint8_t*)pIP6Addr->addr;
+        for (uint32_t i = 0; i < sizeof(pIP6Addr->addr); i++)
+            hash = (hash ^ pAddrBytes[i]) * 16777619u;
+        ipAddr = hash;
+        return true;
+    }
+#endif
+    ipAddr = ip4_addr_get_u32(ip_2_ip4(&peerAddr));
+    return true;
+}
+
 RdWebConnSendRetVal RdClientConnNetconn::write(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxRetryMs)
 {
     // Check active
@@ -52,6 +80,34 @@ RdWebConnSendRetVal RdClientConnNetconn::write(const uint8_t* pBuf, uint32_t buf
     return (err = ERR_OK) ? RdWebConnSendRetVal::WEB_CONN_SEND_OK : RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
 }
 
+RdWebConnSendRetVal RdClientConnNetconn::writev(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t maxRetryMs, uint32_t& bytesWritten)
+{
+    // Check active
+    bytesWritten = 0;
+    if (!isActive())
+    {
+        LOG_W(MODULE_PREFIX, "writev conn %d isActive FALSE", getClientId());
+        return RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+    }
+
+    // Header is flagged as having more to follow so it is sent in the same segment as the payload
+    esp_err_t err = netconn_write(_client, pHdr, hdrLen, NETCONN_COPY | NETCONN_MORE);
+    if (err == ERR_OK)
+    {
+        bytesWritten = hdrLen;
+        err = netconn_write(_client, pBuf, bufLen, NETCONN_COPY);
+    }
+    if (err != ERR_OK)
+    {
+        LOG_W(MODULE_PREFIX, "writev failed err %s (%d) connClient %d",
+                    RdWebInterface::espIdfErrToStr(err), err, getClientId());
+        return RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+    }
+    bytesWritten += bufLen;
+    return RdWebConnSendRetVal::WEB_CONN_SEND_OK;
+}
+
 uint8_t* RdClientConnNetconn::getDataStart(uint32_t& dataLen, bool& errorOccurred, bool& connClosed)
 {
     // End any current data operation
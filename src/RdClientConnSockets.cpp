@@ -51,6 +51,16 @@ void RdClientConnSockets::setup(bool blocking)
     }
 }
 
+bool RdClientConnSockets::getClientIPAddr(uint32_t& ipAddr)
+{
+    struct sockaddr_in peerAddr;
+    socklen_t peerAddrLen = sizeof(peerAddr);
+    if ((getpeername(_client, (struct sockaddr*)&peerAddr, &peerAddrLen) != 0) || (peerAddr.sin_family != AF_INET))
+        return false;
+    ipAddr = peerAddr.sin_addr.s_addr;
+    return true;
+}
+
 RdWebConnSendRetVal RdClientConnSockets::write(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxRetryMs)
 {
     // Check active
@@ -110,6 +120,58 @@ RdWebConnSendRetVal RdClientConnSockets::write(const uint8_t* pBuf, uint32_t buf
     }
 }
 
+RdWebConnSendRetVal RdClientConnSockets::writev(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t maxRetryMs, uint32_t& bytesWritten)
+{
+    // Check active
+    bytesWritten = 0;
+    if (!isActive())
+    {
+        LOG_W(MODULE_PREFIX, "writev conn %d isActive FALSE", getClientId());
+        return RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+    }
+
+    // Gather header and payload
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)pHdr;
+    iov[0].iov_len = hdrLen;
+    iov[1].iov_base = (void*)pBuf;
+    iov[1].iov_len = bufLen;
+
+    // Write using socket
+    uint32_t startMs = millis();
+    while (true)
+    {
+        int rslt = ::writev(_client, iov, 2);
+        if (rslt < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                if ((maxRetryMs == 0) || Utils::isTimeout(millis(), startMs, maxRetryMs))
+                {
+#ifdef DEBUG_SOCKET_EAGAIN
+                    LOG_I(MODULE_PREFIX, "writev EAGAIN returning conn %d len %d retry %dms", getClientId(), hdrLen + bufLen, maxRetryMs);
+#endif
+                    return RdWebConnSendRetVal::WEB_CONN_SEND_EAGAIN;
+                }
+                vTaskDelay(1);
+                continue;
+            }
+#ifdef WARN_SOCKET_SEND_FAIL
+            LOG_I(MODULE_PREFIX, "writev failed errno error %d conn %d len %d", errno, getClientId(), hdrLen + bufLen);
+#endif
+            return RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+        }
+
+        // Partial write leaves the remainder for the caller to queue
+        bytesWritten = rslt;
+#ifdef DEBUG_SOCKET_SEND
+        LOG_I(MODULE_PREFIX, "writev conn %d len %d written %d", getClientId(), hdrLen + bufLen, bytesWritten);
+#endif
+        return bytesWritten == hdrLen + bufLen ? RdWebConnSendRetVal::WEB_CONN_SEND_OK : RdWebConnSendRetVal::WEB_CONN_SEND_EAGAIN;
+    }
+}
+
 uint8_t* RdClientConnSockets::getDataStart(uint32_t& dataLen, bool& errorOccurred, bool& connClosed)
 {
     // End any current data operation
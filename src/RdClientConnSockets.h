@@ -24,8 +24,13 @@ public:
         return (uint32_t) _client;
     }
 
+    // Client IPv4 address
+    virtual bool getClientIPAddr(uint32_t& ipAddr) override final;
+
     // Write
     virtual RdWebConnSendRetVal write(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxRetryMs) override final;
+    virtual RdWebConnSendRetVal writev(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t maxRetryMs, uint32_t& bytesWritten) override final;
 
     // Setup
     virtual void setup(bool blocking) override final;
@@ -0,0 +1,106 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include "RdWebSendGate.h"
+
+// Lookup of the connection slot of a channel without a lock - any task can look up while entries are
+// added and removed by one task at a time (the owner serializes them)
+// Open addressing with linear probing - an entry's channelID is fixed once set (entries are reused when
+// the channel is added again, as channelIDs are set per handler connection and so recur) and its slot is
+// stored with the generation of the slot's send gate when the channel was added
+// add() fails if the table is full - the owner must then look up such channels another way
+class RdWebChannelTable
+{
+public:
+    // Setup (not thread-safe) - capacity is rounded up to a power of 2
+    void setup(uint32_t capacity)
+    {
+        _capacity = MIN_CAPACITY;
+        while (_capacity < capacity)
+            _capacity *= 2;
+        _entries.reset(new Entry[_capacity]);
+    }
+
+    // Add (or update) a channel - connSlotIdx must be less than MAX_CONN_SLOTS
+    bool add(uint32_t channelID, uint32_t connSlotIdx, uint32_t gen)
+    {
+        if ((channelID == NO_CHANNEL) || (connSlotIdx >= MAX_CONN_SLOTS))
+            return false;
+        Entry* pEntry = findEntry(channelID, true);
+        if (!pEntry)
+            return false;
+        pEntry->slotGen.store(((gen & RdWebSendGate::GEN_MASK) << SLOT_BITS) | connSlotIdx, std::memory_order_release);
+        pEntry->channelID.store(channelID, std::memory_order_release);
+        return true;
+    }
+
+    // Remove a channel if it is on connSlotIdx
+    void remove(uint32_t channelID, uint32_t connSlotIdx)
+    {
+        Entry* pEntry = findEntry(channelID, false);
+        if (pEntry && ((pEntry->slotGen.load(std::memory_order_relaxed) & SLOT_MASK) == connSlotIdx))
+            pEntry->slotGen.store(NO_SLOT, std::memory_order_release);
+    }
+
+    // Look up a channel - gen is the generation the slot had when the channel was added
+    bool lookup(uint32_t channelID, uint32_t& connSlotIdx, uint32_t& gen) const
+    {
+        if (channelID == NO_CHANNEL)
+            return false;
+        Entry* pEntry = findEntry(channelID, false);
+        if (!pEntry)
+            return false;
+        uint32_t slotGen = pEntry->slotGen.load(std::memory_order_acquire);
+        if (slotGen == NO_SLOT)
+            return false;
+        connSlotIdx = slotGen & SLOT_MASK;
+        gen = slotGen >> SLOT_BITS;
+        return true;
+    }
+
+    static const uint32_t MAX_CONN_SLOTS = 255;
+
+private:
+    static const uint32_t NO_CHANNEL = UINT32_MAX;
+    static const uint32_t NO_SLOT = UINT32_MAX;
+    static const uint32_t SLOT_BITS = 8;
+    static const uint32_t SLOT_MASK = (1 << SLOT_BITS) - 1;
+    static const uint32_t MIN_CAPACITY = 16;
+
+    class Entry
+    {
+    public:
+        std::atomic<uint32_t> channelID{NO_CHANNEL};
+        std::atomic<uint32_t> slotGen{NO_SLOT};
+    };
+    std::unique_ptr<Entry[]> _entries;
+    uint32_t _capacity = 0;
+
+    // Find the entry for a channel - if claimUnused an unused entry is returned when there is none
+    Entry* findEntry(uint32_t channelID, bool claimUnused) const
+    {
+        if (!_entries)
+            return nullptr;
+        uint32_t idx = (channelID * 2654435761u) & (_capacity - 1);
+        for (uint32_t i = 0; i < _capacity; i++)
+        {
+            Entry* pEntry = &_entries[(idx + i) & (_capacity - 1)];
+            uint32_t entryChannelID = pEntry->channelID.load(std::memory_order_acquire);
+            if (entryChannelID == channelID)
+                return pEntry;
+            if (entryChannelID == NO_CHANNEL)
+                return claimUnused ? pEntry : nullptr;
+        }
+        return nullptr;
+    }
+};
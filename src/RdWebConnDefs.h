@@ -10,8 +10,10 @@
 
 #include "stdint.h"
 #include <functional>
+#include <WString.h>
 
 // Callback function for any endpoint
+// EAGAIN means the data (or the part not yet written) has been queued by the connection and will be sent later
 enum RdWebConnSendRetVal
 {
     WEB_CONN_SEND_FAIL,
@@ -32,4 +34,31 @@ public:
     }
 };
 
+// Send status of a channel
+enum RdWebChannelSendStatus
+{
+    // Ready for a message
+    WEB_CHANNEL_SEND_READY,
+    // Channel tx queue is full - retry later
+    WEB_CHANNEL_SEND_NOT_READY,
+    // A lock wasn't obtained in time - retry later
+    WEB_CHANNEL_SEND_BUSY,
+    // Channel doesn't exist (maybe it has just closed) - messages can be discarded
+    WEB_CHANNEL_SEND_NO_CONN
+};
+
 typedef std::function<RdWebConnSendRetVal(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxSendRetryMs)> RdWebConnSendFn;
+
+// Send a header and payload from separate buffers without copying them together
+typedef std::function<RdWebConnSendRetVal(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t maxSendRetryMs)> RdWebConnSendVecFn;
+
+// Returns true when data queued on the connection has been sent (so a further send won't be queued)
+typedef std::function<bool()> RdWebConnReadyToSendFn;
+
+// Subscribe (or unsubscribe) the connection to publish/subscribe topics (comma separated names)
+typedef std::function<bool(const String& topicNames, bool subscribe)> RdWebConnTopicSubscribeFn;
+
+// Replay server-side events after lastEventID to the connection - returns false if the replay couldn't be
+// started (a lock wasn't obtained in time) and should be retried
+typedef std::function<bool(uint32_t lastEventID)> RdWebConnSSEventsReplayFn;
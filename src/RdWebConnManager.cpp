@@ -12,11 +12,15 @@
 #include "RdWebHandler.h"
 #include "RdWebHandlerWS.h"
 #include "RdWebResponder.h"
+#include "RdWebSSEvent.h"
 #include <stdint.h>
 #include <string.h>
 #include <Utils.h>
+#include <ArduinoTime.h>
 #ifdef ESP8266
 #include "ESP8266Utils.h"
+#else
+#include "esp_system.h"
 #endif
 
 const static char* MODULE_PREFIX = "WebConnMgr";
@@ -31,8 +35,14 @@ const static char* MODULE_PREFIX = "WebConnMgr";
 #include "esp_heap_trace.h"
 #endif
 
+// Warn
+#define WARN_SEND_LOCK_TIMEOUT_DROP
+#define WARN_SEND_LOCK_TIMEOUT_DROP_EVERY 100
+
 // Debug
 // #define DEBUG_WEB_CONN_MANAGER
+// #define DEBUG_SSE_FORMAT_TIMING
+#define DEBUG_SSE_FORMAT_TIMING_EVERY 100
 // #define DEBUG_WEB_SERVER_HANDLERS
 // #define DEBUG_WEBSOCKETS
 // #define DEBUG_WEBSOCKETS_SEND_DETAIL
@@ -50,6 +60,11 @@ RdWebConnManager::RdWebConnManager()
     // Mutex controlling endpoint access
     _endpointsMutex = xSemaphoreCreateMutex();
 
+    // Mutex controlling channel map access
+    _channelMapMutex = xSemaphoreCreateMutex();
+    _channelTableOverflow = false;
+    _lockTimeoutDropCount = 0;
+
     // Setup callback for new connections
     _connClientListener.setHandOffNewConnCB(std::bind(&RdWebConnManager::handleNewConnection, this, std::placeholders::_1));
 }
@@ -58,6 +73,8 @@ RdWebConnManager::~RdWebConnManager()
 {
     if (_endpointsMutex)
         vSemaphoreDelete(_endpointsMutex);
+    if (_channelMapMutex)
+        vSemaphoreDelete(_channelMapMutex);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -71,6 +88,20 @@ void RdWebConnManager::setup(RdWebServerSettings &settings)
 
     // Create slots
     _webConnections.resize(_webServerSettings._numConnSlots);
+    _connSlotSendStates.reset(new ConnSlotSendState[_webServerSettings._numConnSlots]);
+    _channelTable.setup(_webServerSettings._numConnSlots * CHANNEL_TABLE_ENTRIES_PER_CONN_SLOT);
+
+    // Topic subscriptions are held per connection slot
+    _topics.setup(_webServerSettings._numConnSlots);
+
+    // Server-side events kept for replay - event IDs start from a random point on each boot so a
+    // Last-Event-ID from before a reboot doesn't skip events
+#ifndef ESP8266
+    uint32_t sseEventIDSeed = esp_random();
+#else
+    uint32_t sseEventIDSeed = RANDOM_REG32;
+#endif
+    _sseEventRing.setup(_webServerSettings._sseReplayMaxBytes, sseEventIDSeed);
 
 #ifndef ESP8266
     // Create queue for new connections
@@ -173,7 +204,7 @@ bool RdWebConnManager::accommodateConnection(RdClientConnBase* pClientConn)
 #endif
 
     // Place new connection in slot - after this point the WebConnection is responsible for deleting
-    if (!_webConnections[slotIdx].setNewConn(pClientConn, this, _webServerSettings._sendBufferMaxLen))
+    if (!_webConnections[slotIdx].setNewConn(pClientConn, this, slotIdx, _webServerSettings._sendBufferMaxLen))
         return false;
     return true;
 }
@@ -266,40 +297,63 @@ RdWebResponder *RdWebConnManager::getNewResponder(const RdWebRequestHeader &head
     return nullptr;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get send status of a channel
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebChannelSendStatus RdWebConnManager::getChannelSendStatus(uint32_t channelID)
+{
+    uint32_t connSlotIdx = 0;
+    RdWebChannelSendStatus sendStatus = lockChannelForSend(channelID, connSlotIdx);
+    if (sendStatus != WEB_CHANNEL_SEND_READY)
+        return sendStatus;
+    RdWebResponder* pResponder = _webConnections[connSlotIdx].getResponder();
+    bool readyForData = pResponder && pResponder->readyForChannelData(channelID);
+    unlockConnSlot(connSlotIdx);
+    return readyForData ? WEB_CHANNEL_SEND_READY : WEB_CHANNEL_SEND_NOT_READY;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Check if channel is ready to send
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 bool RdWebConnManager::canSend(uint32_t& channelID, bool& noConn)
 {
-    // Find websocket responder corresponding to channel
-    for (uint32_t i = 0; i < _webConnections.size(); i++)
-    {
-        // Check active
-        if (!_webConnections[i].isActive())
-            continue;
+    // If channel doesn't exist (maybe it has just closed) then
+    // indicate no connection so that messages can be discarded
+    RdWebChannelSendStatus sendStatus = getChannelSendStatus(channelID);
+    noConn = sendStatus == WEB_CHANNEL_SEND_NO_CONN;
+    return sendStatus == WEB_CHANNEL_SEND_READY;
+}
 
-        // Get responder
-        RdWebResponder* pResponder = _webConnections[i].getResponder();
-        if (!pResponder)
-            continue;
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get latency of channel
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        // Get channelID
-        uint32_t usedChannelID = 0;
-        if (!pResponder->getChannelID(usedChannelID))
-            continue;
+bool RdWebConnManager::getChannelLatencyMs(uint32_t channelID, uint32_t& lastMs, uint32_t& avgMs)
+{
+    uint32_t connSlotIdx = 0;
+    if (lockChannelForSend(channelID, connSlotIdx) != WEB_CHANNEL_SEND_READY)
+        return false;
+    RdWebResponder* pResponder = _webConnections[connSlotIdx].getResponder();
+    bool latencyOk = pResponder && pResponder->getLatencyMs(lastMs, avgMs);
+    unlockConnSlot(connSlotIdx);
+    return latencyOk;
+}
 
-        // Check for channelID match
-        if (usedChannelID == channelID)
-        {
-            return pResponder->readyForData();
-        }
-    }
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get stats of channel
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // If channel doesn't exist (maybe it has just closed) then
-    // indicate no connection so that messages can be discarded
-    noConn = true;
-    return false;
+String RdWebConnManager::getChannelStatsJSON(uint32_t channelID)
+{
+    uint32_t connSlotIdx = 0;
+    if (lockChannelForSend(channelID, connSlotIdx) != WEB_CHANNEL_SEND_READY)
+        return "{}";
+    RdWebResponder* pResponder = _webConnections[connSlotIdx].getResponder();
+    String statsJSON = pResponder ? pResponder->getChannelStatsJSON(channelID) : "{}";
+    unlockConnSlot(connSlotIdx);
+    return statsJSON;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -309,68 +363,494 @@ bool RdWebConnManager::canSend(uint32_t& channelID, bool& noConn)
 bool RdWebConnManager::sendMsg(const uint8_t* pBuf, uint32_t bufLen,
                                         bool allChannels, uint32_t channelID)
 {
+    // Send on a single channel
+    if (!allChannels)
+    {
+        uint32_t connSlotIdx = 0;
+        if (!lockChannelForSendMsg(channelID, connSlotIdx))
+            return false;
+        bool sendOk = _webConnections[connSlotIdx].sendOnConn(pBuf, bufLen, channelID);
+        unlockConnSlot(connSlotIdx);
+        return sendOk;
+    }
+
+    // Find the slots of all channels
+    if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+    {
+        countLockTimeoutDrop("sendMsg");
+        return false;
+    }
+    std::vector<ConnSlotSendTarget> sendTargets;
+    sendTargets.reserve(_channelIDToConnSlot.size());
+    for (auto& channelSlot : _channelIDToConnSlot)
+    {
+        uint32_t connSlotIdx = 0;
+        if (getChannelResponder(channelSlot.first, connSlotIdx))
+            sendTargets.push_back({connSlotIdx, channelSlot.first, _connSlotSendStates[connSlotIdx].sendGate.getGen()});
+    }
+    xSemaphoreGive(_channelMapMutex);
+
+    // When sending on all channels the websocket frame is encoded once (when first needed) and
+    // the encoded frame is shared by the tx queues of all websocket connections
+    RdWebDataFrame encodedFrame;
     bool anyOk = false;
-    for (uint32_t i = 0; i < _webConnections.size(); i++)
+    for (ConnSlotSendTarget& sendTarget : sendTargets)
     {
 #ifdef DEBUG_WEBSOCKETS_SEND_DETAIL
+        LOG_I(MODULE_PREFIX, "sendMsg webConn %d active %d responder %ld chanID %d ",
+              sendTarget.connSlotIdx,
+              _webConnections[sendTarget.connSlotIdx].isActive(),
+              (unsigned long)_webConnections[sendTarget.connSlotIdx].getResponder(),
+              sendTarget.channelID);
+#endif
+        if (!lockConnSlotForSendMsg(sendTarget))
+            continue;
+        anyOk |= sendOnConnSlotShared(sendTarget.connSlotIdx, sendTarget.channelID, encodedFrame, pBuf, bufLen);
+        unlockConnSlot(sendTarget.connSlotIdx);
+    }
+    return anyOk;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send message on a connection slot as one of many - the slot must be locked for sending
+// For websockets the frame is encoded on first use and the encoded frame is shared by all connections
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnManager::sendOnConnSlotShared(uint32_t connSlotIdx, uint32_t channelID, RdWebDataFrame& encodedFrame, 
+                const uint8_t* pBuf, uint32_t bufLen)
+{
+    // Check active
+    if ((connSlotIdx >= _webConnections.size()) || !_webConnections[connSlotIdx].isActive())
+        return false;
+#ifndef ESP8266
+    if (_webConnections[connSlotIdx].getHeader().reqConnType == REQ_CONN_TYPE_WEBSOCKET)
+    {
+        if (encodedFrame.getLen() == 0)
         {
-            uint32_t debugChanId = 0;
-            bool debugChanIdOk = false;
-            if (_webConnections[i].getResponder())
-                debugChanIdOk = _webConnections[i].getResponder()->getChannelID(debugChanId);
-            LOG_I(MODULE_PREFIX, "sendMsg webConn %d active %d responder %ld chanID %d ",
-                  i,
-                  _webConnections[i].isActive(),
-                  (unsigned long)_webConnections[i].getResponder(),
-                  debugChanIdOk ? debugChanId : -1);
+            std::shared_ptr<std::vector<uint8_t>> pEncoded = std::make_shared<std::vector<uint8_t>>();
+            RdWebSocketLink::encodeFrameUnmasked(*pEncoded, WEBSOCKET_OPCODE_BINARY, pBuf, bufLen);
+            encodedFrame = RdWebDataFrame(pEncoded, true);
         }
+        return _webConnections[connSlotIdx].sendOnConnEncoded(encodedFrame, pBuf, bufLen, channelID);
+    }
+#endif
+    return _webConnections[connSlotIdx].sendOnConn(pBuf, bufLen, channelID);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add publish/subscribe topic
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RdWebConnManager::addTopic(const String& topicName)
+{
+    if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+    {
+        LOG_W(MODULE_PREFIX, "addTopic %s failed - lock timeout", topicName.c_str());
+        return RdWebTopics::TOPIC_IDX_INVALID;
+    }
+    uint32_t topicIdx = _topics.addTopic(topicName);
+    xSemaphoreGive(_channelMapMutex);
+#ifdef DEBUG_WEBSOCKETS
+    LOG_I(MODULE_PREFIX, "addTopic %s idx %d", topicName.c_str(), topicIdx);
 #endif
+    return topicIdx;
+}
 
-        // Check active
-        if (!_webConnections[i].isActive())
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Subscribe/unsubscribe a connection to topics
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnManager::topicSubscribe(const String& topicNames, uint32_t connSlotIdx, bool subscribe)
+{
+    // Called on the connection task so don't wait long
+    if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+    {
+        LOG_W(MODULE_PREFIX, "topicSubscribe %s connSlot %d topics %s failed - lock timeout", 
+                    subscribe ? "SUB" : "UNSUB", connSlotIdx, topicNames.c_str());
+        return false;
+    }
+    bool allOk = true;
+    int startPos = 0;
+    while (startPos <= (int)topicNames.length())
+    {
+        int sepPos = topicNames.indexOf(',', startPos);
+        if (sepPos < 0)
+            sepPos = topicNames.length();
+        String topicName = topicNames.substring(startPos, sepPos);
+        topicName.trim();
+        if (topicName.length() > 0)
+            allOk &= _topics.subscribe(topicName, connSlotIdx, subscribe);
+        startPos = sepPos + 1;
+    }
+    xSemaphoreGive(_channelMapMutex);
+#ifdef DEBUG_WEBSOCKETS
+    LOG_I(MODULE_PREFIX, "topicSubscribe %s connSlot %d topics %s%s", subscribe ? "SUB" : "UNSUB", 
+                connSlotIdx, topicNames.c_str(), allOk ? "" : " (UNKNOWN TOPIC)");
+#endif
+    return allOk;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Publish message to topic subscribers
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnManager::publish(uint32_t topicIdx, const uint8_t* pBuf, uint32_t bufLen)
+{
+    // Find the slots of the subscribers
+    if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+    {
+        countLockTimeoutDrop("publish");
+        return false;
+    }
+    std::vector<ConnSlotSendTarget> sendTargets;
+    _topics.forEachSubscriber(topicIdx, [&](uint32_t connSlotIdx) {
+        // Subscriptions are made on the connection so publish on its main channel
+        uint32_t channelID = 0;
+        if ((connSlotIdx >= _webConnections.size()) || !_connSlotSendStates[connSlotIdx].responderActive)
+            return;
+        RdWebResponder* pResponder = _webConnections[connSlotIdx].getResponder();
+        if (pResponder && pResponder->getChannelID(channelID))
+            sendTargets.push_back({connSlotIdx, channelID, _connSlotSendStates[connSlotIdx].sendGate.getGen()});
+    });
+    xSemaphoreGive(_channelMapMutex);
+
+    // Send
+    bool anyOk = false;
+    RdWebDataFrame encodedFrame;
+    for (ConnSlotSendTarget& sendTarget : sendTargets)
+    {
+        if (!lockConnSlotForSendMsg(sendTarget))
             continue;
+        anyOk |= sendOnConnSlotShared(sendTarget.connSlotIdx, sendTarget.channelID, encodedFrame, pBuf, bufLen);
+        unlockConnSlot(sendTarget.connSlotIdx);
+    }
+    return anyOk;
+}
+
+bool RdWebConnManager::publish(const String& topicName, const uint8_t* pBuf, uint32_t bufLen)
+{
+    if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+    {
+        countLockTimeoutDrop("publish");
+        return false;
+    }
+    uint32_t topicIdx = 0;
+    bool topicOk = _topics.getTopicIdx(topicName, topicIdx);
+    xSemaphoreGive(_channelMapMutex);
+    return topicOk && publish(topicIdx, pBuf, bufLen);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send message generated by a producer on channel
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        // Flag indicating we should send
-        bool sendOnThisSocket = allChannels;
-        if (!sendOnThisSocket)
+bool RdWebConnManager::sendMsgProducer(RdWebSocketTxProducerCB txProducerCB, uint32_t channelID)
+{
+    uint32_t connSlotIdx = 0;
+    if (!lockChannelForSendMsg(channelID, connSlotIdx))
+        return false;
+    bool rslt = _webConnections[connSlotIdx].sendOnConnProducer(txProducerCB, channelID);
+    unlockConnSlot(connSlotIdx);
+    return rslt;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get responder for a channel (if the connection is active) - channel map mutex must be held
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebResponder* RdWebConnManager::getChannelResponder(uint32_t channelID, uint32_t& connSlotIdx)
+{
+    auto it = _channelIDToConnSlot.find(channelID);
+    if (it == _channelIDToConnSlot.end())
+        return nullptr;
+    connSlotIdx = it->second;
+    if ((connSlotIdx >= _webConnections.size()) || !_connSlotSendStates[connSlotIdx].responderActive || 
+                !_webConnections[connSlotIdx].isActive())
+        return nullptr;
+    return _webConnections[connSlotIdx].getResponder();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lock the slot of a channel for sending - the slot is found in the channel table without a lock (the
+// channel map mutex is only needed if the table has overflowed and the channel isn't in it)
+// If WEB_CHANNEL_SEND_READY is returned the slot must be unlocked with unlockConnSlot()
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebChannelSendStatus RdWebConnManager::lockChannelForSend(uint32_t channelID, uint32_t& connSlotIdx)
+{
+    uint32_t responderGen = 0;
+    if (!_channelTable.lookup(channelID, connSlotIdx, responderGen))
+    {
+        if (!_channelTableOverflow)
+            return WEB_CHANNEL_SEND_NO_CONN;
+        if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+            return WEB_CHANNEL_SEND_BUSY;
+        RdWebResponder* pResponder = getChannelResponder(channelID, connSlotIdx);
+        responderGen = pResponder ? _connSlotSendStates[connSlotIdx].sendGate.getGen() : 0;
+        xSemaphoreGive(_channelMapMutex);
+        if (!pResponder)
+            return WEB_CHANNEL_SEND_NO_CONN;
+    }
+    if (connSlotIdx >= _webConnections.size())
+        return WEB_CHANNEL_SEND_NO_CONN;
+    RdWebChannelSendStatus sendStatus = lockConnSlotForSend(connSlotIdx, responderGen);
+    if (sendStatus != WEB_CHANNEL_SEND_READY)
+        return sendStatus;
+
+    // The responder can't be removed while the slot is locked
+    if (!_webConnections[connSlotIdx].isActive() || !_webConnections[connSlotIdx].getResponder())
+    {
+        unlockConnSlot(connSlotIdx);
+        return WEB_CHANNEL_SEND_NO_CONN;
+    }
+    return WEB_CHANNEL_SEND_READY;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lock a connection slot for sending - responderGen is the generation of the responder when the slot was
+// found (if the responder has been removed since then the slot isn't locked)
+// The gate is acquired with a compare-and-swap - if another sender holds it this waits a tick at a time
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebChannelSendStatus RdWebConnManager::lockConnSlotForSend(uint32_t connSlotIdx, uint32_t responderGen)
+{
+    RdWebSendGate& sendGate = _connSlotSendStates[connSlotIdx].sendGate;
+    uint32_t waitTicks = pdMS_TO_TICKS(CONN_SLOT_SEND_WAIT_MS);
+    for (uint32_t waitTick = 0; ; waitTick++)
+    {
+        switch (sendGate.tryAcquire(responderGen))
+        {
+            case RdWebSendGate::GATE_ACQUIRED:
+                return WEB_CHANNEL_SEND_READY;
+            case RdWebSendGate::GATE_GEN_CHANGED:
+                return WEB_CHANNEL_SEND_NO_CONN;
+            default:
+                break;
+        }
+        if (waitTick >= waitTicks)
+            return WEB_CHANNEL_SEND_BUSY;
+        vTaskDelay(1);
+    }
+}
+
+void RdWebConnManager::unlockConnSlot(uint32_t connSlotIdx)
+{
+    _connSlotSendStates[connSlotIdx].sendGate.release();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lock for sending a message - a message which isn't sent because of a lock timeout is counted as dropped
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnManager::lockChannelForSendMsg(uint32_t channelID, uint32_t& connSlotIdx)
+{
+    RdWebChannelSendStatus sendStatus = lockChannelForSend(channelID, connSlotIdx);
+    if (sendStatus == WEB_CHANNEL_SEND_BUSY)
+        countLockTimeoutDrop("sendMsg");
+    return sendStatus == WEB_CHANNEL_SEND_READY;
+}
+
+bool RdWebConnManager::lockConnSlotForSendMsg(const ConnSlotSendTarget& sendTarget)
+{
+    RdWebChannelSendStatus sendStatus = lockConnSlotForSend(sendTarget.connSlotIdx, sendTarget.responderGen);
+    if (sendStatus == WEB_CHANNEL_SEND_BUSY)
+        countLockTimeoutDrop("sendMsg");
+    return sendStatus == WEB_CHANNEL_SEND_READY;
+}
+
+void RdWebConnManager::countLockTimeoutDrop(const char* sendType)
+{
+    uint32_t dropCount = ++_lockTimeoutDropCount;
+#ifdef WARN_SEND_LOCK_TIMEOUT_DROP
+    // Warn on the first drop and then every WARN_SEND_LOCK_TIMEOUT_DROP_EVERY drops
+    if ((dropCount % WARN_SEND_LOCK_TIMEOUT_DROP_EVERY) == 1)
+        LOG_W(MODULE_PREFIX, "%s dropped - lock timeout (total dropped %d)", sendType, dropCount);
+#else
+    (void)dropCount;
+    (void)sendType;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add/remove the responder of a connection slot
+// The channel map mutex is only held briefly by senders (to find slots) so these wait for it - removal
+// also waits for any send in progress to the responder (which is just a put on its tx queue)
+// Channel table entries are added and removed with the channel map mutex held (so one at a time)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebConnManager::responderAdd(uint32_t connSlotIdx)
+{
+    RdWebResponder* pResponder = connSlotIdx < _webConnections.size() ? _webConnections[connSlotIdx].getResponder() : nullptr;
+    if (!pResponder)
+        return;
+    std::vector<uint32_t> respChannelIDs;
+    pResponder->getChannelIDs(respChannelIDs);
+    uint32_t responderGen = _connSlotSendStates[connSlotIdx].sendGate.getGen();
+    xSemaphoreTake(_channelMapMutex, portMAX_DELAY);
+    for (uint32_t respChannelID : respChannelIDs)
+    {
+        _channelIDToConnSlot[respChannelID] = connSlotIdx;
+        if (!_channelTable.add(respChannelID, connSlotIdx, responderGen) && !_channelTableOverflow)
         {
-            // Get responder
-            RdWebResponder *pResponder = _webConnections[i].getResponder();
-            if (!pResponder)
-                continue;
-
-            // Get channelID
-            uint32_t usedChannelID = 0;
-            if (!pResponder->getChannelID(usedChannelID))
-                continue;
-
-            // Check for the channelID of the message
-            if (usedChannelID == channelID)
-                sendOnThisSocket = true;
+            _channelTableOverflow = true;
+            LOG_W(MODULE_PREFIX, "responderAdd channel table full - using channel map");
         }
+    }
+    _connSlotSendStates[connSlotIdx].responderActive = true;
+    _connSlotSendStates[connSlotIdx].isSSEvents = 
+                _webConnections[connSlotIdx].getHeader().reqConnType == REQ_CONN_TYPE_EVENT;
+    xSemaphoreGive(_channelMapMutex);
+#ifdef DEBUG_WEBSOCKETS
+    LOG_I(MODULE_PREFIX, "responderAdd connSlot %d numChannels %d", connSlotIdx, respChannelIDs.size());
+#endif
+}
 
-        // Send if appropriate
-        if (sendOnThisSocket)
-            anyOk |= _webConnections[i].sendOnConn(pBuf, bufLen);
+void RdWebConnManager::responderRemove(uint32_t connSlotIdx)
+{
+    RdWebResponder* pResponder = connSlotIdx < _webConnections.size() ? _webConnections[connSlotIdx].getResponder() : nullptr;
+    if (!pResponder)
+        return;
+    std::vector<uint32_t> respChannelIDs;
+    pResponder->getChannelIDs(respChannelIDs);
+
+    // Stop senders finding the responder - channels are only removed if they still map to this slot
+    ConnSlotSendState& sendState = _connSlotSendStates[connSlotIdx];
+    xSemaphoreTake(_channelMapMutex, portMAX_DELAY);
+    for (uint32_t respChannelID : respChannelIDs)
+    {
+        auto it = _channelIDToConnSlot.find(respChannelID);
+        if ((it != _channelIDToConnSlot.end()) && (it->second == connSlotIdx))
+            _channelIDToConnSlot.erase(it);
+        _channelTable.remove(respChannelID, connSlotIdx);
     }
-    return anyOk;
+    sendState.responderActive = false;
+
+    // Subscriptions end with the responder
+    _topics.unsubscribeAll(connSlotIdx);
+    xSemaphoreGive(_channelMapMutex);
+
+    // Wait for a send in progress and stop senders which found the slot before removal from using it
+    while (!sendState.sendGate.tryAdvanceGen())
+        vTaskDelay(1);
+#ifdef DEBUG_WEBSOCKETS
+    LOG_I(MODULE_PREFIX, "responderRemove connSlot %d numChannels %d", connSlotIdx, respChannelIDs.size());
+#endif
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Send to all server-side events
+// The event is formatted once and the formatted message is shared by all connections and the replay ring
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void RdWebConnManager::serverSideEventsSendMsg(const char *eventContent, const char *eventGroup)
 {
+    // Allocate the event ID, add to the replay ring and find the slots to send to
+    if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+    {
+        countLockTimeoutDrop("serverSideEventsSendMsg");
+        return;
+    }
+    uint32_t eventID = _sseEventRing.allocEventID();
+#ifdef DEBUG_SSE_FORMAT_TIMING
+    uint64_t formatStartUs = micros();
+#endif
+    RdWebDataFrame eventMsg = RdWebSSEvent::formatEventFrame(eventContent, eventGroup, eventID);
+#ifdef DEBUG_SSE_FORMAT_TIMING
+    // Measured on the target including the allocation of the shared message
+    static uint64_t formatTotalUs = 0;
+    static uint32_t formatCount = 0;
+    formatTotalUs += micros() - formatStartUs;
+    if (++formatCount >= DEBUG_SSE_FORMAT_TIMING_EVERY)
+    {
+        LOG_I(MODULE_PREFIX, "serverSideEventsSendMsg format avg %lldus over %d events (last len %d)",
+                    formatTotalUs / formatCount, formatCount, eventMsg.getLen());
+        formatTotalUs = 0;
+        formatCount = 0;
+    }
+#endif
+    _sseEventRing.add(eventID, eventMsg);
+    std::vector<ConnSlotSendTarget> sendTargets;
     for (uint32_t i = 0; i < _webConnections.size(); i++)
     {
-        // Check active
-        if (!_webConnections[i].isActive())
+        if (_connSlotSendStates[i].responderActive && _connSlotSendStates[i].isSSEvents && _webConnections[i].isActive())
+            sendTargets.push_back({i, 0, _connSlotSendStates[i].sendGate.getGen()});
+    }
+    xSemaphoreGive(_channelMapMutex);
+
+    // Send
+    uint32_t groupKey = RdWebSSEvent::getGroupKey(eventGroup, eventID);
+    for (ConnSlotSendTarget& sendTarget : sendTargets)
+    {
+        if (!lockConnSlotForSendMsg(sendTarget))
             continue;
+        _webConnections[sendTarget.connSlotIdx].sendOnSSEvents(eventMsg, eventID, groupKey, false);
+        unlockConnSlot(sendTarget.connSlotIdx);
+    }
+}
 
-        if (_webConnections[i].getHeader().reqConnType == REQ_CONN_TYPE_EVENT)
-            _webConnections[i].sendOnSSEvents(eventContent, eventGroup);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Replay server-side events after lastEventID to a connection
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnManager::serverSideEventsReplay(uint32_t connSlotIdx, uint32_t lastEventID)
+{
+    if (connSlotIdx >= _webConnections.size())
+        return true;
+
+    // Get the events to replay (the messages are shared with the ring so this doesn't copy them)
+    std::vector<std::pair<uint32_t, RdWebDataFrame>> replayEvents;
+    if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+        return false;
+    _sseEventRing.forEachAfter(lastEventID, [&replayEvents](uint32_t eventID, RdWebDataFrame& eventMsg) {
+            replayEvents.push_back({eventID, eventMsg});
+    });
+    xSemaphoreGive(_channelMapMutex);
+#ifdef DEBUG_WEB_CONN_MANAGER
+    LOG_I(MODULE_PREFIX, "serverSideEventsReplay connSlot %d lastEventID %d replayEvents %d", 
+                connSlotIdx, lastEventID, replayEvents.size());
+#endif
+
+    // Replay - this is called on the connection's own task (replayed events are held by the responder
+    // separately from its tx queue) so the slot isn't locked
+    for (auto& replayEvent : replayEvents)
+        _webConnections[connSlotIdx].sendOnSSEvents(replayEvent.second, replayEvent.first, 0, true);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get stats of server-side events connections (JSON array)
+// Each responder is read with its slot locked (as for a send) so it can't be removed while it is read
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String RdWebConnManager::serverSideEventsGetStatsJSON()
+{
+    // Find the slots
+    if (xSemaphoreTake(_channelMapMutex, pdMS_TO_TICKS(CHANNEL_MAP_MUTEX_WAIT_MS)) != pdTRUE)
+        return "[]";
+    std::vector<ConnSlotSendTarget> statsTargets;
+    for (uint32_t i = 0; i < _webConnections.size(); i++)
+    {
+        if (_connSlotSendStates[i].responderActive && _connSlotSendStates[i].isSSEvents && _webConnections[i].isActive())
+            statsTargets.push_back({i, 0, _connSlotSendStates[i].sendGate.getGen()});
+    }
+    xSemaphoreGive(_channelMapMutex);
+
+    // Get stats - a responder removed since the slots were found is skipped
+    String statsJSON;
+    for (ConnSlotSendTarget& statsTarget : statsTargets)
+    {
+        if (lockConnSlotForSend(statsTarget.connSlotIdx, statsTarget.responderGen) != WEB_CHANNEL_SEND_READY)
+            continue;
+        RdWebResponder* pResponder = _webConnections[statsTarget.connSlotIdx].getResponder();
+        if (pResponder)
+        {
+            if (statsJSON.length() > 0)
+                statsJSON += ",";
+            statsJSON += pResponder->getStatsJSON();
+        }
+        unlockConnSlot(statsTarget.connSlotIdx);
     }
+    return "[" + statsJSON + "]";
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -12,14 +12,23 @@
 #include <RdWebConnection.h>
 #include <RdWebSocketDefs.h>
 #include <RdClientListener.h>
+#include "RdWebTopics.h"
+#include "RdWebSSEventRing.h"
+#include "RdWebSendGate.h"
+#include "RdWebChannelTable.h"
 #ifndef ESP8266
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #else
 #include "ESP8266Utils.h"
 #endif
 #include <list>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
 
 class RdWebHandler;
 class RdWebHandlerWS;
@@ -73,16 +82,59 @@ public:
         return _webServerSettings;
     }
 
-    // Check if channel can send a message
+    // Get send status of a channel - WEB_CHANNEL_SEND_BUSY (a lock wasn't obtained in time) should be retried
+    RdWebChannelSendStatus getChannelSendStatus(uint32_t channelID);
+
+    // Check if channel can send a message - noConn is set if the channel doesn't exist (so messages can be
+    // discarded) and false without noConn means the channel isn't ready or is busy (so retry later)
     bool canSend(uint32_t& channelID, bool& noConn);
 
+    // Get latency of a channel (ping round-trip time for websockets)
+    bool getChannelLatencyMs(uint32_t channelID, uint32_t& lastMs, uint32_t& avgMs);
+
+    // Get stats of a channel as JSON
+    String getChannelStatsJSON(uint32_t channelID);
+
     // Send a message on a channel
     bool sendMsg(const uint8_t* pBuf, uint32_t bufLen, 
                 bool allWebSockets, uint32_t channelID);
 
+    // Send message generated in fragments by a producer on channel
+    bool sendMsgProducer(RdWebSocketTxProducerCB txProducerCB, uint32_t channelID);
+
     // Send to all server-side events
     void serverSideEventsSendMsg(const char* eventContent, const char* eventGroup);
 
+    // Replay server-side events after lastEventID to a connection - returns false (and nothing is replayed)
+    // if the channel map lock isn't obtained in time so the caller can retry
+    bool serverSideEventsReplay(uint32_t connSlotIdx, uint32_t lastEventID);
+
+    // Get stats of server-side events connections (JSON array)
+    String serverSideEventsGetStatsJSON();
+
+    // Number of messages (or events) not sent to a connection because a lock wasn't obtained in time
+    uint32_t getLockTimeoutDropCount() const
+    {
+        return _lockTimeoutDropCount;
+    }
+
+    // Add a publish/subscribe topic - returns the topic index (RdWebTopics::TOPIC_IDX_INVALID if a lock
+    // wasn't obtained in time) - topics can be added before or after setup()
+    uint32_t addTopic(const String& topicName);
+
+    // Subscribe (or unsubscribe) a connection to topics - topic names are comma separated
+    // Returns false if any topic doesn't exist (or a lock wasn't obtained in time)
+    bool topicSubscribe(const String& topicNames, uint32_t connSlotIdx, bool subscribe);
+
+    // Publish a message to the channels subscribed to a topic
+    bool publish(uint32_t topicIdx, const uint8_t* pBuf, uint32_t bufLen);
+    bool publish(const String& topicName, const uint8_t* pBuf, uint32_t bufLen);
+
+    // Add/remove the responder of a connection slot (called by connections when responders are created
+    // and before they are deleted) - removal waits for any send in progress to the responder
+    void responderAdd(uint32_t connSlotIdx);
+    void responderRemove(uint32_t connSlotIdx);
+
 private:
 #ifndef ESP8266
     // New connection queue
@@ -102,6 +154,53 @@ private:
     // Standard response headers
     std::list<RdJson::NameValuePair> _stdResponseHeaders;
 
+    // Map of channelID to connection slot index (only responders with a channel, i.e. websockets)
+    // The mutex is held to change the map and the channel table and to enumerate channels - sending to
+    // a single channel uses the channel table which needs no lock
+    std::unordered_map<uint32_t, uint32_t> _channelIDToConnSlot;
+    SemaphoreHandle_t _channelMapMutex;
+    static const uint32_t CHANNEL_MAP_MUTEX_WAIT_MS = 10;
+
+    // Lock-free lookup of the connection slot of a channel (with the slot's send gate generation)
+    // If the table fills the channels not in it are found in the map
+    RdWebChannelTable _channelTable;
+    std::atomic<bool> _channelTableOverflow;
+    static const uint32_t CHANNEL_TABLE_ENTRIES_PER_CONN_SLOT = 8;
+
+    // Send state of each connection slot - the slot's send gate is held during a send which serializes
+    // senders to a connection (so each responder's tx queue has a single producer) and stops the
+    // responder being deleted during a send
+    class ConnSlotSendState
+    {
+    public:
+        // Responder can be sent to (changed with the channel map mutex held)
+        bool responderActive = false;
+        bool isSSEvents = false;
+        // The gate's generation is advanced when the responder is removed so that a sender which
+        // found the slot before removal doesn't send to a later responder in the same slot
+        RdWebSendGate sendGate;
+    };
+    std::unique_ptr<ConnSlotSendState[]> _connSlotSendStates;
+    static const uint32_t CONN_SLOT_SEND_WAIT_MS = 10;
+
+    // Messages not sent because a lock wasn't obtained in time
+    std::atomic<uint32_t> _lockTimeoutDropCount;
+
+    // Slot to send to (found with the channel map mutex held)
+    class ConnSlotSendTarget
+    {
+    public:
+        uint32_t connSlotIdx;
+        uint32_t channelID;
+        uint32_t responderGen;
+    };
+
+    // Publish/subscribe topics (accessed with the channel map mutex held)
+    RdWebTopics _topics;
+
+    // Recent server-side events for replay (accessed with the channel map mutex held)
+    RdWebSSEventRing _sseEventRing;
+
     // Connections
     std::vector<RdWebConnection> _webConnections;
 
@@ -116,6 +215,15 @@ private:
     bool findEmptySlot(uint32_t& slotIx);
     void serviceConnections();
     bool allocateWebSocketChannelID(uint32_t& channelID);
+    RdWebResponder* getChannelResponder(uint32_t channelID, uint32_t& connSlotIdx);
+    RdWebChannelSendStatus lockChannelForSend(uint32_t channelID, uint32_t& connSlotIdx);
+    RdWebChannelSendStatus lockConnSlotForSend(uint32_t connSlotIdx, uint32_t responderGen);
+    void unlockConnSlot(uint32_t connSlotIdx);
+    bool lockChannelForSendMsg(uint32_t channelID, uint32_t& connSlotIdx);
+    bool lockConnSlotForSendMsg(const ConnSlotSendTarget& sendTarget);
+    void countLockTimeoutDrop(const char* sendType);
+    bool sendOnConnSlotShared(uint32_t connSlotIdx, uint32_t channelID, RdWebDataFrame& encodedFrame, 
+                const uint8_t* pBuf, uint32_t bufLen);
     // Handle an incoming connection
     bool handleNewConnection(RdClientConnBase* pClientConn);
 
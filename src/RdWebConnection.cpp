@@ -55,6 +55,7 @@ RdWebConnection::RdWebConnection()
     // Responder
     _pResponder = nullptr;
     _pClientConn = nullptr;
+    _connSlotIdx = 0;
     
     // Clear
     clear();
@@ -90,7 +91,7 @@ RdWebConnection::~RdWebConnection()
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 bool RdWebConnection::setNewConn(RdClientConnBase* pClientConn, RdWebConnManager* pConnManager,
-                uint32_t maxSendBufferBytes)
+                uint32_t connSlotIdx, uint32_t maxSendBufferBytes)
 {
     // Error check - there should not be a current client otherwise there's been a mistake!
     if (_pClientConn != nullptr)
@@ -106,6 +107,7 @@ bool RdWebConnection::setNewConn(RdClientConnBase* pClientConn, RdWebConnManager
     // New connection
     _pClientConn = pClientConn;
     _pConnManager = pConnManager;
+    _connSlotIdx = connSlotIdx;
     _timeoutStartMs = millis();
     _timeoutLastActivityMs = millis();
     _timeoutActive = true;
@@ -113,6 +115,9 @@ bool RdWebConnection::setNewConn(RdClientConnBase* pClientConn, RdWebConnManager
     _timeoutOnIdleDurationMs = MAX_CONN_IDLE_DURATION_MS;
     _maxSendBufferBytes = maxSendBufferBytes;
 
+    // Client address (used for per-client rate limiting)
+    _pClientConn->getClientIPAddr(_header.clientIPAddr);
+
     // Set non-blocking connection
     _pClientConn->setup(USE_BLOCKING_WEB_CONNECTIONS);
 
@@ -137,8 +142,7 @@ void RdWebConnection::clear()
 #ifdef DEBUG_RESPONDER_CREATE_DELETE
         LOG_W(MODULE_PREFIX, "clear deleting _pResponder %d", (uint32_t)_pResponder);
 #endif
-        delete _pResponder;
-        _pResponder = nullptr;
+        deleteResponder();
     }
 
     // Delete any client
@@ -198,20 +202,61 @@ bool RdWebConnection::isActive()
     return _pClientConn && _pClientConn->isActive();
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Delete responder (removing it from the manager first so it can't be used by senders)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebConnection::deleteResponder()
+{
+    if (_pConnManager && _pResponder)
+        _pConnManager->responderRemove(_connSlotIdx);
+    delete _pResponder;
+    _pResponder = nullptr;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Send on connection
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool RdWebConnection::sendOnConn(const uint8_t* pBuf, uint32_t bufLen)
+bool RdWebConnection::sendOnConn(const uint8_t* pBuf, uint32_t bufLen, uint32_t channelID)
 {
 #ifdef DEBUG_WEB_SOCKET_SEND
-    LOG_I(MODULE_PREFIX, "sendOnConnection len %d responder %d connId %d", bufLen, (uint32_t)_pResponder, 
-                    _pClientConn ? _pClientConn->getClientId() : 0);
+    LOG_I(MODULE_PREFIX, "sendOnConnection len %d responder %d connId %d chanID %d", bufLen, (uint32_t)_pResponder, 
+                    _pClientConn ? _pClientConn->getClientId() : 0, channelID);
 #endif
 
     // Send to responder
     if (_pResponder)
-        return _pResponder->sendFrame(pBuf, bufLen);
+        return _pResponder->sendFrame(pBuf, bufLen, channelID);
+
+    // Failure
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send on connection using a frame encoded once for all connections
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnection::sendOnConnEncoded(RdWebDataFrame& encodedFrame, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t channelID)
+{
+    // Send to responder
+    if (_pResponder)
+        return _pResponder->sendFrameEncoded(encodedFrame, pBuf, bufLen, channelID);
+
+    // Failure
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send message generated by a producer on connection
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnection::sendOnConnProducer(RdWebSocketTxProducerCB txProducerCB, uint32_t channelID)
+{
+    // Send to responder
+    if (_pResponder)
+        return _pResponder->sendFrameProducer(txProducerCB, channelID);
 
     // Failure
     return false;
@@ -221,11 +266,11 @@ bool RdWebConnection::sendOnConn(const uint8_t* pBuf, uint32_t bufLen)
 // Send server-side-event
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void RdWebConnection::sendOnSSEvents(const char* eventContent, const char* eventGroup)
+void RdWebConnection::sendOnSSEvents(RdWebDataFrame& eventMsg, uint32_t eventID, uint32_t groupKey, bool isReplay)
 {
 #ifdef DEBUG_WEB_SSEVENT_SEND
-    LOG_I(MODULE_PREFIX, "sendOnSSEvents eventGroup %s eventContent %s responder %d connId %d", 
-                eventGroup, eventContent,
+    LOG_I(MODULE_PREFIX, "sendOnSSEvents len %d eventID %d%s responder %d connId %d", 
+                eventMsg.getLen(), eventID, isReplay ? " (replay)" : "",
                 (uint32_t)_pResponder, 
                 _pClientConn ? _pClientConn->getClientId() : 0);
 #endif
@@ -233,7 +278,7 @@ void RdWebConnection::sendOnSSEvents(const char* eventContent, const char* event
     // Send to responder
     if (_pResponder)
     {
-        _pResponder->sendEvent(eventContent, eventGroup);
+        _pResponder->sendEvent(eventMsg, eventID, groupKey, isReplay);
     }
 }
 
@@ -519,8 +564,7 @@ bool RdWebConnection::serviceConnHeader(const uint8_t* pRxData, uint32_t dataLen
     if (_pResponder)
     {
         LOG_W(MODULE_PREFIX, "onRxData unexpectedly deleting _pResponder %d", (uint32_t)_pResponder);
-        delete _pResponder;
-        _pResponder = nullptr;
+        deleteResponder();
     }
 
     // Debug
@@ -530,8 +574,18 @@ bool RdWebConnection::serviceConnHeader(const uint8_t* pRxData, uint32_t dataLen
 
     // Get a responder (we are responsible for deletion)
     RdWebRequestParams params(_maxSendBufferBytes, _pConnManager->getStdResponseHeaders(), 
-                std::bind(&RdWebConnection::rawSendOnConn, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+                std::bind(&RdWebConnection::rawSendOnConn, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                std::bind(&RdWebConnection::rawSendOnConnVec, this, std::placeholders::_1, std::placeholders::_2, 
+                            std::placeholders::_3, std::placeholders::_4, std::placeholders::_5),
+                std::bind(&RdWebConnection::rawSendReady, this),
+                std::bind(&RdWebConnection::topicSubscribe, this, std::placeholders::_1, std::placeholders::_2),
+                std::bind(&RdWebConnection::sseEventsReplay, this, std::placeholders::_1));
     _pResponder = _pConnManager->getNewResponder(_header, params, statusCode);
+
+    // Register the responder (and its channels if it has them) so the manager can send to it - a server-side
+    // events responder replays events missed by a reconnecting client from its service()
+    if (_pResponder)
+        _pConnManager->responderAdd(_connSlotIdx);
 #ifdef DEBUG_RESPONDER_CREATE_DELETE
     if (_pResponder) 
     {
@@ -579,7 +633,7 @@ bool RdWebConnection::serviceConnHeader(const uint8_t* pRxData, uint32_t dataLen
 // Send data to responder
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool RdWebConnection::responderHandleData(const uint8_t* pRxData, uint32_t dataLen, uint32_t& curBufPos)
+bool RdWebConnection::responderHandleData(uint8_t* pRxData, uint32_t dataLen, uint32_t& curBufPos)
 {
 #ifdef DEBUG_WEB_RESPONDER_HDL_DATA_TIME_THRESH_MS
     uint32_t debugRespHdlDataStartMs = millis();
@@ -589,11 +643,12 @@ bool RdWebConnection::responderHandleData(const uint8_t* pRxData, uint32_t dataL
     uint32_t debugSendStdHdrElapMs = 0;
 #endif
 
-    // Hand any data (if there is any) to responder (if there is one)
+    // Hand any data (if there is any) to responder (if there is one) - the responder may modify the
+    // data in place as the receive buffer is not used after this
     bool errorOccurred = false;
     if (_pResponder && (curBufPos < dataLen) && pRxData)
     {
-        _pResponder->handleData(pRxData+curBufPos, dataLen-curBufPos);
+        _pResponder->handleDataInPlace(pRxData+curBufPos, dataLen-curBufPos);
 #ifdef DEBUG_WEB_RESPONDER_HDL_DATA_TIME_THRESH_MS
         debugRespHdlDataHandleDataMs = millis() - debugRespHdlDataStartMs;
 #endif
@@ -911,6 +966,17 @@ void RdWebConnection::parseNameValueLine(const String& reqLine)
     {
         _header.webSocketVersion = val;
     }
+    else if (name.equalsIgnoreCase("Last-Event-ID"))
+    {
+        _header.sseLastEventID = strtoul(val.c_str(), nullptr, 10);
+    }
+    else if (name.equalsIgnoreCase("Sec-WebSocket-Extensions"))
+    {
+        // Header may be repeated
+        if (_header.webSocketExtensions.length() > 0)
+            _header.webSocketExtensions += ", ";
+        _header.webSocketExtensions += val;
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1023,6 +1089,118 @@ RdWebConnSendRetVal RdWebConnection::rawSendOnConn(const uint8_t* pBuf, uint32_t
     return RdWebConnSendRetVal::WEB_CONN_SEND_EAGAIN;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Raw send of header and payload from separate buffers
+// Any part not accepted by the connection is queued (copied) to be sent later
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebConnSendRetVal RdWebConnection::rawSendOnConnVec(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t maxRetryMs)
+{
+    // Check connection
+    if (!_pClientConn)
+    {
+        LOG_W(MODULE_PREFIX, "rawSendOnConnVec conn is nullptr");
+        return RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+    }
+
+    // Check buffers
+    if (!pHdr || (!pBuf && (bufLen != 0)))
+    {
+        LOG_W(MODULE_PREFIX, "rawSendOnConnVec buffer is nullptr");
+        return RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+    }
+
+    // Handle any data waiting to be written
+    if (!handleTxQueuedData())
+    {
+#ifdef DEBUG_WEB_CONNECTION_DATA_PACKETS
+        LOG_I(MODULE_PREFIX, "rawSendOnConnVec connId %d failed handleTxQueueData", _pClientConn->getClientId());
+#endif
+        return RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+    }
+
+    // Check if data can be sent immediately
+    uint32_t bytesWritten = 0;
+    if (_socketTxQueuedBuffer.size() == 0)
+    {
+        // Queue is currently empty so try to send
+        RdWebConnSendRetVal retVal = _pClientConn->writev(pHdr, hdrLen, pBuf, bufLen, maxRetryMs, bytesWritten);
+#ifdef DEBUG_WEB_CONNECTION_DATA_PACKETS
+        LOG_I(MODULE_PREFIX, "rawSendOnConnVec connId %d send len %d written %d result %s", _pClientConn->getClientId(), 
+                    hdrLen + bufLen, bytesWritten, RdWebConnDefs::getSendRetValStr(retVal));
+#endif
+        if (retVal != RdWebConnSendRetVal::WEB_CONN_SEND_EAGAIN)
+            return retVal;
+    }
+
+    // Check queue max size
+    uint32_t curSize = _socketTxQueuedBuffer.size();
+    uint32_t lenToQueue = hdrLen + bufLen - bytesWritten;
+    if (curSize + lenToQueue > _maxSendBufferBytes)
+    {
+#ifdef DEBUG_WEB_CONNECTION_DATA_PACKETS
+        LOG_I(MODULE_PREFIX, "rawSendOnConnVec connId %d send buffer overflow was %d trying to add %d max %d", 
+                    _pClientConn->getClientId(), curSize, lenToQueue, _maxSendBufferBytes);
+#endif
+        return RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+    }
+
+    // Append the unsent parts of header and payload to buffer
+    _socketTxQueuedBuffer.resize(curSize + lenToQueue);
+    uint8_t* pQueue = _socketTxQueuedBuffer.data() + curSize;
+    if (bytesWritten < hdrLen)
+    {
+        memcpy(pQueue, pHdr + bytesWritten, hdrLen - bytesWritten);
+        pQueue += hdrLen - bytesWritten;
+        bytesWritten = hdrLen;
+    }
+    if (bufLen != 0)
+        memcpy(pQueue, pBuf + bytesWritten - hdrLen, hdrLen + bufLen - bytesWritten);
+
+#ifdef DEBUG_WEB_CONNECTION_DATA_PACKETS
+    LOG_I(MODULE_PREFIX, "rawSendOnConnVec connId %d data added %d to send buffer newLen %d", _pClientConn->getClientId(), 
+                lenToQueue, _socketTxQueuedBuffer.size());
+#endif
+
+    // Ok - the data will be sent later
+    return RdWebConnSendRetVal::WEB_CONN_SEND_EAGAIN;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check if queued data has been sent
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnection::rawSendReady()
+{
+    if (!_pClientConn)
+        return false;
+    handleTxQueuedData();
+    return _socketTxQueuedBuffer.size() == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Subscribe to publish/subscribe topics
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnection::topicSubscribe(const String& topicNames, bool subscribe)
+{
+    if (!_pConnManager)
+        return false;
+    return _pConnManager->topicSubscribe(topicNames, _connSlotIdx, subscribe);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Replay server-side events
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebConnection::sseEventsReplay(uint32_t lastEventID)
+{
+    if (!_pConnManager)
+        return true;
+    return _pConnManager->serverSideEventsReplay(_connSlotIdx, lastEventID);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Send standard headers
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
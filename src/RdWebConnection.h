@@ -10,6 +10,8 @@
 
 #include <WString.h>
 #include "RdWebConnDefs.h"
+#include "RdWebSocketDefs.h"
+#include "RdWebDataFrame.h"
 #include "RdWebRequestParams.h"
 #include "RdWebRequestHeader.h"
 #include "RdClientConnBase.h"
@@ -29,18 +31,24 @@ public:
     // Called frequently
     void service();
 
-    // Send on connection
-    bool sendOnConn(const uint8_t* pBuf, uint32_t bufLen);
+    // Send on a channel of the connection
+    bool sendOnConn(const uint8_t* pBuf, uint32_t bufLen, uint32_t channelID);
+
+    // Send on connection using a frame encoded once for all connections
+    bool sendOnConnEncoded(RdWebDataFrame& encodedFrame, const uint8_t* pBuf, uint32_t bufLen, uint32_t channelID);
+
+    // Send message generated by a producer on connection
+    bool sendOnConnProducer(RdWebSocketTxProducerCB txProducerCB, uint32_t channelID);
 
     // Send on server-side events
-    void sendOnSSEvents(const char* eventContent, const char* eventGroup);
+    void sendOnSSEvents(RdWebDataFrame& eventMsg, uint32_t eventID, uint32_t groupKey, bool isReplay);
 
     // Clear (closes connection if open)
     void clear();
 
     // Set a new connection
     bool setNewConn(RdClientConnBase* pClientConn, RdWebConnManager* pConnManager,
-                uint32_t maxSendBufferBytes);
+                uint32_t connSlotIdx, uint32_t maxSendBufferBytes);
 
     // True if active
     bool isActive();
@@ -58,8 +66,9 @@ public:
     }
 
 private:
-    // Connection manager
+    // Connection manager and index of this connection's slot in the manager
     RdWebConnManager* _pConnManager;
+    uint32_t _connSlotIdx;
 
     // Client connection
     RdClientConnBase* _pClientConn;
@@ -73,6 +82,7 @@ private:
 
     // Responder
     RdWebResponder* _pResponder;
+    void deleteResponder();
 
     // Send headers if needed
     bool _isStdHeaderRequired;
@@ -130,7 +140,7 @@ private:
     bool serviceConnHeader(const uint8_t* pRxData, uint32_t dataLen, uint32_t& curBufPos);
 
     // Send data to responder
-    bool responderHandleData(const uint8_t* pRxData, uint32_t dataLen, uint32_t& curBufPos);
+    bool responderHandleData(uint8_t* pRxData, uint32_t dataLen, uint32_t& curBufPos);
 
     // Set HTTP response status
     void setHTTPResponseStatus(RdHttpStatusCode reponseCode);
@@ -138,6 +148,19 @@ private:
     // Raw send on connection - used by websockets, etc
     RdWebConnSendRetVal rawSendOnConn(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxRetryMs);    
 
+    // Raw send of header and payload from separate buffers
+    RdWebConnSendRetVal rawSendOnConnVec(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t maxRetryMs);
+
+    // Check if queued data has been sent (so raw send won't need to queue)
+    bool rawSendReady();
+
+    // Subscribe (or unsubscribe) this connection to publish/subscribe topics
+    bool topicSubscribe(const String& topicNames, bool subscribe);
+
+    // Replay server-side events after lastEventID to this connection (false if it should be retried)
+    bool sseEventsReplay(uint32_t lastEventID);
+
     // Send standard headers
     bool sendStandardHeaders();
 
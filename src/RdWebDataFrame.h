@@ -11,8 +11,13 @@
 #include <string.h>
 #include <stdint.h>
 #include <vector>
+#include <memory>
+#include "RdWebTxSlab.h"
 
 // Buffer for tx queue
+// The data is immutable and shared by copies of the frame so a frame can be queued on several
+// connections (and copied in and out of queues) without copying the data
+// The data is either held in a shared vector or in blocks of a slab (which must outlive the frame)
 class RdWebDataFrame
 {
 public:
@@ -20,18 +25,98 @@ public:
     {
     }
     RdWebDataFrame(const uint8_t* pBuf, uint32_t bufLen)
+        : _pFrame(std::make_shared<const std::vector<uint8_t>>(pBuf, pBuf + bufLen))
     {
-        frame.resize(bufLen);
-        memcpy(frame.data(), pBuf, frame.size());
     }
+    // Frame on the heap with a header followed by data
+    RdWebDataFrame(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen)
+    {
+        std::shared_ptr<std::vector<uint8_t>> pFrame = std::make_shared<std::vector<uint8_t>>();
+        pFrame->reserve(hdrLen + bufLen);
+        pFrame->insert(pFrame->end(), pHdr, pHdr + hdrLen);
+        pFrame->insert(pFrame->end(), pBuf, pBuf + bufLen);
+        _pFrame = pFrame;
+    }
+    // Frame using shared data - isEncoded indicates the data is already encoded for the protocol
+    // (e.g. a complete websocket frame) and can be sent as-is
+    RdWebDataFrame(std::shared_ptr<const std::vector<uint8_t>> pFrame, bool isEncoded)
+        : _pFrame(pFrame), _isEncoded(isEncoded)
+    {
+    }
+    // Frame in a slab (the header and data are copied into it) - check isValid() as the slab may be full
+    RdWebDataFrame(RdWebTxSlab& slab, const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen)
+    {
+        if (slab.alloc(pHdr, hdrLen, pBuf, bufLen, _slabBlockIdx))
+        {
+            _pSlab = &slab;
+            _slabLen = hdrLen + bufLen;
+        }
+    }
+    RdWebDataFrame(const RdWebDataFrame& other)
+        : _pFrame(other._pFrame), _isEncoded(other._isEncoded), 
+          _pSlab(other._pSlab), _slabBlockIdx(other._slabBlockIdx), _slabLen(other._slabLen)
+    {
+        if (_pSlab)
+            _pSlab->addRef(_slabBlockIdx);
+    }
+    RdWebDataFrame(RdWebDataFrame&& other)
+        : _pFrame(std::move(other._pFrame)), _isEncoded(other._isEncoded), 
+          _pSlab(other._pSlab), _slabBlockIdx(other._slabBlockIdx), _slabLen(other._slabLen)
+    {
+        other._pSlab = nullptr;
+    }
+    RdWebDataFrame& operator=(RdWebDataFrame other)
+    {
+        std::swap(_pFrame, other._pFrame);
+        std::swap(_isEncoded, other._isEncoded);
+        std::swap(_pSlab, other._pSlab);
+        std::swap(_slabBlockIdx, other._slabBlockIdx);
+        std::swap(_slabLen, other._slabLen);
+        return *this;
+    }
+    ~RdWebDataFrame()
+    {
+        if (_pSlab)
+            _pSlab->release(_slabBlockIdx);
+    }
+    bool isValid()
+    {
+        return _pFrame || _pSlab;
+    }
+    // Get data - nullptr if the frame is held in a chain of slab blocks (use copyData())
     const uint8_t* getData()
     {
-        return frame.data();
+        if (_pSlab)
+            return _pSlab->isChained(_slabBlockIdx) ? nullptr : _pSlab->getBlock(_slabBlockIdx);
+        return _pFrame ? _pFrame->data() : nullptr;
+    }
+    uint32_t getLen() const
+    {
+        if (_pSlab)
+            return _slabLen;
+        return _pFrame ? _pFrame->size() : 0;
+    }
+    bool isEncoded()
+    {
+        return _isEncoded;
     }
-    uint32_t getLen()
+    // Copy part of the data - returns number of bytes copied
+    uint32_t copyData(uint32_t offset, uint8_t* pBuf, uint32_t maxLen)
     {
-        return frame.size();
+        uint32_t frameLen = getLen();
+        if (offset >= frameLen)
+            return 0;
+        if (maxLen > frameLen - offset)
+            maxLen = frameLen - offset;
+        if (_pSlab)
+            return _pSlab->copyData(_slabBlockIdx, offset, pBuf, maxLen);
+        memcpy(pBuf, _pFrame->data() + offset, maxLen);
+        return maxLen;
     }
 private:
-    std::vector<uint8_t> frame;
-};
\ No newline at end of file
+    std::shared_ptr<const std::vector<uint8_t>> _pFrame;
+    bool _isEncoded = false;
+    RdWebTxSlab* _pSlab = nullptr;
+    uint16_t _slabBlockIdx = RdWebTxSlab::NO_BLOCK;
+    uint32_t _slabLen = 0;
+};
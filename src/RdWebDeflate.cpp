@@ -0,0 +1,729 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RdWebDeflate.h"
+#include <Logger.h>
+#include <string.h>
+#include <memory>
+
+// #define DEBUG_WEB_DEFLATE_NEGOTIATE
+// #define DEBUG_WEB_DEFLATE_ERRORS
+
+#if defined(DEBUG_WEB_DEFLATE_NEGOTIATE) || defined(DEBUG_WEB_DEFLATE_ERRORS)
+static const char *MODULE_PREFIX = "RdWebDeflate";
+#endif
+
+// Length and distance codes (RFC1951 3.2.5)
+static const uint16_t LEN_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LEN_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Trailer of a sync flush which is removed from the end of each message (RFC7692 7.2.1)
+static const uint8_t SYNC_FLUSH_TRAILER[4] = {0x00, 0x00, 0xff, 0xff};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Stats
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String RdWebDeflateStats::getDebugJSON()
+{
+    char statsStr[200];
+    snprintf(statsStr, sizeof(statsStr),
+                R"({"txMsgs":%d,"txIn":%llu,"txOut":%llu,"txPC":%d,"rxMsgs":%d,"rxIn":%llu,"rxOut":%llu,"rxPC":%d,"rxErr":%d})",
+                txMsgs, (unsigned long long)txBytesIn, (unsigned long long)txBytesOut,
+                txBytesIn == 0 ? 100 : (int)(txBytesOut * 100 / txBytesIn),
+                rxMsgs, (unsigned long long)rxBytesIn, (unsigned long long)rxBytesOut,
+                rxBytesOut == 0 ? 100 : (int)(rxBytesIn * 100 / rxBytesOut),
+                rxErrors);
+    return statsStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor / Destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebDeflate::RdWebDeflate()
+{
+    _txWindowBits = MAX_WINDOW_BITS;
+    _txNoContextTakeover = false;
+    _rxWindowBits = MAX_WINDOW_BITS;
+    _rxNoContextTakeover = false;
+    _pStats = nullptr;
+    _txWindowStart = 0;
+    _bitBuf = 0;
+    _bitCount = 0;
+}
+
+RdWebDeflate::~RdWebDeflate()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Negotiate
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebDeflate::negotiate(const String& extensionsOffer, uint32_t maxWindowBits, bool noContextTakeover,
+            String& respParams)
+{
+    if (maxWindowBits < MIN_WINDOW_BITS)
+        maxWindowBits = MIN_WINDOW_BITS;
+    if (maxWindowBits > MAX_WINDOW_BITS)
+        maxWindowBits = MAX_WINDOW_BITS;
+
+    // Offers are comma separated and params within an offer are semicolon separated
+    int offerStart = 0;
+    while (offerStart < (int)extensionsOffer.length())
+    {
+        int offerEnd = extensionsOffer.indexOf(',', offerStart);
+        if (offerEnd < 0)
+            offerEnd = extensionsOffer.length();
+        String offer = extensionsOffer.substring(offerStart, offerEnd);
+        offerStart = offerEnd + 1;
+
+        // Extension name
+        int paramPos = offer.indexOf(';');
+        String extName = paramPos < 0 ? offer : offer.substring(0, paramPos);
+        extName.trim();
+        if (!extName.equalsIgnoreCase("permessage-deflate"))
+            continue;
+
+        // Params
+        uint32_t txWindowBits = maxWindowBits;
+        bool txNoContextTakeover = noContextTakeover;
+        uint32_t rxWindowBits = MAX_WINDOW_BITS;
+        bool rxNoContextTakeover = noContextTakeover;
+        bool clientWindowBitsOffered = false;
+        bool offerValid = true;
+        while (offerValid && (paramPos >= 0))
+        {
+            int paramEnd = offer.indexOf(';', paramPos + 1);
+            String param = offer.substring(paramPos + 1, paramEnd < 0 ? offer.length() : paramEnd);
+            paramPos = paramEnd;
+            String name, val;
+            if (!getParam(param, name, val))
+                continue;
+            uint32_t bits = val.toInt();
+            if (name.equalsIgnoreCase("server_no_context_takeover"))
+            {
+                txNoContextTakeover = true;
+            }
+            else if (name.equalsIgnoreCase("client_no_context_takeover"))
+            {
+                rxNoContextTakeover = true;
+            }
+            else if (name.equalsIgnoreCase("server_max_window_bits"))
+            {
+                // Our window can't be reduced below the minimum
+                if ((bits < MIN_WINDOW_BITS) || (bits > MAX_WINDOW_BITS))
+                    offerValid = false;
+                else if (bits < txWindowBits)
+                    txWindowBits = bits;
+            }
+            else if (name.equalsIgnoreCase("client_max_window_bits"))
+            {
+                clientWindowBitsOffered = true;
+                if ((val.length() > 0) && ((bits < 8) || (bits > MAX_WINDOW_BITS)))
+                    offerValid = false;
+                else if ((val.length() > 0) && (bits < rxWindowBits))
+                    rxWindowBits = bits;
+            }
+            else
+            {
+                offerValid = false;
+            }
+        }
+        if (!offerValid)
+            continue;
+
+        // Client window can only be limited if the client offered it
+        if (clientWindowBitsOffered && (maxWindowBits < rxWindowBits))
+            rxWindowBits = maxWindowBits;
+
+        // Accept
+        _txWindowBits = txWindowBits;
+        _txNoContextTakeover = txNoContextTakeover;
+        _rxWindowBits = rxWindowBits;
+        _rxNoContextTakeover = rxNoContextTakeover;
+        resetCompressor();
+        _rxHistory.clear();
+
+        // Response
+        respParams = "permessage-deflate; server_max_window_bits=" + String(_txWindowBits);
+        if (_txNoContextTakeover)
+            respParams += "; server_no_context_takeover";
+        if (_rxNoContextTakeover)
+            respParams += "; client_no_context_takeover";
+        if (clientWindowBitsOffered)
+            respParams += "; client_max_window_bits=" + String(_rxWindowBits);
+#ifdef DEBUG_WEB_DEFLATE_NEGOTIATE
+        LOG_I(MODULE_PREFIX, "negotiate offer %s resp %s", extensionsOffer.c_str(), respParams.c_str());
+#endif
+        return true;
+    }
+#ifdef DEBUG_WEB_DEFLATE_NEGOTIATE
+    LOG_I(MODULE_PREFIX, "negotiate no acceptable offer in %s", extensionsOffer.c_str());
+#endif
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Compress part of a message
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebDeflate::compress(const uint8_t* pBuf, uint32_t bufLen, bool msgFinal, std::vector<uint8_t>& outBuf)
+{
+    uint32_t outStartLen = outBuf.size();
+
+    // Add the data to the window
+    uint32_t startIdx = _txWindow.size();
+    _txWindow.insert(_txWindow.end(), pBuf, pBuf + bufLen);
+
+    // Compress with fixed huffman codes - falling back to a stored block if that is smaller
+    if (bufLen > 0)
+    {
+        compressFixed(startIdx, outBuf);
+        if (outBuf.size() - outStartLen > bufLen + STORED_BLOCK_HEADER_BYTES)
+        {
+            outBuf.resize(outStartLen);
+            _bitBuf = 0;
+            _bitCount = 0;
+            putStored(pBuf, bufLen, outBuf);
+        }
+    }
+
+    // Sync flush (empty stored block) - the trailer is removed at the end of the message
+    putBits(outBuf, 0, 3);
+    flushBits(outBuf);
+    outBuf.insert(outBuf.end(), SYNC_FLUSH_TRAILER, SYNC_FLUSH_TRAILER + sizeof(SYNC_FLUSH_TRAILER));
+    if (msgFinal)
+        outBuf.resize(outBuf.size() - sizeof(SYNC_FLUSH_TRAILER));
+
+    // Stats
+    if (_pStats)
+    {
+        _pStats->txBytesIn += bufLen;
+        _pStats->txBytesOut += outBuf.size() - outStartLen;
+        if (msgFinal)
+            _pStats->txMsgs++;
+    }
+
+    // Keep only the window for the next part
+    if (msgFinal && _txNoContextTakeover)
+    {
+        resetCompressor();
+        return;
+    }
+    uint32_t windowSize = 1 << _txWindowBits;
+    if (_txWindow.size() > windowSize)
+    {
+        uint32_t toRemove = _txWindow.size() - windowSize;
+        _txWindow.erase(_txWindow.begin(), _txWindow.begin() + toRemove);
+        _txWindowStart += toRemove;
+    }
+
+    // Rebase positions in the hash table before they overflow
+    if (_txWindowStart > REBASE_POS)
+    {
+        for (uint32_t& hashPos : _txHashHead)
+            hashPos = hashPos > _txWindowStart ? hashPos - _txWindowStart : 0;
+        _txWindowStart = 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Compress window data from startIdx as a fixed huffman block
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebDeflate::compressFixed(uint32_t startIdx, std::vector<uint8_t>& outBuf)
+{
+    // Hash table holds stream position + 1 of the last occurrence (0 if none)
+    if (_txHashHead.size() == 0)
+        _txHashHead.resize(1 << HASH_BITS, 0);
+    uint32_t windowSize = 1 << _txWindowBits;
+    const uint8_t* pWin = _txWindow.data();
+    uint32_t winLen = _txWindow.size();
+
+    // Block header - not final, fixed huffman
+    putBits(outBuf, 0x02, 3);
+
+    uint32_t idx = startIdx;
+    while (idx < winLen)
+    {
+        // Look for a match
+        uint32_t matchLen = 0;
+        uint32_t matchDist = 0;
+        if (idx + MIN_MATCH <= winLen)
+        {
+            uint32_t hashIdx = hash3(pWin + idx);
+            uint32_t candPos = _txHashHead[hashIdx];
+            uint32_t curPos = _txWindowStart + idx;
+            _txHashHead[hashIdx] = curPos + 1;
+            if ((candPos > _txWindowStart) && (curPos + 1 - candPos <= windowSize))
+            {
+                uint32_t candIdx = candPos - 1 - _txWindowStart;
+                uint32_t maxLen = winLen - idx;
+                if (maxLen > MAX_MATCH)
+                    maxLen = MAX_MATCH;
+                uint32_t len = 0;
+                while ((len < maxLen) && (pWin[candIdx + len] == pWin[idx + len]))
+                    len++;
+                if (len >= MIN_MATCH)
+                {
+                    matchLen = len;
+                    matchDist = idx - candIdx;
+                }
+            }
+        }
+
+        // Literal
+        if (matchLen == 0)
+        {
+            putFixedLitLen(outBuf, pWin[idx]);
+            idx++;
+            continue;
+        }
+
+        // Length code
+        uint32_t lenCode = 28;
+        while (LEN_BASE[lenCode] > matchLen)
+            lenCode--;
+        putFixedLitLen(outBuf, 257 + lenCode);
+        putBits(outBuf, matchLen - LEN_BASE[lenCode], LEN_EXTRA[lenCode]);
+
+        // Distance code (fixed 5 bit codes)
+        uint32_t distCode = 29;
+        while (DIST_BASE[distCode] > matchDist)
+            distCode--;
+        putHuffman(outBuf, distCode, 5);
+        putBits(outBuf, matchDist - DIST_BASE[distCode], DIST_EXTRA[distCode]);
+
+        // Add positions within the match to the hash table
+        for (uint32_t i = 1; (i < matchLen) && (idx + i + MIN_MATCH <= winLen); i++)
+            _txHashHead[hash3(pWin + idx + i)] = _txWindowStart + idx + i + 1;
+        idx += matchLen;
+    }
+
+    // End of block
+    putFixedLitLen(outBuf, 256);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Stored blocks
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebDeflate::putStored(const uint8_t* pBuf, uint32_t bufLen, std::vector<uint8_t>& outBuf)
+{
+    while (bufLen > 0)
+    {
+        uint32_t blockLen = bufLen > 0xffff ? 0xffff : bufLen;
+        putBits(outBuf, 0, 3);
+        flushBits(outBuf);
+        outBuf.push_back(blockLen & 0xff);
+        outBuf.push_back(blockLen >> 8);
+        outBuf.push_back(~blockLen & 0xff);
+        outBuf.push_back((~blockLen >> 8) & 0xff);
+        outBuf.insert(outBuf.end(), pBuf, pBuf + blockLen);
+        pBuf += blockLen;
+        bufLen -= blockLen;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Bit output
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebDeflate::putBits(std::vector<uint8_t>& outBuf, uint32_t bits, uint32_t numBits)
+{
+    _bitBuf |= bits << _bitCount;
+    _bitCount += numBits;
+    while (_bitCount >= 8)
+    {
+        outBuf.push_back(_bitBuf & 0xff);
+        _bitBuf >>= 8;
+        _bitCount -= 8;
+    }
+}
+
+void RdWebDeflate::putHuffman(std::vector<uint8_t>& outBuf, uint32_t code, uint32_t numBits)
+{
+    // Huffman codes are sent most significant bit first
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < numBits; i++)
+        reversed |= ((code >> i) & 1) << (numBits - 1 - i);
+    putBits(outBuf, reversed, numBits);
+}
+
+void RdWebDeflate::putFixedLitLen(std::vector<uint8_t>& outBuf, uint32_t sym)
+{
+    if (sym < 144)
+        putHuffman(outBuf, 0x30 + sym, 8);
+    else if (sym < 256)
+        putHuffman(outBuf, 0x190 + sym - 144, 9);
+    else if (sym < 280)
+        putHuffman(outBuf, sym - 256, 7);
+    else
+        putHuffman(outBuf, 0xc0 + sym - 280, 8);
+}
+
+void RdWebDeflate::flushBits(std::vector<uint8_t>& outBuf)
+{
+    if (_bitCount > 0)
+        outBuf.push_back(_bitBuf & 0xff);
+    _bitBuf = 0;
+    _bitCount = 0;
+}
+
+void RdWebDeflate::resetCompressor()
+{
+    _txWindow.clear();
+    _txWindow.shrink_to_fit();
+    _txWindowStart = 0;
+    _txHashHead.clear();
+    _txHashHead.shrink_to_fit();
+    _bitBuf = 0;
+    _bitCount = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Inflate - decodes a deflate stream (RFC1951) in the manner of zlib's puff
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class RdWebInflater
+{
+public:
+    RdWebInflater(const uint8_t* pIn, uint32_t inLen, std::vector<uint8_t>& out, uint32_t maxOutLen)
+        : _pIn(pIn), _inLen(inLen), _out(out), _maxOutLen(maxOutLen)
+    {
+    }
+
+    // Decode blocks until the input is used (or a final block is found)
+    bool inflate()
+    {
+        bool isFinal = false;
+        while (!isFinal && (_inPos < _inLen))
+        {
+            isFinal = bits(1) != 0;
+            uint32_t blockType = bits(2);
+            bool rslt = false;
+            if (blockType == 0)
+                rslt = stored();
+            else if (blockType == 1)
+                rslt = fixed();
+            else if (blockType == 2)
+                rslt = dynamic();
+            if (!rslt || _isError)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    // Huffman decoding table - count of codes of each length and symbols ordered by code
+    static const uint32_t MAX_BITS = 15;
+    static const uint32_t MAX_LCODES = 286;
+    static const uint32_t MAX_DCODES = 30;
+    static const uint32_t FIXED_LCODES = 288;
+    struct Huffman
+    {
+        uint16_t count[MAX_BITS + 1];
+        uint16_t symbol[FIXED_LCODES];
+    };
+
+    // Tables (literal/length and distance) - allocated on first use and reused for each block
+    std::unique_ptr<Huffman[]> _pTables;
+    bool _tablesAreFixed = false;
+
+    // Input and output
+    const uint8_t* _pIn;
+    uint32_t _inLen;
+    uint32_t _inPos = 0;
+    uint32_t _bitBuf = 0;
+    uint32_t _bitCount = 0;
+    std::vector<uint8_t>& _out;
+    uint32_t _maxOutLen;
+    bool _isError = false;
+
+    uint32_t bits(uint32_t need)
+    {
+        uint32_t val = _bitBuf;
+        while (_bitCount < need)
+        {
+            if (_inPos >= _inLen)
+            {
+                _isError = true;
+                return 0;
+            }
+            val |= ((uint32_t)_pIn[_inPos++]) << _bitCount;
+            _bitCount += 8;
+        }
+        _bitBuf = val >> need;
+        _bitCount -= need;
+        return val & ((1ul << need) - 1);
+    }
+
+    bool stored()
+    {
+        _bitBuf = 0;
+        _bitCount = 0;
+        if (_inPos + 4 > _inLen)
+            return false;
+        uint32_t len = _pIn[_inPos] | (_pIn[_inPos + 1] << 8);
+        uint32_t nlen = _pIn[_inPos + 2] | (_pIn[_inPos + 3] << 8);
+        _inPos += 4;
+        if ((len != (~nlen & 0xffff)) || (_inPos + len > _inLen) || (_out.size() + len > _maxOutLen))
+            return false;
+        _out.insert(_out.end(), _pIn + _inPos, _pIn + _inPos + len);
+        _inPos += len;
+        return true;
+    }
+
+    int decode(const Huffman& h)
+    {
+        int code = 0, first = 0, index = 0;
+        for (uint32_t len = 1; len <= MAX_BITS; len++)
+        {
+            code |= bits(1);
+            if (_isError)
+                return -1;
+            int count = h.count[len];
+            if (code - count < first)
+                return h.symbol[index + (code - first)];
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+
+    // Returns false if the code lengths are over-subscribed
+    static bool construct(Huffman& h, const uint16_t* pLengths, uint32_t num)
+    {
+        for (uint32_t len = 0; len <= MAX_BITS; len++)
+            h.count[len] = 0;
+        for (uint32_t sym = 0; sym < num; sym++)
+            h.count[pLengths[sym]]++;
+        if (h.count[0] == num)
+            return true;
+        int left = 1;
+        for (uint32_t len = 1; len <= MAX_BITS; len++)
+        {
+            left <<= 1;
+            left -= h.count[len];
+            if (left < 0)
+                return false;
+        }
+        uint16_t offs[MAX_BITS + 1];
+        offs[1] = 0;
+        for (uint32_t len = 1; len < MAX_BITS; len++)
+            offs[len + 1] = offs[len] + h.count[len];
+        for (uint32_t sym = 0; sym < num; sym++)
+            if (pLengths[sym] != 0)
+                h.symbol[offs[pLengths[sym]]++] = sym;
+        return true;
+    }
+
+    bool codes(const Huffman& lencode, const Huffman& distcode)
+    {
+        while (true)
+        {
+            int sym = decode(lencode);
+            if (sym < 0)
+                return false;
+            if (sym < 256)
+            {
+                if (_out.size() >= _maxOutLen)
+                    return false;
+                _out.push_back(sym);
+                continue;
+            }
+            if (sym == 256)
+                return true;
+            sym -= 257;
+            if (sym >= 29)
+                return false;
+            uint32_t len = LEN_BASE[sym] + bits(LEN_EXTRA[sym]);
+            int distSym = decode(distcode);
+            if ((distSym < 0) || (distSym >= 30))
+                return false;
+            uint32_t dist = DIST_BASE[distSym] + bits(DIST_EXTRA[distSym]);
+            if (_isError || (dist > _out.size()) || (_out.size() + len > _maxOutLen))
+                return false;
+            uint32_t from = _out.size() - dist;
+            for (uint32_t i = 0; i < len; i++)
+                _out.push_back(_out[from + i]);
+        }
+    }
+
+    bool allocTables()
+    {
+        if (!_pTables)
+            _pTables.reset(new Huffman[2]);
+        return (bool)_pTables;
+    }
+
+    bool fixed()
+    {
+        // Fixed tables are only constructed if the previous block didn't use them
+        if (!allocTables())
+            return false;
+        if (!_tablesAreFixed)
+        {
+            uint16_t lengths[FIXED_LCODES];
+            uint32_t sym = 0;
+            for (; sym < 144; sym++) lengths[sym] = 8;
+            for (; sym < 256; sym++) lengths[sym] = 9;
+            for (; sym < 280; sym++) lengths[sym] = 7;
+            for (; sym < FIXED_LCODES; sym++) lengths[sym] = 8;
+            construct(_pTables[0], lengths, FIXED_LCODES);
+            for (sym = 0; sym < MAX_DCODES; sym++) lengths[sym] = 5;
+            construct(_pTables[1], lengths, MAX_DCODES);
+            _tablesAreFixed = true;
+        }
+        return codes(_pTables[0], _pTables[1]);
+    }
+
+    bool dynamic()
+    {
+        static const uint8_t ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        uint32_t nlen = bits(5) + 257;
+        uint32_t ndist = bits(5) + 1;
+        uint32_t ncode = bits(4) + 4;
+        if (_isError || (nlen > MAX_LCODES) || (ndist > MAX_DCODES))
+            return false;
+
+        // Code length code lengths
+        if (!allocTables())
+            return false;
+        _tablesAreFixed = false;
+        Huffman* pTables = _pTables.get();
+        uint16_t lengths[MAX_LCODES + MAX_DCODES];
+        uint32_t index = 0;
+        for (; index < ncode; index++)
+            lengths[ORDER[index]] = bits(3);
+        for (; index < 19; index++)
+            lengths[ORDER[index]] = 0;
+        if (!construct(pTables[0], lengths, 19))
+            return false;
+
+        // Literal/length and distance code lengths
+        index = 0;
+        while (index < nlen + ndist)
+        {
+            int sym = decode(pTables[0]);
+            if (sym < 0)
+                return false;
+            if (sym < 16)
+            {
+                lengths[index++] = sym;
+                continue;
+            }
+            uint16_t len = 0;
+            uint32_t repeat = 0;
+            if (sym == 16)
+            {
+                if (index == 0)
+                    return false;
+                len = lengths[index - 1];
+                repeat = 3 + bits(2);
+            }
+            else if (sym == 17)
+            {
+                repeat = 3 + bits(3);
+            }
+            else
+            {
+                repeat = 11 + bits(7);
+            }
+            if (_isError || (index + repeat > nlen + ndist))
+                return false;
+            while (repeat--)
+                lengths[index++] = len;
+        }
+
+        // Must have an end-of-block code
+        if (lengths[256] == 0)
+            return false;
+        if (!construct(pTables[0], lengths, nlen))
+            return false;
+        if (!construct(pTables[1], lengths + nlen, ndist))
+            return false;
+        return codes(pTables[0], pTables[1]);
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decompress a complete message
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebDeflate::decompress(const uint8_t* pBuf, uint32_t bufLen, std::vector<uint8_t>& outBuf, uint32_t maxLen)
+{
+    // Restore the trailer removed by the sender
+    std::vector<uint8_t> inBuf;
+    inBuf.reserve(bufLen + sizeof(SYNC_FLUSH_TRAILER));
+    inBuf.assign(pBuf, pBuf + bufLen);
+    inBuf.insert(inBuf.end(), SYNC_FLUSH_TRAILER, SYNC_FLUSH_TRAILER + sizeof(SYNC_FLUSH_TRAILER));
+
+    // Output starts with history so back references can reach previous messages
+    uint32_t historyLen = _rxHistory.size();
+    outBuf.swap(_rxHistory);
+    _rxHistory.clear();
+    RdWebInflater inflater(inBuf.data(), inBuf.size(), outBuf, historyLen + maxLen);
+    bool rslt = inflater.inflate();
+
+    // Keep the history for the next message
+    if (rslt && !_rxNoContextTakeover)
+    {
+        // Some deflate implementations use a 512 byte window when 256 is requested
+        uint32_t windowSize = 1 << (_rxWindowBits < MIN_WINDOW_BITS ? MIN_WINDOW_BITS : _rxWindowBits);
+        uint32_t keepLen = outBuf.size() > windowSize ? windowSize : outBuf.size();
+        _rxHistory.assign(outBuf.end() - keepLen, outBuf.end());
+    }
+    outBuf.erase(outBuf.begin(), outBuf.begin() + historyLen);
+
+    // Stats
+    if (_pStats)
+    {
+        if (rslt)
+        {
+            _pStats->rxMsgs++;
+            _pStats->rxBytesIn += bufLen;
+            _pStats->rxBytesOut += outBuf.size();
+        }
+        else
+        {
+            _pStats->rxErrors++;
+        }
+    }
+#ifdef DEBUG_WEB_DEFLATE_ERRORS
+    if (!rslt)
+        LOG_W(MODULE_PREFIX, "decompress failed inLen %d outLen %d", bufLen, outBuf.size());
+#endif
+    return rslt;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get extension param name and value (value may be quoted)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebDeflate::getParam(const String& param, String& name, String& val)
+{
+    int eqPos = param.indexOf('=');
+    name = eqPos < 0 ? param : param.substring(0, eqPos);
+    name.trim();
+    val = eqPos < 0 ? "" : param.substring(eqPos + 1);
+    val.trim();
+    if (val.startsWith("\"") && val.endsWith("\"") && (val.length() >= 2))
+        val = val.substring(1, val.length() - 1);
+    return name.length() > 0;
+}
@@ -0,0 +1,122 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <WString.h>
+
+// Statistics for compressed messages (shared by all connections of a handler)
+class RdWebDeflateStats
+{
+public:
+    RdWebDeflateStats()
+    {
+        clear();
+    }
+    void clear()
+    {
+        txMsgs = 0;
+        txBytesIn = 0;
+        txBytesOut = 0;
+        rxMsgs = 0;
+        rxBytesIn = 0;
+        rxBytesOut = 0;
+        rxErrors = 0;
+    }
+    String getDebugJSON();
+
+    // Tx bytes in are uncompressed and out are compressed - rx bytes in are compressed
+    uint32_t txMsgs;
+    uint64_t txBytesIn;
+    uint64_t txBytesOut;
+    uint32_t rxMsgs;
+    uint64_t rxBytesIn;
+    uint64_t rxBytesOut;
+    uint32_t rxErrors;
+};
+
+// permessage-deflate (RFC7692) compression for websockets
+// The compressor uses LZ77 with a hash table and fixed huffman codes (falling back to stored blocks for
+// data that doesn't compress) so it only needs memory for the sliding window and hash table
+// Each part of a message is compressed and sync-flushed so fragments can be produced as data is sent
+class RdWebDeflate
+{
+public:
+    RdWebDeflate();
+    virtual ~RdWebDeflate();
+
+    // Negotiate using the Sec-WebSocket-Extensions header of the request
+    // Returns true if permessage-deflate was offered and accepted in which case respParams contains the
+    // value for the Sec-WebSocket-Extensions header of the response
+    bool negotiate(const String& extensionsOffer, uint32_t maxWindowBits, bool noContextTakeover,
+                String& respParams);
+
+    // Set stats
+    void setStats(RdWebDeflateStats* pStats)
+    {
+        _pStats = pStats;
+    }
+
+    // Compress part of a message - compressed data is appended to outBuf
+    // Output is no more than MAX_COMPRESS_OVERHEAD_BYTES larger than the input
+    void compress(const uint8_t* pBuf, uint32_t bufLen, bool msgFinal, std::vector<uint8_t>& outBuf);
+
+    // Decompress a complete message - returns false on error or if the result would exceed maxLen
+    bool decompress(const uint8_t* pBuf, uint32_t bufLen, std::vector<uint8_t>& outBuf, uint32_t maxLen);
+
+    // Window sizes
+    static const uint32_t MIN_WINDOW_BITS = 9;
+    static const uint32_t MAX_WINDOW_BITS = 15;
+
+    // Max growth of compressed data (stored block header, partial byte and sync flush)
+    static const uint32_t MAX_COMPRESS_OVERHEAD_BYTES = 12;
+
+private:
+    // Negotiated params
+    uint32_t _txWindowBits;
+    bool _txNoContextTakeover;
+    uint32_t _rxWindowBits;
+    bool _rxNoContextTakeover;
+
+    // Stats
+    RdWebDeflateStats* _pStats;
+
+    // Compressor window (previous data and current input) and hash of 3 byte sequences to position in stream
+    std::vector<uint8_t> _txWindow;
+    uint32_t _txWindowStart;
+    std::vector<uint32_t> _txHashHead;
+    static const uint32_t HASH_BITS = 10;
+    static const uint32_t MIN_MATCH = 3;
+    static const uint32_t MAX_MATCH = 258;
+    static const uint32_t REBASE_POS = 0x40000000;
+    static const uint32_t STORED_BLOCK_HEADER_BYTES = 5;
+
+    // Output bits
+    uint32_t _bitBuf;
+    uint32_t _bitCount;
+    void putBits(std::vector<uint8_t>& outBuf, uint32_t bits, uint32_t numBits);
+    void putHuffman(std::vector<uint8_t>& outBuf, uint32_t code, uint32_t numBits);
+    void putFixedLitLen(std::vector<uint8_t>& outBuf, uint32_t sym);
+    void flushBits(std::vector<uint8_t>& outBuf);
+    void compressFixed(uint32_t startIdx, std::vector<uint8_t>& outBuf);
+    void putStored(const uint8_t* pBuf, uint32_t bufLen, std::vector<uint8_t>& outBuf);
+    void resetCompressor();
+
+    // Decompressor history (previous output within window)
+    std::vector<uint8_t> _rxHistory;
+
+    // Helpers
+    static uint32_t hash3(const uint8_t* pBuf)
+    {
+        uint32_t val = pBuf[0] | (pBuf[1] << 8) | (pBuf[2] << 16);
+        return (val * 2654435761u) >> (32 - HASH_BITS);
+    }
+    static bool getParam(const String& param, String& name, String& val);
+};
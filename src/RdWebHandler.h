@@ -45,6 +45,10 @@ public:
     {
         return false;
     }
+    virtual String getDebugJSON()
+    {
+        return "{}";
+    }
     
 private:
 };
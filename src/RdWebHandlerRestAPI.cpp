@@ -0,0 +1,330 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RdWebHandlerRestAPI.h"
+#include "RdWebServerSettings.h"
+#include "RdWebResponderPrecomputed.h"
+#include "RdWebResponderRestAPIBatch.h"
+#include <inttypes.h>
+#include <Logger.h>
+#include <ArduinoTime.h>
+
+// #define DEBUG_WEB_HANDLER_REST_API
+
+#ifdef DEBUG_WEB_HANDLER_REST_API
+static const char* MODULE_PREFIX = "WebHandlerRestAPI";
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor / Destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebHandlerRestAPI::RdWebHandlerRestAPI(const String& restAPIPrefix, RdWebAPIMatchEndpointCB matchEndpointCB)
+{
+    _matchEndpointCB = matchEndpointCB;
+    _restAPIPrefix = restAPIPrefix;
+    if (!_restAPIPrefix.startsWith("/"))
+        _restAPIPrefix = "/" + _restAPIPrefix;
+    _batchMaxSize = 0;
+    _endpointMatchCacheMaxEntries = 0;
+    _endpointMatchCacheHits = 0;
+    _endpointMatchCacheMisses = 0;
+    _endpointMatchCacheGen = 0;
+    _endpointsVersionCB = nullptr;
+    _endpointsVersion = 0;
+    _endpointMatchCacheMutex = xSemaphoreCreateMutex();
+}
+
+RdWebHandlerRestAPI::~RdWebHandlerRestAPI()
+{
+    if (_endpointMatchCacheMutex)
+        vSemaphoreDelete(_endpointMatchCacheMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get a responder if we can handle this request
+// NOTE: this returns a new object or NULL
+// NOTE: if a new object is returned the caller is responsible for deleting it when appropriate
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebResponder* RdWebHandlerRestAPI::getNewResponder(const RdWebRequestHeader& requestHeader,
+        const RdWebRequestParams& params, const RdWebServerSettings& webServerSettings,
+        RdHttpStatusCode &statusCode)
+{
+    // Check
+    if (!_matchEndpointCB)
+        return nullptr;
+
+    // Debug
+#ifdef DEBUG_WEB_HANDLER_REST_API
+    uint64_t getResponderStartUs = micros();
+#endif
+
+    // Check for API prefix
+    if (!requestHeader.URL.startsWith(_restAPIPrefix))
+    {
+#ifdef DEBUG_WEB_HANDLER_REST_API
+        uint64_t getResponderEndUs = micros();
+        LOG_W(MODULE_PREFIX, "getNewResponder no match with %s for %s took %lldus",
+                    _restAPIPrefix.c_str(), requestHeader.URL.c_str(), getResponderEndUs-getResponderStartUs);
+#endif
+        return nullptr;
+    }
+
+    // Remove prefix on test string
+    String reqStr = requestHeader.URIAndParams.substring(_restAPIPrefix.length());
+
+    // Check rate limits - limited requests get a precomputed response before any endpoint processing
+    if (!_rateLimiter.isRequestAllowed(requestHeader.clientIPAddr, reqStr))
+    {
+        statusCode = HTTP_STATUS_TOOMANYREQUESTS;
+        return new RdWebResponderPrecomputed(_rateLimiter.getTooManyRequestsResponse());
+    }
+
+    // Check for a batch
+    if ((_batchMaxSize != 0) && (requestHeader.extract.method == WEB_METHOD_POST) &&
+                (requestHeader.URL.substring(_restAPIPrefix.length()) == _batchReqName))
+    {
+        // Check size of batch body
+        if (requestHeader.extract.contentLength > _batchMaxSize * (RdWebResponderRestAPIBatch::MAX_BATCH_REQ_STR_LEN + 4) + 2)
+        {
+            statusCode = HTTP_STATUS_PAYLOADTOOLARGE;
+            return nullptr;
+        }
+        statusCode = HTTP_STATUS_OK;
+        return new RdWebResponderRestAPIBatch(this, params, requestHeader.extract.contentLength,
+                        requestHeader.clientIPAddr, webServerSettings._restAPIChannelID, _batchMaxSize);
+    }
+
+    // Check the response cache - only cacheable endpoints are ever stored so a hit
+    // doesn't need the endpoint to be matched
+    String cachedResp;
+    if ((requestHeader.extract.method == WEB_METHOD_GET) && _responseCache.get(reqStr, cachedResp))
+    {
+        RdWebResponderRestAPI* pResponder = new RdWebResponderRestAPI(RdWebServerRestEndpoint(), this, params,
+                        reqStr, requestHeader.extract,
+                        webServerSettings._restAPIChannelID, nullptr);
+        if (pResponder)
+            pResponder->setCachedResponse(cachedResp);
+
+#ifdef DEBUG_WEB_HANDLER_REST_API
+        uint64_t getResponderEndUs = micros();
+        LOG_I(MODULE_PREFIX, "getNewResponder cached response uri %s len %d took %lld",
+                    requestHeader.URL.c_str(), cachedResp.length(), getResponderEndUs-getResponderStartUs);
+#endif
+        statusCode = HTTP_STATUS_OK;
+        return pResponder;
+    }
+
+    // Match endpoint
+    RdWebServerRestEndpoint endpoint;
+    if (!matchEndpoint(reqStr, requestHeader.extract.method, endpoint))
+    {
+#ifdef DEBUG_WEB_HANDLER_REST_API
+        uint64_t getResponderEndUs = micros();
+        LOG_W(MODULE_PREFIX, "getNewResponder no matching endpoint found %s took %lld",
+                    requestHeader.URL.c_str(), getResponderEndUs-getResponderStartUs);
+#endif
+        return nullptr;
+    }
+
+    // Looks like we can handle this so create a new responder object
+    bool useCache = (requestHeader.extract.method == WEB_METHOD_GET) && (endpoint.cacheTTLMs != 0);
+    RdWebResponder* pResponder = new RdWebResponderRestAPI(endpoint, this, params,
+                    reqStr, requestHeader.extract,
+                    webServerSettings._restAPIChannelID,
+                    useCache ? &_responseCache : nullptr);
+
+    // Debug
+#ifdef DEBUG_WEB_HANDLER_REST_API
+    uint64_t getResponderEndUs = micros();
+    LOG_I(MODULE_PREFIX, "getNewResponder constructed new responder %lx uri %s took %lld",
+                (unsigned long)pResponder, requestHeader.URL.c_str(), getResponderEndUs-getResponderStartUs);
+#endif
+
+    // Return new responder - caller must clean up by deleting object when no longer needed
+    statusCode = HTTP_STATUS_OK;
+    return pResponder;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Enable batched requests
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebHandlerRestAPI::enableBatch(const String& batchReqName, uint32_t maxBatchSize)
+{
+    _batchReqName = batchReqName;
+    if (!_batchReqName.startsWith("/"))
+        _batchReqName = "/" + _batchReqName;
+    _batchMaxSize = maxBatchSize;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle a single request from a batch
+// Requests are treated as GETs and are subject to the same rate limits and response cache as direct requests
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdHttpStatusCode RdWebHandlerRestAPI::handleBatchRequest(uint32_t clientIPAddr, const String& reqStr,
+                String& respStr, const APISourceInfo& sourceInfo)
+{
+    // Requests may include the API prefix or not
+    String subReqStr = reqStr;
+    if (subReqStr.startsWith(_restAPIPrefix))
+        subReqStr = subReqStr.substring(_restAPIPrefix.length());
+    if (!subReqStr.startsWith("/"))
+        subReqStr = "/" + subReqStr;
+
+    // Check rate limits
+    if (!_rateLimiter.isRequestAllowed(clientIPAddr, subReqStr))
+        return HTTP_STATUS_TOOMANYREQUESTS;
+
+    // Check the response cache
+    if (_responseCache.get(subReqStr, respStr))
+        return HTTP_STATUS_OK;
+
+    // Match endpoint
+    RdWebServerRestEndpoint endpoint;
+    if (!_matchEndpointCB || !matchEndpoint(subReqStr, WEB_METHOD_GET, endpoint) || !endpoint.restApiFn)
+        return HTTP_STATUS_NOTFOUND;
+
+    // Check ready
+    if (endpoint.restApiFnIsReady && !endpoint.restApiFnIsReady(sourceInfo))
+        return HTTP_STATUS_SERVICEUNAVAILABLE;
+
+    // Call endpoint
+    endpoint.restApiFn(subReqStr, respStr, sourceInfo);
+    if (endpoint.cacheTTLMs != 0)
+        _responseCache.put(subReqStr, respStr, endpoint.cacheTTLMs);
+
+#ifdef DEBUG_WEB_HANDLER_REST_API
+    LOG_I(MODULE_PREFIX, "handleBatchRequest req %s respLen %d", subReqStr.c_str(), respStr.length());
+#endif
+    return HTTP_STATUS_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Endpoint match cache
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebHandlerRestAPI::setEndpointMatchCacheMaxEntries(uint32_t maxEntries, RdWebAPIEndpointsVersionCB endpointsVersionCB)
+{
+    uint32_t endpointsVersion = endpointsVersionCB ? endpointsVersionCB() : 0;
+    if (xSemaphoreTake(_endpointMatchCacheMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    _endpointMatchCacheMaxEntries = maxEntries;
+    _endpointsVersionCB = endpointsVersionCB;
+    _endpointsVersion = endpointsVersion;
+    clearEndpointMatchCache();
+    xSemaphoreGive(_endpointMatchCacheMutex);
+}
+
+void RdWebHandlerRestAPI::invalidateEndpointMatchCache()
+{
+    if (xSemaphoreTake(_endpointMatchCacheMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    clearEndpointMatchCache();
+    xSemaphoreGive(_endpointMatchCacheMutex);
+}
+
+// Must be called with the mutex held
+void RdWebHandlerRestAPI::clearEndpointMatchCache()
+{
+    _endpointMatchCacheMap.clear();
+    _endpointMatchCacheList.clear();
+    _endpointMatchCacheGen++;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Match endpoint using the cache if enabled
+// Only successful matches are cached as other handlers may deal with unmatched requests
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebHandlerRestAPI::matchEndpoint(const String& reqStr, RdWebServerMethod method, RdWebServerRestEndpoint& endpoint)
+{
+    // Get cache settings (set under the mutex by setEndpointMatchCacheMaxEntries)
+    uint32_t cacheMaxEntries = 0;
+    RdWebAPIEndpointsVersionCB endpointsVersionCB;
+    if (xSemaphoreTake(_endpointMatchCacheMutex, portMAX_DELAY) == pdTRUE)
+    {
+        cacheMaxEntries = _endpointMatchCacheMaxEntries;
+        endpointsVersionCB = _endpointsVersionCB;
+        xSemaphoreGive(_endpointMatchCacheMutex);
+    }
+
+    // Check cache enabled
+    if (cacheMaxEntries == 0)
+        return _matchEndpointCB(reqStr.c_str(), method, endpoint);
+
+    // Key is method and path
+    int queryPos = reqStr.indexOf('?');
+    String cacheKey = String((int)method) + ":" + (queryPos < 0 ? reqStr : reqStr.substring(0, queryPos));
+
+    // Application's endpoints version (got without the mutex held as it is an application callback)
+    uint32_t endpointsVersion = endpointsVersionCB ? endpointsVersionCB() : 0;
+
+    // Check cache
+    uint32_t cacheGen = 0;
+    if (xSemaphoreTake(_endpointMatchCacheMutex, portMAX_DELAY) == pdTRUE)
+    {
+        // Clear the cache if the application's endpoints have changed
+        if (endpointsVersionCB && (endpointsVersion != _endpointsVersion))
+        {
+            clearEndpointMatchCache();
+            _endpointsVersion = endpointsVersion;
+        }
+        cacheGen = _endpointMatchCacheGen;
+
+        // Find and move to front (most recently used)
+        auto mapIt = _endpointMatchCacheMap.find(cacheKey);
+        if (mapIt != _endpointMatchCacheMap.end())
+        {
+            _endpointMatchCacheList.splice(_endpointMatchCacheList.begin(), _endpointMatchCacheList, mapIt->second);
+            endpoint = mapIt->second->endpoint;
+            _endpointMatchCacheHits++;
+            xSemaphoreGive(_endpointMatchCacheMutex);
+            return true;
+        }
+        _endpointMatchCacheMisses++;
+        xSemaphoreGive(_endpointMatchCacheMutex);
+    }
+
+    // Match using application callback
+    if (!_matchEndpointCB(reqStr.c_str(), method, endpoint))
+        return false;
+
+    // Add to cache (unless invalidated since the lookup) - when full the least recently used is replaced
+    if (xSemaphoreTake(_endpointMatchCacheMutex, portMAX_DELAY) == pdTRUE)
+    {
+        if ((cacheGen == _endpointMatchCacheGen) && (_endpointMatchCacheMaxEntries != 0) &&
+                    (_endpointMatchCacheMap.find(cacheKey) == _endpointMatchCacheMap.end()))
+        {
+            if ((_endpointMatchCacheList.size() >= _endpointMatchCacheMaxEntries) && !_endpointMatchCacheList.empty())
+            {
+                _endpointMatchCacheMap.erase(_endpointMatchCacheList.back().cacheKey);
+                _endpointMatchCacheList.pop_back();
+            }
+            _endpointMatchCacheList.push_front({cacheKey, endpoint});
+            _endpointMatchCacheMap[cacheKey] = _endpointMatchCacheList.begin();
+        }
+        xSemaphoreGive(_endpointMatchCacheMutex);
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String RdWebHandlerRestAPI::getDebugJSON()
+{
+    char matchCacheStr[80];
+    snprintf(matchCacheStr, sizeof(matchCacheStr), R"({"hits":%)" PRIu32 R"(,"misses":%)" PRIu32 R"(,"entries":%)" PRIu32 "}",
+                _endpointMatchCacheHits, _endpointMatchCacheMisses, (uint32_t)_endpointMatchCacheList.size());
+    return R"({"cache":)" + _responseCache.getDebugJSON() + R"(,"rateLimit":)" + _rateLimiter.getDebugJSON() +
+                R"(,"matchCache":)" + matchCacheStr + "}";
+}
@@ -8,87 +8,119 @@
 
 #pragma once
 
+#include <map>
+#include <list>
 #include <Logger.h>
 #include "RdWebHandler.h"
 #include "RdWebInterface.h"
 #include "RdWebRequestHeader.h"
 #include "RdWebResponderRestAPI.h"
-
-// #define DEBUG_WEB_HANDLER_REST_API
+#include "RdWebRestAPICache.h"
+#include "RdWebRateLimiter.h"
+#include "APISourceInfo.h"
 
 class RdWebRequest;
 
 class RdWebHandlerRestAPI : public RdWebHandler
 {
 public:
-    RdWebHandlerRestAPI(const String& restAPIPrefix, RdWebAPIMatchEndpointCB matchEndpointCB)
+    RdWebHandlerRestAPI(const String& restAPIPrefix, RdWebAPIMatchEndpointCB matchEndpointCB);
+    virtual ~RdWebHandlerRestAPI();
+    virtual const char* getName() override
     {
-        _matchEndpointCB = matchEndpointCB;
-        _restAPIPrefix = restAPIPrefix;
-        if (!_restAPIPrefix.startsWith("/"))
-            _restAPIPrefix = "/" + _restAPIPrefix;
+        return "HandlerRESTAPI";
     }
-    virtual ~RdWebHandlerRestAPI()
+    virtual RdWebResponder* getNewResponder(const RdWebRequestHeader& requestHeader,
+            const RdWebRequestParams& params, const RdWebServerSettings& webServerSettings,
+            RdHttpStatusCode &statusCode) override final;
+
+    // Set max bytes held by response cache (0 disables the cache)
+    void setResponseCacheMaxBytes(uint32_t maxBytes)
     {
+        _responseCache.setMaxBytes(maxBytes);
     }
-    virtual const char* getName() override
+
+    // Invalidate cached responses for requests starting with reqPrefix (empty prefix invalidates all)
+    void invalidateResponseCache(const String& reqPrefix = "")
     {
-        return "HandlerRESTAPI";
+        _responseCache.invalidate(reqPrefix);
     }
-    virtual RdWebResponder* getNewResponder(const RdWebRequestHeader& requestHeader, 
-            const RdWebRequestParams& params, const RdWebServerSettings& webServerSettings,
-            RdHttpStatusCode &statusCode) override final
+
+    // Set per-client rate limit - requests over the limit get a 429 response (ratePerSec == 0 disables)
+    // maxClients is the number of client addresses tracked (least recently used are forgotten)
+    void setRateLimitPerClient(uint32_t ratePerSec, uint32_t burst, uint32_t maxClients)
     {
-        // Check
-        if (!_matchEndpointCB)
-            return nullptr;
-
-        // Debug
-#ifdef DEBUG_WEB_HANDLER_REST_API
-        uint64_t getResponderStartUs = micros();
-#endif
-
-        // Check for API prefix
-        if (!requestHeader.URL.startsWith(_restAPIPrefix))
-        {
-#ifdef DEBUG_WEB_HANDLER_REST_API
-            uint64_t getResponderEndUs = micros();
-            LOG_W("WebHandlerRestAPI", "getNewResponder no match with %s for %s took %lldus", 
-                        _restAPIPrefix.c_str(), requestHeader.URL.c_str(), getResponderEndUs-getResponderStartUs);
-#endif
-            return nullptr;
-        }
-
-        // Remove prefix on test string
-        String reqStr = requestHeader.URIAndParams.substring(_restAPIPrefix.length());
-        RdWebServerRestEndpoint endpoint;
-        if (!_matchEndpointCB(reqStr.c_str(), requestHeader.extract.method, endpoint))
-        {
-#ifdef DEBUG_WEB_HANDLER_REST_API
-            uint64_t getResponderEndUs = micros();
-            LOG_W("WebHandlerRestAPI", "getNewResponder no matching endpoint found %s took %lld", 
-                        requestHeader.URL.c_str(), getResponderEndUs-getResponderStartUs);
-#endif
-            return nullptr;
-        }
-        // Looks like we can handle this so create a new responder object
-        RdWebResponder* pResponder = new RdWebResponderRestAPI(endpoint, this, params, 
-                        reqStr, requestHeader.extract, 
-                        webServerSettings._restAPIChannelID);
-
-        // Debug
-#ifdef DEBUG_WEB_HANDLER_REST_API
-        uint64_t getResponderEndUs = micros();
-        LOG_I("WebHandlerRestAPI", "getNewResponder constructed new responder %lx uri %s took %lld", 
-                    (unsigned long)pResponder, requestHeader.URL.c_str(), getResponderEndUs-getResponderStartUs);
-#endif
-
-        // Return new responder - caller must clean up by deleting object when no longer needed
-        statusCode = HTTP_STATUS_OK;
-        return pResponder;
+        _rateLimiter.setClientLimit(ratePerSec, burst, maxClients);
+    }
+
+    // Add a rate limit shared by all clients for requests starting with reqPrefix
+    void addRateLimitForPrefix(const String& reqPrefix, uint32_t ratePerSec, uint32_t burst)
+    {
+        _rateLimiter.addPrefixLimit(reqPrefix, ratePerSec, burst);
+    }
+
+    // Clear prefix rate limits
+    void clearRateLimitPrefixes()
+    {
+        _rateLimiter.clearPrefixLimits();
     }
 
+    // Enable cache of endpoint matches (maxEntries == 0 disables) - matches are keyed on method and
+    // path (excluding query) so the endpoint match callback must not depend on query parameters
+    // The cache is cleared automatically when the version returned by endpointsVersionCB changes -
+    // if no callback is provided invalidateEndpointMatchCache() must be called when endpoints change
+    void setEndpointMatchCacheMaxEntries(uint32_t maxEntries, RdWebAPIEndpointsVersionCB endpointsVersionCB = nullptr);
+
+    // Invalidate endpoint match cache
+    void invalidateEndpointMatchCache();
+
+    // Enable batched requests - a POST to batchReqName (e.g. "batch") with a JSON array of request
+    // strings executes each (as a GET) and responds with a JSON array of results (maxBatchSize == 0 disables)
+    void enableBatch(const String& batchReqName, uint32_t maxBatchSize);
+
+    // Handle a single request from a batch - returns HTTP status for the request
+    RdHttpStatusCode handleBatchRequest(uint32_t clientIPAddr, const String& reqStr,
+                    String& respStr, const APISourceInfo& sourceInfo);
+
+    // Debug
+    virtual String getDebugJSON() override;
+
 private:
     RdWebAPIMatchEndpointCB _matchEndpointCB;
     String _restAPIPrefix;
+
+    // Cache of responses from endpoints with a cacheTTLMs
+    RdWebRestAPICache _responseCache;
+
+    // Rate limiting
+    RdWebRateLimiter _rateLimiter;
+
+    // Batched requests
+    String _batchReqName;
+    uint32_t _batchMaxSize;
+
+    // Endpoint match cache - least recently used entries are at the back of the list and the map
+    // finds entries by key
+    class EndpointMatchCacheEntry
+    {
+    public:
+        String cacheKey;
+        RdWebServerRestEndpoint endpoint;
+    };
+    std::list<EndpointMatchCacheEntry> _endpointMatchCacheList;
+    std::map<String, std::list<EndpointMatchCacheEntry>::iterator> _endpointMatchCacheMap;
+    uint32_t _endpointMatchCacheMaxEntries;
+
+    // Endpoint match cache generation (incremented when invalidated so a match started before
+    // invalidation isn't cached) and the application's endpoints version when last checked
+    uint32_t _endpointMatchCacheGen;
+    RdWebAPIEndpointsVersionCB _endpointsVersionCB;
+    uint32_t _endpointsVersion;
+    uint32_t _endpointMatchCacheHits;
+    uint32_t _endpointMatchCacheMisses;
+    SemaphoreHandle_t _endpointMatchCacheMutex;
+
+    // Helpers
+    bool matchEndpoint(const String& reqStr, RdWebServerMethod method, RdWebServerRestEndpoint& endpoint);
+    void clearEndpointMatchCache();
 };
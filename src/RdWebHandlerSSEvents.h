@@ -19,10 +19,17 @@ class RdWebRequest;
 class RdWebHandlerSSEvents : public RdWebHandler
 {
 public:
-    RdWebHandlerSSEvents(const String& eventsPath, RdWebSSEventsCB eventCallback)
+    // txQueueMax is the number of events queued for each connection and txQueuePolicy is the policy
+    // when the queue is full (as for websockets) - "latest" keeps only the latest event in each event group
+    // (and drops the oldest event of any group if full) so txQueueMax should exceed the number of groups
+    RdWebHandlerSSEvents(const String& eventsPath, RdWebSSEventsCB eventCallback,
+                uint32_t txQueueMax = RdWebResponderSSEvents::DEFAULT_TX_QUEUE_MAX_LEN,
+                const String& txQueuePolicy = "dropNewest")
             : _eventCallback(eventCallback)
     {
         _eventsPath = eventsPath;
+        _txQueueMax = txQueueMax;
+        _txQueuePolicy = RdWebTxQueue<int>::getPolicyFromStr(txQueuePolicy);
     }
     virtual ~RdWebHandlerSSEvents()
     {
@@ -50,8 +57,10 @@ public:
         }
 
         // We can handle this so create a new responder object
-        RdWebResponder* pResponder = new RdWebResponderSSEvents(this, params, requestHeader.URL, 
+        RdWebResponderSSEvents* pResponder = new RdWebResponderSSEvents(this, params, requestHeader.URL, 
                     _eventCallback, webServerSettings);
+        if (pResponder)
+            pResponder->setTxQueue(_txQueueMax, _txQueuePolicy);
 
         // Debug
         // LOG_W("WebHandlerSSEvents", "getNewResponder constructed new responder %lx uri %s", (unsigned long)pResponder, requestHeader.URL.c_str());
@@ -64,4 +73,6 @@ public:
 private:
     String _eventsPath;
     RdWebSSEventsCB _eventCallback;
+    uint32_t _txQueueMax;
+    RdWebTxQueuePolicy _txQueuePolicy;
 };
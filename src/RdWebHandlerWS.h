@@ -23,8 +23,9 @@ class RdWebHandlerWS : public RdWebHandler
 {
 public:
     RdWebHandlerWS(const ConfigBase& config,
-            RdWebSocketCanAcceptCB canAcceptRxMsgCB, RdWebSocketMsgCB rxMsgCB)
-            : _canAcceptRxMsgCB(canAcceptRxMsgCB), _rxMsgCB(rxMsgCB)
+            RdWebSocketCanAcceptCB canAcceptRxMsgCB, RdWebSocketMsgCB rxMsgCB,
+            RdWebSocketStreamMsgCB rxStreamMsgCB = nullptr)
+            : _canAcceptRxMsgCB(canAcceptRxMsgCB), _rxMsgCB(rxMsgCB), _rxStreamMsgCB(rxStreamMsgCB)
     {
         // Store config
         _wsConfig = config;
@@ -33,6 +34,11 @@ public:
         uint32_t maxConn = _wsConfig.getLong("maxConn", 1);
         _channelIDUsage.clear();
         _channelIDUsage.resize(maxConn);
+
+        // Virtual channels for connections which multiplex (the first is the connection's channel)
+        uint32_t muxChannels = _wsConfig.getLong("muxChannels", 0);
+        for (ChannelIDUsage& channelIDUsage : _channelIDUsage)
+            channelIDUsage.virtChannelIDs.resize(muxChannels > 1 ? muxChannels - 1 : 0, UINT32_MAX);
     }
     virtual ~RdWebHandlerWS()
     {
@@ -45,6 +51,10 @@ public:
     {
         return "HandlerWS";
     }
+    virtual String getDebugJSON() override
+    {
+        return R"({"deflate":)" + _deflateStats.getDebugJSON() + "}";
+    }
     virtual RdWebResponder* getNewResponder(const RdWebRequestHeader& requestHeader, 
                 const RdWebRequestParams& params, 
                 const RdWebServerSettings& webServerSettings,
@@ -84,17 +94,38 @@ public:
         }
 
         // Looks like we can handle this so create a new responder object
-        RdWebResponder* pResponder = new RdWebResponderWS(this, params, requestHeader.URL, 
+        RdWebResponderWS* pResponder = new RdWebResponderWS(this, params, requestHeader.URL, 
                     webServerSettings, _canAcceptRxMsgCB, _rxMsgCB, 
                     _channelIDUsage[wsConnIdxAvailable].channelID,
                     _wsConfig.getLong("pktMaxBytes", 1000),
                     _wsConfig.getLong("txQueueMax", 10),
                     _wsConfig.getLong("pingMs", 2000),
-                    _wsConfig.getLong("noPongMs", 5000)
+                    _wsConfig.getLong("noPongMs", 5000),
+                    _rxStreamMsgCB
                     );
 
         if (pResponder)
         {
+            pResponder->setTxQueuePolicy(
+                        RdWebTxQueue<RdWebDataFrame>::getPolicyFromStr(_wsConfig.getString("txQueuePolicy", "dropNewest")),
+                        _wsConfig.getLong("txQueueBlockMs", 100),
+                        _txMsgKeyCB);
+            pResponder->setTxCoalesceMs(_wsConfig.getLong("txCoalesceMs", 0));
+            pResponder->setTxMsgMaxBytes(_wsConfig.getLong("txMsgMaxBytes", RdWebSocketLink::MAX_WS_MESSAGE_SIZE));
+            pResponder->setTxSlab(_wsConfig.getLong("txSlabBytes", RdWebResponderWS::DEFAULT_TX_SLAB_BYTES),
+                        _wsConfig.getLong("txSlabBlockBytes", RdWebResponderWS::DEFAULT_TX_SLAB_BLOCK_BYTES));
+            pResponder->setTopicCtrl(_wsConfig.getLong("topics", 0) != 0);
+            if ((_wsConfig.getLong("muxChannels", 0) > 0) && isMuxRequested(requestHeader.params))
+            {
+                std::vector<uint32_t> muxChannelIDs = { _channelIDUsage[wsConnIdxAvailable].channelID };
+                muxChannelIDs.insert(muxChannelIDs.end(), _channelIDUsage[wsConnIdxAvailable].virtChannelIDs.begin(),
+                            _channelIDUsage[wsConnIdxAvailable].virtChannelIDs.end());
+                pResponder->setMux(muxChannelIDs, _wsConfig.getLong("muxCredits", 8));
+            }
+            pResponder->setDeflate(_wsConfig.getLong("deflate", 0) != 0,
+                        _wsConfig.getLong("deflateWindowBits", 10),
+                        _wsConfig.getLong("deflateNoContextTakeover", 0) != 0,
+                        &_deflateStats);
             statusCode = HTTP_STATUS_OK;
             _channelIDUsage[wsConnIdxAvailable].isUsed = true;
         }
@@ -106,6 +137,20 @@ public:
         return pResponder;
     }
 
+    // Set streamed receive callback - when set received messages are delivered in pieces as they
+    // arrive (so they are not limited in size) and the rxMsgCB is not used
+    void setRxStreamMsgCB(RdWebSocketStreamMsgCB rxStreamMsgCB)
+    {
+        _rxStreamMsgCB = rxStreamMsgCB;
+    }
+
+    // Set function to get the key of a message sent by the application - used by the "latest" tx queue
+    // policy where a message replaces a queued message with the same key
+    void setTxMsgKeyCB(RdWebSocketMsgKeyCB txMsgKeyCB)
+    {
+        _txMsgKeyCB = txMsgKeyCB;
+    }
+
     // Setup websocket channel ID
     void setupWebSocketChannelID(uint32_t wsConnIdx, uint32_t chanID)
     {
@@ -116,6 +161,17 @@ public:
         _channelIDUsage[wsConnIdx].isUsed = false;
     }
 
+    // Setup channel ID of a virtual channel (index 1 upwards - index 0 is the connection's channel) used
+    // when a client requests multiplexing ("mux=1" in the URL query) and the "muxChannels" config is set
+    void setupWebSocketVirtualChannelID(uint32_t wsConnIdx, uint32_t virtChanIdx, uint32_t chanID)
+    {
+        // Check valid
+        if ((wsConnIdx >= _channelIDUsage.size()) || (virtChanIdx == 0) || 
+                    (virtChanIdx > _channelIDUsage[wsConnIdx].virtChannelIDs.size()))
+            return;
+        _channelIDUsage[wsConnIdx].virtChannelIDs[virtChanIdx - 1] = chanID;
+    }
+
     void responderDelete(RdWebResponderWS* pResponder)
     {
         // Get the channelID
@@ -136,6 +192,11 @@ private:
     // WS interface functions
     RdWebSocketCanAcceptCB _canAcceptRxMsgCB;
     RdWebSocketMsgCB _rxMsgCB;
+    RdWebSocketStreamMsgCB _rxStreamMsgCB;
+    RdWebSocketMsgKeyCB _txMsgKeyCB;
+
+    // Compression stats for all connections
+    RdWebDeflateStats _deflateStats;
 
     // Web socket protocol channelIDs
     class ChannelIDUsage
@@ -143,8 +204,22 @@ private:
     public:
         uint32_t channelID = UINT32_MAX;
         bool isUsed = false;
+        std::vector<uint32_t> virtChannelIDs;
     };
     std::vector<ChannelIDUsage> _channelIDUsage;
+
+    // Check if the client requested multiplexing in the URL query
+    static bool isMuxRequested(const String& reqParams)
+    {
+        std::vector<RdJson::NameValuePair> queryNameValues;
+        RdJson::extractNameValues(reqParams, "=", "&", NULL, queryNameValues);
+        for (RdJson::NameValuePair& nvp : queryNameValues)
+        {
+            if (nvp.name.equals("mux"))
+                return nvp.value.equals("1");
+        }
+        return false;
+    }
 };
 
 #endif
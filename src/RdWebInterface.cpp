@@ -83,6 +83,7 @@ const char* RdWebInterface::getHTTPStatusStr(RdHttpStatusCode status)
         case HTTP_STATUS_PAYLOADTOOLARGE: return "Request Entity Too Large";
         case HTTP_STATUS_URITOOLONG: return "Request-URI Too Large";
         case HTTP_STATUS_UNSUPPORTEDMEDIATYPE: return "Unsupported Media Type";
+        case HTTP_STATUS_TOOMANYREQUESTS: return "Too Many Requests";
         case HTTP_STATUS_NOTIMPLEMENTED: return "Not Implemented";
         case HTTP_STATUS_SERVICEUNAVAILABLE: return "Service Unavailable";
         default: return "See W3 ORG";
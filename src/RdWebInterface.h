@@ -11,6 +11,7 @@
 #include "stdint.h"
 #include "stddef.h"
 #include <functional>
+#include "RdWebJsonSAX.h"
 extern "C"
 {
 #include "lwip/err.h"
@@ -143,6 +144,8 @@ typedef std::function<void(String &reqStr, const uint8_t *pData, size_t len, siz
 					size_t total, const APISourceInfo& sourceInfo)> RdWebAPIFnBody;
 typedef std::function<void(String &reqStr, FileStreamBlock& fileStreamBlock, const APISourceInfo& sourceInfo)> RdWebAPIFnChunk;
 typedef std::function<bool(const APISourceInfo& sourceInfo)> RdWebAPIFnIsReady;
+typedef std::function<void(String &reqStr, RdJsonSAXEvent event, const String& value, uint32_t depth,
+					const APISourceInfo& sourceInfo)> RdWebAPIFnJsonSAX;
 
 // REST API support
 class RdWebServerRestEndpoint
@@ -154,16 +157,30 @@ public:
         restApiFnBody = nullptr;
         restApiFnChunk = nullptr;
 		restApiFnIsReady = nullptr;
+		restApiFnJsonSAX = nullptr;
+		cacheTTLMs = 0;
     }
     RdWebAPIFunction restApiFn;
     RdWebAPIFnBody restApiFnBody;
     RdWebAPIFnChunk restApiFnChunk;
 	RdWebAPIFnIsReady restApiFnIsReady;
+
+	// Receives events from incremental parsing of a JSON body (so the body need not be accumulated)
+	RdWebAPIFnJsonSAX restApiFnJsonSAX;
+
+	// Time a GET response may be served from the handler's response cache (0 = not cached)
+	uint32_t cacheTTLMs;
 };
 
 typedef std::function<bool(const char* url, RdWebServerMethod method, RdWebServerRestEndpoint& endpoint)> RdWebAPIMatchEndpointCB;
 
+// Version of the application's endpoints - must change whenever an endpoint is added or removed
+typedef std::function<uint32_t()> RdWebAPIEndpointsVersionCB;
+
 // Websocket support
 typedef std::function<bool(uint32_t channelID)> RdWebSocketCanAcceptCB;
 typedef std::function<void(uint32_t channelID, const uint8_t* pBuf, uint32_t bufLen)> RdWebSocketMsgCB;
+typedef std::function<uint32_t(uint32_t channelID, const uint8_t* pBuf, uint32_t bufLen)> RdWebSocketMsgKeyCB;
+typedef std::function<void(uint32_t channelID, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t msgOffset, bool frameFinal, bool msgFinal)> RdWebSocketStreamMsgCB;
 
@@ -0,0 +1,340 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RdWebJsonSAX.h"
+#include <Logger.h>
+
+// #define DEBUG_JSON_SAX_ERROR
+
+#ifdef DEBUG_JSON_SAX_ERROR
+static const char *MODULE_PREFIX = "RdWebJsonSAX";
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor / Destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebJsonSAX::RdWebJsonSAX(uint32_t maxTokenLen)
+{
+    _maxTokenLen = maxTokenLen;
+    clear();
+}
+
+RdWebJsonSAX::~RdWebJsonSAX()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Clear
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebJsonSAX::clear()
+{
+    _parseState = RDJSONSAX_VALUE;
+    _token = "";
+    _stringIsKey = false;
+    _unicodeVal = 0;
+    _unicodeDigits = 0;
+    _depth = 0;
+    for (uint32_t i = 0; i < MAX_DEPTH / 32; i++)
+        _isArrayBits[i] = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle data - returns false on error
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebJsonSAX::handleData(const uint8_t *pBuf, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if (_parseState == RDJSONSAX_ERROR)
+            return false;
+        if (!handleChar(pBuf[i]))
+        {
+#ifdef DEBUG_JSON_SAX_ERROR
+            LOG_W(MODULE_PREFIX, "handleData error at pos %d char %c depth %d", i, pBuf[i], _depth);
+#endif
+            setError();
+            return false;
+        }
+    }
+    return _parseState != RDJSONSAX_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Finish - called at the end of the input to send a number or literal which ends the input (as these
+// are only ended by the next character) - returns false (and sends an error event) if the input
+// doesn't end with a complete value
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebJsonSAX::finish()
+{
+    if (_parseState == RDJSONSAX_ERROR)
+        return false;
+
+    // Whitespace ends a number or literal as any following character would
+    if ((_parseState == RDJSONSAX_NUMBER) || (_parseState == RDJSONSAX_LITERAL))
+    {
+        if (!handleChar(' '))
+        {
+            setError();
+            return false;
+        }
+    }
+
+    // Check the outermost value is complete
+    if (_parseState != RDJSONSAX_DONE)
+    {
+#ifdef DEBUG_JSON_SAX_ERROR
+        LOG_W(MODULE_PREFIX, "finish input ended before value complete depth %d", _depth);
+#endif
+        setError();
+        return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle a single character - returns false on error
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebJsonSAX::handleChar(uint8_t ch)
+{
+    switch(_parseState)
+    {
+        case RDJSONSAX_ERROR:
+            return false;
+        case RDJSONSAX_DONE:
+            return isspace(ch);
+        case RDJSONSAX_VALUE:
+            if (isspace(ch))
+                return true;
+            return handleValueStart(ch);
+        case RDJSONSAX_VALUE_OR_ARRAY_END:
+            if (isspace(ch))
+                return true;
+            if (ch == ']')
+                return handleContainerEnd(ch);
+            return handleValueStart(ch);
+        case RDJSONSAX_KEY_OR_OBJECT_END:
+        case RDJSONSAX_KEY:
+            if (isspace(ch))
+                return true;
+            if ((ch == '}') && (_parseState == RDJSONSAX_KEY_OR_OBJECT_END))
+                return handleContainerEnd(ch);
+            if (ch != '"')
+                return false;
+            _token = "";
+            _stringIsKey = true;
+            _parseState = RDJSONSAX_STRING;
+            return true;
+        case RDJSONSAX_COLON:
+            if (isspace(ch))
+                return true;
+            if (ch != ':')
+                return false;
+            _parseState = RDJSONSAX_VALUE;
+            return true;
+        case RDJSONSAX_AFTER_VALUE:
+        {
+            if (isspace(ch))
+                return true;
+            if ((ch == '}') || (ch == ']'))
+                return handleContainerEnd(ch);
+            if (ch != ',')
+                return false;
+            bool isArray = _isArrayBits[(_depth-1) / 32] & (1UL << ((_depth-1) % 32));
+            _parseState = isArray ? RDJSONSAX_VALUE : RDJSONSAX_KEY;
+            return true;
+        }
+        case RDJSONSAX_STRING:
+            if (ch == '"')
+            {
+                if (_stringIsKey)
+                {
+                    sendEvent(RDJSONSAX_EVENT_KEY, _token);
+                    _token = "";
+                    _parseState = RDJSONSAX_COLON;
+                    return true;
+                }
+                sendEvent(RDJSONSAX_EVENT_STRING, _token);
+                return handleValueEnd();
+            }
+            if (ch == '\\')
+            {
+                _parseState = RDJSONSAX_STRING_ESCAPE;
+                return true;
+            }
+            if ((uint8_t)ch < 0x20)
+                return false;
+            return addTokenChar(ch);
+        case RDJSONSAX_STRING_ESCAPE:
+            _parseState = RDJSONSAX_STRING;
+            switch(ch)
+            {
+                case '"': case '\\': case '/': return addTokenChar(ch);
+                case 'b': return addTokenChar('\b');
+                case 'f': return addTokenChar('\f');
+                case 'n': return addTokenChar('\n');
+                case 'r': return addTokenChar('\r');
+                case 't': return addTokenChar('\t');
+                case 'u':
+                    _unicodeVal = 0;
+                    _unicodeDigits = 0;
+                    _parseState = RDJSONSAX_STRING_UNICODE;
+                    return true;
+            }
+            return false;
+        case RDJSONSAX_STRING_UNICODE:
+            if (!isxdigit(ch))
+                return false;
+            _unicodeVal = (_unicodeVal << 4) | (isdigit(ch) ? ch - '0' : (tolower(ch) - 'a' + 10));
+            if (++_unicodeDigits == 4)
+            {
+                addUnicodeChar(_unicodeVal);
+                _parseState = RDJSONSAX_STRING;
+                return _token.length() <= _maxTokenLen;
+            }
+            return true;
+        case RDJSONSAX_NUMBER:
+            if (isdigit(ch) || (ch == '-') || (ch == '+') || (ch == '.') || (ch == 'e') || (ch == 'E'))
+                return addTokenChar(ch);
+            sendEvent(RDJSONSAX_EVENT_NUMBER, _token);
+            if (!handleValueEnd())
+                return false;
+            return handleChar(ch);
+        case RDJSONSAX_LITERAL:
+            if (isalpha(ch))
+                return addTokenChar(ch);
+            if ((_token == "true") || (_token == "false"))
+                sendEvent(RDJSONSAX_EVENT_BOOL, _token);
+            else if (_token == "null")
+                sendEvent(RDJSONSAX_EVENT_NULL, _token);
+            else
+                return false;
+            if (!handleValueEnd())
+                return false;
+            return handleChar(ch);
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle first character of a value
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebJsonSAX::handleValueStart(uint8_t ch)
+{
+    _token = "";
+    if ((ch == '{') || (ch == '['))
+    {
+        if (_depth >= MAX_DEPTH)
+            return false;
+        bool isArray = ch == '[';
+        sendEvent(isArray ? RDJSONSAX_EVENT_ARRAY_START : RDJSONSAX_EVENT_OBJECT_START, _token);
+        if (isArray)
+            _isArrayBits[_depth / 32] |= (1UL << (_depth % 32));
+        else
+            _isArrayBits[_depth / 32] &= ~(1UL << (_depth % 32));
+        _depth++;
+        _parseState = isArray ? RDJSONSAX_VALUE_OR_ARRAY_END : RDJSONSAX_KEY_OR_OBJECT_END;
+        return true;
+    }
+    if (ch == '"')
+    {
+        _stringIsKey = false;
+        _parseState = RDJSONSAX_STRING;
+        return true;
+    }
+    if (isdigit(ch) || (ch == '-'))
+    {
+        _parseState = RDJSONSAX_NUMBER;
+        return addTokenChar(ch);
+    }
+    if (isalpha(ch))
+    {
+        _parseState = RDJSONSAX_LITERAL;
+        return addTokenChar(ch);
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle end of object or array
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebJsonSAX::handleContainerEnd(char ch)
+{
+    if (_depth == 0)
+        return false;
+    bool isArray = _isArrayBits[(_depth-1) / 32] & (1UL << ((_depth-1) % 32));
+    if (isArray != (ch == ']'))
+        return false;
+    _depth--;
+    _token = "";
+    sendEvent(isArray ? RDJSONSAX_EVENT_ARRAY_END : RDJSONSAX_EVENT_OBJECT_END, _token);
+    return handleValueEnd();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle end of a value
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebJsonSAX::handleValueEnd()
+{
+    _token = "";
+    _parseState = _depth == 0 ? RDJSONSAX_DONE : RDJSONSAX_AFTER_VALUE;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add to token checking length
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebJsonSAX::addTokenChar(char ch)
+{
+    if (_token.length() >= _maxTokenLen)
+        return false;
+    _token += ch;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add unicode escape as UTF-8 (surrogate pairs are encoded individually)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebJsonSAX::addUnicodeChar(uint32_t codePoint)
+{
+    if (codePoint < 0x80)
+    {
+        _token += (char)codePoint;
+    }
+    else if (codePoint < 0x800)
+    {
+        _token += (char)(0xc0 | (codePoint >> 6));
+        _token += (char)(0x80 | (codePoint & 0x3f));
+    }
+    else
+    {
+        _token += (char)(0xe0 | (codePoint >> 12));
+        _token += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        _token += (char)(0x80 | (codePoint & 0x3f));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set error
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebJsonSAX::setError()
+{
+    _parseState = RDJSONSAX_ERROR;
+    _token = "";
+    sendEvent(RDJSONSAX_EVENT_ERROR, _token);
+}
@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <WString.h>
+#include <functional>
+
+enum RdJsonSAXEvent
+{
+    RDJSONSAX_EVENT_OBJECT_START,
+    RDJSONSAX_EVENT_OBJECT_END,
+    RDJSONSAX_EVENT_ARRAY_START,
+    RDJSONSAX_EVENT_ARRAY_END,
+    RDJSONSAX_EVENT_KEY,
+    RDJSONSAX_EVENT_STRING,
+    RDJSONSAX_EVENT_NUMBER,
+    RDJSONSAX_EVENT_BOOL,
+    RDJSONSAX_EVENT_NULL,
+    RDJSONSAX_EVENT_ERROR,
+};
+
+// Event callback - value is the key, string (unescaped), number text or "true"/"false"/"null"
+// depth is the nesting level of the token (0 for the outermost value)
+typedef std::function<void(RdJsonSAXEvent event, const String& value, uint32_t depth)> RdJsonSAXEventCB;
+
+// Incremental (SAX style) JSON tokenizer - data can be split at any point across calls to handleData
+// and memory used is bounded by the longest single token (key, string or number)
+class RdWebJsonSAX
+{
+public:
+    RdJsonSAXEventCB onEvent;
+
+    RdWebJsonSAX(uint32_t maxTokenLen = DEFAULT_MAX_TOKEN_LEN);
+    ~RdWebJsonSAX();
+    void clear();
+    bool handleData(const uint8_t *pBuf, uint32_t len);
+
+    // Must be called at the end of the input (a number or literal at the end is only sent by finish)
+    // Returns false if the input doesn't end with a complete value
+    bool finish();
+    bool isComplete() const
+    {
+        return _parseState == RDJSONSAX_DONE;
+    }
+    bool hasError() const
+    {
+        return _parseState == RDJSONSAX_ERROR;
+    }
+
+    static const char* getEventText(RdJsonSAXEvent event)
+    {
+        switch(event)
+        {
+            case RDJSONSAX_EVENT_OBJECT_START: return("JsonSAXObjectStart");
+            case RDJSONSAX_EVENT_OBJECT_END: return("JsonSAXObjectEnd");
+            case RDJSONSAX_EVENT_ARRAY_START: return("JsonSAXArrayStart");
+            case RDJSONSAX_EVENT_ARRAY_END: return("JsonSAXArrayEnd");
+            case RDJSONSAX_EVENT_KEY: return("JsonSAXKey");
+            case RDJSONSAX_EVENT_STRING: return("JsonSAXString");
+            case RDJSONSAX_EVENT_NUMBER: return("JsonSAXNumber");
+            case RDJSONSAX_EVENT_BOOL: return("JsonSAXBool");
+            case RDJSONSAX_EVENT_NULL: return("JsonSAXNull");
+            case RDJSONSAX_EVENT_ERROR: return("JsonSAXError");
+        }
+        return "UNKNOWN";
+    }
+
+    // Limits
+    static const uint32_t DEFAULT_MAX_TOKEN_LEN = 256;
+    static const uint32_t MAX_DEPTH = 64;
+
+private:
+    enum State
+    {
+        RDJSONSAX_ERROR,
+        RDJSONSAX_VALUE,
+        RDJSONSAX_VALUE_OR_ARRAY_END,
+        RDJSONSAX_KEY_OR_OBJECT_END,
+        RDJSONSAX_KEY,
+        RDJSONSAX_COLON,
+        RDJSONSAX_AFTER_VALUE,
+        RDJSONSAX_STRING,
+        RDJSONSAX_STRING_ESCAPE,
+        RDJSONSAX_STRING_UNICODE,
+        RDJSONSAX_NUMBER,
+        RDJSONSAX_LITERAL,
+        RDJSONSAX_DONE
+    };
+
+    // Parser state
+    State _parseState;
+
+    // Current token
+    String _token;
+    uint32_t _maxTokenLen;
+    bool _stringIsKey;
+
+    // Unicode escape
+    uint32_t _unicodeVal;
+    uint32_t _unicodeDigits;
+
+    // Nesting depth and a bit per level which is set for arrays and clear for objects
+    uint32_t _depth;
+    uint32_t _isArrayBits[MAX_DEPTH / 32];
+
+    // Helpers
+    bool handleChar(uint8_t ch);
+    bool handleValueStart(uint8_t ch);
+    bool handleContainerEnd(char ch);
+    bool handleValueEnd();
+    bool addTokenChar(char ch);
+    void addUnicodeChar(uint32_t codePoint);
+    void setError();
+    void sendEvent(RdJsonSAXEvent event, const String& value)
+    {
+        if (onEvent)
+            onEvent(event, value, _depth);
+    }
+};
@@ -0,0 +1,249 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RdWebRateLimiter.h"
+#include <inttypes.h>
+#include <Logger.h>
+#include <Utils.h>
+#include <ArduinoTime.h>
+
+#define WARN_RATE_LIMITER_SHED_REQUEST
+
+#ifdef WARN_RATE_LIMITER_SHED_REQUEST
+static const char *MODULE_PREFIX = "RdWebRateLimit";
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor / Destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebRateLimiter::RdWebRateLimiter()
+{
+    _clientRatePerSec = 0;
+    _clientBurst = 0;
+    _maxClients = 0;
+    _shedByClientCount = 0;
+    _shedByPrefixCount = 0;
+    _shedWarnLastMs = 0;
+    _shedWarnCount = 0;
+    _isEnabled = false;
+    _limiterMutex = xSemaphoreCreateMutex();
+    formTooManyRequestsResponse();
+}
+
+RdWebRateLimiter::~RdWebRateLimiter()
+{
+    if (_limiterMutex)
+        vSemaphoreDelete(_limiterMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set per-client limit
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRateLimiter::setClientLimit(uint32_t ratePerSec, uint32_t burst, uint32_t maxClients)
+{
+    if (xSemaphoreTake(_limiterMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    _clientRatePerSec = ratePerSec;
+    _clientBurst = burst == 0 ? 1 : burst;
+    _maxClients = maxClients;
+    _clients.clear();
+    _clients.reserve(_maxClients);
+    updateEnabled();
+    xSemaphoreGive(_limiterMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add prefix limit
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRateLimiter::addPrefixLimit(const String& reqPrefix, uint32_t ratePerSec, uint32_t burst)
+{
+    if (ratePerSec == 0)
+        return;
+    if (xSemaphoreTake(_limiterMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    PrefixBucket prefixBucket;
+    prefixBucket.reqPrefix = reqPrefix;
+    prefixBucket.ratePerSec = ratePerSec;
+    prefixBucket.burst = burst == 0 ? 1 : burst;
+    prefixBucket.bucket.init(prefixBucket.burst, millis());
+    _prefixLimits.push_back(prefixBucket);
+    updateEnabled();
+    xSemaphoreGive(_limiterMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Clear prefix limits
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRateLimiter::clearPrefixLimits()
+{
+    if (xSemaphoreTake(_limiterMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    _prefixLimits.clear();
+    updateEnabled();
+    xSemaphoreGive(_limiterMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Update enabled flag - must be called with the mutex held
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRateLimiter::updateEnabled()
+{
+    _isEnabled.store((_clientRatePerSec != 0) || !_prefixLimits.empty(), std::memory_order_release);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check if a request is allowed
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebRateLimiter::isRequestAllowed(uint32_t clientIPAddr, const String& reqStr)
+{
+    // Check enabled
+    if (!isEnabled())
+        return true;
+
+    if (xSemaphoreTake(_limiterMutex, portMAX_DELAY) != pdTRUE)
+        return true;
+    uint32_t nowMs = millis();
+
+    // Check client bucket
+    ClientBucket* pClient = nullptr;
+    if ((_clientRatePerSec != 0) && (_maxClients != 0))
+    {
+        pClient = &getClientBucket(clientIPAddr, nowMs);
+        if (!pClient->bucket.hasToken(_clientRatePerSec, _clientBurst, nowMs))
+        {
+            _shedByClientCount++;
+#ifdef WARN_RATE_LIMITER_SHED_REQUEST
+            uint32_t shedWarnCount = isShedWarnDue(nowMs);
+#endif
+            xSemaphoreGive(_limiterMutex);
+#ifdef WARN_RATE_LIMITER_SHED_REQUEST
+            if (shedWarnCount != 0)
+                LOG_W(MODULE_PREFIX, "isRequestAllowed shed client %08" PRIx32 " req %s (shed %" PRIu32 " since last warning)",
+                            clientIPAddr, reqStr.c_str(), shedWarnCount);
+#endif
+            return false;
+        }
+    }
+
+    // Check first matching prefix bucket
+    PrefixBucket* pPrefix = nullptr;
+    for (PrefixBucket& prefixBucket : _prefixLimits)
+    {
+        if (reqStr.startsWith(prefixBucket.reqPrefix))
+        {
+            pPrefix = &prefixBucket;
+            break;
+        }
+    }
+    if (pPrefix && !pPrefix->bucket.hasToken(pPrefix->ratePerSec, pPrefix->burst, nowMs))
+    {
+        pPrefix->shedCount++;
+        _shedByPrefixCount++;
+#ifdef WARN_RATE_LIMITER_SHED_REQUEST
+        uint32_t shedWarnCount = isShedWarnDue(nowMs);
+        String reqPrefix = shedWarnCount != 0 ? pPrefix->reqPrefix : "";
+#endif
+        xSemaphoreGive(_limiterMutex);
+#ifdef WARN_RATE_LIMITER_SHED_REQUEST
+        if (shedWarnCount != 0)
+            LOG_W(MODULE_PREFIX, "isRequestAllowed shed prefix %s req %s (shed %" PRIu32 " since last warning)",
+                        reqPrefix.c_str(), reqStr.c_str(), shedWarnCount);
+#endif
+        return false;
+    }
+
+    // Allowed so consume tokens
+    if (pClient)
+        pClient->bucket.takeToken();
+    if (pPrefix)
+        pPrefix->bucket.takeToken();
+    xSemaphoreGive(_limiterMutex);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String RdWebRateLimiter::getDebugJSON()
+{
+    char jsonStr[100];
+    snprintf(jsonStr, sizeof(jsonStr), R"({"shedClient":%)" PRIu32 R"(,"shedPrefix":%)" PRIu32 R"(,"clients":%)" PRIu32 "}",
+                _shedByClientCount, _shedByPrefixCount, (uint32_t)_clients.size());
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Count a shed request and check if a warning is due - warnings are limited to one per interval as
+// requests are shed when the server is overloaded and logging each would add to the load
+// Returns the number of requests shed since the last warning (0 if no warning is due)
+// Must be called with the mutex held
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RdWebRateLimiter::isShedWarnDue(uint32_t nowMs)
+{
+    _shedWarnCount++;
+    if ((_shedWarnLastMs != 0) && !Utils::isTimeout(nowMs, _shedWarnLastMs, SHED_WARN_INTERVAL_MS))
+        return 0;
+    _shedWarnLastMs = nowMs == 0 ? 1 : nowMs;
+    uint32_t shedWarnCount = _shedWarnCount;
+    _shedWarnCount = 0;
+    return shedWarnCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get bucket for a client - the least recently used client is replaced if the table is full
+// Must be called with the mutex held
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebRateLimiter::ClientBucket& RdWebRateLimiter::getClientBucket(uint32_t clientIPAddr, uint32_t nowMs)
+{
+    // Find existing or least recently used
+    uint32_t lruIdx = 0;
+    for (uint32_t i = 0; i < _clients.size(); i++)
+    {
+        if (_clients[i].ipAddr == clientIPAddr)
+        {
+            _clients[i].lastUsedMs = nowMs;
+            return _clients[i];
+        }
+        if (nowMs - _clients[i].lastUsedMs > nowMs - _clients[lruIdx].lastUsedMs)
+            lruIdx = i;
+    }
+
+    // Add or replace
+    if (_clients.size() < _maxClients)
+    {
+        _clients.resize(_clients.size() + 1);
+        lruIdx = _clients.size() - 1;
+    }
+    ClientBucket& client = _clients[lruIdx];
+    client.ipAddr = clientIPAddr;
+    client.lastUsedMs = nowMs;
+    client.bucket.init(_clientBurst, nowMs);
+    return client;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Form the 429 response - rates are whole tokens per second so a token is always available within 1s
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRateLimiter::formTooManyRequestsResponse()
+{
+    _tooManyRequestsResp =
+            "HTTP/1.1 429 Too Many Requests\r\n"
+            "Retry-After: 1\r\n"
+            "Content-Length: 0\r\n"
+            "Connection: close\r\n\r\n";
+}
@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <vector>
+#include <WString.h>
+#ifndef ESP8266
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include "ESP8266Utils.h"
+#endif
+
+// Token-bucket rate limiting of requests per client IP address and per request prefix
+class RdWebRateLimiter
+{
+public:
+    RdWebRateLimiter();
+    virtual ~RdWebRateLimiter();
+
+    // Set per-client limit - ratePerSec == 0 disables per-client limiting
+    // maxClients is the size of the LRU table of tracked clients
+    void setClientLimit(uint32_t ratePerSec, uint32_t burst, uint32_t maxClients);
+
+    // Add a limit for requests starting with reqPrefix (shared by all clients)
+    void addPrefixLimit(const String& reqPrefix, uint32_t ratePerSec, uint32_t burst);
+
+    // Remove all prefix limits
+    void clearPrefixLimits();
+
+    // Check if enabled (the flag is updated under the mutex whenever the limits change)
+    bool isEnabled()
+    {
+        return _isEnabled.load(std::memory_order_acquire);
+    }
+
+    // Check if a request is allowed - consumes a token if so
+    bool isRequestAllowed(uint32_t clientIPAddr, const String& reqStr);
+
+    // Precomputed 429 response (status line, headers and empty body)
+    const String& getTooManyRequestsResponse()
+    {
+        return _tooManyRequestsResp;
+    }
+
+    // Stats
+    uint32_t getShedCount()
+    {
+        return _shedByClientCount + _shedByPrefixCount;
+    }
+    String getDebugJSON();
+
+private:
+    // Token bucket - tokens are held in thousandths so refill is exact in ms
+    class TokenBucket
+    {
+    public:
+        void init(uint32_t burst, uint32_t nowMs)
+        {
+            milliTokens = burst * 1000;
+            lastRefillMs = nowMs;
+        }
+        bool hasToken(uint32_t ratePerSec, uint32_t burst, uint32_t nowMs)
+        {
+            uint64_t refilled = milliTokens + (uint64_t)(nowMs - lastRefillMs) * ratePerSec;
+            milliTokens = refilled > burst * 1000 ? burst * 1000 : (uint32_t)refilled;
+            lastRefillMs = nowMs;
+            return milliTokens >= 1000;
+        }
+        void takeToken()
+        {
+            milliTokens -= 1000;
+        }
+        uint32_t milliTokens = 0;
+        uint32_t lastRefillMs = 0;
+    };
+
+    // Per-client bucket
+    class ClientBucket
+    {
+    public:
+        uint32_t ipAddr = 0;
+        uint32_t lastUsedMs = 0;
+        TokenBucket bucket;
+    };
+
+    // Per-prefix bucket
+    class PrefixBucket
+    {
+    public:
+        String reqPrefix;
+        uint32_t ratePerSec = 0;
+        uint32_t burst = 0;
+        uint32_t shedCount = 0;
+        TokenBucket bucket;
+    };
+
+    // Client limits
+    uint32_t _clientRatePerSec;
+    uint32_t _clientBurst;
+    uint32_t _maxClients;
+    std::vector<ClientBucket> _clients;
+
+    // Prefix limits
+    std::list<PrefixBucket> _prefixLimits;
+
+    // Precomputed response
+    String _tooManyRequestsResp;
+
+    // Stats
+    uint32_t _shedByClientCount;
+    uint32_t _shedByPrefixCount;
+
+    // Shed warnings (rate limited)
+    uint32_t _shedWarnLastMs;
+    uint32_t _shedWarnCount;
+    static const uint32_t SHED_WARN_INTERVAL_MS = 5000;
+
+    // Mutex as limits may be changed from another task
+    SemaphoreHandle_t _limiterMutex;
+
+    // Enabled flag so requests can be checked without taking the mutex when there are no limits
+    std::atomic<bool> _isEnabled;
+
+    // Helpers
+    ClientBucket& getClientBucket(uint32_t clientIPAddr, uint32_t nowMs);
+    void formTooManyRequestsResponse();
+    void updateEnabled();
+    uint32_t isShedWarnDue(uint32_t nowMs);
+};
@@ -78,6 +78,9 @@ public:
         isContinue = false;
         reqConnType = REQ_CONN_TYPE_HTTP;
         extract.clear();
+        clientIPAddr = 0;
+        webSocketExtensions.clear();
+        sseLastEventID = 0;
     }
 
     // Got first line (which contains request)
@@ -111,8 +114,15 @@ public:
     // Requested connection type
     RdWebReqConnectionType reqConnType;
 
+    // Client IPv4 address (0 if unknown)
+    uint32_t clientIPAddr;
+
     // WebSocket info
     String webSocketKey;
     String webSocketVersion;
+    String webSocketExtensions;
+
+    // Server-side events Last-Event-ID (0 if none)
+    uint32_t sseLastEventID;
 
 };
@@ -18,11 +18,19 @@ class RdWebRequestParams
 public:
     RdWebRequestParams(uint32_t maxSendSize, 
             std::list<RdJson::NameValuePair>* pResponseHeaders,
-            RdWebConnSendFn webConnRawSend)
+            RdWebConnSendFn webConnRawSend,
+            RdWebConnSendVecFn webConnRawSendVec = nullptr,
+            RdWebConnReadyToSendFn webConnReadyToSend = nullptr,
+            RdWebConnTopicSubscribeFn webConnTopicSubscribe = nullptr,
+            RdWebConnSSEventsReplayFn webConnSSEventsReplay = nullptr)
     {
         _maxSendSize = maxSendSize;
         _pResponseHeaders = pResponseHeaders;
         _webConnRawSend = webConnRawSend;
+        _webConnRawSendVec = webConnRawSendVec;
+        _webConnReadyToSend = webConnReadyToSend;
+        _webConnTopicSubscribe = webConnTopicSubscribe;
+        _webConnSSEventsReplay = webConnSSEventsReplay;
     }
     uint32_t getMaxSendSize()
     {
@@ -32,6 +40,22 @@ public:
     {
         return _webConnRawSend;
     }
+    RdWebConnSendVecFn getWebConnRawSendVec() const
+    {
+        return _webConnRawSendVec;
+    }
+    RdWebConnReadyToSendFn getWebConnReadyToSend() const
+    {
+        return _webConnReadyToSend;
+    }
+    RdWebConnTopicSubscribeFn getWebConnTopicSubscribe() const
+    {
+        return _webConnTopicSubscribe;
+    }
+    RdWebConnSSEventsReplayFn getWebConnSSEventsReplay() const
+    {
+        return _webConnSSEventsReplay;
+    }
     std::list<RdJson::NameValuePair>* getHeaders() const
     {
         return _pResponseHeaders;
@@ -41,4 +65,8 @@ private:
     uint32_t _maxSendSize;
     std::list<RdJson::NameValuePair>* _pResponseHeaders;
     RdWebConnSendFn _webConnRawSend;
+    RdWebConnSendVecFn _webConnRawSendVec;
+    RdWebConnReadyToSendFn _webConnReadyToSend;
+    RdWebConnTopicSubscribeFn _webConnTopicSubscribe;
+    RdWebConnSSEventsReplayFn _webConnSSEventsReplay;
 };
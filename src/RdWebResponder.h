@@ -9,9 +9,12 @@
 #pragma once
 
 #include <list>
+#include <vector>
 #include <WString.h>
 #include <RdJson.h>
 #include <RdWebConnDefs.h>
+#include "RdWebSocketDefs.h"
+#include "RdWebDataFrame.h"
 
 class RdWebConnection;
 
@@ -40,6 +43,12 @@ public:
         return false;
     }
 
+    // Handle inbound data in a receive buffer which the responder may modify (only valid during the call)
+    virtual bool handleDataInPlace(uint8_t* pBuf, uint32_t dataLen)
+    {
+        return handleData(pBuf, dataLen);
+    }
+
     // Start responding
     virtual bool startResponding(RdWebConnection& request)
     {
@@ -88,14 +97,29 @@ public:
         return true;
     }
 
-    // Send a frame of data
-    virtual bool sendFrame(const uint8_t* pBuf, uint32_t bufLen)
+    // Send a frame of data on a channel of the responder
+    virtual bool sendFrame(const uint8_t* pBuf, uint32_t bufLen, uint32_t channelID)
     {
         return false;
     }
 
-    // Send event content and group
-    virtual void sendEvent(const char* eventContent, const char* eventGroup)
+    // Send a frame of data that has also been encoded (once for all connections) - responders which
+    // can't use the encoded frame send the data
+    virtual bool sendFrameEncoded(RdWebDataFrame& encodedFrame, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t channelID)
+    {
+        return sendFrame(pBuf, bufLen, channelID);
+    }
+
+    // Send a message generated in pieces by a producer
+    virtual bool sendFrameProducer(RdWebSocketTxProducerCB txProducerCB, uint32_t channelID)
+    {
+        return false;
+    }
+
+    // Send event message (formatted by RdWebSSEvent) - replayed events are sent before any others
+    // groupKey identifies the event group (for coalescing queued events)
+    virtual void sendEvent(RdWebDataFrame& eventMsg, uint32_t eventID, uint32_t groupKey, bool isReplay)
     {
     }
 
@@ -111,12 +135,44 @@ public:
         return false;
     }
 
+    // Get all channelIDs for responder (a responder can carry several channels)
+    virtual void getChannelIDs(std::vector<uint32_t>& channelIDs)
+    {
+        uint32_t channelID = 0;
+        if (getChannelID(channelID))
+            channelIDs.push_back(channelID);
+    }
+
     // Ready for data
     virtual bool readyForData()
     {
         return true;
     }
 
+    // Ready for data to be sent on a channel
+    virtual bool readyForChannelData(uint32_t channelID)
+    {
+        return readyForData();
+    }
+
+    // Get stats for a channel as JSON
+    virtual String getChannelStatsJSON(uint32_t channelID)
+    {
+        return "{}";
+    }
+
+    // Get stats (JSON) for responders without a channel
+    virtual String getStatsJSON()
+    {
+        return "{}";
+    }
+
+    // Get latency (e.g. ping round-trip time) - last and smoothed average
+    virtual bool getLatencyMs(uint32_t& lastMs, uint32_t& avgMs)
+    {
+        return false;
+    }
+
 protected:
     // Is Active
     bool _isActive;
@@ -0,0 +1,77 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <WString.h>
+#include "RdWebResponder.h"
+
+// Responder which sends a complete precomputed HTTP response (status line, headers and body)
+// Any request body is discarded
+class RdWebResponderPrecomputed : public RdWebResponder
+{
+public:
+    RdWebResponderPrecomputed(const String& response)
+    {
+        _response = response;
+        _curDataPos = 0;
+    }
+
+    virtual ~RdWebResponderPrecomputed()
+    {
+    }
+
+    // Handle inbound data
+    virtual bool handleData(const uint8_t* pBuf, uint32_t dataLen) override final
+    {
+        return true;
+    }
+
+    // Start responding
+    virtual bool startResponding(RdWebConnection& request) override final
+    {
+        _isActive = true;
+        _curDataPos = 0;
+        return _isActive;
+    }
+
+    // Get response next
+    virtual uint32_t getResponseNext(uint8_t*& pBuf, uint32_t bufMaxLen) override final
+    {
+        uint32_t lenToSend = _response.length() - _curDataPos;
+        if (lenToSend > bufMaxLen)
+            lenToSend = bufMaxLen;
+        pBuf = (uint8_t*) (_response.c_str() + _curDataPos);
+        _curDataPos += lenToSend;
+        if (_curDataPos >= _response.length())
+            _isActive = false;
+        return lenToSend;
+    }
+
+    // Leave connection open
+    virtual bool leaveConnOpen() override final
+    {
+        return false;
+    }
+
+    // Send standard headers
+    virtual bool isStdHeaderRequired() override final
+    {
+        return false;
+    }
+
+    // Get responder type
+    virtual const char* getResponderType() override final
+    {
+        return "PRECOMP";
+    }
+
+private:
+    String _response;
+    uint32_t _curDataPos;
+};
@@ -7,6 +7,7 @@
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "RdWebResponderRestAPI.h"
+#include "RdWebRestAPICache.h"
 #include <Logger.h>
 #include <FileStreamBlock.h>
 #include <APISourceInfo.h>
@@ -18,8 +19,9 @@
 // #define DEBUG_MULTIPART_HEADERS
 // #define DEBUG_MULTIPART_DATA
 // #define DEBUG_RESPONDER_API_START_END
+// #define DEBUG_JSON_SAX_EVENTS
 
-#if defined(DEBUG_RESPONDER_REST_API) || defined(DEBUG_RESPONDER_REST_API_NON_MULTIPART_DATA) || defined(DEBUG_RESPONDER_REST_API_MULTIPART_DATA) || defined(DEBUG_MULTIPART_EVENTS) || defined(DEBUG_RESPONDER_REST_API) || defined(DEBUG_MULTIPART_DATA) || defined(DEBUG_RESPONDER_API_START_END)
+#if defined(DEBUG_RESPONDER_REST_API) || defined(DEBUG_RESPONDER_REST_API_NON_MULTIPART_DATA) || defined(DEBUG_RESPONDER_REST_API_MULTIPART_DATA) || defined(DEBUG_MULTIPART_EVENTS) || defined(DEBUG_RESPONDER_REST_API) || defined(DEBUG_MULTIPART_DATA) || defined(DEBUG_RESPONDER_API_START_END) || defined(DEBUG_JSON_SAX_EVENTS)
 static const char *MODULE_PREFIX = "RdWebRespREST";
 #endif
 
@@ -30,19 +32,18 @@ static const char *MODULE_PREFIX = "RdWebRespREST";
 RdWebResponderRestAPI::RdWebResponderRestAPI(const RdWebServerRestEndpoint& endpoint, RdWebHandler* pWebHandler, 
                     const RdWebRequestParams& params, String& reqStr, 
                     const RdWebRequestHeaderExtract& headerExtract,
-                    uint32_t channelID)
+                    uint32_t channelID, RdWebRestAPICache* pResponseCache)
     : _reqParams(params), _apiSourceInfo(channelID)
 {
     _endpoint = endpoint;
     _pWebHandler = pWebHandler;
+    _pResponseCache = pResponseCache;
+    _respFromCache = false;
     _endpointCalled = false;
     _requestStr = reqStr;
     _headerExtract = headerExtract;
     _respStrPos = 0;
     _sendStartMs = millis();
-#ifdef APPLY_MIN_GAP_BETWEEN_API_CALLS_MS    
-    _lastFileReqMs = 0;
-#endif
 
     // Hook up callbacks
     _multipartParser.onEvent = std::bind(&RdWebResponderRestAPI::multipartOnEvent, this, 
@@ -53,6 +54,10 @@ RdWebResponderRestAPI::RdWebResponderRestAPI(const RdWebServerRestEndpoint& endp
     _multipartParser.onHeaderNameValue = std::bind(&RdWebResponderRestAPI::multipartOnHeaderNameValue, this, 
             std::placeholders::_1, std::placeholders::_2);
 
+    if (_endpoint.restApiFnJsonSAX)
+        _jsonParser.onEvent = std::bind(&RdWebResponderRestAPI::jsonParserOnEvent, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+
     // Check if multipart
     if (_headerExtract.isMultipart)
     {
@@ -99,6 +104,14 @@ bool RdWebResponderRestAPI::handleData(const uint8_t* pBuf, uint32_t dataLen)
         // Send as the body
         if (_endpoint.restApiFnBody)
             _endpoint.restApiFnBody(_requestStr, pBuf, dataLen, curBufPos, _headerExtract.contentLength, _apiSourceInfo);
+
+        // Parse as JSON incrementally (finishing at the end of the body)
+        if (_endpoint.restApiFnJsonSAX)
+        {
+            _jsonParser.handleData(pBuf, dataLen);
+            if (_numBytesReceived >= _headerExtract.contentLength)
+                _jsonParser.finish();
+        }
     }
     return true;
 }
@@ -110,7 +123,7 @@ bool RdWebResponderRestAPI::handleData(const uint8_t* pBuf, uint32_t dataLen)
 bool RdWebResponderRestAPI::startResponding(RdWebConnection& request)
 {
     _isActive = true;
-    _endpointCalled = false;
+    _endpointCalled = _respFromCache;
     _numBytesReceived = 0;
     _respStrPos = 0;
     _sendStartMs = millis();
@@ -145,14 +158,7 @@ uint32_t RdWebResponderRestAPI::getResponseNext(uint8_t*& pBuf, uint32_t bufMaxL
     // Check if we need to call API
     uint32_t respLen = 0;
     if (!_endpointCalled)
-    {
-        // Call endpoint
-        if (_endpoint.restApiFn)
-            _endpoint.restApiFn(_requestStr, _respStr, _apiSourceInfo);
-
-        // Endpoint done
-        _endpointCalled = true;
-    }
+        callEndpoint();
 
     // Check how much of buffer to send
     uint32_t respRemain = _respStr.length() - _respStrPos;
@@ -206,13 +212,6 @@ bool RdWebResponderRestAPI::leaveConnOpen()
 
 bool RdWebResponderRestAPI::readyForData()
 {
-#ifdef APPLY_MIN_GAP_BETWEEN_API_CALLS_MS
-    if (!Utils::isTimeout(millis(), _lastFileReqMs, APPLY_MIN_GAP_BETWEEN_API_CALLS_MS))
-        return false;
-    _lastFileReqMs = millis();
-    LOG_I(MODULE_PREFIX, "readyForData time %d", _lastFileReqMs);
-#endif
-
     // Check if endpoint specifies a ready function
     if (_endpoint.restApiFnIsReady)
         return _endpoint.restApiFnIsReady(_apiSourceInfo);
@@ -254,6 +253,19 @@ void RdWebResponderRestAPI::multipartOnHeaderNameValue(const String& name, const
 #endif
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Callback on JSON body parser
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebResponderRestAPI::jsonParserOnEvent(RdJsonSAXEvent event, const String& value, uint32_t depth)
+{
+#ifdef DEBUG_JSON_SAX_EVENTS
+    LOG_W(MODULE_PREFIX, "jsonParserEvent event %s value %s depth %d", RdWebJsonSAX::getEventText(event), value.c_str(), depth);
+#endif
+    if (_endpoint.restApiFnJsonSAX)
+        _endpoint.restApiFnJsonSAX(_requestStr, event, value, depth, _apiSourceInfo);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Get content length (or -1 if not known)
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -261,13 +273,35 @@ void RdWebResponderRestAPI::multipartOnHeaderNameValue(const String& name, const
 int RdWebResponderRestAPI::getContentLength()
 {
     if (!_endpointCalled)
-    {
-        // Call endpoint
-        if (_endpoint.restApiFn)
-            _endpoint.restApiFn(_requestStr, _respStr, _apiSourceInfo);
-
-        // Endpoint done
-        _endpointCalled = true;
-    }
+        callEndpoint();
     return _respStr.length();
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set response from cache
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebResponderRestAPI::setCachedResponse(const String& respStr)
+{
+    _respStr = respStr;
+    _respFromCache = true;
+    _endpointCalled = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Call endpoint and store response in cache if required
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebResponderRestAPI::callEndpoint()
+{
+    // Call endpoint
+    if (_endpoint.restApiFn)
+        _endpoint.restApiFn(_requestStr, _respStr, _apiSourceInfo);
+
+    // Endpoint done
+    _endpointCalled = true;
+
+    // Cache the response
+    if (_pResponseCache)
+        _pResponseCache->put(_requestStr, _respStr, _endpoint.cacheTTLMs);
+}
@@ -16,11 +16,11 @@
 #include <RdWebRequestParams.h>
 #include <RdWebConnection.h>
 #include "RdWebMultipart.h"
+#include "RdWebJsonSAX.h"
 #include "APISourceInfo.h"
 
-// #define APPLY_MIN_GAP_BETWEEN_API_CALLS_MS 200
-
 class RdWebHandler;
+class RdWebRestAPICache;
 
 class RdWebResponderRestAPI : public RdWebResponder
 {
@@ -28,7 +28,7 @@ public:
     RdWebResponderRestAPI(const RdWebServerRestEndpoint& endpoint, RdWebHandler* pWebHandler, 
                         const RdWebRequestParams& params, String& reqStr, 
                         const RdWebRequestHeaderExtract& headerExtract,
-                        uint32_t channelID);
+                        uint32_t channelID, RdWebRestAPICache* pResponseCache);
     virtual ~RdWebResponderRestAPI();
 
     // Handle inbound data
@@ -58,6 +58,9 @@ public:
     // Ready for data
     virtual bool readyForData() override final;
 
+    // Set response already available from cache (endpoint is not called)
+    void setCachedResponse(const String& respStr);
+
 private:
     // Endpoint
     RdWebServerRestEndpoint _endpoint;
@@ -71,6 +74,10 @@ private:
     // Extract from header
     RdWebRequestHeaderExtract _headerExtract;
 
+    // Response cache (nullptr if response is not to be cached)
+    RdWebRestAPICache* _pResponseCache;
+    bool _respFromCache;
+
     // Vars
     bool _endpointCalled;
     String _requestStr;
@@ -85,17 +92,17 @@ private:
     // Multipart parser
     RdWebMultipart _multipartParser;
 
+    // JSON body parser (used if the endpoint has a restApiFnJsonSAX)
+    RdWebJsonSAX _jsonParser;
+
     // API source
     APISourceInfo _apiSourceInfo;
 
-    // Throttle back API requests
-#ifdef APPLY_MIN_GAP_BETWEEN_API_CALLS_MS    
-    uint32_t _lastFileReqMs;
-#endif
-
     // Helpers
+    void callEndpoint();
     void multipartOnEvent(RdMultipartEvent event, const uint8_t *pBuf, uint32_t pos);
     void multipartOnData(const uint8_t *pBuf, uint32_t len, RdMultipartForm& formInfo, 
                 uint32_t contentPos, bool isFinalPart);
     void multipartOnHeaderNameValue(const String& name, const String& val);
+    void jsonParserOnEvent(RdJsonSAXEvent event, const String& value, uint32_t depth);
 };
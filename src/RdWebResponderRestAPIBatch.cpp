@@ -0,0 +1,313 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RdWebResponderRestAPIBatch.h"
+#include "RdWebHandlerRestAPI.h"
+#include "RdWebJsonSAX.h"
+#include <Logger.h>
+
+// #define DEBUG_RESPONDER_REST_API_BATCH
+#define WARN_RESPONDER_REST_API_BATCH_INVALID
+
+#if defined(DEBUG_RESPONDER_REST_API_BATCH) || defined(WARN_RESPONDER_REST_API_BATCH_INVALID)
+static const char *MODULE_PREFIX = "RdWebRespBatch";
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor / Destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebResponderRestAPIBatch::RdWebResponderRestAPIBatch(RdWebHandlerRestAPI* pWebHandler, const RdWebRequestParams& params,
+                    uint32_t contentLength, uint32_t clientIPAddr,
+                    uint32_t channelID, uint32_t maxBatchSize)
+    : _reqParams(params), _apiSourceInfo(channelID)
+{
+    _pWebHandler = pWebHandler;
+    _contentLength = contentLength;
+    _clientIPAddr = clientIPAddr;
+    _maxBatchSize = maxBatchSize;
+    _numBytesReceived = 0;
+    _batchReqIdx = 0;
+    _batchParsed = false;
+    _batchEndSent = false;
+    _respStrPos = 0;
+    _bodyStr.reserve(_contentLength);
+}
+
+RdWebResponderRestAPIBatch::~RdWebResponderRestAPIBatch()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle inbound data
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderRestAPIBatch::handleData(const uint8_t* pBuf, uint32_t dataLen)
+{
+    // Accumulate body - the handler has already checked the content length is bounded
+    uint32_t lenToAdd = dataLen;
+    if (_numBytesReceived + lenToAdd > _contentLength)
+        lenToAdd = _contentLength - _numBytesReceived;
+    _bodyStr.concat((const char*)pBuf, lenToAdd);
+    _numBytesReceived += lenToAdd;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Start responding
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderRestAPIBatch::startResponding(RdWebConnection& request)
+{
+    _isActive = true;
+    _numBytesReceived = 0;
+    _bodyStr = "";
+    _batchReqs.clear();
+    _batchReqIdx = 0;
+    _batchParsed = false;
+    _batchEndSent = false;
+    _respStr = "";
+    _respStrPos = 0;
+    return _isActive;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get response next
+// Each request in the batch is only executed once the response to the previous one has been sent
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RdWebResponderRestAPIBatch::getResponseNext(uint8_t*& pBuf, uint32_t bufMaxLen)
+{
+    // Wait for all of the body
+    if (_numBytesReceived < _contentLength)
+        return 0;
+
+    // Parse the batch and start the response array
+    if (!_batchParsed)
+    {
+        _batchParsed = true;
+        _respStr = "[";
+        _respStrPos = 0;
+        if (!parseBatch())
+        {
+            _batchReqs.clear();
+            _respStr += R"({"req":"","status":400,"rslt":"invalid batch"})";
+        }
+        else if (_batchReqs.size() > _maxBatchSize)
+        {
+            _batchReqs.clear();
+            _respStr += R"({"req":"","status":413,"rslt":"batch too large"})";
+        }
+        _bodyStr = "";
+    }
+
+    // Form next response when the previous one has been sent
+    if (_respStrPos >= _respStr.length())
+        formNextResponse();
+
+    // Check how much to send
+    uint32_t respRemain = _respStr.length() - _respStrPos;
+    uint32_t respLen = bufMaxLen > respRemain ? respRemain : bufMaxLen;
+    pBuf = (uint8_t*) (_respStr.c_str() + _respStrPos);
+    _respStrPos += respLen;
+
+    // Check if complete
+    if (_batchEndSent && (_respStrPos >= _respStr.length()))
+        _isActive = false;
+
+#ifdef DEBUG_RESPONDER_REST_API_BATCH
+    LOG_I(MODULE_PREFIX, "getResponseNext reqIdx %d numReqs %d respLen %d isActive %d",
+                _batchReqIdx, _batchReqs.size(), respLen, _isActive);
+#endif
+    return respLen;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execute the next request in the batch and form its response (or end the response array)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebResponderRestAPIBatch::formNextResponse()
+{
+    _respStrPos = 0;
+
+    // Check for end
+    if (_batchReqIdx >= _batchReqs.size())
+    {
+        _respStr = "]";
+        _batchEndSent = true;
+        return;
+    }
+
+    // Execute request
+    String& reqStr = _batchReqs[_batchReqIdx];
+    String endpointResp;
+    RdHttpStatusCode statusCode = _pWebHandler->handleBatchRequest(_clientIPAddr, reqStr, endpointResp, _apiSourceInfo);
+
+    // Form response element
+    _respStr = _batchReqIdx == 0 ? "" : ",";
+    _respStr += R"({"req":)";
+    appendJSONString(_respStr, reqStr);
+    _respStr += R"(,"status":)" + String((int)statusCode) + R"(,"rslt":)";
+
+    // Endpoints generally respond with JSON objects or arrays which are included as-is - anything
+    // else (including malformed JSON which would corrupt the batch response) is included as a string
+    endpointResp.trim();
+    if (isValidJSONContainer(endpointResp))
+        _respStr += endpointResp;
+    else
+        appendJSONString(_respStr, endpointResp);
+    _respStr += "}";
+
+    // Free memory used by request
+    reqStr = "";
+    _batchReqIdx++;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parse batch - a JSON array of strings
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderRestAPIBatch::parseBatch()
+{
+    const char* pStr = _bodyStr.c_str();
+    uint32_t pos = 0;
+    uint32_t len = _bodyStr.length();
+
+    // Skip whitespace and expect start of array
+    while ((pos < len) && isspace(pStr[pos]))
+        pos++;
+    if ((pos >= len) || (pStr[pos] != '['))
+        return false;
+    pos++;
+
+    // Extract strings
+    bool expectValue = true;
+    while (pos < len)
+    {
+        char ch = pStr[pos++];
+        if (isspace(ch))
+            continue;
+        if (ch == ']')
+            return _batchReqs.empty() || !expectValue;
+        if (!expectValue)
+        {
+            if (ch != ',')
+                break;
+            expectValue = true;
+            continue;
+        }
+        if (ch != '"')
+            break;
+
+        // Extract string handling escapes
+        String reqStr;
+        bool strComplete = false;
+        while ((pos < len) && (reqStr.length() <= MAX_BATCH_REQ_STR_LEN))
+        {
+            ch = pStr[pos++];
+            if (ch == '"')
+            {
+                strComplete = true;
+                break;
+            }
+            if (ch == '\\')
+            {
+                if (pos >= len)
+                    break;
+                ch = pStr[pos++];
+                switch(ch)
+                {
+                    case 'b': ch = '\b'; break;
+                    case 'f': ch = '\f'; break;
+                    case 'n': ch = '\n'; break;
+                    case 'r': ch = '\r'; break;
+                    case 't': ch = '\t'; break;
+                    case 'u':
+                    {
+                        // Only ASCII is valid in a request string
+                        if (pos + 4 > len)
+                            return false;
+                        char hexStr[5] = { pStr[pos], pStr[pos+1], pStr[pos+2], pStr[pos+3], 0 };
+                        long charCode = strtol(hexStr, nullptr, 16);
+                        if ((charCode <= 0) || (charCode > 0x7f))
+                            return false;
+                        ch = (char)charCode;
+                        pos += 4;
+                        break;
+                    }
+                    default: break;
+                }
+            }
+            reqStr += ch;
+        }
+        if (!strComplete)
+            break;
+        _batchReqs.push_back(reqStr);
+        expectValue = false;
+    }
+
+#ifdef WARN_RESPONDER_REST_API_BATCH_INVALID
+    LOG_W(MODULE_PREFIX, "parseBatch invalid at pos %d len %d", pos, len);
+#endif
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check a string is a single valid JSON object or array
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderRestAPIBatch::isValidJSONContainer(const String& jsonStr)
+{
+    if (!jsonStr.startsWith("{") && !jsonStr.startsWith("["))
+        return false;
+
+    // Tokens can't be longer than the string
+    RdWebJsonSAX jsonValidator(jsonStr.length());
+    if (!jsonValidator.handleData((const uint8_t*)jsonStr.c_str(), jsonStr.length()) || !jsonValidator.isComplete())
+    {
+#ifdef WARN_RESPONDER_REST_API_BATCH_INVALID
+        LOG_W(MODULE_PREFIX, "isValidJSONContainer endpoint response invalid JSON len %d", jsonStr.length());
+#endif
+        return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Append a string as a quoted JSON string
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebResponderRestAPIBatch::appendJSONString(String& outStr, const String& inStr)
+{
+    outStr += '"';
+    for (uint32_t i = 0; i < inStr.length(); i++)
+    {
+        char ch = inStr[i];
+        switch(ch)
+        {
+            case '"': outStr += "\\\""; break;
+            case '\\': outStr += "\\\\"; break;
+            case '\n': outStr += "\\n"; break;
+            case '\r': outStr += "\\r"; break;
+            case '\t': outStr += "\\t"; break;
+            default:
+                if ((uint8_t)ch < 0x20)
+                {
+                    char escStr[7];
+                    snprintf(escStr, sizeof(escStr), "\\u%04x", ch);
+                    outStr += escStr;
+                }
+                else
+                {
+                    outStr += ch;
+                }
+                break;
+        }
+    }
+    outStr += '"';
+}
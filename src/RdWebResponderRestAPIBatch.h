@@ -0,0 +1,95 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include <WString.h>
+#include "RdWebResponder.h"
+#include <RdWebRequestParams.h>
+#include "APISourceInfo.h"
+
+class RdWebHandlerRestAPI;
+
+// Responder for a batch of REST API requests
+// The request body is a JSON array of request strings, e.g. ["/v","/status?x=1"]
+// Each request is executed in turn and the results streamed back as a JSON array of
+// {"req":<request>,"status":<HTTP status>,"rslt":<endpoint response>}
+class RdWebResponderRestAPIBatch : public RdWebResponder
+{
+public:
+    RdWebResponderRestAPIBatch(RdWebHandlerRestAPI* pWebHandler, const RdWebRequestParams& params,
+                        uint32_t contentLength, uint32_t clientIPAddr,
+                        uint32_t channelID, uint32_t maxBatchSize);
+    virtual ~RdWebResponderRestAPIBatch();
+
+    // Handle inbound data
+    virtual bool handleData(const uint8_t* pBuf, uint32_t dataLen) override final;
+
+    // Start responding
+    virtual bool startResponding(RdWebConnection& request) override final;
+
+    // Get response next
+    virtual uint32_t getResponseNext(uint8_t*& pBuf, uint32_t bufMaxLen) override final;
+
+    // Get content type
+    virtual const char* getContentType() override final
+    {
+        return "text/json";
+    }
+
+    // Leave connection open
+    virtual bool leaveConnOpen() override final
+    {
+        return false;
+    }
+
+    // Get responder type
+    virtual const char* getResponderType() override final
+    {
+        return "APIBATCH";
+    }
+
+    // Max length of a single request string in a batch
+    static const uint32_t MAX_BATCH_REQ_STR_LEN = 200;
+
+private:
+    // Handler
+    RdWebHandlerRestAPI* _pWebHandler;
+
+    // Params
+    RdWebRequestParams _reqParams;
+
+    // Request info
+    uint32_t _contentLength;
+    uint32_t _clientIPAddr;
+    uint32_t _maxBatchSize;
+
+    // Body received so far
+    String _bodyStr;
+    uint32_t _numBytesReceived;
+
+    // Batch requests and index of next to execute
+    std::vector<String> _batchReqs;
+    uint32_t _batchReqIdx;
+    bool _batchParsed;
+    bool _batchEndSent;
+
+    // Response for current request and position sent
+    String _respStr;
+    uint32_t _respStrPos;
+
+    // API source
+    APISourceInfo _apiSourceInfo;
+
+    // Helpers
+    bool parseBatch();
+    void formNextResponse();
+    static bool isValidJSONContainer(const String& jsonStr);
+    static void appendJSONString(String& outStr, const String& inStr);
+};
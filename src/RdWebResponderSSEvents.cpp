@@ -12,6 +12,7 @@
 #include "RdWebConnDefs.h"
 #include <Logger.h>
 #include <Utils.h>
+#include <inttypes.h>
 
 // #define DEBUG_RESPONDER_EVENTS
 #define WARN_EVENTS_SEND_APP_DATA_FAIL
@@ -33,7 +34,22 @@ RdWebResponderSSEvents::RdWebResponderSSEvents(RdWebHandler *pWebHandler, const
     _pWebHandler = pWebHandler;
     _requestStr = reqStr;
     _isInitialResponse = true;
-    _txQueue.setMaxLen(EVENT_TX_QUEUE_SIZE);
+    _lastReplayedEventID = 0;
+    _replayPendingEventID = 0;
+    _eventsSent = 0;
+    _eventsReplayed = 0;
+    _txQueue.setup(DEFAULT_TX_QUEUE_MAX_LEN, TX_QUEUE_POLICY_DROP_NEWEST, 0);
+
+    // Initial response - the retry field sets the client's reconnect delay
+    _initialResponse = 
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/event-stream\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "Cache-Control: no-cache\r\n"
+            "Connection: keep-alive\r\n"
+            "Accept-Ranges: none\r\n\r\n";
+    if (webServerSettings._sseRetryMs != 0)
+        _initialResponse += "retry: " + String(webServerSettings._sseRetryMs) + "\r\n\r\n";
 }
 
 RdWebResponderSSEvents::~RdWebResponderSSEvents()
@@ -46,19 +62,51 @@ RdWebResponderSSEvents::~RdWebResponderSSEvents()
 
 void RdWebResponderSSEvents::service()
 {
-    // Check for data waiting to be sent
-    RdWebSSEvent event;
-    if (_txQueue.get(event))
+    // Events can't be sent until the initial response has been sent
+    if (_isInitialResponse)
+        return;
+
+    // Get events to replay to a reconnecting client (retried if the connection manager is busy)
+    if (_replayPendingEventID != 0)
+    {
+        RdWebConnSSEventsReplayFn replayFn = _reqParams.getWebConnSSEventsReplay();
+        if (replayFn && !replayFn(_replayPendingEventID))
+            return;
+        _replayPendingEventID = 0;
+    }
+
+    // Check for data waiting to be sent - replayed events first
+    QueuedEvent event;
+    bool eventValid = false;
+    if (!_replayEvents.empty())
+    {
+        event = _replayEvents.front();
+        _replayEvents.pop_front();
+        eventValid = true;
+        _lastReplayedEventID = event.eventID;
+        _eventsReplayed++;
+    }
+    else
+    {
+        // Skip events that have already been replayed
+        while (_txQueue.get(event))
+        {
+            eventValid = event.eventID > _lastReplayedEventID;
+            if (eventValid)
+                break;
+        }
+    }
+    if (eventValid)
     {
 #ifdef DEBUG_RESPONDER_EVENTS
-        LOG_W(MODULE_PREFIX, "service sendMsg group %s content %s", event.getGroup().c_str(), event.getContent().c_str());
+        LOG_W(MODULE_PREFIX, "service sendMsg eventID %d len %d", event.eventID, event.eventMsg.getLen());
 #endif
-        // Format message
-        String outMsg = generateEventMessage(event.getContent(), event.getGroup(), time(NULL));
+        // Send the formatted message
+        _eventsSent++;
         RdWebConnSendFn rawSendFn = _reqParams.getWebConnRawSend();
         if (rawSendFn)
         {
-            bool rslt = rawSendFn((const uint8_t*)outMsg.c_str(), outMsg.length(), MAX_SSEVENT_SEND_RETRY_MS) == RdWebConnSendRetVal::WEB_CONN_SEND_OK;
+            bool rslt = rawSendFn(event.eventMsg.getData(), event.eventMsg.getLen(), MAX_SSEVENT_SEND_RETRY_MS) == RdWebConnSendRetVal::WEB_CONN_SEND_OK;
             if (!rslt)
                 _isActive = false;
         }
@@ -87,8 +135,11 @@ bool RdWebResponderSSEvents::startResponding(RdWebConnection &request)
 {
     // Now active
     _isActive = true;
+
+    // Events missed by a reconnecting client are replayed from service()
+    _replayPendingEventID = request.getHeader().sseLastEventID;
 #ifdef DEBUG_RESPONDER_EVENTS
-    LOG_I(MODULE_PREFIX, "startResponding isActive %d", _isActive);
+    LOG_I(MODULE_PREFIX, "startResponding isActive %d replayAfter %d", _isActive, _replayPendingEventID);
 #endif
     return _isActive;
 }
@@ -97,35 +148,27 @@ bool RdWebResponderSSEvents::startResponding(RdWebConnection &request)
 // Get response next
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-uint32_t RdWebResponderSSEvents::getResponseNext(uint8_t *pBuf, uint32_t bufMaxLen)
+uint32_t RdWebResponderSSEvents::getResponseNext(uint8_t*& pBuf, uint32_t bufMaxLen)
 {
     uint32_t respLen = 0;
 
     // Check if initial response
     if (_isInitialResponse)
     {
-        // Response for snprintf
-        const char SSEVENT_RESPONSE[] =
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: text/event-stream\r\n"
-            "Access-Control-Allow-Origin: *\r\n"
-            "Cache-Control: no-cache\r\n"
-            "Connection: keep-alive\r\n"
-            "Accept-Ranges: none\r\n\r\n";
-
-        // Reponse string
-        snprintf((char *)pBuf, bufMaxLen, SSEVENT_RESPONSE);
+        // Response
+        pBuf = (uint8_t*)_initialResponse.c_str();
 
         // Response done
         _isInitialResponse = false;
 
         // Debug
 #ifdef DEBUG_RESPONDER_EVENTS
-        LOG_I(MODULE_PREFIX, "getResponseNext isActive %d resp %s", _isActive, (char *)pBuf);
+        LOG_I(MODULE_PREFIX, "getResponseNext isActive %d resp %s", _isActive, _initialResponse.c_str());
 #endif
 
         // Return
-        return strnlen((char *)pBuf, bufMaxLen);
+        respLen = _initialResponse.length();
+        return respLen < bufMaxLen ? respLen : bufMaxLen;
     }
 
     // // Get
@@ -160,123 +203,49 @@ bool RdWebResponderSSEvents::leaveConnOpen()
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Send event content and group
+// Send event message
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void RdWebResponderSSEvents::sendEvent(const char* eventContent, const char* eventGroup)
+void RdWebResponderSSEvents::sendEvent(RdWebDataFrame& eventMsg, uint32_t eventID, uint32_t groupKey, bool isReplay)
 {
+    QueuedEvent event;
+    event.eventMsg = eventMsg;
+    event.eventID = eventID;
+
+    // Replayed events are all held (the number is limited by the size of the replay ring)
+    if (isReplay)
+    {
+        _replayEvents.push_back(event);
+        return;
+    }
+
     // Add to queue - don't block if full
-    RdWebSSEvent event(eventContent, eventGroup);
-    bool putRslt = _txQueue.put(event);
+    bool putRslt = _txQueue.put(event, groupKey);
     if (!putRslt)
     {
 #ifdef WARN_EVENTS_SEND_APP_DATA_FAIL
-        LOG_W(MODULE_PREFIX, "sendFrame failed group %s content %s", eventGroup, eventContent);
+        LOG_W(MODULE_PREFIX, "sendEvent failed eventID %d len %d", eventID, eventMsg.getLen());
 #endif
     }
     else
     {
 #ifdef DEBUG_RESPONDER_EVENTS
-        LOG_W(MODULE_PREFIX, "sendFrame ok group %s content %s", eventGroup, eventContent);
+        LOG_W(MODULE_PREFIX, "sendEvent ok eventID %d len %d", eventID, eventMsg.getLen());
 #endif
     }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Send a frame of data
-// From ESPAsyncWebServer
+// Get stats
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-String RdWebResponderSSEvents::generateEventMessage(const String& msgStr, const String& eventStr, uint32_t id)
+String RdWebResponderSSEvents::getStatsJSON()
 {
-    String ev = "";
-
-    if (id)
-    {
-        ev += "id: ";
-        ev += String(id);
-        ev += "\r\n";
-    }
-
-    if (pEvent != NULL)
-    {
-        ev += "event: ";
-        ev += String(pEvent);
-        ev += "\r\n";
-    }
-
-    char* pMsg = msgStr.c_str();
-    size_t messageLen = msgStr.length();
-    char *lineStart = pMsg;
-    char *lineEnd;
-    do
-    {
-        char *nextN = strchr(lineStart, '\n');
-        char *nextR = strchr(lineStart, '\r');
-        if (nextN == NULL && nextR == NULL)
-        {
-            size_t llen = (pMsg + messageLen) - lineStart;
-            char *ldata = (char*)malloc(llen + 1);
-            if (ldata != NULL)
-            {
-                memcpy(ldata, lineStart, llen);
-                ldata[llen] = 0;
-                ev += "data: ";
-                ev += ldata;
-                ev += "\r\n\r\n";
-                free(ldata);
-            }
-            lineStart = pMsg + messageLen;
-        }
-        else
-        {
-            char *nextLine = NULL;
-            if (nextN != NULL && nextR != NULL)
-            {
-                if (nextR < nextN)
-                {
-                    lineEnd = nextR;
-                    if (nextN == (nextR + 1))
-                        nextLine = nextN + 1;
-                    else
-                        nextLine = nextR + 1;
-                }
-                else
-                {
-                    lineEnd = nextN;
-                    if (nextR == (nextN + 1))
-                        nextLine = nextR + 1;
-                    else
-                        nextLine = nextN + 1;
-                }
-            }
-            else if (nextN != NULL)
-            {
-                lineEnd = nextN;
-                nextLine = nextN + 1;
-            }
-            else
-            {
-                lineEnd = nextR;
-                nextLine = nextR + 1;
-            }
-
-            size_t llen = lineEnd - lineStart;
-            char *ldata = (char *)malloc(llen + 1);
-            if (ldata != NULL)
-            {
-                memcpy(ldata, lineStart, llen);
-                ldata[llen] = 0;
-                ev += "data: ";
-                ev += ldata;
-                ev += "\r\n";
-                free(ldata);
-            }
-            lineStart = nextLine;
-            if (lineStart == (pMsg + messageLen))
-                ev += "\r\n";
-        }
-    } while (lineStart < (pMsg + messageLen));
-
-    return ev;
+    char jsonStr[150];
+    snprintf(jsonStr, sizeof(jsonStr),
+                R"({"txQ":%)" PRIu32 R"(,"txQMax":%)" PRIu32 R"(,"sent":%)" PRIu32 R"(,"replayed":%)" PRIu32
+                R"(,"dropped":%)" PRIu32 R"(,"coalesced":%)" PRIu32 "}",
+                _txQueue.count(), _txQueue.maxLen(), _eventsSent, _eventsReplayed,
+                _txQueue.getDropCount(), _txQueue.getReplaceCount());
+    return jsonStr;
 }
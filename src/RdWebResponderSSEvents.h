@@ -15,7 +15,8 @@
 #include <RdWebSocketLink.h>
 #include <RdWebSSEvent.h>
 #include <Logger.h>
-#include <ThreadSafeQueue.h>
+#include "RdWebTxQueue.h"
+#include <deque>
 
 class RdWebHandler;
 class RdWebServerSettings;
@@ -42,7 +43,7 @@ public:
     virtual bool startResponding(RdWebConnection& request) override final;
 
     // Get response next
-    virtual uint32_t getResponseNext(uint8_t* pBuf, uint32_t bufMaxLen) override final;
+    virtual uint32_t getResponseNext(uint8_t*& pBuf, uint32_t bufMaxLen) override final;
 
     // Get content type
     virtual const char* getContentType() override final;
@@ -56,8 +57,21 @@ public:
         return false;
     }
 
-    // Send event content and group
-    virtual void sendEvent(const char* eventContent, const char* eventGroup);
+    // Send event message (formatted by RdWebSSEvent) - replayed events are sent before any others
+    virtual void sendEvent(RdWebDataFrame& eventMsg, uint32_t eventID, uint32_t groupKey, bool isReplay) override final;
+
+    // Set tx queue length and policy - the latest-keyed policy removes a queued event in the same group
+    // and queues the new event at the end (so events stay in ID order) - if the queue is full of events
+    // in other groups the oldest is dropped so maxLen should exceed the number of groups in use
+    void setTxQueue(uint32_t maxLen, RdWebTxQueuePolicy policy)
+    {
+        _txQueue.setup(maxLen, policy, 0);
+    }
+
+    // Get stats (JSON)
+    virtual String getStatsJSON() override final;
+
+    static const uint32_t DEFAULT_TX_QUEUE_MAX_LEN = 2;
 
     // Get responder type
     virtual const char* getResponderType() override final
@@ -79,13 +93,36 @@ private:
     String _requestStr;
     bool _isInitialResponse;
 
-    // Queue for sending frames over the event channel
-    static const uint32_t EVENT_TX_QUEUE_SIZE = 2;
-    ThreadSafeQueue<RdWebSSEvent> _txQueue;
+    // Initial response (headers and the retry field)
+    String _initialResponse;
+
+    // Queued event - the formatted message is shared with the other connections the event was sent on
+    class QueuedEvent
+    {
+    public:
+        RdWebDataFrame eventMsg;
+        uint32_t eventID = 0;
+    };
+
+    // Queue for sending frames over the event channel - events are put by the application and got in
+    // service() - the queue has no lock between the two sides but it has a single producer because
+    // senders are serialized by the connection manager (with the connection slot's send mutex)
+    // Events that can't be queued are dropped (or replace a queued event in the same group)
+    RdWebTxQueue<QueuedEvent> _txQueue;
+
+    // Events replayed to a reconnecting client (put when the replay is obtained in service() and sent before
+    // queued events - which are skipped if they were also replayed)
+    std::deque<QueuedEvent> _replayEvents;
+    uint32_t _lastReplayedEventID;
+
+    // Last-Event-ID of a reconnecting client whose replay hasn't been obtained yet (0 if none) - retried
+    // in service() and queued events aren't sent until it is done
+    uint32_t _replayPendingEventID;
+
+    // Stats
+    uint32_t _eventsSent;
+    uint32_t _eventsReplayed;
 
     // Retry
     static const uint32_t MAX_SSEVENT_SEND_RETRY_MS = 1;
-
-    // Generate event message
-    String generateEventMessage(const String& msgStr, const String& eventStr, uint32_t id);
 };
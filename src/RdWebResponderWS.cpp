@@ -15,10 +15,11 @@
 #include "RdWebHandlerWS.h"
 #include <Logger.h>
 #include <Utils.h>
+#include <ArduinoTime.h>
+#include <RdJson.h>
 
 // Warn
 #define WARN_WS_SEND_APP_DATA_FAIL
-#define WARN_WS_PACKET_TOO_BIG
 
 // Debug
 // #define DEBUG_RESPONDER_WS
@@ -41,26 +42,54 @@ RdWebResponderWS::RdWebResponderWS(RdWebHandlerWS* pWebHandler, const RdWebReque
             const String& reqStr, const RdWebServerSettings& webServerSettings,
             RdWebSocketCanAcceptCB canAcceptMsgCB, RdWebSocketMsgCB sendMsgCB,
             uint32_t channelID, uint32_t packetMaxBytes, uint32_t txQueueSize,
-            uint32_t pingIntervalMs, uint32_t disconnIfNoPongMs)
+            uint32_t pingIntervalMs, uint32_t disconnIfNoPongMs,
+            RdWebSocketStreamMsgCB sendStreamMsgCB)
     :   _reqParams(params), _canAcceptMsgCB(canAcceptMsgCB), 
-        _sendMsgCB(sendMsgCB), _txQueue(txQueueSize)
+        _sendMsgCB(sendMsgCB), _sendStreamMsgCB(sendStreamMsgCB), _txQueue(txQueueSize)
 {
     // Store socket info
     _pWebHandler = pWebHandler;
     _requestStr = reqStr;
     _channelID = channelID;
     _packetMaxBytes = packetMaxBytes;
+    _txMsgMaxBytes = _packetMaxBytes > RdWebSocketLink::MAX_WS_MESSAGE_SIZE ? _packetMaxBytes : RdWebSocketLink::MAX_WS_MESSAGE_SIZE;
+    _txProducerCB = nullptr;
+    _txProducerMutex = xSemaphoreCreateMutex();
+
+    // Virtual channel messages are tagged with the virtual channel index (plus 1) so the credit taken
+    // when the message was queued is returned if the tx queue policy drops or replaces it
+    _txQueue.setRemovedCB([this](const RdWebDataFrame& frame, uint32_t tag) {
+        uint32_t frameLen = frame.getLen();
+        _mux.txMsgCancel(tag - 1, frameLen > RdWebSocketMux::MUX_HEADER_BYTES ? 
+                    frameLen - RdWebSocketMux::MUX_HEADER_BYTES : 0);
+    });
+
+    // Fragments (with header) must fit in the connection's send buffer
+    uint32_t fragmentMaxBytes = _packetMaxBytes;
+    uint32_t maxSendSize = _reqParams.getMaxSendSize();
+    if ((maxSendSize > RdWebSocketLink::MAX_WS_FRAME_HEADER_BYTES) && 
+                (fragmentMaxBytes + RdWebSocketLink::MAX_WS_FRAME_HEADER_BYTES > maxSendSize))
+        fragmentMaxBytes = maxSendSize - RdWebSocketLink::MAX_WS_FRAME_HEADER_BYTES;
 
     // Init socket link
     _webSocketLink.setup(std::bind(&RdWebResponderWS::webSocketCallback, this, 
                             std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
-                params.getWebConnRawSend(), pingIntervalMs, true, disconnIfNoPongMs);
+                params.getWebConnRawSend(), params.getWebConnRawSendVec(), params.getWebConnReadyToSend(), 
+                pingIntervalMs, true, disconnIfNoPongMs, fragmentMaxBytes);
+
+    // Streamed receive
+    if (_sendStreamMsgCB)
+        _webSocketLink.setRxStreamCB(std::bind(&RdWebResponderWS::webSocketStreamCallback, this, 
+                            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3,
+                            std::placeholders::_4, std::placeholders::_5, std::placeholders::_6));
 }
 
 RdWebResponderWS::~RdWebResponderWS()
 {
     if (_pWebHandler)
         _pWebHandler->responderDelete(this);
+    if (_txProducerMutex)
+        vSemaphoreDelete(_txProducerMutex);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -79,17 +108,167 @@ void RdWebResponderWS::service()
         return;
     }
 
-    // Check for data waiting to be sent
-    RdWebDataFrame frame;
-    if (_txQueue.get(frame))
+    // Wait until any message in progress has been sent (the link sends a fragment on each service)
+    if (_webSocketLink.isTxMsgInProgress())
+        return;
+
+    // Queued frames and a waiting producer take turns - after each send from the queue the producer
+    // (if any) is started so that steady queue traffic doesn't starve it
+    if (_txProducerTurn && (_txCoalesceBuffer.size() == 0) && !_txMsgFrameWaiting)
+    {
+        _txProducerTurn = false;
+        if (startWaitingProducer())
+            return;
+    }
+
+    // Encode queued frames into the coalescing buffer - stopping at a frame too large to fit
+    // which is sent in fragments after the buffer - frames that are already encoded (shared by
+    // several connections) are copied into the buffer or, if not coalescing, sent directly
+    uint32_t coalesceMaxBytes = _webSocketLink.getTxFragmentMaxBytes();
+
+    // Return credit for messages received on virtual channels
+    uint8_t muxCreditMsg[RdWebSocketMux::MUX_CREDIT_MSG_BYTES];
+    while (_mux.isEnabled() && 
+                (_txCoalesceBuffer.size() + sizeof(muxCreditMsg) + RdWebSocketLink::MAX_WS_FRAME_HEADER_BYTES + 
+                        RdWebDeflate::MAX_COMPRESS_OVERHEAD_BYTES <= coalesceMaxBytes) &&
+                _mux.getRxCreditMsg(muxCreditMsg, sizeof(muxCreditMsg)))
+    {
+        if (_txCoalesceBuffer.size() == 0)
+            _txCoalesceStartMs = millis();
+        _webSocketLink.encodeFrame(_txCoalesceBuffer, WEBSOCKET_OPCODE_BINARY, muxCreditMsg, sizeof(muxCreditMsg));
+    }
+
+    while (!_txMsgFrameWaiting)
+    {
+        _txMsgFrame = RdWebDataFrame();
+        if (!_txQueue.get(_txMsgFrame))
+            break;
+        uint32_t encodedMaxLen = _txMsgFrame.getLen();
+        if (!_txMsgFrame.isEncoded())
+            encodedMaxLen += RdWebSocketLink::MAX_WS_FRAME_HEADER_BYTES + RdWebDeflate::MAX_COMPRESS_OVERHEAD_BYTES;
+        if ((_txCoalesceBuffer.size() + encodedMaxLen > coalesceMaxBytes) || !_txMsgFrame.isValid() ||
+                    (_txMsgFrame.isEncoded() && (_txCoalesceMs == 0) && (_txCoalesceBuffer.size() == 0)))
+        {
+            _txMsgFrameWaiting = true;
+            break;
+        }
+        if (_txCoalesceBuffer.size() == 0)
+        {
+            _txCoalesceBuffer.reserve(coalesceMaxBytes);
+            _txCoalesceStartMs = millis();
+        }
+        if (_txMsgFrame.isEncoded())
+        {
+            _txCoalesceBuffer.insert(_txCoalesceBuffer.end(), _txMsgFrame.getData(), 
+                        _txMsgFrame.getData() + _txMsgFrame.getLen());
+        }
+        else if (_txMsgFrame.getData())
+        {
+            _webSocketLink.encodeFrame(_txCoalesceBuffer, WEBSOCKET_OPCODE_BINARY, _txMsgFrame.getData(), _txMsgFrame.getLen());
+        }
+        else
+        {
+            // Frame held in a chain of slab blocks - copied out to be encoded
+            _txChainedCopyBuffer.resize(_txMsgFrame.getLen());
+            _txMsgFrame.copyData(0, _txChainedCopyBuffer.data(), _txChainedCopyBuffer.size());
+            _webSocketLink.encodeFrame(_txCoalesceBuffer, WEBSOCKET_OPCODE_BINARY, 
+                        _txChainedCopyBuffer.data(), _txChainedCopyBuffer.size());
+        }
+    }
+
+    // Send coalesced frames when the buffer is full, a large frame is waiting or the latency budget is used
+    if (_txCoalesceBuffer.size() > 0)
+    {
+        bool sendNow = _txMsgFrameWaiting || (_txCoalesceMs == 0) ||
+                    (_txCoalesceBuffer.size() + RdWebSocketLink::MAX_WS_FRAME_HEADER_BYTES >= coalesceMaxBytes) ||
+                    Utils::isTimeout(millis(), _txCoalesceStartMs, _txCoalesceMs);
+        if (!sendNow || !_webSocketLink.isReadyToSend())
+            return;
+#ifdef DEBUG_WS_SEND_APP_DATA
+        LOG_W(MODULE_PREFIX, "service sendEncodedFrames len %d", _txCoalesceBuffer.size());
+#endif
+        if (!_webSocketLink.sendEncodedFrames(_txCoalesceBuffer.data(), _txCoalesceBuffer.size()))
+            _isActive = false;
+        _txCoalesceBuffer.clear();
+        _txProducerTurn = true;
+        return;
+    }
+
+    // Encoded frame - sent from the shared buffer which is released when the last connection has sent it
+    if (_txMsgFrameWaiting && _txMsgFrame.isEncoded())
+    {
+        if (!_webSocketLink.isReadyToSend())
+            return;
+        _txMsgFrameWaiting = false;
+#ifdef DEBUG_WS_SEND_APP_DATA
+        LOG_W(MODULE_PREFIX, "service sendEncodedFrames shared len %d", _txMsgFrame.getLen());
+#endif
+        if (!_webSocketLink.sendEncodedFrames(_txMsgFrame.getData(), _txMsgFrame.getLen()))
+            _isActive = false;
+        _txMsgFrame = RdWebDataFrame();
+        _txProducerTurn = true;
+        return;
+    }
+
+    // Large frame held in a chain of slab blocks - the fragments are copied from the blocks by a
+    // producer (which holds a reference to the frame until the message has been sent)
+    if (_txMsgFrameWaiting && !_txMsgFrame.getData())
     {
+        _txMsgFrameWaiting = false;
 #ifdef DEBUG_WS_SEND_APP_DATA
-        LOG_W(MODULE_PREFIX, "service sendMsg len %d", frame.getLen());
+        LOG_W(MODULE_PREFIX, "service sendMsgProducer chained len %d", _txMsgFrame.getLen());
 #endif
-        // Send
-        if (!_webSocketLink.sendMsg(WEBSOCKET_OPCODE_BINARY, frame.getData(), frame.getLen()))
+        RdWebDataFrame chainedFrame = std::move(_txMsgFrame);
+        _txMsgFrame = RdWebDataFrame();
+        if (!_webSocketLink.sendMsgProducer(WEBSOCKET_OPCODE_BINARY, 
+                    [chainedFrame](uint8_t* pBuf, uint32_t bufMaxLen, uint32_t msgOffset, bool& msgFinal) mutable {
+                        uint32_t partLen = chainedFrame.copyData(msgOffset, pBuf, bufMaxLen);
+                        msgFinal = msgOffset + partLen >= chainedFrame.getLen();
+                        return partLen;
+                    }))
             _isActive = false;
+        _txProducerTurn = true;
+        return;
+    }
+
+    // Large frame - the frame is held until all fragments are sent
+    if (_txMsgFrameWaiting)
+    {
+        _txMsgFrameWaiting = false;
+#ifdef DEBUG_WS_SEND_APP_DATA
+        LOG_W(MODULE_PREFIX, "service sendMsg len %d", _txMsgFrame.getLen());
+#endif
+        if (!_webSocketLink.sendMsgFragmented(WEBSOCKET_OPCODE_BINARY, _txMsgFrame.getData(), _txMsgFrame.getLen()))
+            _isActive = false;
+        _txProducerTurn = true;
+        return;
     }
+
+    // Nothing queued so start any waiting producer
+    startWaitingProducer();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Start sending from a waiting producer (returns true if one was started)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderWS::startWaitingProducer()
+{
+    RdWebSocketTxProducerCB txProducerCB = nullptr;
+    if (_txProducerMutex && (xSemaphoreTake(_txProducerMutex, 0) == pdTRUE))
+    {
+        txProducerCB = _txProducerCB;
+        _txProducerCB = nullptr;
+        xSemaphoreGive(_txProducerMutex);
+    }
+    if (!txProducerCB)
+        return false;
+#ifdef DEBUG_WS_SEND_APP_DATA
+    LOG_W(MODULE_PREFIX, "service sendMsgProducer");
+#endif
+    if (!_webSocketLink.sendMsgProducer(WEBSOCKET_OPCODE_BINARY, txProducerCB))
+        _isActive = false;
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -121,6 +300,25 @@ bool RdWebResponderWS::handleData(const uint8_t* pBuf, uint32_t dataLen)
     return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle inbound data in a receive buffer which can be modified
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderWS::handleDataInPlace(uint8_t* pBuf, uint32_t dataLen)
+{
+#ifdef DEBUG_RESPONDER_WS
+    LOG_I(MODULE_PREFIX, "handleDataInPlace len %d", dataLen);
+#endif
+
+    // Handle it with link
+    _webSocketLink.handleRxDataInPlace(pBuf, dataLen);
+
+    // Check if the link is still active
+    if (!_webSocketLink.isActive())
+        _isActive = false;
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Ready for data
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -132,6 +330,20 @@ bool RdWebResponderWS::readyForData()
     return false;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Ready for data on a channel
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderWS::readyForChannelData(uint32_t channelID)
+{
+    // Virtual channels need credit from the client
+    if (_mux.isEnabled() && !_mux.canSend(channelID))
+        return false;
+    if (_canAcceptMsgCB)
+        return _canAcceptMsgCB(channelID);
+    return false;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Start responding
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -140,7 +352,21 @@ bool RdWebResponderWS::startResponding(RdWebConnection& request)
 {
     // Set link to upgrade-request already received state
     _webSocketLink.upgradeReceived(request.getHeader().webSocketKey, 
-                        request.getHeader().webSocketVersion);
+                        request.getHeader().webSocketVersion,
+                        request.getHeader().webSocketExtensions);
+
+    // Topics subscribed in the URL query
+    RdWebConnTopicSubscribeFn topicSubscribeFn = _reqParams.getWebConnTopicSubscribe();
+    if (_topicCtrlEnabled && topicSubscribeFn && (request.getHeader().params.length() > 0))
+    {
+        std::vector<RdJson::NameValuePair> queryNameValues;
+        RdJson::extractNameValues(request.getHeader().params, "=", "&", NULL, queryNameValues);
+        for (RdJson::NameValuePair& nvp : queryNameValues)
+        {
+            if (nvp.name.equals("topics"))
+                topicSubscribeFn(nvp.value, true);
+        }
+    }
 
     // Now active
     _isActive = true;
@@ -196,21 +422,51 @@ bool RdWebResponderWS::leaveConnOpen()
     // Send a frame of data
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool RdWebResponderWS::sendFrame(const uint8_t* pBuf, uint32_t bufLen)
+bool RdWebResponderWS::sendFrame(const uint8_t* pBuf, uint32_t bufLen, uint32_t channelID)
 {
-    // Check packet size limit
-    if (bufLen > _packetMaxBytes)
+    // Check size - the message is copied so the size is limited (larger messages can be sent with a producer)
+    if (bufLen > _txMsgMaxBytes)
     {
-#ifdef WARN_WS_PACKET_TOO_BIG
-        LOG_W(MODULE_PREFIX, "sendFrame TOO BIG len %d maxLen %d", bufLen, _packetMaxBytes);
+#ifdef WARN_WS_SEND_APP_DATA_FAIL
+        LOG_W(MODULE_PREFIX, "sendFrame len %d > max %d", bufLen, _txMsgMaxBytes);
 #endif
         return false;
     }
-    // Add to queue - don't block if full
-    RdWebDataFrame frame(pBuf, bufLen);
-    bool putRslt = _txQueue.put(frame, MAX_WAIT_FOR_TX_QUEUE_MS);
+
+    // Virtual channel messages have the mux header added
+    uint8_t muxHeader[RdWebSocketMux::MUX_HEADER_BYTES];
+    uint32_t muxHeaderLen = 0;
+    uint32_t virtChanIdx = 0;
+    uint32_t txQueueTag = 0;
+    if (_mux.isEnabled())
+    {
+        if (!_mux.txMsgStart(channelID, bufLen, virtChanIdx))
+            return false;
+        RdWebSocketMux::writeHeader(muxHeader, virtChanIdx, RdWebSocketMux::MUX_MSG_DATA);
+        muxHeaderLen = sizeof(muxHeader);
+        txQueueTag = virtChanIdx + 1;
+    }
+
+    // Copy into the slab - falling back to the heap if there is no slab or not enough free blocks
+    RdWebDataFrame frame;
+    if (_txSlab.isSetup())
+        frame = RdWebDataFrame(_txSlab, muxHeader, muxHeaderLen, pBuf, bufLen);
+    if (!frame.isValid())
+    {
+#ifdef DEBUG_WS_SEND_APP_DATA
+        LOG_W(MODULE_PREFIX, "sendFrame heap frame len %d slabFreeBlocks %d", bufLen, _txSlab.getFreeBlocks());
+#endif
+        frame = RdWebDataFrame(muxHeader, muxHeaderLen, pBuf, bufLen);
+        _txSlabFallbackCount++;
+    }
+
+    // Add to queue (messages larger than _packetMaxBytes are sent in fragments) - if full the tx queue
+    // policy determines whether to wait, drop this message or drop/replace a queued one
+    bool putRslt = _txQueue.put(frame, _txMsgKeyCB ? _txMsgKeyCB(channelID, pBuf, bufLen) : 0, txQueueTag);
     if (!putRslt)
     {
+        if (_mux.isEnabled())
+            _mux.txMsgCancel(virtChanIdx, bufLen);
 #ifdef WARN_WS_SEND_APP_DATA_FAIL
         LOG_W(MODULE_PREFIX, "sendFrame add to txQueue failed len %d count %d maxLen %d", bufLen, _txQueue.count(), _txQueue.maxLen());
 #endif
@@ -224,6 +480,70 @@ bool RdWebResponderWS::sendFrame(const uint8_t* pBuf, uint32_t bufLen)
     return putRslt;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send a frame of data that has also been encoded (shared with other connections)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderWS::sendFrameEncoded(RdWebDataFrame& encodedFrame, const uint8_t* pBuf, uint32_t bufLen,
+            uint32_t channelID)
+{
+    // The encoded frame can only be used if the link doesn't mask or compress, it doesn't need fragmenting
+    // and it doesn't need a virtual channel header
+    if (!_webSocketLink.canSendUnmaskedFrames() || (encodedFrame.getLen() > _webSocketLink.getTxFragmentMaxBytes()) ||
+                _mux.isEnabled())
+        return sendFrame(pBuf, bufLen, channelID);
+
+    // Add to queue (only a reference to the encoded frame is queued) - the tx queue policy applies if full
+    bool putRslt = _txQueue.put(encodedFrame, _txMsgKeyCB ? _txMsgKeyCB(channelID, pBuf, bufLen) : 0);
+#ifdef WARN_WS_SEND_APP_DATA_FAIL
+    if (!putRslt)
+        LOG_W(MODULE_PREFIX, "sendFrameEncoded add to txQueue failed len %d count %d maxLen %d", 
+                    bufLen, _txQueue.count(), _txQueue.maxLen());
+#endif
+    return putRslt;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send a message generated in pieces by a producer
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderWS::sendFrameProducer(RdWebSocketTxProducerCB txProducerCB, uint32_t channelID)
+{
+    // Only one producer can be waiting
+    if (!txProducerCB || (xSemaphoreTake(_txProducerMutex, pdMS_TO_TICKS(MAX_WAIT_FOR_TX_QUEUE_MS)) != pdTRUE))
+        return false;
+    bool isAdded = !_txProducerCB;
+    uint32_t virtChanIdx = 0;
+    if (isAdded && _mux.isEnabled())
+        isAdded = _mux.txMsgStart(channelID, 0, virtChanIdx);
+    if (isAdded && _mux.isEnabled())
+    {
+        // The virtual channel header is added before the first part of the message
+        _txProducerCB = [txProducerCB, virtChanIdx](uint8_t* pBuf, uint32_t bufMaxLen, uint32_t msgOffset, bool& msgFinal) {
+            if (msgOffset > 0)
+                return txProducerCB(pBuf, bufMaxLen, msgOffset - RdWebSocketMux::MUX_HEADER_BYTES, msgFinal);
+            if (bufMaxLen <= RdWebSocketMux::MUX_HEADER_BYTES)
+                return (uint32_t)0;
+            uint32_t partLen = txProducerCB(pBuf + RdWebSocketMux::MUX_HEADER_BYTES, 
+                        bufMaxLen - RdWebSocketMux::MUX_HEADER_BYTES, 0, msgFinal);
+            if ((partLen == 0) && !msgFinal)
+                return (uint32_t)0;
+            RdWebSocketMux::writeHeader(pBuf, virtChanIdx, RdWebSocketMux::MUX_MSG_DATA);
+            return partLen + RdWebSocketMux::MUX_HEADER_BYTES;
+        };
+    }
+    else if (isAdded)
+    {
+        _txProducerCB = txProducerCB;
+    }
+    xSemaphoreGive(_txProducerMutex);
+#ifdef WARN_WS_SEND_APP_DATA_FAIL
+    if (!isAdded)
+        LOG_W(MODULE_PREFIX, "sendFrameProducer failed producer already waiting");
+#endif
+    return isAdded;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Websocket callback
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -265,6 +585,10 @@ void RdWebResponderWS::webSocketCallback(RdWebSocketEventCode eventCode, const u
         }
 		case WEBSOCKET_EVENT_TEXT:
         {
+            // Topic subscription messages are handled here
+            if (_topicCtrlEnabled && handleTopicCtrlMsg(pBuf, bufLen))
+                break;
+
             // Send the message
             if (_sendMsgCB && (pBuf != NULL))
                 _sendMsgCB(_channelID, (uint8_t*) pBuf, bufLen);
@@ -278,6 +602,18 @@ void RdWebResponderWS::webSocketCallback(RdWebSocketEventCode eventCode, const u
         }
 		case WEBSOCKET_EVENT_BINARY:
         {
+            // Messages on virtual channels are sent to the application on their channel
+            if (_mux.isEnabled())
+            {
+                uint32_t virtChannelID = 0;
+                const uint8_t* pPayload = nullptr;
+                uint32_t payloadLen = 0;
+                if ((_mux.handleRxMsg(pBuf, bufLen, virtChannelID, pPayload, payloadLen) == RdWebSocketMux::MUX_RX_DATA) && 
+                            _sendMsgCB)
+                    _sendMsgCB(virtChannelID, pPayload, payloadLen);
+                break;
+            }
+
             // Send the message
             if (_sendMsgCB && (pBuf != NULL))
                 _sendMsgCB(_channelID, (uint8_t*) pBuf, bufLen);
@@ -313,4 +649,55 @@ void RdWebResponderWS::webSocketCallback(RdWebSocketEventCode eventCode, const u
 	}
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Websocket streamed data callback
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebResponderWS::webSocketStreamCallback(RdWebSocketEventCode eventCode, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t msgOffset, bool frameFinal, bool msgFinal)
+{
+#ifdef DEBUG_WEBSOCKETS_TRAFFIC
+    LOG_I(MODULE_PREFIX, "webSocketStreamCallback rx %s len %d msgOffset %d frameFinal %d msgFinal %d",
+                eventCode == WEBSOCKET_EVENT_TEXT ? "text" : "binary", bufLen, msgOffset, frameFinal, msgFinal);
+#endif
+    if (_sendStreamMsgCB)
+        _sendStreamMsgCB(_channelID, pBuf, bufLen, msgOffset, frameFinal, msgFinal);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle topic subscription message - returns true if the message was a subscription message
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebResponderWS::handleTopicCtrlMsg(const uint8_t* pBuf, uint32_t bufLen)
+{
+    // Check for prefix
+    bool subscribe = false;
+    uint32_t prefixLen = 0;
+    if (!pBuf)
+        return false;
+    if ((bufLen >= strlen(TOPIC_SUB_PREFIX)) && (memcmp(pBuf, TOPIC_SUB_PREFIX, strlen(TOPIC_SUB_PREFIX)) == 0))
+    {
+        subscribe = true;
+        prefixLen = strlen(TOPIC_SUB_PREFIX);
+    }
+    else if ((bufLen >= strlen(TOPIC_UNSUB_PREFIX)) && (memcmp(pBuf, TOPIC_UNSUB_PREFIX, strlen(TOPIC_UNSUB_PREFIX)) == 0))
+    {
+        prefixLen = strlen(TOPIC_UNSUB_PREFIX);
+    }
+    else
+    {
+        return false;
+    }
+
+    // Subscribe/unsubscribe
+    RdWebConnTopicSubscribeFn topicSubscribeFn = _reqParams.getWebConnTopicSubscribe();
+    if (topicSubscribeFn)
+    {
+        String topicNames;
+        Utils::strFromBuffer(pBuf + prefixLen, bufLen - prefixLen, topicNames);
+        topicSubscribeFn(topicNames, subscribe);
+    }
+    return true;
+}
+
 #endif
@@ -15,9 +15,11 @@
 #include <RdWebRequestParams.h>
 #include <RdWebConnection.h>
 #include <RdWebSocketLink.h>
+#include "RdWebSocketMux.h"
 #include <RdWebDataFrame.h>
 #include <Logger.h>
-#include <ThreadSafeQueue.h>
+#include "RdWebTxQueue.h"
+#include "RdWebTxSlab.h"
 #include "RdWebInterface.h"
 
 class RdWebHandlerWS;
@@ -31,7 +33,8 @@ public:
             const String& reqStr, const RdWebServerSettings& webServerSettings,
             RdWebSocketCanAcceptCB canAcceptMsgCB, RdWebSocketMsgCB sendMsgCB,
             uint32_t channelID, uint32_t packetMaxBytes, uint32_t txQueueSize,
-            uint32_t pingIntervalMs, uint32_t disconnIfNoPongMs);
+            uint32_t pingIntervalMs, uint32_t disconnIfNoPongMs,
+            RdWebSocketStreamMsgCB sendStreamMsgCB = nullptr);
     virtual ~RdWebResponderWS();
 
     // Service - called frequently
@@ -40,6 +43,9 @@ public:
     // Handle inbound data
     virtual bool handleData(const uint8_t* pBuf, uint32_t dataLen) override final;
 
+    // Handle inbound data in a receive buffer which can be modified (frames are unmasked in place)
+    virtual bool handleDataInPlace(uint8_t* pBuf, uint32_t dataLen) override final;
+
     // Start responding
     virtual bool startResponding(RdWebConnection& request) override final;
 
@@ -59,7 +65,14 @@ public:
     }
 
     // Send a frame of data
-    virtual bool sendFrame(const uint8_t* pBuf, uint32_t bufLen) override final;
+    virtual bool sendFrame(const uint8_t* pBuf, uint32_t bufLen, uint32_t channelID) override final;
+
+    // Send a frame of data that has also been encoded (shared with other connections)
+    virtual bool sendFrameEncoded(RdWebDataFrame& encodedFrame, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t channelID) override final;
+
+    // Send a message generated in pieces by a producer
+    virtual bool sendFrameProducer(RdWebSocketTxProducerCB txProducerCB, uint32_t channelID) override final;
 
     // Get responder type
     virtual const char* getResponderType() override final
@@ -74,9 +87,112 @@ public:
         return true;
     }
 
+    // Get all channelIDs (the virtual channels when multiplexed)
+    virtual void getChannelIDs(std::vector<uint32_t>& channelIDs) override final
+    {
+        if (_mux.isEnabled())
+            _mux.getChannelIDs(channelIDs);
+        else
+            channelIDs.push_back(_channelID);
+    }
+
     // Ready for data
     virtual bool readyForData() override final;
 
+    // Ready for data to be sent on a channel
+    virtual bool readyForChannelData(uint32_t channelID) override final;
+
+    // Get stats for a channel as JSON
+    virtual String getChannelStatsJSON(uint32_t channelID) override final
+    {
+        return _mux.isEnabled() ? _mux.getStatsJSON(channelID) : "{}";
+    }
+
+    // Get latency from ping round-trip time (false if no pong has been received)
+    virtual bool getLatencyMs(uint32_t& lastMs, uint32_t& avgMs) override final
+    {
+        lastMs = _webSocketLink.getPingRTTMs();
+        avgMs = _webSocketLink.getPingRTTAvgMs();
+        return _webSocketLink.isPingRTTValid();
+    }
+
+    // Set tx queue policy (applied when the client can't keep up) and function to get the key of a
+    // message for the latest-keyed policy (if no key function is set all messages have the same key)
+    void setTxQueuePolicy(RdWebTxQueuePolicy policy, uint32_t blockMaxMs, RdWebSocketMsgKeyCB txMsgKeyCB)
+    {
+        _txQueue.setup(_txQueue.maxLen(), policy, blockMaxMs);
+        _txMsgKeyCB = txMsgKeyCB;
+    }
+
+    // Get number of tx messages dropped by the tx queue policy
+    uint32_t getTxDropCount()
+    {
+        return _txQueue.getDropCount();
+    }
+
+    // Get number of tx messages replaced by a newer message with the same key (latest-keyed policy)
+    uint32_t getTxReplaceCount()
+    {
+        return _txQueue.getReplaceCount();
+    }
+
+    // Set max size of a message sent with sendFrame() - messages are copied into the tx queue so larger
+    // messages must be sent with sendFrameProducer() (which generates the message in pieces)
+    void setTxMsgMaxBytes(uint32_t txMsgMaxBytes)
+    {
+        _txMsgMaxBytes = txMsgMaxBytes < _packetMaxBytes ? _packetMaxBytes : txMsgMaxBytes;
+    }
+
+    // Set the slab which holds queued tx frames without using the heap - slabBytes is the total size
+    // (0 for no slab) and frames larger than blockBytes use a chain of blocks - frames that don't fit
+    // in the free blocks (e.g. a message larger than the slab or a burst of messages) are put on the heap
+    // so the slab limits the memory preallocated for each connection, not the size of messages
+    void setTxSlab(uint32_t slabBytes, uint32_t blockBytes)
+    {
+        if ((slabBytes == 0) || (blockBytes == 0))
+            return;
+        _txSlab.setup(blockBytes, (slabBytes + blockBytes - 1) / blockBytes);
+    }
+
+    // Get number of tx frames put on the heap because they didn't fit in the slab
+    uint32_t getTxSlabFallbackCount()
+    {
+        return _txSlabFallbackCount;
+    }
+
+    // Default tx slab size and block size
+    static const uint32_t DEFAULT_TX_SLAB_BYTES = 4096;
+    static const uint32_t DEFAULT_TX_SLAB_BLOCK_BYTES = 256;
+
+    // Set time that small frames can be held waiting for others to be sent in the same write
+    void setTxCoalesceMs(uint32_t txCoalesceMs)
+    {
+        _txCoalesceMs = txCoalesceMs;
+    }
+
+    // Enable topic subscription by the client - with the "topics" URL query parameter (comma separated
+    // topic names) and with text messages "SUB:<topics>" and "UNSUB:<topics>" (which are not passed
+    // on to the application - control messages are not recognised when receive is streamed)
+    void setTopicCtrl(bool enable)
+    {
+        _topicCtrlEnabled = enable;
+    }
+
+    // Multiplex virtual channels over the websocket (the "rdmux" sub-protocol) - channelIDs are the
+    // channels of virtual channel indices 0 upwards and credits is the number of messages each side
+    // can send on a virtual channel before credit is returned (0 for no flow control)
+    // Must be called before the responder's channels are registered
+    void setMux(const std::vector<uint32_t>& channelIDs, uint32_t credits)
+    {
+        _mux.setup(channelIDs, credits);
+    }
+
+    // Set permessage-deflate compression (negotiated with the client when responding starts)
+    void setDeflate(bool enable, uint32_t windowBits, bool noContextTakeover, RdWebDeflateStats* pStats)
+    {
+        _webSocketLink.setDeflate(enable, windowBits, noContextTakeover, pStats);
+    }
+
 private:
     // Handler
     RdWebHandlerWS* _pWebHandler;
@@ -87,6 +203,11 @@ private:
     // Websocket callback
     RdWebSocketCB _webSocketCB;
 
+    // Slab holding queued tx frames - declared before the link and tx queue as frames they hold
+    // reference its blocks - frames that don't fit in the free blocks are put on the heap
+    RdWebTxSlab _txSlab;
+    uint32_t _txSlabFallbackCount = 0;
+
     // Websocket link
     RdWebSocketLink _webSocketLink;
 
@@ -96,22 +217,61 @@ private:
     // Send message function
     RdWebSocketMsgCB _sendMsgCB;
 
+    // Send streamed message function (nullptr if messages are not streamed)
+    RdWebSocketStreamMsgCB _sendStreamMsgCB;
+
     // ChannelID
     uint32_t _channelID = UINT32_MAX;
 
     // Vars
     String _requestStr;
 
-    // Queue for sending frames over the web socket
-    ThreadSafeQueue<RdWebDataFrame> _txQueue;
+    // Queue for sending frames over the web socket - frames are put by the application and got in
+    // service() - the queue has no lock between the two sides but it has a single producer because
+    // senders are serialized by the connection manager (with the connection slot's send mutex)
+    RdWebTxQueue<RdWebDataFrame> _txQueue;
+    RdWebSocketMsgKeyCB _txMsgKeyCB;
     static const uint32_t MAX_WAIT_FOR_TX_QUEUE_MS = 2;
 
-    // Max packet size
+    // Message currently being sent in fragments (or waiting to be sent after coalesced frames)
+    RdWebDataFrame _txMsgFrame;
+    bool _txMsgFrameWaiting = false;
+
+    // Small frames are encoded into a buffer and sent in a single write (frames held in a chain of
+    // slab blocks are copied out first)
+    std::vector<uint8_t> _txCoalesceBuffer;
+    std::vector<uint8_t> _txChainedCopyBuffer;
+    uint32_t _txCoalesceStartMs = 0;
+    uint32_t _txCoalesceMs = 0;
+
+    // Producer waiting to send (only one at a time) - it takes turns with sends from the queue
+    RdWebSocketTxProducerCB _txProducerCB;
+    SemaphoreHandle_t _txProducerMutex;
+    bool _txProducerTurn = false;
+    bool startWaitingProducer();
+
+    // Max packet size (messages larger than this are sent in fragments)
     uint32_t _packetMaxBytes = 5000;
 
+    // Max size of a message sent with sendFrame()
+    uint32_t _txMsgMaxBytes = RdWebSocketLink::MAX_WS_MESSAGE_SIZE;
+
+    // Virtual channel multiplexing
+    RdWebSocketMux _mux;
+
+    // Topic subscription control by the client
+    bool _topicCtrlEnabled = false;
+    static constexpr const char* TOPIC_SUB_PREFIX = "SUB:";
+    static constexpr const char* TOPIC_UNSUB_PREFIX = "UNSUB:";
+    bool handleTopicCtrlMsg(const uint8_t* pBuf, uint32_t bufLen);
+
     // Callback on websocket activity
     void webSocketCallback(RdWebSocketEventCode eventCode, const uint8_t* pBuf, uint32_t bufLen);
 
+    // Callback on streamed websocket data
+    void webSocketStreamCallback(RdWebSocketEventCode eventCode, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t msgOffset, bool frameFinal, bool msgFinal);
+
     // Debug
     static const uint32_t MAX_DEBUG_TEXT_STR_LEN = 100;
     static const uint32_t MAX_DEBUG_BIN_HEX_LEN = 50;    
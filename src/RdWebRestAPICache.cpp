@@ -0,0 +1,232 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RdWebRestAPICache.h"
+#include <inttypes.h>
+#include <Logger.h>
+#include <Utils.h>
+#include <ArduinoTime.h>
+
+// #define DEBUG_REST_API_CACHE
+
+#ifdef DEBUG_REST_API_CACHE
+static const char *MODULE_PREFIX = "RdWebRESTCache";
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor / Destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebRestAPICache::RdWebRestAPICache()
+{
+    _maxBytes = DEFAULT_MAX_BYTES;
+    _bytesHeld = 0;
+    _hitCount = 0;
+    _missCount = 0;
+    _cacheMutex = xSemaphoreCreateMutex();
+}
+
+RdWebRestAPICache::~RdWebRestAPICache()
+{
+    if (_cacheMutex)
+        vSemaphoreDelete(_cacheMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set max bytes
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRestAPICache::setMaxBytes(uint32_t maxBytes)
+{
+    if (xSemaphoreTake(_cacheMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    _maxBytes = maxBytes;
+    evictToFit(0);
+    xSemaphoreGive(_cacheMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get a cached response
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebRestAPICache::get(const String& reqStr, String& respStr)
+{
+    // Don't hold up the connection if the cache is busy
+    if (xSemaphoreTake(_cacheMutex, pdMS_TO_TICKS(MAX_WAIT_FOR_CACHE_MUTEX_MS)) != pdTRUE)
+        return false;
+
+    // Check enabled
+    if (_maxBytes == 0)
+    {
+        xSemaphoreGive(_cacheMutex);
+        return false;
+    }
+
+    // Find entry
+    bool found = false;
+    for (auto it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        if (!it->reqStr.equals(reqStr))
+            continue;
+
+        // Check expiry
+        if (Utils::isTimeout(millis(), it->storedMs, it->ttlMs))
+        {
+            _bytesHeld -= it->getSize();
+            _entries.erase(it);
+            break;
+        }
+
+        // Move to front (most recently used)
+        if (it != _entries.begin())
+            _entries.splice(_entries.begin(), _entries, it);
+        respStr = _entries.front().respStr;
+        found = true;
+        break;
+    }
+
+    // Stats - misses are counted when the response is stored as a lookup may be for an endpoint
+    // which can't be cached
+    if (found)
+        _hitCount++;
+    xSemaphoreGive(_cacheMutex);
+
+#ifdef DEBUG_REST_API_CACHE
+    LOG_I(MODULE_PREFIX, "get %s %s bytesHeld %d", reqStr.c_str(), found ? "HIT" : "MISS", _bytesHeld);
+#endif
+    return found;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Store a response
+// Only called for cacheable requests which missed the cache so this is where misses are counted
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRestAPICache::put(const String& reqStr, const String& respStr, uint32_t ttlMs)
+{
+    // Check for anything to do
+    if (ttlMs == 0)
+        return;
+
+    // New entry
+    CacheEntry newEntry;
+    newEntry.reqStr = reqStr;
+    newEntry.respStr = respStr;
+    newEntry.storedMs = millis();
+    newEntry.ttlMs = ttlMs;
+    uint32_t entrySize = newEntry.getSize();
+
+    if (xSemaphoreTake(_cacheMutex, pdMS_TO_TICKS(MAX_WAIT_FOR_CACHE_MUTEX_MS)) != pdTRUE)
+        return;
+
+    // Check enabled and the entry fits
+    if (_maxBytes == 0)
+    {
+        xSemaphoreGive(_cacheMutex);
+        return;
+    }
+    _missCount++;
+    if (entrySize > _maxBytes)
+    {
+        xSemaphoreGive(_cacheMutex);
+        return;
+    }
+
+    // Remove any existing entry for this request
+    for (auto it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        if (it->reqStr.equals(reqStr))
+        {
+            _bytesHeld -= it->getSize();
+            _entries.erase(it);
+            break;
+        }
+    }
+
+    // Make room and add
+    evictToFit(entrySize);
+    _entries.push_front(newEntry);
+    _bytesHeld += entrySize;
+    xSemaphoreGive(_cacheMutex);
+
+#ifdef DEBUG_REST_API_CACHE
+    LOG_I(MODULE_PREFIX, "put %s len %d ttlMs %d bytesHeld %d", reqStr.c_str(), respStr.length(), ttlMs, _bytesHeld);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Invalidate entries
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRestAPICache::invalidate(const String& reqPrefix)
+{
+    if (xSemaphoreTake(_cacheMutex, portMAX_DELAY) != pdTRUE)
+        return;
+    for (auto it = _entries.begin(); it != _entries.end(); )
+    {
+        if (it->reqStr.startsWith(reqPrefix))
+        {
+            _bytesHeld -= it->getSize();
+            it = _entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    xSemaphoreGive(_cacheMutex);
+
+#ifdef DEBUG_REST_API_CACHE
+    LOG_I(MODULE_PREFIX, "invalidate prefix %s bytesHeld %d", reqPrefix.c_str(), _bytesHeld);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String RdWebRestAPICache::getDebugJSON()
+{
+    uint32_t lookups = _hitCount + _missCount;
+    char jsonStr[150];
+    snprintf(jsonStr, sizeof(jsonStr),
+                R"({"hits":%)" PRIu32 R"(,"misses":%)" PRIu32 R"(,"hitPC":%)" PRIu32 R"(,"bytes":%)" PRIu32
+                R"(,"maxBytes":%)" PRIu32 R"(,"entries":%)" PRIu32 "}",
+                _hitCount, _missCount, lookups == 0 ? 0 : (uint32_t)((uint64_t)_hitCount * 100 / lookups),
+                _bytesHeld, _maxBytes, (uint32_t)_entries.size());
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Evict entries to make room - expired entries go first then least recently used
+// Must be called with the mutex held
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebRestAPICache::evictToFit(uint32_t bytesRequired)
+{
+    // Remove expired
+    for (auto it = _entries.begin(); it != _entries.end(); )
+    {
+        if (Utils::isTimeout(millis(), it->storedMs, it->ttlMs))
+        {
+            _bytesHeld -= it->getSize();
+            it = _entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    // Remove least recently used
+    while (!_entries.empty() && (_bytesHeld + bytesRequired > _maxBytes))
+    {
+        _bytesHeld -= _entries.back().getSize();
+        _entries.pop_back();
+    }
+}
@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <list>
+#include <WString.h>
+#ifndef ESP8266
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include "ESP8266Utils.h"
+#endif
+
+// Cache of responses from idempotent REST API endpoints
+// Entries are keyed on the request string and expire after the endpoint's TTL
+class RdWebRestAPICache
+{
+public:
+    RdWebRestAPICache();
+    virtual ~RdWebRestAPICache();
+
+    // Set max bytes held by the cache (0 disables caching)
+    void setMaxBytes(uint32_t maxBytes);
+
+    // Get a cached response - returns false if not present or expired
+    bool get(const String& reqStr, String& respStr);
+
+    // Store a response
+    void put(const String& reqStr, const String& respStr, uint32_t ttlMs);
+
+    // Invalidate entries whose request string starts with reqPrefix (empty prefix invalidates all)
+    void invalidate(const String& reqPrefix);
+
+    // Stats - hits and misses only count lookups of cacheable requests
+    uint32_t getHitCount()
+    {
+        return _hitCount;
+    }
+    uint32_t getMissCount()
+    {
+        return _missCount;
+    }
+    uint32_t getBytesHeld()
+    {
+        return _bytesHeld;
+    }
+    String getDebugJSON();
+
+    // Default max bytes
+    static const uint32_t DEFAULT_MAX_BYTES = 4096;
+
+private:
+    // Cache entry
+    class CacheEntry
+    {
+    public:
+        String reqStr;
+        String respStr;
+        uint32_t storedMs = 0;
+        uint32_t ttlMs = 0;
+        uint32_t getSize() const
+        {
+            return reqStr.length() + respStr.length() + sizeof(CacheEntry);
+        }
+    };
+
+    // Entries - most recently used first
+    std::list<CacheEntry> _entries;
+
+    // Limits and stats
+    uint32_t _maxBytes;
+    uint32_t _bytesHeld;
+    uint32_t _hitCount;
+    uint32_t _missCount;
+
+    // Mutex as invalidation can come from another task
+    SemaphoreHandle_t _cacheMutex;
+    static const uint32_t MAX_WAIT_FOR_CACHE_MUTEX_MS = 2;
+
+    // Helpers
+    void evictToFit(uint32_t bytesRequired);
+};
@@ -0,0 +1,133 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <utility>
+
+// Bounded lock-free queue for a single producer task and a single consumer task
+// Slots are allocated by setMaxLen() (which must be called before the queue is in use) so put()
+// and get() take no lock and don't allocate (other than any copying of the item itself)
+// put() and removeQueued() must only be called by the producer and get(), peek() and clear() only by the consumer - where
+// there are several producer tasks the owner must serialize them (RdWebConnManager does this with a per-connection
+// RdWebSendGate which is a compare-and-swap so a producer which isn't contended takes no lock)
+// count() can be called by either
+template<typename T>
+class RdWebSPSCQueue
+{
+public:
+    RdWebSPSCQueue(uint32_t maxLen = DEFAULT_MAX_LEN)
+    {
+        setMaxLen(maxLen);
+    }
+
+    // Set max length (allocates slots and empties the queue)
+    void setMaxLen(uint32_t maxLen)
+    {
+        // One slot is always empty to distinguish full from empty
+        _slots.clear();
+        _slots.resize(maxLen + 1);
+        _putIdx.store(0, std::memory_order_relaxed);
+        _getIdx.store(0, std::memory_order_relaxed);
+    }
+
+    // Get max length
+    uint32_t maxLen() const
+    {
+        return _slots.size() - 1;
+    }
+
+    // Add item (producer only) - returns false if full
+    bool put(const T& item)
+    {
+        uint32_t putIdx = _putIdx.load(std::memory_order_relaxed);
+        uint32_t nextIdx = advance(putIdx);
+        if (nextIdx == _getIdx.load(std::memory_order_acquire))
+            return false;
+        _slots[putIdx] = item;
+        _putIdx.store(nextIdx, std::memory_order_release);
+        return true;
+    }
+
+    // Remove item (consumer only) - returns false if empty
+    // The slot is left empty so resources held by the item are released by the consumer
+    bool get(T& item)
+    {
+        uint32_t getIdx = _getIdx.load(std::memory_order_relaxed);
+        if (getIdx == _putIdx.load(std::memory_order_acquire))
+            return false;
+        item = std::move(_slots[getIdx]);
+        _slots[getIdx] = T();
+        _getIdx.store(advance(getIdx), std::memory_order_release);
+        return true;
+    }
+
+    // Copy the next item without removing it (consumer only) - returns false if empty
+    bool peek(T& item)
+    {
+        uint32_t getIdx = _getIdx.load(std::memory_order_relaxed);
+        if (getIdx == _putIdx.load(std::memory_order_acquire))
+            return false;
+        item = _slots[getIdx];
+        return true;
+    }
+
+    // Remove the first queued item (from oldest) for which match(item) returns true - later items move
+    // up so the order is kept - returns false if none matched
+    // Only valid if get() can't run at the same time and called by the producer (as put is moved back)
+    template<typename Match>
+    bool removeQueued(Match match)
+    {
+        uint32_t putIdx = _putIdx.load(std::memory_order_acquire);
+        uint32_t idx = _getIdx.load(std::memory_order_acquire);
+        while ((idx != putIdx) && !match(_slots[idx]))
+            idx = advance(idx);
+        if (idx == putIdx)
+            return false;
+        for (uint32_t nextIdx = advance(idx); nextIdx != putIdx; nextIdx = advance(nextIdx))
+        {
+            _slots[idx] = std::move(_slots[nextIdx]);
+            idx = nextIdx;
+        }
+        _slots[idx] = T();
+        _putIdx.store(idx, std::memory_order_release);
+        return true;
+    }
+
+    // Number of items in the queue
+    uint32_t count() const
+    {
+        uint32_t putIdx = _putIdx.load(std::memory_order_acquire);
+        uint32_t getIdx = _getIdx.load(std::memory_order_acquire);
+        return putIdx >= getIdx ? putIdx - getIdx : putIdx + _slots.size() - getIdx;
+    }
+
+    // Remove all items (consumer only)
+    void clear()
+    {
+        T item;
+        while (get(item))
+            ;
+    }
+
+    static const uint32_t DEFAULT_MAX_LEN = 10;
+
+private:
+    // Slots and indices (put is only written by the producer and get only by the consumer)
+    std::vector<T> _slots;
+    std::atomic<uint32_t> _putIdx;
+    std::atomic<uint32_t> _getIdx;
+
+    uint32_t advance(uint32_t idx) const
+    {
+        return (idx + 1 >= _slots.size()) ? 0 : idx + 1;
+    }
+};
@@ -8,30 +8,116 @@
 
 #pragma once
 
-#include <WString.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include "RdWebDataFrame.h"
 
-// SSEvent for tx queue
+// SSEvent message formatting
 class RdWebSSEvent
 {
 public:
-    RdWebSSEvent()
+    // Format an event message into a frame for the tx queue - the formatted message is shared by
+    // copies of the frame so an event can be formatted once and queued on every connection
+    static RdWebDataFrame formatEventFrame(const char* eventContent, const char* eventGroup, uint32_t id)
     {
+        uint32_t contentLen = eventContent ? strlen(eventContent) : 0;
+        uint32_t groupLen = eventGroup ? strlen(eventGroup) : 0;
+        std::shared_ptr<std::vector<uint8_t>> pMsg = std::make_shared<std::vector<uint8_t>>(
+                    formatEvent(nullptr, 0, eventContent, contentLen, eventGroup, groupLen, id));
+        formatEvent(pMsg->data(), pMsg->size(), eventContent, contentLen, eventGroup, groupLen, id);
+        return RdWebDataFrame(pMsg, true);
     }
-    RdWebSSEvent(const char* eventContent, const char* eventGroup)
+
+    // Format an event message (id and event lines followed by a data line for each line of the content)
+    // into pBuf in a single pass with no allocation - lines of the content may end in CR, LF or CRLF
+    // The id line is omitted if id is 0 and the event line if there is no group
+    // Returns the length of the message - if this is more than bufMaxLen only bufMaxLen bytes are
+    // written and the buffer must be enlarged and the message formatted again
+    static uint32_t formatEvent(uint8_t* pBuf, uint32_t bufMaxLen, const char* pContent, uint32_t contentLen,
+                const char* pGroup, uint32_t groupLen, uint32_t id)
     {
-        _content = eventContent;
-        _group = eventGroup;
+        uint32_t msgLen = 0;
+        if (id != 0)
+        {
+            // Digits are generated backwards from the end of the line
+            char idStr[sizeof("id: 4294967295\r\n")];
+            char* pIdStr = idStr + sizeof(idStr) - 1;
+            *--pIdStr = '\n';
+            *--pIdStr = '\r';
+            do
+            {
+                *--pIdStr = '0' + id % 10;
+                id /= 10;
+            } while (id != 0);
+            pIdStr -= sizeof("id: ") - 1;
+            memcpy(pIdStr, "id: ", sizeof("id: ") - 1);
+            appendBytes(pBuf, bufMaxLen, msgLen, pIdStr, idStr + sizeof(idStr) - 1 - pIdStr);
+        }
+        if (groupLen > 0)
+        {
+            appendBytes(pBuf, bufMaxLen, msgLen, "event: ", sizeof("event: ") - 1);
+            appendBytes(pBuf, bufMaxLen, msgLen, pGroup, groupLen);
+            appendBytes(pBuf, bufMaxLen, msgLen, "\r\n", 2);
+        }
+
+        // Data lines (a line break at the end of the content doesn't start another line) - the next CR
+        // and LF are found with memchr and each is only searched for again once passed
+        uint32_t lineStart = 0;
+        uint32_t nextCR = findChar(pContent, contentLen, 0, '\r');
+        uint32_t nextLF = findChar(pContent, contentLen, 0, '\n');
+        do
+        {
+            if (nextCR < lineStart)
+                nextCR = findChar(pContent, contentLen, lineStart, '\r');
+            if (nextLF < lineStart)
+                nextLF = findChar(pContent, contentLen, lineStart, '\n');
+            uint32_t lineEnd = nextCR < nextLF ? nextCR : nextLF;
+            appendBytes(pBuf, bufMaxLen, msgLen, "data: ", sizeof("data: ") - 1);
+            appendBytes(pBuf, bufMaxLen, msgLen, pContent + lineStart, lineEnd - lineStart);
+            appendBytes(pBuf, bufMaxLen, msgLen, "\r\n", 2);
+            lineStart = lineEnd + 1;
+            if ((lineEnd + 1 < contentLen) && (pContent[lineEnd] == '\r') && (pContent[lineEnd + 1] == '\n'))
+                lineStart++;
+        } while (lineStart < contentLen);
+
+        // Blank line ends the event
+        appendBytes(pBuf, bufMaxLen, msgLen, "\r\n", 2);
+        return msgLen;
     }
-    const String& getContent()
+
+    // Key for coalescing queued events - events in the same group have the same key (a hash of the group)
+    // and events with no group have a key which is unique to the event
+    static uint32_t getGroupKey(const char* eventGroup, uint32_t eventID)
     {
-        return _content;
+        if (!eventGroup || (*eventGroup == 0))
+            return eventID | UNGROUPED_KEY_FLAG;
+
+        // FNV-1a hash
+        uint32_t hash = 2166136261UL;
+        for (const char* pCh = eventGroup; *pCh; pCh++)
+            hash = (hash ^ (uint8_t)*pCh) * 16777619UL;
+        return hash & ~UNGROUPED_KEY_FLAG;
     }
-    const String& getGroup()
+
+private:
+    static const uint32_t UNGROUPED_KEY_FLAG = 0x80000000;
+
+    // Position of the next ch at or after startPos (contentLen if none)
+    static uint32_t findChar(const char* pContent, uint32_t contentLen, uint32_t startPos, char ch)
     {
-        return _group;
+        if (startPos >= contentLen)
+            return contentLen;
+        const char* pFound = (const char*)memchr(pContent + startPos, ch, contentLen - startPos);
+        return pFound ? pFound - pContent : contentLen;
     }
 
-private:
-    String _content;
-    String _group;
-};
\ No newline at end of file
+    // Append to a message - msgLen is advanced even when the buffer is full so the length needed is known
+    static void appendBytes(uint8_t* pBuf, uint32_t bufMaxLen, uint32_t& msgLen, const char* pData, uint32_t dataLen)
+    {
+        if (msgLen < bufMaxLen)
+            memcpy(pBuf + msgLen, pData, msgLen + dataLen <= bufMaxLen ? dataLen : bufMaxLen - msgLen);
+        msgLen += dataLen;
+    }
+};
@@ -0,0 +1,105 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include "RdWebDataFrame.h"
+
+// Ring of recent server-side events so events missed by a reconnecting client (which sends the
+// Last-Event-ID header) can be replayed - the ring is bounded by the total size of the formatted
+// messages (which are shared with the connection tx queues so holding them costs no copies)
+// Event IDs are allocated by the ring and increase monotonically from a starting point which setup() picks
+// from a seed (random on each boot) so IDs a client received before a reboot are unlikely to match
+// new events - an ID outside the range allocated since setup() replays the whole ring
+// Not thread-safe - the owner must serialize access
+class RdWebSSEventRing
+{
+public:
+    RdWebSSEventRing()
+    {
+    }
+
+    // Setup (clears the ring) - maxBytes of 0 disables replay
+    // The first ID is in the lower quarter of the range so IDs don't wrap in practice
+    void setup(uint32_t maxBytes, uint32_t eventIDSeed)
+    {
+        _maxBytes = maxBytes;
+        _events.clear();
+        _bytes = 0;
+        _firstEventID = (eventIDSeed & FIRST_EVENT_ID_MASK) + 1;
+        _nextEventID = _firstEventID;
+    }
+
+    // Allocate the ID for a new event
+    uint32_t allocEventID()
+    {
+        uint32_t eventID = _nextEventID++;
+        if (_nextEventID == 0)
+            _nextEventID = 1;
+        return eventID;
+    }
+
+    // Add an event - the oldest events are removed to keep within the size limit
+    void add(uint32_t eventID, const RdWebDataFrame& eventMsg)
+    {
+        if (_maxBytes == 0)
+            return;
+        _events.push_back({eventID, eventMsg});
+        _bytes += _events.back().eventMsg.getLen();
+        while (!_events.empty() && (_bytes > _maxBytes))
+        {
+            _bytes -= _events.front().eventMsg.getLen();
+            _events.pop_front();
+        }
+    }
+
+    // Call fn(eventID, eventMsg) for each event after lastEventID (oldest first)
+    // All events are included if lastEventID wasn't allocated since setup (e.g. before a reboot)
+    template<typename Fn>
+    void forEachAfter(uint32_t lastEventID, Fn fn)
+    {
+        if ((lastEventID < _firstEventID) || (lastEventID >= _nextEventID))
+            lastEventID = 0;
+        for (RingEvent& event : _events)
+        {
+            if (event.eventID > lastEventID)
+                fn(event.eventID, event.eventMsg);
+        }
+    }
+
+    // Number of events and bytes held
+    uint32_t getNumEvents() const
+    {
+        return _events.size();
+    }
+    uint32_t getBytes() const
+    {
+        return _bytes;
+    }
+
+private:
+    // Events (in ID order)
+    class RingEvent
+    {
+    public:
+        uint32_t eventID;
+        RdWebDataFrame eventMsg;
+    };
+    std::deque<RingEvent> _events;
+
+    // Size
+    uint32_t _maxBytes = 0;
+    uint32_t _bytes = 0;
+
+    // First and next event IDs (0 is not used as it means no ID)
+    static const uint32_t FIRST_EVENT_ID_MASK = 0x3fffffff;
+    uint32_t _firstEventID = 1;
+    uint32_t _nextEventID = 1;
+};
@@ -0,0 +1,66 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Gate serializing the tasks which send to a connection slot without a mutex - a sender acquires the gate
+// with a single compare-and-swap which fails if another sender holds it or if the generation has changed
+// (the generation is advanced when the slot's responder is removed so a sender which found the slot
+// earlier can't send to a later responder)
+class RdWebSendGate
+{
+public:
+    enum AcquireResult
+    {
+        GATE_ACQUIRED,
+        GATE_HELD,
+        GATE_GEN_CHANGED
+    };
+
+    // Current generation (only the low GEN_BITS are kept)
+    uint32_t getGen() const
+    {
+        return (_gate.load(std::memory_order_acquire) >> 1) & GEN_MASK;
+    }
+
+    // Try to acquire for sending to the responder of generation gen
+    AcquireResult tryAcquire(uint32_t gen)
+    {
+        uint32_t expected = (gen & GEN_MASK) << 1;
+        if (_gate.compare_exchange_strong(expected, expected | BUSY_BIT, std::memory_order_acquire,
+                    std::memory_order_relaxed))
+            return GATE_ACQUIRED;
+        return ((expected >> 1) & GEN_MASK) == (gen & GEN_MASK) ? GATE_HELD : GATE_GEN_CHANGED;
+    }
+
+    // Release (by the sender which acquired)
+    void release()
+    {
+        _gate.fetch_and(~BUSY_BIT, std::memory_order_release);
+    }
+
+    // Advance the generation - fails if a sender holds the gate
+    bool tryAdvanceGen()
+    {
+        uint32_t cur = _gate.load(std::memory_order_relaxed);
+        if (cur & BUSY_BIT)
+            return false;
+        uint32_t next = ((((cur >> 1) + 1) & GEN_MASK) << 1);
+        return _gate.compare_exchange_strong(cur, next, std::memory_order_acq_rel, std::memory_order_relaxed);
+    }
+
+    static const uint32_t GEN_BITS = 24;
+    static const uint32_t GEN_MASK = (1 << GEN_BITS) - 1;
+
+private:
+    static const uint32_t BUSY_BIT = 1;
+    std::atomic<uint32_t> _gate{0};
+};
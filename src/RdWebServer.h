@@ -34,22 +34,80 @@ public:
     // Handler
     bool addHandler(RdWebHandler* pHandler);
 
-    // Check if channel can send
+    // Check if channel can send - noConn is set if the channel doesn't exist (so messages can be discarded)
     bool canSend(uint32_t channelID, bool& noConn)
     {
         return _connManager.canSend(channelID, noConn);
     }
 
-    // Send message on a channel
+    // Get send status of a channel - distinguishes a full tx queue and a lock timeout (both should be
+    // retried) from a channel that doesn't exist
+    RdWebChannelSendStatus getChannelSendStatus(uint32_t channelID)
+    {
+        return _connManager.getChannelSendStatus(channelID);
+    }
+
+    // Get latency of a channel in ms - last and smoothed average (websocket ping round-trip time)
+    // Returns false if the channel doesn't exist or has no latency measurement yet
+    bool getChannelLatencyMs(uint32_t channelID, uint32_t& lastMs, uint32_t& avgMs)
+    {
+        return _connManager.getChannelLatencyMs(channelID, lastMs, avgMs);
+    }
+
+    // Get stats of a channel as JSON (e.g. virtual channel traffic and flow control)
+    String getChannelStatsJSON(uint32_t channelID)
+    {
+        return _connManager.getChannelStatsJSON(channelID);
+    }
+
+    // Send message on a channel - the message is copied so websocket messages are limited in size (by the
+    // handler's txMsgMaxBytes config) and larger messages must be sent with sendMsgProducer()
     bool sendMsg(const uint8_t* pBuf, uint32_t bufLen, 
                 bool allChannels, uint32_t channelID)
     {
         return _connManager.sendMsg(pBuf, bufLen, allChannels, channelID);
     }
 
+    // Send a message on a channel with the content generated in fragments by a producer
+    // (so the message doesn't need to be held in memory) - the producer is called from the server task
+    bool sendMsgProducer(RdWebSocketTxProducerCB txProducerCB, uint32_t channelID)
+    {
+        return _connManager.sendMsgProducer(txProducerCB, channelID);
+    }
+
     // Send to all server-side events
     void serverSideEventsSendMsg(const char* eventContent, const char* eventGroup);
 
+    // Get stats of server-side events connections (JSON array with queue, drop and coalesce counts)
+    String serverSideEventsGetStatsJSON()
+    {
+        return _connManager.serverSideEventsGetStatsJSON();
+    }
+
+    // Number of messages (or events) not sent to a connection because a lock wasn't obtained in time
+    uint32_t getLockTimeoutDropCount() const
+    {
+        return _connManager.getLockTimeoutDropCount();
+    }
+
+    // Add a publish/subscribe topic (before or after setup) - returns the topic index which can be used to
+    // publish (RdWebTopics::TOPIC_IDX_INVALID if the topic couldn't be added because the server was busy)
+    // Websocket clients subscribe to topics when the handler's "topics" config is set
+    uint32_t addTopic(const String& topicName)
+    {
+        return _connManager.addTopic(topicName);
+    }
+
+    // Publish a message on the channels subscribed to a topic
+    bool publish(uint32_t topicIdx, const uint8_t* pBuf, uint32_t bufLen)
+    {
+        return _connManager.publish(topicIdx, pBuf, bufLen);
+    }
+    bool publish(const String& topicName, const uint8_t* pBuf, uint32_t bufLen)
+    {
+        return _connManager.publish(topicName, pBuf, bufLen);
+    }
+
 private:
 
 #ifndef ESP8266
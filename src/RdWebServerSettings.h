@@ -24,6 +24,10 @@ public:
     // Send buffer max length
     static const int DEFAULT_SEND_BUFFER_MAX_LEN = 1000;
 
+    // Server-side events replay ring size and client reconnect delay
+    static const int DEFAULT_SSE_REPLAY_MAX_BYTES = 4096;
+    static const int DEFAULT_SSE_RETRY_MS = 3000;
+
     RdWebServerSettings()
     {
         _serverTCPPort = DEFAULT_HTTP_PORT;
@@ -35,13 +39,17 @@ public:
         _taskStackSize = DEFAULT_TASK_SIZE_BYTES;
         _sendBufferMaxLen = DEFAULT_SEND_BUFFER_MAX_LEN;
         _restAPIChannelID = UINT32_MAX;
+        _sseReplayMaxBytes = DEFAULT_SSE_REPLAY_MAX_BYTES;
+        _sseRetryMs = DEFAULT_SSE_RETRY_MS;
     }
 
     RdWebServerSettings(int port, uint32_t connSlots, bool wsEnable, 
             bool enableFileServer, uint32_t taskCore,
             uint32_t taskPriority, uint32_t taskStackSize,
             uint32_t sendBufferMaxLen,
-            uint32_t restAPIChannelID)
+            uint32_t restAPIChannelID,
+            uint32_t sseReplayMaxBytes = DEFAULT_SSE_REPLAY_MAX_BYTES,
+            uint32_t sseRetryMs = DEFAULT_SSE_RETRY_MS)
     {
         _serverTCPPort = port;
         _numConnSlots = connSlots;
@@ -52,6 +60,8 @@ public:
         _taskStackSize = taskStackSize;
         _sendBufferMaxLen = sendBufferMaxLen;
         _restAPIChannelID = restAPIChannelID;
+        _sseReplayMaxBytes = sseReplayMaxBytes;
+        _sseRetryMs = sseRetryMs;
     }
 
     // TCP port of server
@@ -76,4 +86,9 @@ public:
 
     // Channel ID for REST API
     uint32_t _restAPIChannelID;
+
+    // Server-side events replay ring size (bytes of recent events kept for replay to reconnecting
+    // clients - 0 to disable) and the delay before a client reconnects (sent in the retry field)
+    uint32_t _sseReplayMaxBytes;
+    uint32_t _sseRetryMs;
 };
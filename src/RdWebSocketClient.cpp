@@ -0,0 +1,751 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ESP8266
+
+#include "RdWebSocketClient.h"
+#include <Utils.h>
+#include <ArduinoTime.h>
+#include <Logger.h>
+#include "RdWebSocketPlatform.h"
+
+static const char *MODULE_PREFIX = "RdWSClient";
+
+// Warn
+#define WARN_WS_CLIENT_CONN_FAIL
+#define WARN_WS_CLIENT_UPGRADE_FAIL
+
+// Debug
+// #define DEBUG_WS_CLIENT_STATE
+// #define DEBUG_WS_CLIENT_UPGRADE
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor / Destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebSocketClient::RdWebSocketClient()
+{
+    _connState = WS_CLIENT_IDLE;
+    _connStateMs = 0;
+    _port = 0;
+    _serverIPAddr = 0;
+    _resolveRequired = true;
+    _socket = -1;
+    _webSocketCB = nullptr;
+    _pingIntervalMs = 0;
+    _disconnIfNoPongMs = 0;
+    _closeRxd = false;
+    _reconnectMinMs = DEFAULT_RECONNECT_MIN_MS;
+    _reconnectMaxMs = DEFAULT_RECONNECT_MAX_MS;
+    _reconnectDelayMs = DEFAULT_RECONNECT_MIN_MS;
+    _reconnectWaitMs = 0;
+    _txMsgSent = false;
+    _sendFailed = false;
+    _txSocketProgressMs = 0;
+    _connectCount = 0;
+    _connectFailCount = 0;
+}
+
+RdWebSocketClient::~RdWebSocketClient()
+{
+    closeSocket();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketClient::setup(const String& wsURL, RdWebSocketCB webSocketCB, uint32_t pingIntervalMs,
+                uint32_t disconnIfNoPongMs, uint32_t txQueueMaxLen, uint32_t reconnectMinMs, uint32_t reconnectMaxMs)
+{
+    // Close any existing link
+    close();
+
+    // Only plain websockets are supported
+    static const char WS_URL_PREFIX[] = "ws://";
+    if (!wsURL.startsWith(WS_URL_PREFIX))
+    {
+        LOG_W(MODULE_PREFIX, "setup unsupported URL %s", wsURL.c_str());
+        return false;
+    }
+
+    // Split into host, port and path
+    String hostPort = wsURL.substring(sizeof(WS_URL_PREFIX) - 1);
+    int pathPos = hostPort.indexOf('/');
+    _path = "/";
+    if (pathPos >= 0)
+    {
+        _path = hostPort.substring(pathPos);
+        hostPort = hostPort.substring(0, pathPos);
+    }
+    int colonPos = hostPort.indexOf(':');
+    _host = hostPort;
+    _port = 80;
+    if (colonPos >= 0)
+    {
+        _host = hostPort.substring(0, colonPos);
+        _port = hostPort.substring(colonPos + 1).toInt();
+    }
+    if ((_host.length() == 0) || (_port == 0))
+    {
+        LOG_W(MODULE_PREFIX, "setup invalid URL %s", wsURL.c_str());
+        return false;
+    }
+
+    // A numeric address is never resolved - a name is resolved when first connecting
+    struct in_addr hostAddr;
+    _resolveRequired = inet_pton(AF_INET, _host.c_str(), &hostAddr) != 1;
+    _serverIPAddr = _resolveRequired ? 0 : hostAddr.s_addr;
+
+    // Settings
+    _webSocketCB = webSocketCB;
+    _pingIntervalMs = pingIntervalMs;
+    _disconnIfNoPongMs = disconnIfNoPongMs;
+    _reconnectMinMs = reconnectMinMs > 0 ? reconnectMinMs : DEFAULT_RECONNECT_MIN_MS;
+    _reconnectMaxMs = reconnectMaxMs > _reconnectMinMs ? reconnectMaxMs : _reconnectMinMs;
+    _reconnectDelayMs = _reconnectMinMs;
+
+    // Messages queued while the link is down are dropped oldest first
+    _txQueue.setup(txQueueMaxLen, TX_QUEUE_POLICY_DROP_OLDEST, 0);
+
+    // Connect on next service
+    _reconnectWaitMs = 0;
+    setConnState(WS_CLIENT_WAIT_RECONNECT);
+    LOG_I(MODULE_PREFIX, "setup host %s port %d path %s", _host.c_str(), _port, _path.c_str());
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::service()
+{
+    switch (_connState)
+    {
+        case WS_CLIENT_WAIT_RECONNECT:
+        {
+            if (!Utils::isTimeout(millis(), _connStateMs, _reconnectWaitMs))
+                break;
+            if (!startConnect())
+                disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+            break;
+        }
+        case WS_CLIENT_CONNECTING:
+            serviceConnecting();
+            break;
+        case WS_CLIENT_UPGRADING:
+            serviceUpgrading();
+            break;
+        case WS_CLIENT_CONNECTED:
+            serviceConnected();
+            break;
+        default:
+            break;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send message
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketClient::sendMsg(const uint8_t* pBuf, uint32_t bufLen, bool isText)
+{
+    if (_connState == WS_CLIENT_IDLE)
+        return false;
+
+    // Queue the opcode and message
+    std::shared_ptr<std::vector<uint8_t>> pMsg = std::make_shared<std::vector<uint8_t>>(bufLen + 1);
+    (*pMsg)[0] = isText ? WEBSOCKET_OPCODE_TEXT : WEBSOCKET_OPCODE_BINARY;
+    if (bufLen > 0)
+        memcpy(pMsg->data() + 1, pBuf, bufLen);
+    return _txQueue.put(pMsg);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Close
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::close()
+{
+    bool wasConnected = _connState == WS_CLIENT_CONNECTED;
+    if (wasConnected && _pWebSocketLink)
+    {
+        uint8_t closeCode[2] = {0x03, 0xe8};
+        _pWebSocketLink->sendMsg(WEBSOCKET_OPCODE_CLOSE, closeCode, sizeof(closeCode));
+    }
+    closeSocket();
+    _pTxMsg.reset();
+    setConnState(WS_CLIENT_IDLE);
+    if (wasConnected && _webSocketCB)
+        _webSocketCB(WEBSOCKET_EVENT_DISCONNECT_INTERNAL, nullptr, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Stats
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String RdWebSocketClient::getStatsJSON()
+{
+    char jsonStr[200];
+    snprintf(jsonStr, sizeof(jsonStr),
+                R"({"conn":%d,"connects":%d,"fails":%d,"backoffMs":%d,"txQ":%d,"txDrop":%d,"rttMs":%d})",
+                isConnected() ? 1 : 0, _connectCount, _connectFailCount, _reconnectDelayMs,
+                _txQueue.count(), _txQueue.getDropCount(),
+                _pWebSocketLink ? _pWebSocketLink->getPingRTTAvgMs() : 0);
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Start connecting - the TCP connection is made without blocking but name resolution blocks (it is only
+// done when there is no address from an earlier connection)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketClient::startConnect()
+{
+    // Resolve host
+    if (_resolveRequired)
+    {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* pAddrInfo = nullptr;
+        if ((getaddrinfo(_host.c_str(), nullptr, &hints, &pAddrInfo) != 0) || !pAddrInfo)
+        {
+#ifdef WARN_WS_CLIENT_CONN_FAIL
+            LOG_W(MODULE_PREFIX, "startConnect failed to resolve %s", _host.c_str());
+#endif
+            return false;
+        }
+        _serverIPAddr = ((struct sockaddr_in*)pAddrInfo->ai_addr)->sin_addr.s_addr;
+        _resolveRequired = false;
+        freeaddrinfo(pAddrInfo);
+    }
+
+    // Create non-blocking socket
+    _socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (_socket < 0)
+    {
+        LOG_E(MODULE_PREFIX, "startConnect failed to create socket errno %d", errno);
+        return false;
+    }
+    int flags = fcntl(_socket, F_GETFL, 0);
+    if (flags != -1)
+        fcntl(_socket, F_SETFL, flags | O_NONBLOCK);
+
+    // Connect
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(_port);
+    serverAddr.sin_addr.s_addr = _serverIPAddr;
+    int rslt = connect(_socket, (struct sockaddr*)&serverAddr, sizeof(serverAddr));
+    if (rslt == 0)
+        return sendUpgradeReq();
+    if (errno != EINPROGRESS)
+    {
+#ifdef WARN_WS_CLIENT_CONN_FAIL
+        LOG_W(MODULE_PREFIX, "startConnect connect failed errno %d", errno);
+#endif
+        connectFailed();
+        return false;
+    }
+    setConnState(WS_CLIENT_CONNECTING);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TCP connection failed - the server may have moved so a name is resolved again on the next attempt
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::connectFailed()
+{
+    struct in_addr hostAddr;
+    if (inet_pton(AF_INET, _host.c_str(), &hostAddr) != 1)
+        _resolveRequired = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service connecting - wait for the socket to be writable
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::serviceConnecting()
+{
+    fd_set writeSet;
+    FD_ZERO(&writeSet);
+    FD_SET(_socket, &writeSet);
+    struct timeval timeout = {0, 0};
+    int rslt = select(_socket + 1, nullptr, &writeSet, nullptr, &timeout);
+    if (rslt == 0)
+    {
+        if (Utils::isTimeout(millis(), _connStateMs, CONNECT_TIMEOUT_MS))
+        {
+#ifdef WARN_WS_CLIENT_CONN_FAIL
+            LOG_W(MODULE_PREFIX, "serviceConnecting timed-out host %s port %d", _host.c_str(), _port);
+#endif
+            connectFailed();
+            disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        }
+        return;
+    }
+
+    // Check result of connect
+    int sockErr = 0;
+    socklen_t sockErrLen = sizeof(sockErr);
+    if ((rslt < 0) || (getsockopt(_socket, SOL_SOCKET, SO_ERROR, &sockErr, &sockErrLen) != 0) || (sockErr != 0))
+    {
+#ifdef WARN_WS_CLIENT_CONN_FAIL
+        LOG_W(MODULE_PREFIX, "serviceConnecting failed host %s port %d errno %d", _host.c_str(), _port,
+                    sockErr != 0 ? sockErr : errno);
+#endif
+        connectFailed();
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        return;
+    }
+    if (!sendUpgradeReq())
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send upgrade request with a new random key
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketClient::sendUpgradeReq()
+{
+    // Key is 16 random bytes base64 encoded
+    static const uint32_t WS_KEY_BYTES = 16;
+    uint8_t keyBytes[WS_KEY_BYTES];
+    for (uint32_t i = 0; i < WS_KEY_BYTES; i += sizeof(uint32_t))
+    {
+        uint32_t randVal = RdWebSocketPlatform::random32();
+        memcpy(keyBytes + i, &randVal, sizeof(randVal));
+    }
+    char keyBase64[WS_KEY_BYTES * 2];
+    uint32_t keyBase64Len = 0;
+    if (!RdWebSocketPlatform::base64Encode(keyBytes, WS_KEY_BYTES, keyBase64, sizeof(keyBase64), keyBase64Len))
+        return false;
+    _wsKey = keyBase64;
+    _wsAcceptExpected = RdWebSocketLink::genMagicResponse(_wsKey, "13");
+
+    // Form request
+    String reqStr = "GET " + _path + " HTTP/1.1\r\n"
+                "Host: " + _host + ":" + String(_port) + "\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Key: " + _wsKey + "\r\n"
+                "Sec-WebSocket-Version: 13\r\n"
+                "\r\n";
+#ifdef DEBUG_WS_CLIENT_UPGRADE
+    LOG_I(MODULE_PREFIX, "sendUpgradeReq %s", reqStr.c_str());
+#endif
+
+    // Send
+    _upgradeRespBuf.clear();
+    if (rawSend((const uint8_t*)reqStr.c_str(), reqStr.length(), 0) == WEB_CONN_SEND_FAIL)
+        return false;
+    setConnState(WS_CLIENT_UPGRADING);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service upgrading - wait for the upgrade response
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::serviceUpgrading()
+{
+    // Send any part of the request the socket didn't accept
+    if (!flushTxSocketBuf())
+    {
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        return;
+    }
+
+    // Get data
+    uint8_t rxBuf[RX_BUFFER_LEN];
+    int rxLen = recv(_socket, rxBuf, sizeof(rxBuf), MSG_DONTWAIT);
+    if (rxLen < 0)
+    {
+        if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
+        {
+            disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+            return;
+        }
+        rxLen = 0;
+    }
+    else if (rxLen == 0)
+    {
+#ifdef WARN_WS_CLIENT_UPGRADE_FAIL
+        LOG_W(MODULE_PREFIX, "serviceUpgrading closed by server");
+#endif
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        return;
+    }
+    _upgradeRespBuf.insert(_upgradeRespBuf.end(), rxBuf, rxBuf + rxLen);
+
+    // Check for end of response header
+    static const uint8_t HTTP_HEADER_END[] = "\r\n\r\n";
+    int hdrEndPos = Utils::findInBuf(_upgradeRespBuf.data(), _upgradeRespBuf.size(),
+                HTTP_HEADER_END, sizeof(HTTP_HEADER_END) - 1);
+    if (hdrEndPos < 0)
+    {
+        if ((_upgradeRespBuf.size() > UPGRADE_RESP_MAX_LEN) || Utils::isTimeout(millis(), _connStateMs, UPGRADE_TIMEOUT_MS))
+        {
+#ifdef WARN_WS_CLIENT_UPGRADE_FAIL
+            LOG_W(MODULE_PREFIX, "serviceUpgrading no valid response len %d", _upgradeRespBuf.size());
+#endif
+            disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        }
+        return;
+    }
+    uint32_t respLen = hdrEndPos + sizeof(HTTP_HEADER_END) - 1;
+    if (!checkUpgradeResp(respLen))
+    {
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        return;
+    }
+
+    // Create the link - client links mask sent data
+    _closeRxd = false;
+    _sendFailed = false;
+    _txMsgSent = false;
+    _pWebSocketLink.reset(new RdWebSocketLink());
+    _pWebSocketLink->setup(
+                std::bind(&RdWebSocketClient::onWebSocketEvent, this,
+                        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                std::bind(&RdWebSocketClient::rawSend, this,
+                        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                nullptr, nullptr, _pingIntervalMs, false, _disconnIfNoPongMs, TX_FRAGMENT_MAX_BYTES);
+    _pWebSocketLink->upgradeComplete();
+
+    // Connected
+    setConnState(WS_CLIENT_CONNECTED);
+    _connectCount++;
+    _reconnectDelayMs = _reconnectMinMs;
+    if (_webSocketCB)
+        _webSocketCB(WEBSOCKET_EVENT_CONNECT, nullptr, 0);
+
+    // Handle any frames received with the response
+    if (_upgradeRespBuf.size() > respLen)
+        _pWebSocketLink->handleRxData(_upgradeRespBuf.data() + respLen, _upgradeRespBuf.size() - respLen);
+    _upgradeRespBuf.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check upgrade response - status must be 101, Upgrade must be websocket, Connection must include upgrade
+// and Sec-WebSocket-Accept must match the key sent
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketClient::checkUpgradeResp(uint32_t respLen)
+{
+    String respStr;
+    Utils::strFromBuffer(_upgradeRespBuf.data(), respLen, respStr, false);
+#ifdef DEBUG_WS_CLIENT_UPGRADE
+    LOG_I(MODULE_PREFIX, "checkUpgradeResp %s", respStr.c_str());
+#endif
+
+    // Status line
+    static const char HTTP_STATUS_SWITCHING[] = "HTTP/1.1 101";
+    if (!respStr.startsWith(HTTP_STATUS_SWITCHING))
+    {
+#ifdef WARN_WS_CLIENT_UPGRADE_FAIL
+        LOG_W(MODULE_PREFIX, "checkUpgradeResp not switching protocols %s",
+                    respStr.substring(0, respStr.indexOf('\r')).c_str());
+#endif
+        return false;
+    }
+
+    // Check headers (header names and the Upgrade and Connection values are case-insensitive)
+    bool upgradeOk = false;
+    bool connectionOk = false;
+    bool acceptOk = false;
+    int lineStart = respStr.indexOf('\n') + 1;
+    while (lineStart > 0)
+    {
+        int lineEnd = respStr.indexOf('\n', lineStart);
+        String lineStr = lineEnd < 0 ? respStr.substring(lineStart) : respStr.substring(lineStart, lineEnd);
+        int colonPos = lineStr.indexOf(':');
+        if (colonPos > 0)
+        {
+            String nameStr = lineStr.substring(0, colonPos);
+            nameStr.trim();
+            String valueStr = lineStr.substring(colonPos + 1);
+            valueStr.trim();
+            if (nameStr.equalsIgnoreCase("Upgrade"))
+            {
+                upgradeOk = valueStr.equalsIgnoreCase("websocket");
+            }
+            else if (nameStr.equalsIgnoreCase("Connection"))
+            {
+                // Connection is a comma separated list of tokens
+                valueStr.toLowerCase();
+                int tokStart = 0;
+                while (tokStart >= 0)
+                {
+                    int tokEnd = valueStr.indexOf(',', tokStart);
+                    String tokStr = tokEnd < 0 ? valueStr.substring(tokStart) : valueStr.substring(tokStart, tokEnd);
+                    tokStr.trim();
+                    if (tokStr.equals("upgrade"))
+                        connectionOk = true;
+                    tokStart = tokEnd < 0 ? -1 : tokEnd + 1;
+                }
+            }
+            else if (nameStr.equalsIgnoreCase("Sec-WebSocket-Accept"))
+            {
+                acceptOk = valueStr.equals(_wsAcceptExpected);
+#ifdef WARN_WS_CLIENT_UPGRADE_FAIL
+                if (!acceptOk)
+                    LOG_W(MODULE_PREFIX, "checkUpgradeResp accept mismatch %s expected %s",
+                                valueStr.c_str(), _wsAcceptExpected.c_str());
+#endif
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+#ifdef WARN_WS_CLIENT_UPGRADE_FAIL
+    if (!upgradeOk || !connectionOk || !acceptOk)
+        LOG_W(MODULE_PREFIX, "checkUpgradeResp invalid headers upgrade %s connection %s accept %s",
+                    upgradeOk ? "Y" : "N", connectionOk ? "Y" : "N", acceptOk ? "Y" : "N");
+#endif
+    return upgradeOk && connectionOk && acceptOk;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service connected
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::serviceConnected()
+{
+    // Handle received data
+    uint8_t rxBuf[RX_BUFFER_LEN];
+    int rxLen = recv(_socket, rxBuf, sizeof(rxBuf), MSG_DONTWAIT);
+    if (rxLen > 0)
+    {
+        _pWebSocketLink->handleRxDataInPlace(rxBuf, rxLen);
+    }
+    else if (rxLen == 0)
+    {
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_EXTERNAL);
+        return;
+    }
+    else if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
+    {
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        return;
+    }
+
+    // Send data the socket didn't accept earlier
+    if (!flushTxSocketBuf())
+    {
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        return;
+    }
+    if (!_txSocketBuf.empty() && Utils::isTimeout(millis(), _txSocketProgressMs, TX_SOCKET_STALL_TIMEOUT_MS))
+    {
+#ifdef WARN_WS_CLIENT_CONN_FAIL
+        LOG_W(MODULE_PREFIX, "serviceConnected send stalled with %d bytes waiting", _txSocketBuf.size());
+#endif
+        disconnect(WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        return;
+    }
+
+    // Service the link (pings and fragments of messages being sent) - fragments are held back while
+    // the socket is still draining so they aren't generated faster than it accepts them
+    if (_txSocketBuf.empty() || !_pWebSocketLink->isTxMsgInProgress())
+        _pWebSocketLink->service();
+    if (!_pWebSocketLink->isActive() || _sendFailed)
+    {
+        disconnect(_closeRxd ? WEBSOCKET_EVENT_DISCONNECT_EXTERNAL : WEBSOCKET_EVENT_DISCONNECT_ERROR);
+        return;
+    }
+
+    // Send queued messages
+    if (_txSocketBuf.empty())
+        serviceTx();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send queued messages - one message at a time (large messages are sent in fragments by the link)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::serviceTx()
+{
+    // Check if the current message is complete
+    if (_pWebSocketLink->isTxMsgInProgress())
+        return;
+    if (_txMsgSent)
+    {
+        _pTxMsg.reset();
+        _txMsgSent = false;
+    }
+
+    // Get next message
+    if (!_pTxMsg && !_txQueue.get(_pTxMsg))
+        return;
+
+    // Send - the message is kept and retried if it can't be sent
+    WebSocketOpCodes opCode = (WebSocketOpCodes)(*_pTxMsg)[0];
+    const uint8_t* pBuf = _pTxMsg->data() + 1;
+    uint32_t bufLen = _pTxMsg->size() - 1;
+    if (bufLen <= _pWebSocketLink->getTxFragmentMaxBytes())
+        _txMsgSent = _pWebSocketLink->sendMsg(opCode, pBuf, bufLen);
+    else
+        _txMsgSent = _pWebSocketLink->sendMsgFragmented(opCode, pBuf, bufLen);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Disconnect and wait to reconnect
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::disconnect(RdWebSocketEventCode eventCode)
+{
+    bool wasConnected = _connState == WS_CLIENT_CONNECTED;
+    closeSocket();
+
+    // A message which wasn't completely sent is sent again from the start after reconnecting
+    _txMsgSent = false;
+
+    // Backoff doubles on each failure with jitter so clients don't reconnect in step
+    if (!wasConnected)
+        _connectFailCount++;
+    _reconnectWaitMs = _reconnectDelayMs + RdWebSocketPlatform::random32() % (_reconnectDelayMs / 4 + 1);
+    _reconnectDelayMs = _reconnectDelayMs * 2 < _reconnectMaxMs ? _reconnectDelayMs * 2 : _reconnectMaxMs;
+    setConnState(WS_CLIENT_WAIT_RECONNECT);
+#ifdef WARN_WS_CLIENT_CONN_FAIL
+    LOG_W(MODULE_PREFIX, "disconnect %s reconnect in %dms", RdWebSocketLink::getEventStr(eventCode), _reconnectWaitMs);
+#endif
+
+    // Callback
+    if (wasConnected && _webSocketCB)
+        _webSocketCB(eventCode, nullptr, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Close socket and link
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::closeSocket()
+{
+    if (_socket >= 0)
+        ::close(_socket);
+    _socket = -1;
+    _pWebSocketLink.reset();
+    _upgradeRespBuf.clear();
+    _txSocketBuf.clear();
+    _txSocketBuf.shrink_to_fit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set connection state
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::setConnState(ConnState connState)
+{
+#ifdef DEBUG_WS_CLIENT_STATE
+    LOG_I(MODULE_PREFIX, "setConnState %d -> %d", _connState, connState);
+#endif
+    _connState = connState;
+    _connStateMs = millis();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send on socket - never blocks (maxRetryMs is unused) - anything the socket doesn't accept is kept and
+// written by later calls or by service() and EAGAIN is returned to indicate it will be sent later
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebConnSendRetVal RdWebSocketClient::rawSend(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxRetryMs)
+{
+    if (_socket < 0)
+        return WEB_CONN_SEND_FAIL;
+
+    // Data already waiting must go first
+    if (!flushTxSocketBuf())
+        return WEB_CONN_SEND_FAIL;
+
+    // Send directly if nothing is waiting
+    uint32_t sentLen = 0;
+    if (_txSocketBuf.empty())
+    {
+        int rslt = send(_socket, pBuf, bufLen, MSG_DONTWAIT);
+        if (rslt < 0)
+        {
+            if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
+            {
+                _sendFailed = true;
+                return WEB_CONN_SEND_FAIL;
+            }
+            rslt = 0;
+        }
+        sentLen = rslt;
+        if (sentLen >= bufLen)
+            return WEB_CONN_SEND_OK;
+        _txSocketProgressMs = millis();
+    }
+
+    // Keep the remainder - if there is no room the stream can't be continued
+    uint32_t curLen = _txSocketBuf.size();
+    if (curLen + bufLen - sentLen > TX_SOCKET_BUF_MAX_BYTES)
+    {
+#ifdef WARN_WS_CLIENT_CONN_FAIL
+        LOG_W(MODULE_PREFIX, "rawSend overflow waiting %d adding %d max %d", curLen, bufLen - sentLen, TX_SOCKET_BUF_MAX_BYTES);
+#endif
+        _sendFailed = true;
+        return WEB_CONN_SEND_FAIL;
+    }
+    _txSocketBuf.insert(_txSocketBuf.end(), pBuf + sentLen, pBuf + bufLen);
+    return WEB_CONN_SEND_EAGAIN;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Write as much of the waiting data as the socket will accept - returns false on socket error
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketClient::flushTxSocketBuf()
+{
+    if (_txSocketBuf.empty())
+        return true;
+    if (_socket < 0)
+        return false;
+    int rslt = send(_socket, _txSocketBuf.data(), _txSocketBuf.size(), MSG_DONTWAIT);
+    if (rslt < 0)
+    {
+        if ((errno == EWOULDBLOCK) || (errno == EAGAIN))
+            return true;
+        _sendFailed = true;
+        return false;
+    }
+    if (rslt > 0)
+    {
+        _txSocketBuf.erase(_txSocketBuf.begin(), _txSocketBuf.begin() + rslt);
+        _txSocketProgressMs = millis();
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle link events
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketClient::onWebSocketEvent(RdWebSocketEventCode eventCode, const uint8_t* pBuf, uint32_t bufLen)
+{
+    // Disconnection is reported when the link is serviced
+    switch (eventCode)
+    {
+        case WEBSOCKET_EVENT_DISCONNECT_EXTERNAL:
+        case WEBSOCKET_EVENT_DISCONNECT_INTERNAL:
+        case WEBSOCKET_EVENT_DISCONNECT_ERROR:
+            _closeRxd = true;
+            break;
+        default:
+            if (_webSocketCB)
+                _webSocketCB(eventCode, pBuf, bufLen);
+            break;
+    }
+}
+
+#endif
@@ -0,0 +1,151 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef ESP8266
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <WString.h>
+#include "RdWebSocketLink.h"
+#include "RdWebTxQueue.h"
+
+// WebSocket client - keeps a persistent link to an upstream server (e.g. for telemetry)
+// The connection is made (and re-made after failures with exponential backoff) by service() which must
+// be called frequently - messages sent while the link is down are queued and sent when it reconnects
+// service() doesn't block except to resolve the server's name (getaddrinfo) which is done on the first
+// connection attempt and again only after a TCP connection fails - a numeric address is never resolved
+// Sockets, random numbers and base64 are from RdWebSocketPlatform so this also builds on a host (for tests)
+class RdWebSocketClient
+{
+public:
+    RdWebSocketClient();
+    virtual ~RdWebSocketClient();
+
+    // Setup - the URL is of the form ws://host[:port][/path]
+    // The callback receives the connect and disconnect events as well as received messages
+    bool setup(const String& wsURL, RdWebSocketCB webSocketCB, uint32_t pingIntervalMs = 0,
+                uint32_t disconnIfNoPongMs = 0, uint32_t txQueueMaxLen = DEFAULT_TX_QUEUE_MAX_LEN,
+                uint32_t reconnectMinMs = DEFAULT_RECONNECT_MIN_MS, uint32_t reconnectMaxMs = DEFAULT_RECONNECT_MAX_MS);
+
+    // Service - called frequently
+    void service();
+
+    // Send message (queued until the link is connected) - returns false if the queue is full
+    bool sendMsg(const uint8_t* pBuf, uint32_t bufLen, bool isText = false);
+    bool sendText(const String& msg)
+    {
+        return sendMsg((const uint8_t*)msg.c_str(), msg.length(), true);
+    }
+
+    // Check connected
+    bool isConnected() const
+    {
+        return _connState == WS_CLIENT_CONNECTED;
+    }
+
+    // Close the link (no reconnect until setup() is called again)
+    void close();
+
+    // Stats
+    String getStatsJSON();
+
+    static const uint32_t DEFAULT_TX_QUEUE_MAX_LEN = 10;
+    static const uint32_t DEFAULT_RECONNECT_MIN_MS = 1000;
+    static const uint32_t DEFAULT_RECONNECT_MAX_MS = 60000;
+
+private:
+    // Connection state
+    enum ConnState
+    {
+        WS_CLIENT_IDLE,
+        WS_CLIENT_WAIT_RECONNECT,
+        WS_CLIENT_CONNECTING,
+        WS_CLIENT_UPGRADING,
+        WS_CLIENT_CONNECTED
+    };
+    ConnState _connState;
+    uint32_t _connStateMs;
+
+    // Server - the address (IPv4, network byte order) is kept from the last name resolution
+    String _host;
+    uint16_t _port;
+    String _path;
+    uint32_t _serverIPAddr;
+    bool _resolveRequired;
+
+    // Socket (-1 if not open)
+    int _socket;
+
+    // Link (framing, masking and ping/pong) - a new link is created for each connection
+    std::unique_ptr<RdWebSocketLink> _pWebSocketLink;
+    RdWebSocketCB _webSocketCB;
+    uint32_t _pingIntervalMs;
+    uint32_t _disconnIfNoPongMs;
+    bool _closeRxd;
+
+    // Upgrade key and the accept value expected from the server
+    String _wsKey;
+    String _wsAcceptExpected;
+
+    // Upgrade response received so far
+    std::vector<uint8_t> _upgradeRespBuf;
+    static const uint32_t UPGRADE_RESP_MAX_LEN = 1024;
+
+    // Reconnect backoff - doubles on each failure (with random jitter) and is reset when the upgrade succeeds
+    uint32_t _reconnectMinMs;
+    uint32_t _reconnectMaxMs;
+    uint32_t _reconnectDelayMs;
+    uint32_t _reconnectWaitMs;
+
+    // Tx queue - the first byte of each frame is the opcode
+    RdWebTxQueue<std::shared_ptr<const std::vector<uint8_t>>> _txQueue;
+
+    // Message being sent - held until the link has sent all fragments (and kept for sending after
+    // reconnecting if the link fails before then)
+    std::shared_ptr<const std::vector<uint8_t>> _pTxMsg;
+    bool _txMsgSent;
+    bool _sendFailed;
+
+    // Data not yet accepted by the socket - sends never block so whatever the socket doesn't take is
+    // kept here and written before anything else (no new messages are started until it has drained)
+    std::vector<uint8_t> _txSocketBuf;
+    uint32_t _txSocketProgressMs;
+    static const uint32_t TX_SOCKET_BUF_MAX_BYTES = 8192;
+    static const uint32_t TX_SOCKET_STALL_TIMEOUT_MS = 10000;
+
+    // Stats
+    uint32_t _connectCount;
+    uint32_t _connectFailCount;
+
+    // Timeouts
+    static const uint32_t CONNECT_TIMEOUT_MS = 5000;
+    static const uint32_t UPGRADE_TIMEOUT_MS = 5000;
+    static const uint32_t RX_BUFFER_LEN = 1024;
+    static const uint32_t TX_FRAGMENT_MAX_BYTES = 1024;
+
+    // Helpers
+    bool startConnect();
+    void connectFailed();
+    void serviceConnecting();
+    void serviceUpgrading();
+    void serviceConnected();
+    void serviceTx();
+    void disconnect(RdWebSocketEventCode eventCode);
+    void closeSocket();
+    void setConnState(ConnState connState);
+    RdWebConnSendRetVal rawSend(const uint8_t* pBuf, uint32_t bufLen, uint32_t maxRetryMs);
+    bool flushTxSocketBuf();
+    bool sendUpgradeReq();
+    bool checkUpgradeResp(uint32_t respLen);
+    void onWebSocketEvent(RdWebSocketEventCode eventCode, const uint8_t* pBuf, uint32_t bufLen);
+};
+
+#endif
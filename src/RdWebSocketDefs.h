@@ -36,3 +36,14 @@ enum WebSocketOpCodes
 };
 
 typedef std::function<void(RdWebSocketEventCode eventCode, const uint8_t* pBuf, uint32_t bufLen)> RdWebSocketCB;
+
+// Streamed receive - data message payload is delivered in pieces as it arrives
+// msgOffset is the position of pBuf[0] in the message, frameFinal and msgFinal indicate the end
+// of the current frame and of the message respectively
+typedef std::function<void(RdWebSocketEventCode eventCode, const uint8_t* pBuf, uint32_t bufLen,
+                uint32_t msgOffset, bool frameFinal, bool msgFinal)> RdWebSocketRxStreamCB;
+
+// Producer for a fragmented outbound message - called each time a fragment can be sent
+// Fill pBuf with up to bufMaxLen bytes of the message starting at msgOffset and return the number
+// of bytes written (0 if nothing is available yet) - set msgFinal on the last part of the message
+typedef std::function<uint32_t(uint8_t* pBuf, uint32_t bufMaxLen, uint32_t msgOffset, bool& msgFinal)> RdWebSocketTxProducerCB;
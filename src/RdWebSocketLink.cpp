@@ -14,12 +14,9 @@
 #include <WString.h>
 #include <Utils.h>
 #include <ArduinoTime.h>
-#include <mbedtls/sha1.h>
-#include <mbedtls/base64.h>
-#include <RdWebConnection.h>
 #include <Logger.h>
 #include <stdio.h>
-#include "esp_system.h"
+#include "RdWebSocketPlatform.h"
 
 static const char *MODULE_PREFIX = "RdWSLink";
 
@@ -39,6 +36,7 @@ static const char *MODULE_PREFIX = "RdWSLink";
 // #define DEBUG_WEBSOCKET_DATA_BUFFERING_CONTENT
 // #define DEBUG_WEBSOCKET_DATA_PROCESSING
 // #define DEBUG_WEBSOCKET_RX_DETAIL
+// #define DEBUG_WEBSOCKET_MASK_TIMING
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Constructor / Destructor
@@ -50,10 +48,34 @@ RdWebSocketLink::RdWebSocketLink()
     _upgradeRespSent = false;
     _webSocketCB = NULL;
     _rawConnSendFn = NULL;
+    _rawConnSendVecFn = NULL;
+    _rawConnReadyToSendFn = NULL;
+    _txMsgInProgress = false;
+    _txMsgOpCode = WEBSOCKET_OPCODE_BINARY;
+    _pTxMsgBuf = nullptr;
+    _txMsgLen = 0;
+    _txMsgPos = 0;
+    _txProducerCB = nullptr;
+    _txFragmentMaxBytes = DEFAULT_TX_FRAGMENT_MAX_BYTES;
+    _deflateEnabled = false;
+    _deflateWindowBits = RdWebDeflate::MAX_WINDOW_BITS;
+    _deflateNoContextTakeover = false;
+    _deflateActive = false;
+    _txMsgCompressed = false;
     _isActive = false;
+    _pingJitterMs = 0;
     _pingTimeLastMs = 0;
     _pongRxLastMs = 0;
+    _rxLastMs = 0;
     _disconnIfNoPongMs = 0;
+    _pingAwaitingPong = false;
+    _pingRTTMs = 0;
+    _pingRTTAvgMs = 0;
+    _pingRTTValid = false;
+    _rxStreamCB = nullptr;
+    _rxStreamFrameRemaining = 0;
+    _rxStreamFramePos = 0;
+    _rxStreamMsgOffset = 0;
 }
 
 RdWebSocketLink::~RdWebSocketLink()
@@ -64,15 +86,21 @@ RdWebSocketLink::~RdWebSocketLink()
 // Setup the web socket
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void RdWebSocketLink::setup(RdWebSocketCB webSocketCB, RdWebConnSendFn rawConnSendFn,
-                uint32_t pingIntervalMs, bool roleIsServer, uint32_t disconnIfNoPongMs)
+void RdWebSocketLink::setup(RdWebSocketCB webSocketCB, RdWebConnSendFn rawConnSendFn, RdWebConnSendVecFn rawConnSendVecFn,
+                RdWebConnReadyToSendFn rawConnReadyToSendFn, uint32_t pingIntervalMs, bool roleIsServer, 
+                uint32_t disconnIfNoPongMs, uint32_t txFragmentMaxBytes)
 {
     _webSocketCB = webSocketCB;
     _rawConnSendFn = rawConnSendFn;
+    _rawConnSendVecFn = rawConnSendVecFn;
+    _rawConnReadyToSendFn = rawConnReadyToSendFn;
+    _txFragmentMaxBytes = txFragmentMaxBytes > 0 ? txFragmentMaxBytes : DEFAULT_TX_FRAGMENT_MAX_BYTES;
     _pingIntervalMs = pingIntervalMs;
     _pingTimeLastMs = 0;
     _pongRxLastMs = 0;
+    _rxLastMs = 0;
     _disconnIfNoPongMs = disconnIfNoPongMs;
+    updatePingJitter();
     _maskSentData = !roleIsServer;
     _isActive = true;
 }
@@ -87,50 +115,121 @@ void RdWebSocketLink::service()
     // Handle ping / pong
     if (_upgradeRespSent && _pingIntervalMs != 0)
     {
-        // Check if time to send ping
-        if (Utils::isTimeout(millis(), _pingTimeLastMs, _pingIntervalMs))
+        // Check if time to send ping - any received frame shows the link is alive so pings are only
+        // sent when the link has been silent
+        uint32_t nowMs = millis();
+        uint32_t pingAfterMs = _pingIntervalMs + _pingJitterMs;
+        if (Utils::isTimeout(nowMs, _rxLastMs, pingAfterMs) && Utils::isTimeout(nowMs, _pingTimeLastMs, pingAfterMs))
         {
 #ifdef DEBUG_WEBSOCKET_PING_PONG
             LOG_I(MODULE_PREFIX, "PING");
 #endif
             sendMsg(WEBSOCKET_OPCODE_PING, PING_MSG, sizeof(PING_MSG));
-            _pingTimeLastMs = millis();
+            _pingTimeLastMs = nowMs;
+            _pingAwaitingPong = true;
+            updatePingJitter();
         }
 
-        // Check for disconnect on no pong - this intentionally only starts working after
+        // Check for disconnect when nothing received - this intentionally only starts working after
         // a first pong has been received - this is because older martypy versions did not
         // correctly handle the pong response
         if ((_disconnIfNoPongMs != 0) && (_pongRxLastMs != 0) &&
-                 Utils::isTimeout(millis(), _pongRxLastMs, _disconnIfNoPongMs))
+                 Utils::isTimeout(nowMs, _rxLastMs, _disconnIfNoPongMs))
         {
             if (!_warnNoPongShown)
             {
-                LOG_W(MODULE_PREFIX, "service - no PONG received for %ldms (>%dms), link inactive",
-                        Utils::timeElapsed(millis(), _pongRxLastMs),
+                LOG_W(MODULE_PREFIX, "service - nothing received for %ldms (>%dms), link inactive",
+                        Utils::timeElapsed(nowMs, _rxLastMs),
                         _disconnIfNoPongMs);
                 _warnNoPongShown = true;
             }
             _isActive = false;
         }
     }
+
+    // Send next fragment of any message in progress
+    serviceTxMsg();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Choose a random jitter for the next ping
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketLink::updatePingJitter()
+{
+    _pingJitterMs = RdWebSocketPlatform::random32() % (_pingIntervalMs / PING_JITTER_DIVISOR + 1);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Upgrade the link - explicitly assume request header received
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void RdWebSocketLink::upgradeReceived(const String &wsKey, const String &wsVersion)
+void RdWebSocketLink::upgradeReceived(const String &wsKey, const String &wsVersion, const String& wsExtensions)
 {
     _upgradeReqReceived = true;
     _wsKey = wsKey;
     _wsVersion = wsVersion;
+
+    // Negotiate compression (streamed receive delivers data before a message is complete so can't be used)
+    _deflateActive = false;
+    if (_deflateEnabled && !_rxStreamCB)
+        _deflateActive = _deflate.negotiate(wsExtensions, _deflateWindowBits, _deflateNoContextTakeover, _deflateRespParams);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Upgrade the link (client side) - data received from now on is websocket frames
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketLink::upgradeComplete()
+{
+    _upgradeReqReceived = true;
+    _upgradeRespSent = true;
+    _deflateActive = false;
+    _pingTimeLastMs = millis();
+    _rxLastMs = _pingTimeLastMs;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Handle incoming data
+// The data is copied into the reassembly buffer (after any residual data from previous calls) and processed there
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void RdWebSocketLink::handleRxData(const uint8_t *pBuf, uint32_t bufLen)
+{
+    if (!checkUpgradeReq(pBuf, bufLen))
+        return;
+    addToRxDataToProcess(pBuf, bufLen);
+    processRxData(_rxDataToProcess.data(), _rxDataToProcess.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle incoming data in a buffer that can be modified
+// Frames wholly within the buffer are unmasked in place and passed to the callback without copying - data is only
+// copied if there is residual data from previous calls (i.e. a frame spans received blocks)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketLink::handleRxDataInPlace(uint8_t *pBuf, uint32_t bufLen)
+{
+    const uint8_t* pData = pBuf;
+    uint32_t dataLen = bufLen;
+    if (!checkUpgradeReq(pData, dataLen))
+        return;
+    pBuf += bufLen - dataLen;
+    bufLen = dataLen;
+    if (_rxDataToProcess.size() == 0)
+    {
+        processRxData(pBuf, bufLen);
+        return;
+    }
+    addToRxDataToProcess(pBuf, bufLen);
+    processRxData(_rxDataToProcess.data(), _rxDataToProcess.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check for upgrade request - returns false if there is no more data to process
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketLink::checkUpgradeReq(const uint8_t*& pBuf, uint32_t& bufLen)
 {
     static const uint8_t UPGRADE_REQ_TEXT[] = "Upgrade: websocket\r\n";
     static const uint8_t UPGRADE_REQ_KEY[] = "Sec-WebSocket-Key: ";
@@ -140,18 +239,18 @@ void RdWebSocketLink::handleRxData(const uint8_t *pBuf, uint32_t bufLen)
     {
         // Check for header
         if (Utils::findInBuf(pBuf, bufLen, UPGRADE_REQ_TEXT, sizeof(UPGRADE_REQ_TEXT)) < 0)
-            return;
+            return false;
 
         // Check for upgrade key
         int keyPos = Utils::findInBuf(pBuf, bufLen, UPGRADE_REQ_KEY, sizeof(UPGRADE_REQ_KEY));
         if (keyPos < 0)
-            return;
+            return false;
         keyPos += sizeof(UPGRADE_REQ_TEXT);
 
         // Find key length
         int keyLen = Utils::findInBuf(pBuf + keyPos, bufLen - keyPos, HTTP_EOL_STR, sizeof(HTTP_EOL_STR));
         if (keyLen < 0)
-            return;
+            return false;
 
         // Extract key
         Utils::strFromBuffer(pBuf + keyPos, keyLen, _wsKey);
@@ -159,7 +258,7 @@ void RdWebSocketLink::handleRxData(const uint8_t *pBuf, uint32_t bufLen)
 
         // Continue with any excess data
         if (keyPos + keyLen >= bufLen)
-            return;
+            return false;
         pBuf += keyPos + keyLen;
         bufLen -= (keyPos + keyLen);
 
@@ -167,64 +266,81 @@ void RdWebSocketLink::handleRxData(const uint8_t *pBuf, uint32_t bufLen)
         LOG_W(MODULE_PREFIX, "handleRxData excessDataAfter ws upgrade len %d", bufLen);
 #endif
     }
+    return bufLen > 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add data to the reassembly buffer (discarding residual data if the total is too large)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // Check if any data already received
-    if (_rxDataToProcess.size() > 0)
+void RdWebSocketLink::addToRxDataToProcess(const uint8_t *pBuf, uint32_t bufLen)
+{
+    if (_rxDataToProcess.size() + bufLen > MAX_WS_MESSAGE_SIZE + 50)
     {
-        if (_rxDataToProcess.size() + bufLen > MAX_WS_MESSAGE_SIZE + 50)
-        {
 #ifdef WARN_WEBSOCKET_DATA_DISCARD_AS_EXCEEDS_MSG_SIZE
         LOG_W(MODULE_PREFIX, "handleRxData discard as exceeds max stashed %d len %d max %d", 
                 _rxDataToProcess.size(), bufLen, MAX_WS_MESSAGE_SIZE);
 #endif
-            _rxDataToProcess.clear();
-        }
-        else
-        {
+        _rxDataToProcess.clear();
+    }
 #ifdef DEBUG_WEBSOCKET_DATA_BUFFERING
-        LOG_I(MODULE_PREFIX, "handleRxData adding stashedLen %d len %d", 
-                _rxDataToProcess.size(), bufLen);
-#endif
-#ifdef DEBUG_WEBSOCKET_DATA_BUFFERING_CONTENT
-            String prevResidual;
-            Utils::getHexStrFromBytes(_rxDataToProcess.data(), 
-                    _rxDataToProcess.size() < MAX_DEBUG_BIN_HEX_LEN ? _rxDataToProcess.size() : MAX_DEBUG_BIN_HEX_LEN,
-                    prevResidual);
-            LOG_I(MODULE_PREFIX, "handleRxData prevResidual len %d data %s%s", 
-                    _rxDataToProcess.size(), prevResidual.c_str(),
-                    _rxDataToProcess.size() < MAX_DEBUG_BIN_HEX_LEN ? "" : "...");
+    LOG_I(MODULE_PREFIX, "handleRxData adding stashedLen %d len %d", 
+            _rxDataToProcess.size(), bufLen);
 #endif
-            //_rxDataToProcess.insert(_rxDataToProcess.end(), pBuf, pBuf+bufLen);
-            uint32_t curSize = _rxDataToProcess.size();
-            _rxDataToProcess.resize(curSize + bufLen);
-            memcpy(_rxDataToProcess.data()+curSize, pBuf, bufLen);
-            pBuf = _rxDataToProcess.data();
-            bufLen = _rxDataToProcess.size();
 #ifdef DEBUG_WEBSOCKET_DATA_BUFFERING_CONTENT
-            String dataToProc;
-            Utils::getHexStrFromBytes(_rxDataToProcess.data(), 
-                    _rxDataToProcess.size() < MAX_DEBUG_BIN_HEX_LEN ? _rxDataToProcess.size() : MAX_DEBUG_BIN_HEX_LEN, 
-                    dataToProc);
-            LOG_I(MODULE_PREFIX, "handleRxData agg dataToProc len %d data %s%s", 
-                    _rxDataToProcess.size(), dataToProc.c_str(),
-                    _rxDataToProcess.size() < MAX_DEBUG_BIN_HEX_LEN ? "" : "...");
+    String prevResidual;
+    Utils::getHexStrFromBytes(_rxDataToProcess.data(), 
+            _rxDataToProcess.size() < MAX_DEBUG_BIN_HEX_LEN ? _rxDataToProcess.size() : MAX_DEBUG_BIN_HEX_LEN,
+            prevResidual);
+    LOG_I(MODULE_PREFIX, "handleRxData prevResidual len %d data %s%s", 
+            _rxDataToProcess.size(), prevResidual.c_str(),
+            _rxDataToProcess.size() < MAX_DEBUG_BIN_HEX_LEN ? "" : "...");
 #endif
-        }
-    }
+    _rxDataToProcess.insert(_rxDataToProcess.end(), pBuf, pBuf + bufLen);
+}
 
-    // Handle packets
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Fail the connection - send CLOSE with the status code and stop processing further data (RFC6455 7.1.7)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketLink::failConnection(uint16_t closeCode)
+{
+    uint8_t closePayload[2] = {(uint8_t)(closeCode >> 8), (uint8_t)(closeCode & 0xff)};
+    sendMsg(WEBSOCKET_OPCODE_CLOSE, closePayload, sizeof(closePayload));
+    _isActive = false;
+    if (_webSocketCB)
+        _webSocketCB(WEBSOCKET_EVENT_DISCONNECT_ERROR, nullptr, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Process received data (frames are unmasked in place)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketLink::processRxData(uint8_t *pBuf, uint32_t bufLen)
+{
+    // Handle packets - in streamed mode data frame payload is handled as it arrives
     while(bufLen > 0)
     {
-        int32_t dataConsumed = handleRxPacketData(pBuf, bufLen);
+        uint32_t dataConsumed = 0;
+        if (_rxStreamFrameRemaining > 0)
+            dataConsumed = handleRxStreamData(pBuf, bufLen);
+        else
+            dataConsumed = handleRxPacketData(pBuf, bufLen);
 #ifdef DEBUG_WEBSOCKET_DATA_PROCESSING
         LOG_I(MODULE_PREFIX, "handleRxData consumed %d bufLen %d", dataConsumed, bufLen);
 #endif
         if (dataConsumed == 0)
         {
-            // Store residual data (needs to use temp store as it may be copying part of itself)
-            std::vector<uint8_t> tmpData;
-            tmpData.assign(pBuf, pBuf+bufLen);
-            _rxDataToProcess.assign(tmpData.data(), tmpData.data()+tmpData.size());
+            // Store residual data - moving it to the start if it is already in the reassembly buffer
+            if (_rxDataToProcess.size() > 0)
+            {
+                memmove(_rxDataToProcess.data(), pBuf, bufLen);
+                _rxDataToProcess.resize(bufLen);
+            }
+            else
+            {
+                _rxDataToProcess.assign(pBuf, pBuf + bufLen);
+            }
 #ifdef DEBUG_WEBSOCKET_DATA_BUFFERING
             LOG_I(MODULE_PREFIX, "handleRxData storing residual now stashed %d", _rxDataToProcess.size());
 #endif
@@ -239,7 +355,10 @@ void RdWebSocketLink::handleRxData(const uint8_t *pBuf, uint32_t bufLen)
 #endif
             break;
         }
-        if (dataConsumed >= bufLen)
+
+        // Any received data shows the link is alive
+        _rxLastMs = millis();
+        if ((dataConsumed >= bufLen) || !_isActive)
         {
             // Clear any residual data
             _rxDataToProcess.clear();
@@ -270,6 +389,7 @@ uint32_t RdWebSocketLink::getTxData(uint8_t*& pBuf, uint32_t bufMaxLen)
 
         // Make sure we don't PING too early
         _pingTimeLastMs = millis();
+        _rxLastMs = _pingTimeLastMs;
 
         // Form the upgrade response
         _wsUpgradeResponse = formUpgradeResponse(_wsKey, _wsVersion, bufMaxLen);
@@ -288,94 +408,302 @@ uint32_t RdWebSocketLink::getTxData(uint8_t*& pBuf, uint32_t bufMaxLen)
 
 bool RdWebSocketLink::sendMsg(WebSocketOpCodes opCode, const uint8_t *pBuf, uint32_t bufLen)
 {
-    // Get length of frame
-    uint32_t frameLen = bufLen + 2;
-    uint32_t hdrLenCode = bufLen;
-    if (bufLen > 125)
+    return sendFrame(opCode, true, pBuf, bufLen);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send fragmented message from a buffer
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketLink::sendMsgFragmented(WebSocketOpCodes opCode, const uint8_t* pBuf, uint32_t bufLen)
+{
+    // Only one message at a time
+    if (_txMsgInProgress)
+        return false;
+    _txMsgInProgress = true;
+    _txMsgOpCode = opCode;
+    _pTxMsgBuf = pBuf;
+    _txMsgLen = bufLen;
+    _txMsgPos = 0;
+    _txProducerCB = nullptr;
+
+    // Short messages are not worth compressing
+    _txMsgCompressed = _deflateActive && (opCode != WEBSOCKET_OPCODE_CONTINUE) && (opCode < WEBSOCKET_OPCODE_CLOSE) &&
+                (bufLen >= DEFLATE_MIN_MSG_BYTES);
+
+    // Send the first fragment now
+    serviceTxMsg();
+    return _isActive;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send fragmented message from a producer
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketLink::sendMsgProducer(WebSocketOpCodes opCode, RdWebSocketTxProducerCB txProducerCB)
+{
+    // Only one message at a time
+    if (_txMsgInProgress || !txProducerCB)
+        return false;
+    _txMsgInProgress = true;
+    _txMsgOpCode = opCode;
+    _pTxMsgBuf = nullptr;
+    _txMsgLen = 0;
+    _txMsgPos = 0;
+    _txProducerCB = txProducerCB;
+    _txMsgCompressed = _deflateActive && (opCode != WEBSOCKET_OPCODE_CONTINUE) && (opCode < WEBSOCKET_OPCODE_CLOSE);
+
+    // Send the first fragment now
+    serviceTxMsg();
+    return _isActive;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send the next fragment of a message in progress
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketLink::serviceTxMsg()
+{
+    // Check there is something to send and the previous fragment has left the connection
+    if (!_txMsgInProgress || !_isActive)
+        return;
+    if (_rawConnReadyToSendFn && !_rawConnReadyToSendFn())
+        return;
+
+    // Opcode (and compressed flag) are only used on the first fragment
+    bool isFirstFragment = _txMsgPos == 0;
+    WebSocketOpCodes opCode = isFirstFragment ? _txMsgOpCode : WEBSOCKET_OPCODE_CONTINUE;
+
+    // Leave room for compression overhead
+    uint32_t fragmentMaxBytes = _txFragmentMaxBytes;
+    if (_txMsgCompressed && (fragmentMaxBytes > 2 * RdWebDeflate::MAX_COMPRESS_OVERHEAD_BYTES))
+        fragmentMaxBytes -= RdWebDeflate::MAX_COMPRESS_OVERHEAD_BYTES;
+
+    // Get the fragment
+    const uint8_t* pFragment = nullptr;
+    uint32_t fragmentLen = 0;
+    bool msgFinal = false;
+    if (_txProducerCB)
     {
-        frameLen += 2;
-        hdrLenCode = 126;
+        _txFragmentBuffer.resize(fragmentMaxBytes);
+        fragmentLen = _txProducerCB(_txFragmentBuffer.data(), fragmentMaxBytes, _txMsgPos, msgFinal);
+        if (fragmentLen > fragmentMaxBytes)
+            fragmentLen = fragmentMaxBytes;
+
+        // Nothing available from the producer yet
+        if ((fragmentLen == 0) && !msgFinal)
+            return;
+        pFragment = _txFragmentBuffer.data();
     }
-    if (bufLen > 65535)
+    else
     {
-        frameLen += 6;
-        hdrLenCode = 127;
+        fragmentLen = _txMsgLen - _txMsgPos;
+        if (fragmentLen > fragmentMaxBytes)
+            fragmentLen = fragmentMaxBytes;
+        msgFinal = _txMsgPos + fragmentLen >= _txMsgLen;
+        pFragment = _pTxMsgBuf + _txMsgPos;
     }
-    if (_maskSentData)
-        frameLen += 4;
 
-    // Check valid
-    if (frameLen >= MAX_WS_MESSAGE_SIZE)
-    {
 #ifdef DEBUG_WEBSOCKET_SEND
-        LOG_W(MODULE_PREFIX, "WebSocket sendMsg too long %d > %d", frameLen, MAX_WS_MESSAGE_SIZE);
+    LOG_I(MODULE_PREFIX, "serviceTxMsg opCode %d msgPos %d len %d final %d", opCode, _txMsgPos, fragmentLen, msgFinal);
 #endif
-        return false;
-    }
 
-    // Buffer
-    std::vector<uint8_t> frameBuffer(frameLen);
-
-    // Setup header
-    frameBuffer[0] = 0x80 | opCode;
-    frameBuffer[1] = (_maskSentData ? 0x80 : 0) | hdrLenCode;
+    // Send - compressing if required
+    bool sendOk = false;
+    if (_txMsgCompressed)
+    {
+        _txDeflateBuffer.clear();
+        _deflate.compress(pFragment, fragmentLen, msgFinal, _txDeflateBuffer);
+        sendOk = sendFrame(opCode, msgFinal, _txDeflateBuffer.data(), _txDeflateBuffer.size(), isFirstFragment);
+    }
+    else
+    {
+        sendOk = sendFrame(opCode, msgFinal, pFragment, fragmentLen);
+    }
+    if (!sendOk)
+    {
+        LOG_W(MODULE_PREFIX, "serviceTxMsg send failed msgPos %d len %d", _txMsgPos, fragmentLen);
+        _isActive = false;
+    }
+    _txMsgPos += fragmentLen;
 
-    // Length
-    uint32_t pos = 2;
-    if (hdrLenCode == 126)
+    // Check complete
+    if (msgFinal || !_isActive)
     {
-        frameBuffer[pos++] = bufLen / 256;
-        frameBuffer[pos++] = bufLen % 256;
+        _txMsgInProgress = false;
+        _pTxMsgBuf = nullptr;
+        _txProducerCB = nullptr;
+        _txFragmentBuffer.clear();
+        _txFragmentBuffer.shrink_to_fit();
+        _txDeflateBuffer.clear();
+        _txDeflateBuffer.shrink_to_fit();
     }
-    else if (hdrLenCode == 127)
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Encode a complete message as a single frame appended to outBuf
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RdWebSocketLink::encodeFrame(std::vector<uint8_t>& outBuf, WebSocketOpCodes opCode, const uint8_t* pBuf, uint32_t bufLen)
+{
+    // Compress if required
+    bool compressed = _deflateActive && (opCode != WEBSOCKET_OPCODE_CONTINUE) && (opCode < WEBSOCKET_OPCODE_CLOSE) &&
+                (bufLen >= DEFLATE_MIN_MSG_BYTES);
+    if (compressed)
     {
-        for (int i = 0; i < 8; i++)
-            frameBuffer[pos++] = (bufLen >> ((7 - i) * 8)) & 0xff;
+        _txDeflateBuffer.clear();
+        _deflate.compress(pBuf, bufLen, true, _txDeflateBuffer);
+        pBuf = _txDeflateBuffer.data();
+        bufLen = _txDeflateBuffer.size();
     }
 
     // Generate a random mask if required
     uint8_t maskBytes[WSHeaderInfo::WEB_SOCKET_MASK_KEY_BYTES] = {0, 0, 0, 0};
     if (_maskSentData)
     {
-        uint32_t maskKey = esp_random();
+        uint32_t maskKey = RdWebSocketPlatform::random32();
         if (maskKey == 0)
             maskKey = 0x55555555;
         for (int i = 0; i < WSHeaderInfo::WEB_SOCKET_MASK_KEY_BYTES; i++)
-        {
             maskBytes[i] = (maskKey >> ((3 - i) * 8)) & 0xff;
-            frameBuffer[pos++] = maskBytes[i];
-        }
     }
 
-    // Sanity check
-    if (pos + bufLen != frameBuffer.size())
-    {
-        LOG_W(MODULE_PREFIX, "sendMsg something awry with frameLen %d + %d != %d", pos, bufLen, frameBuffer.size());
+    // Header and payload (masked if required)
+    uint8_t frameHdr[MAX_WS_FRAME_HEADER_BYTES];
+    uint32_t hdrLen = formFrameHeader(frameHdr, opCode, true, compressed, bufLen, _maskSentData ? maskBytes : nullptr);
+    uint32_t startLen = outBuf.size();
+    outBuf.resize(startLen + hdrLen + bufLen);
+    memcpy(outBuf.data() + startLen, frameHdr, hdrLen);
+    if (_maskSentData)
+        RdWebSocketMask::maskCopy(outBuf.data() + startLen + hdrLen, pBuf, bufLen, maskBytes);
+    else if (bufLen != 0)
+        memcpy(outBuf.data() + startLen + hdrLen, pBuf, bufLen);
+    return hdrLen + bufLen;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Encode a complete message as an unmasked and uncompressed frame
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketLink::encodeFrameUnmasked(std::vector<uint8_t>& outBuf, WebSocketOpCodes opCode, 
+            const uint8_t* pBuf, uint32_t bufLen)
+{
+    uint8_t frameHdr[MAX_WS_FRAME_HEADER_BYTES];
+    uint32_t hdrLen = formFrameHeader(frameHdr, opCode, true, false, bufLen, nullptr);
+    outBuf.reserve(outBuf.size() + hdrLen + bufLen);
+    outBuf.insert(outBuf.end(), frameHdr, frameHdr + hdrLen);
+    outBuf.insert(outBuf.end(), pBuf, pBuf + bufLen);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send encoded frames
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketLink::sendEncodedFrames(const uint8_t* pBuf, uint32_t bufLen)
+{
+    if (!_rawConnSendFn)
         return false;
-    }
+    RdWebConnSendRetVal sendRetc = _rawConnSendFn(pBuf, bufLen, MAX_WS_SEND_RETRY_MS);
+#ifdef DEBUG_WEBSOCKET_SEND
+    LOG_I(MODULE_PREFIX, "WebSocket sendEncodedFrames result %s send %d bytes", 
+            RdWebConnDefs::getSendRetValStr(sendRetc), bufLen);
+#endif
+    return sendRetc != RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+}
 
-    // Copy the data
-    memcpy(frameBuffer.data() + pos, pBuf, bufLen);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send a single frame
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // Mask the data
+bool RdWebSocketLink::sendFrame(WebSocketOpCodes opCode, bool finalFrame, const uint8_t *pBuf, uint32_t bufLen,
+            bool compressed)
+{
+    // Generate a random mask if required
+    uint8_t maskBytes[WSHeaderInfo::WEB_SOCKET_MASK_KEY_BYTES] = {0, 0, 0, 0};
     if (_maskSentData)
     {
-        for (uint32_t i = 0; i < bufLen; i++)
-            frameBuffer[pos + i] ^= maskBytes[i % WSHeaderInfo::WEB_SOCKET_MASK_KEY_BYTES];
+        uint32_t maskKey = RdWebSocketPlatform::random32();
+        if (maskKey == 0)
+            maskKey = 0x55555555;
+        for (int i = 0; i < WSHeaderInfo::WEB_SOCKET_MASK_KEY_BYTES; i++)
+            maskBytes[i] = (maskKey >> ((3 - i) * 8)) & 0xff;
     }
 
-    // Send
+    // Form header
+    uint8_t frameHdr[MAX_WS_FRAME_HEADER_BYTES];
+    uint32_t hdrLen = formFrameHeader(frameHdr, opCode, finalFrame, compressed, bufLen, _maskSentData ? maskBytes : nullptr);
+    uint32_t frameLen = hdrLen + bufLen;
+
+    // Unmasked frames are sent directly from the header on the stack and the caller's buffer
     RdWebConnSendRetVal sendRetc = RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
-    if (_rawConnSendFn)
-        sendRetc = _rawConnSendFn(frameBuffer.data(), frameBuffer.size(), MAX_WS_SEND_RETRY_MS);
+    if (!_maskSentData && _rawConnSendVecFn)
+    {
+        sendRetc = _rawConnSendVecFn(frameHdr, hdrLen, pBuf, bufLen, MAX_WS_SEND_RETRY_MS);
+    }
+    else
+    {
+        // Buffer with the data masked as it is copied
+        std::vector<uint8_t> frameBuffer(frameLen);
+        memcpy(frameBuffer.data(), frameHdr, hdrLen);
+        if (_maskSentData)
+            RdWebSocketMask::maskCopy(frameBuffer.data() + hdrLen, pBuf, bufLen, maskBytes);
+        else if (bufLen != 0)
+            memcpy(frameBuffer.data() + hdrLen, pBuf, bufLen);
+
+        // Send
+        if (_rawConnSendFn)
+            sendRetc = _rawConnSendFn(frameBuffer.data(), frameBuffer.size(), MAX_WS_SEND_RETRY_MS);
+    }
 
 #ifdef DEBUG_WEBSOCKET_SEND
-    LOG_I(MODULE_PREFIX, "WebSocket sendMsg result %s send %d bytes", 
+    LOG_I(MODULE_PREFIX, "WebSocket sendFrame result %s send %d bytes final %d", 
             RdWebConnDefs::getSendRetValStr(sendRetc), 
-            frameBuffer.size());
+            frameLen, finalFrame);
 #endif
 
-    return sendRetc == RdWebConnSendRetVal::WEB_CONN_SEND_OK;
+    // Data queued by the connection (EAGAIN) will be sent later
+    return sendRetc != RdWebConnSendRetVal::WEB_CONN_SEND_FAIL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Form frame header
+// pMaskKey is nullptr if the frame is not masked
+// Returns length of header
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RdWebSocketLink::formFrameHeader(uint8_t* pHdr, WebSocketOpCodes opCode, bool finalFrame, bool compressed,
+            uint32_t payloadLen, const uint8_t* pMaskKey)
+{
+    // Opcode and length code
+    uint32_t hdrLenCode = payloadLen;
+    if (payloadLen > 65535)
+        hdrLenCode = 127;
+    else if (payloadLen > 125)
+        hdrLenCode = 126;
+    pHdr[0] = (finalFrame ? 0x80 : 0) | (compressed ? 0x40 : 0) | opCode;
+    pHdr[1] = (pMaskKey ? 0x80 : 0) | hdrLenCode;
+
+    // Length
+    uint32_t pos = 2;
+    if (hdrLenCode == 126)
+    {
+        pHdr[pos++] = payloadLen / 256;
+        pHdr[pos++] = payloadLen % 256;
+    }
+    else if (hdrLenCode == 127)
+    {
+        uint64_t payloadLen64 = payloadLen;
+        for (int i = 0; i < 8; i++)
+            pHdr[pos++] = (payloadLen64 >> ((7 - i) * 8)) & 0xff;
+    }
+
+    // Mask
+    if (pMaskKey)
+    {
+        for (int i = 0; i < WSHeaderInfo::WEB_SOCKET_MASK_KEY_BYTES; i++)
+            pHdr[pos++] = pMaskKey[i];
+    }
+    return pos;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -391,7 +719,10 @@ String RdWebSocketLink::formUpgradeResponse(const String &wsKey, const String &w
         "Connection: Upgrade\r\n"
         "Sec-WebSocket-Accept: " +
         genMagicResponse(wsKey, wsVersion) + 
-        "\r\n\r\n";
+        "\r\n";
+    if (_deflateActive)
+        respStr += "Sec-WebSocket-Extensions: " + _deflateRespParams + "\r\n";
+    respStr += "\r\n";
 
     // Debug
 #ifdef DEBUG_WEBSOCKET_LINK
@@ -414,20 +745,15 @@ String RdWebSocketLink::genMagicResponse(const String &wsKey, const String &wsVe
     // Concatenated key
     String concatKey = wsKey + WEB_SOCKET_HASH;
 
-    // Use MBED TLS to perform SHA1 step
-    static const uint32_t SHA1_RESULT_LEN = 20;
-    uint8_t sha1Result[SHA1_RESULT_LEN];
-    mbedtls_sha1((uint8_t *)concatKey.c_str(), concatKey.length(), sha1Result);
+    // SHA1 step
+    uint8_t sha1Result[RdWebSocketPlatform::SHA1_RESULT_LEN];
+    RdWebSocketPlatform::sha1((const uint8_t *)concatKey.c_str(), concatKey.length(), sha1Result);
 
     // Base64 result can't be larger than 2x the input
-    char base64Result[SHA1_RESULT_LEN * 2];
+    char base64Result[RdWebSocketPlatform::SHA1_RESULT_LEN * 2];
     uint32_t outputLen = 0;
-    mbedtls_base64_encode((uint8_t *)base64Result, sizeof(base64Result), &outputLen, sha1Result, SHA1_RESULT_LEN);
-
-    // Terminate the string and return
-    if (outputLen >= sizeof(base64Result))
+    if (!RdWebSocketPlatform::base64Encode(sha1Result, sizeof(sha1Result), base64Result, sizeof(base64Result), outputLen))
         return "";
-    base64Result[outputLen] = '\0';
     return base64Result;
 }
 
@@ -436,7 +762,7 @@ String RdWebSocketLink::genMagicResponse(const String &wsKey, const String &wsVe
 // Returns amount of data consumed (0 if header is not complete yet or not enough data for entire block)
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-uint32_t RdWebSocketLink::handleRxPacketData(const uint8_t *pBuf, uint32_t bufLen)
+uint32_t RdWebSocketLink::handleRxPacketData(uint8_t *pBuf, uint32_t bufLen)
 {
     // Extract header
     extractWSHeaderInfo(pBuf, bufLen);
@@ -446,17 +772,54 @@ uint32_t RdWebSocketLink::handleRxPacketData(const uint8_t *pBuf, uint32_t bufLe
     LOG_I(MODULE_PREFIX, "handleRxPacketData header len %lld dataPos %d bufLen %d data %s", 
                 _wsHeader.len, _wsHeader.dataPos, bufLen, outStr.c_str());
 #endif
+    if (_wsHeader.dataPos == 0)
+        return 0;
+
+    // RSV1 is only valid on the first frame of a data message when compression has been negotiated
+    if (_wsHeader.rsv1 && (!_deflateActive || 
+                ((_wsHeader.opcode != WEBSOCKET_OPCODE_BINARY) && (_wsHeader.opcode != WEBSOCKET_OPCODE_TEXT))))
+    {
+        LOG_W(MODULE_PREFIX, "handleRxPacketData RSV1 set opcode %d deflate %s - failing connection", 
+                    _wsHeader.opcode, _deflateActive ? "Y" : "N");
+        failConnection(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+        return bufLen;
+    }
+
+    // Check for streamed data frame - only the header is consumed here
+    bool isDataFrame = (_wsHeader.opcode == WEBSOCKET_OPCODE_CONTINUE) || (_wsHeader.opcode == WEBSOCKET_OPCODE_BINARY) ||
+                (_wsHeader.opcode == WEBSOCKET_OPCODE_TEXT);
+    if (_rxStreamCB && isDataFrame)
+    {
+        _rxStreamFrameRemaining = _wsHeader.len;
+        _rxStreamFramePos = 0;
+        if (_wsHeader.opcode != WEBSOCKET_OPCODE_CONTINUE)
+            _rxStreamMsgOffset = 0;
+
+        // Empty frames are reported immediately
+        if (_wsHeader.len == 0)
+        {
+            _rxStreamCB(_wsHeader.firstFrameOpcode == WEBSOCKET_OPCODE_TEXT ? WEBSOCKET_EVENT_TEXT : WEBSOCKET_EVENT_BINARY,
+                        nullptr, 0, _rxStreamMsgOffset, true, _wsHeader.fin);
+        }
+        return _wsHeader.dataPos;
+    }
+
+    // Wait for the whole frame
     if (_wsHeader.dataPos + _wsHeader.len > bufLen)
         return 0;
 
     // Check if we are ignoring (because a frame was too big)
-    if (_wsHeader.ignoreUntilFinal && _wsHeader.fin)
+    if (_wsHeader.ignoreUntilFinal && isDataFrame)
     {
-        _wsHeader.ignoreUntilFinal = false;
+        if (_wsHeader.fin)
+            _wsHeader.ignoreUntilFinal = false;
         return _wsHeader.dataPos + _wsHeader.len;
     }
 
-    // Handle payload
+    // Handle payload (which is unmasked in place)
+    uint8_t* pFrameData = pBuf + _wsHeader.dataPos;
+    const uint8_t* pCallbackData = nullptr;
+    uint32_t callbackDataLen = 0;
     RdWebSocketEventCode callbackEventCode = WEBSOCKET_EVENT_NONE;
     switch (_wsHeader.opcode)
     {
@@ -464,42 +827,68 @@ uint32_t RdWebSocketLink::handleRxPacketData(const uint8_t *pBuf, uint32_t bufLe
         case WEBSOCKET_OPCODE_BINARY:
         case WEBSOCKET_OPCODE_TEXT:
         {
-            // Get length of data to copy
-            uint32_t copyLen = bufLen - _wsHeader.dataPos;
-            if (copyLen > _wsHeader.len)
-                copyLen = _wsHeader.len;
-            else
-                _callbackData.clear();
+            // Whole frame is in the buffer at this point
+            uint32_t frameLen = _wsHeader.len;
 
-            // Handle continuation
+            // Handle continuation - otherwise this is the start of a new message
             uint32_t curBufSize = 0;
             if (_wsHeader.opcode == WEBSOCKET_OPCODE_CONTINUE)
                 curBufSize = _callbackData.size();
+            else
+                _callbackData.clear();
 
             // Check we don't try to store too much
-            if (curBufSize + copyLen > MAX_WS_MESSAGE_SIZE)
+            if (curBufSize + frameLen > MAX_WS_MESSAGE_SIZE)
             {
                 LOG_W(MODULE_PREFIX, "handleRxPacketData msg > max %d", MAX_WS_MESSAGE_SIZE);
                 _callbackData.clear();
                 _wsHeader.ignoreUntilFinal = true;
                 return _wsHeader.dataPos + _wsHeader.len;             
             }
-            // Add the data to any existing
-            _callbackData.resize(curBufSize + copyLen);
-            memcpy(_callbackData.data(), pBuf + _wsHeader.dataPos, copyLen);
-            if (_wsHeader.fin)
-                callbackEventCode = _wsHeader.firstFrameOpcode == WEBSOCKET_OPCODE_TEXT ? WEBSOCKET_EVENT_TEXT : WEBSOCKET_EVENT_BINARY;
+
+            // Unmask with this frame's key
+            unmaskInPlace(pFrameData, frameLen);
+
+            // A message in a single frame is used where it is - fragments are added to the reassembly buffer
+            pCallbackData = pFrameData;
+            callbackDataLen = frameLen;
+            if ((_wsHeader.opcode == WEBSOCKET_OPCODE_CONTINUE) || !_wsHeader.fin)
+            {
+                _callbackData.insert(_callbackData.end(), pFrameData, pFrameData + frameLen);
+                if (!_wsHeader.fin)
+                    break;
+                pCallbackData = _callbackData.data();
+                callbackDataLen = _callbackData.size();
+            }
+
+            // Decompress
+            if (_wsHeader.msgCompressed)
+            {
+                if (!_deflate.decompress(pCallbackData, callbackDataLen, _rxInflateBuffer, MAX_WS_MESSAGE_SIZE))
+                {
+                    LOG_W(MODULE_PREFIX, "handleRxPacketData decompress failed len %d - failing connection", 
+                                callbackDataLen);
+                    _callbackData.clear();
+                    failConnection(WEBSOCKET_CLOSE_INVALID_DATA);
+                    return bufLen;
+                }
+                pCallbackData = _rxInflateBuffer.data();
+                callbackDataLen = _rxInflateBuffer.size();
+            }
+            callbackEventCode = _wsHeader.firstFrameOpcode == WEBSOCKET_OPCODE_TEXT ? WEBSOCKET_EVENT_TEXT : WEBSOCKET_EVENT_BINARY;
             break;
         }
         case WEBSOCKET_OPCODE_PING:
         {
             callbackEventCode = WEBSOCKET_EVENT_PING;
-            uint32_t copyLen = bufLen - _wsHeader.dataPos;
-            if (copyLen > MAX_WS_MESSAGE_SIZE)
+
+            // Control frame payloads are at most 125 bytes
+            if (_wsHeader.len > MAX_WS_CONTROL_PAYLOAD_BYTES)
                 break;
 
-            // Send PONG
-            sendMsg(WEBSOCKET_OPCODE_PONG, pBuf + _wsHeader.dataPos, _wsHeader.len);
+            // Send PONG with the unmasked payload of the PING
+            unmaskInPlace(pFrameData, _wsHeader.len);
+            sendMsg(WEBSOCKET_OPCODE_PONG, pFrameData, _wsHeader.len);
 
 #ifdef DEBUG_WEBSOCKET_PING_PONG
             LOG_I(MODULE_PREFIX, "handleRxPacketData Rx PING Tx PONG %lld", _wsHeader.len);
@@ -513,6 +902,16 @@ uint32_t RdWebSocketLink::handleRxPacketData(const uint8_t *pBuf, uint32_t bufLe
             _pongRxLastMs = millis();
             _warnNoPongShown = false;
 
+            // Round-trip time
+            if (_pingAwaitingPong)
+            {
+                _pingAwaitingPong = false;
+                _pingRTTMs = Utils::timeElapsed(_pongRxLastMs, _pingTimeLastMs);
+                _pingRTTAvgMs = !_pingRTTValid ? _pingRTTMs :
+                            (_pingRTTAvgMs * (PING_RTT_AVG_WEIGHT - 1) + _pingRTTMs) / PING_RTT_AVG_WEIGHT;
+                _pingRTTValid = true;
+            }
+
 #ifdef DEBUG_WEBSOCKET_PING_PONG
             LOG_I(MODULE_PREFIX, "handleRxPacketData PONG");
 #endif
@@ -534,38 +933,74 @@ uint32_t RdWebSocketLink::handleRxPacketData(const uint8_t *pBuf, uint32_t bufLe
     {
 #ifdef DEBUG_WEBSOCKET_LINK_EVENTS
         // Debug
-        LOG_I(MODULE_PREFIX, "handleRxPacketData callback eventCode %s len %d", getEventStr(callbackEventCode), _callbackData.size());
+        LOG_I(MODULE_PREFIX, "handleRxPacketData callback eventCode %s len %d", getEventStr(callbackEventCode), callbackDataLen);
 #endif
 
         // Callback
         if (_webSocketCB)
         {
-            // Unmask the data
-            unmaskData();
-
 #ifdef DEBUG_WEBSOCKET_LINK_DATA_STR
             String cbStr;
-            Utils::strFromBuffer(_callbackData.data(), 
-                        _callbackData.size() < MAX_DEBUG_TEXT_STR_LEN ? _callbackData.size() : MAX_DEBUG_TEXT_STR_LEN, 
+            Utils::strFromBuffer(pCallbackData, 
+                        callbackDataLen < MAX_DEBUG_TEXT_STR_LEN ? callbackDataLen : MAX_DEBUG_TEXT_STR_LEN, 
                         cbStr, false);
             LOG_I(MODULE_PREFIX, "handleRxPacketData %s%s", cbStr.c_str(),
-                        _callbackData.size() < MAX_DEBUG_TEXT_STR_LEN ? "" : " ...");
+                        callbackDataLen < MAX_DEBUG_TEXT_STR_LEN ? "" : " ...");
 #endif
 #ifdef DEBUG_WEBSOCKET_LINK_DATA_BINARY
-            Utils::logHexBuf(_callbackData.data(), 
-                        _callbackData.size() < MAX_DEBUG_BIN_HEX_LEN ? _callbackData.size() : MAX_DEBUG_BIN_HEX_LEN, 
+            Utils::logHexBuf(pCallbackData, 
+                        callbackDataLen < MAX_DEBUG_BIN_HEX_LEN ? callbackDataLen : MAX_DEBUG_BIN_HEX_LEN, 
                         MODULE_PREFIX, "handleRxPacketData");
 #endif
-            // Perform callback
-            _webSocketCB(callbackEventCode, _callbackData.data(), _callbackData.size());
+            // Perform callback - control frames may arrive between the fragments of a message
+            // so the reassembled data is only passed (and cleared) for data events
+            if ((callbackEventCode == WEBSOCKET_EVENT_TEXT) || (callbackEventCode == WEBSOCKET_EVENT_BINARY))
+                _webSocketCB(callbackEventCode, pCallbackData, callbackDataLen);
+            else
+                _webSocketCB(callbackEventCode, nullptr, 0);
         }
 
-        // Clear compiled data
-        _callbackData.clear();
+        // Clear compiled data (buffers keep their capacity for reuse)
+        if ((callbackEventCode == WEBSOCKET_EVENT_TEXT) || (callbackEventCode == WEBSOCKET_EVENT_BINARY))
+        {
+            _callbackData.clear();
+            _rxInflateBuffer.clear();
+        }
     }
     return _wsHeader.dataPos + _wsHeader.len;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle streamed data frame payload
+// Returns amount of data consumed
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RdWebSocketLink::handleRxStreamData(uint8_t *pBuf, uint32_t bufLen)
+{
+    // Payload in this buffer
+    uint32_t chunkLen = bufLen;
+    if (chunkLen > _rxStreamFrameRemaining)
+        chunkLen = _rxStreamFrameRemaining;
+
+    // Unmask in place
+    unmaskInPlace(pBuf, chunkLen, _rxStreamFramePos);
+    _rxStreamFramePos += chunkLen;
+    _rxStreamFrameRemaining -= chunkLen;
+
+    // Callback
+    bool frameFinal = _rxStreamFrameRemaining == 0;
+    bool msgFinal = frameFinal && _wsHeader.fin;
+#ifdef DEBUG_WEBSOCKET_LINK_EVENTS
+    LOG_I(MODULE_PREFIX, "handleRxStreamData len %d msgOffset %d frameFinal %d msgFinal %d", 
+                chunkLen, _rxStreamMsgOffset, frameFinal, msgFinal);
+#endif
+    if (_rxStreamCB)
+        _rxStreamCB(_wsHeader.firstFrameOpcode == WEBSOCKET_OPCODE_TEXT ? WEBSOCKET_EVENT_TEXT : WEBSOCKET_EVENT_BINARY,
+                    pBuf, chunkLen, _rxStreamMsgOffset, frameFinal, msgFinal);
+    _rxStreamMsgOffset += chunkLen;
+    return chunkLen;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Extract header information
 // Returns block len (or 0 if not enough data yet to read header)
@@ -587,18 +1022,25 @@ uint32_t RdWebSocketLink::extractWSHeaderInfo(const uint8_t *pBuf, uint32_t bufL
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Unmask
+// Copy received payload unmasking if required
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void RdWebSocketLink::unmaskData()
+void RdWebSocketLink::unmaskInPlace(uint8_t* pBuf, uint32_t len, uint32_t maskOffset)
 {
-    if (_wsHeader.mask)
-    {
-        for (uint32_t i = 0; i < _callbackData.size(); i++)
-        {
-            _callbackData[i] ^= _wsHeader.maskKey[i % WSHeaderInfo::WEB_SOCKET_MASK_KEY_BYTES];
-        }
-    }
+    if (!_wsHeader.mask)
+        return;
+
+#ifdef DEBUG_WEBSOCKET_MASK_TIMING
+    uint64_t unmaskStartUs = micros();
+#endif
+
+    RdWebSocketMask::maskInPlace(pBuf, len, _wsHeader.maskKey, maskOffset);
+
+#ifdef DEBUG_WEBSOCKET_MASK_TIMING
+    uint64_t unmaskElapUs = micros() - unmaskStartUs;
+    if (unmaskElapUs > 0)
+        LOG_I(MODULE_PREFIX, "unmaskInPlace len %d took %lldus %.1fMB/s", len, unmaskElapUs, (double)len / unmaskElapUs);
+#endif
 }
 
 #endif
@@ -15,6 +15,8 @@
 #include <WString.h>
 #include "RdWebSocketDefs.h"
 #include "RdWebConnDefs.h"
+#include "RdWebSocketMask.h"
+#include "RdWebDeflate.h"
 
 class RdWebSocketLink
 {
@@ -25,30 +27,124 @@ public:
     virtual ~RdWebSocketLink();
 
     // Setup the web socket
-    void setup(RdWebSocketCB webSocketCB, RdWebConnSendFn rawConnSendFn, 
-            uint32_t pingIntervalMs, bool roleIsServer, uint32_t disconnIfNoPongMs);
+    void setup(RdWebSocketCB webSocketCB, RdWebConnSendFn rawConnSendFn, RdWebConnSendVecFn rawConnSendVecFn,
+            RdWebConnReadyToSendFn rawConnReadyToSendFn, uint32_t pingIntervalMs, bool roleIsServer, 
+            uint32_t disconnIfNoPongMs, uint32_t txFragmentMaxBytes);
 
     // Service - called frequently
     void service();
 
+    // Set streamed receive - when set data messages are delivered in pieces as they arrive (with no limit
+    // on message size) rather than being reassembled and sent to the callback passed to setup()
+    void setRxStreamCB(RdWebSocketRxStreamCB rxStreamCB)
+    {
+        _rxStreamCB = rxStreamCB;
+    }
+
+    // Set permessage-deflate compression - must be called before the upgrade and is not used with
+    // streamed receive
+    void setDeflate(bool enable, uint32_t windowBits, bool noContextTakeover, RdWebDeflateStats* pStats)
+    {
+        _deflateEnabled = enable;
+        _deflateWindowBits = windowBits;
+        _deflateNoContextTakeover = noContextTakeover;
+        _deflate.setStats(pStats);
+    }
+
     // Upgrade the link
-    void upgradeReceived(const String& wsKey, const String& wsVersion);
+    void upgradeReceived(const String& wsKey, const String& wsVersion, const String& wsExtensions = "");
+
+    // Upgrade the link (client side) - the server's upgrade response has been received and checked
+    void upgradeComplete();
 
-    // Handle incoming data
+    // Gen the hash required for response (the Sec-WebSocket-Accept value for a key)
+    static String genMagicResponse(const String& wsKey, const String& wsVersion);
+
+    // Handle incoming data (copied into the reassembly buffer)
     void handleRxData(const uint8_t* pBuf, uint32_t bufLen);
+
+    // Handle incoming data in a buffer which may be modified - frames are unmasked in place and, when
+    // they are wholly within the buffer, passed to the callback without copying
+    void handleRxDataInPlace(uint8_t* pBuf, uint32_t bufLen);
     
     // Get data to tx
     uint32_t getTxData(uint8_t*& pBuf, uint32_t bufMaxLen);
 
-    // Send message
+    // Send message (as a single frame) - data messages must not be sent while a fragmented message is in progress
     bool sendMsg(WebSocketOpCodes opCode, const uint8_t* pBuf, uint32_t bufLen);
 
+    // Send message in fragments of up to txFragmentMaxBytes - one fragment is sent on each call to
+    // service() when the connection is ready so control frames can be sent in between
+    // The buffer must remain valid until isTxMsgInProgress() returns false
+    bool sendMsgFragmented(WebSocketOpCodes opCode, const uint8_t* pBuf, uint32_t bufLen);
+
+    // Send message with fragments generated by a producer callback
+    bool sendMsgProducer(WebSocketOpCodes opCode, RdWebSocketTxProducerCB txProducerCB);
+
+    // Check if a fragmented message is being sent
+    bool isTxMsgInProgress()
+    {
+        return _txMsgInProgress;
+    }
+
+    // Check if ping round-trip time has been measured (a pong has been received) - the time can be 0ms
+    bool isPingRTTValid()
+    {
+        return _pingRTTValid;
+    }
+
+    // Get ping round-trip time - last and smoothed average (0 if no pong received)
+    uint32_t getPingRTTMs()
+    {
+        return _pingRTTMs;
+    }
+    uint32_t getPingRTTAvgMs()
+    {
+        return _pingRTTAvgMs;
+    }
+
+    // Encode a complete message as a single frame appended to outBuf (for sending with other frames)
+    // Returns the number of bytes added
+    uint32_t encodeFrame(std::vector<uint8_t>& outBuf, WebSocketOpCodes opCode, const uint8_t* pBuf, uint32_t bufLen);
+
+    // Encode a complete message as a single unmasked and uncompressed frame - such frames don't
+    // depend on the state of a link so they can be shared by all server-side links
+    static void encodeFrameUnmasked(std::vector<uint8_t>& outBuf, WebSocketOpCodes opCode, 
+                const uint8_t* pBuf, uint32_t bufLen);
+
+    // Check if frames encoded by encodeFrameUnmasked() can be sent on this link
+    bool canSendUnmaskedFrames()
+    {
+        return !_maskSentData && !_deflateActive;
+    }
+
+    // Send frames encoded with encodeFrame() or encodeFrameUnmasked()
+    bool sendEncodedFrames(const uint8_t* pBuf, uint32_t bufLen);
+
+    // Check if the connection has sent all queued data
+    bool isReadyToSend()
+    {
+        return !_rawConnReadyToSendFn || _rawConnReadyToSendFn();
+    }
+
+    // Max bytes in a frame (messages larger than this are fragmented)
+    uint32_t getTxFragmentMaxBytes()
+    {
+        return _txFragmentMaxBytes;
+    }
+
     // Check active
     bool isActive()
     {
         return _isActive;
     }
 
+    // Max frame header size (2 bytes + 8 byte length + 4 byte mask)
+    static const uint32_t MAX_WS_FRAME_HEADER_BYTES = 14;
+
+    // Max message size (received messages which aren't streamed and the default for queued sent messages)
+    static const uint32_t MAX_WS_MESSAGE_SIZE = 5000;
+
     // Helper
     static const char* getEventStr(RdWebSocketEventCode eventCode)
     {
@@ -76,38 +172,93 @@ private:
     String _wsKey;
     String _wsVersion;
 
-    // Data to be sent to callback when complete
+    // Reassembly buffer for messages sent in fragments
     std::vector<uint8_t> _callbackData;
     RdWebSocketCB _webSocketCB;
 
-    // Received data not yet processed
+    // Received data not yet processed (residual data from a frame which spans received blocks)
     std::vector<uint8_t> _rxDataToProcess;
 
+    // Decompressed message
+    std::vector<uint8_t> _rxInflateBuffer;
+
+    // Streamed receive
+    RdWebSocketRxStreamCB _rxStreamCB;
+    uint64_t _rxStreamFrameRemaining;
+    uint64_t _rxStreamFramePos;
+    uint32_t _rxStreamMsgOffset;
+
     // Raw send on the connection
     RdWebConnSendFn _rawConnSendFn;
 
+    // Raw send of header and payload from separate buffers (used for unmasked frames)
+    RdWebConnSendVecFn _rawConnSendVecFn;
+
+    // Check connection has sent queued data
+    RdWebConnReadyToSendFn _rawConnReadyToSendFn;
+
+    // Fragmented message being sent - from a buffer or from a producer
+    bool _txMsgInProgress;
+    WebSocketOpCodes _txMsgOpCode;
+    const uint8_t* _pTxMsgBuf;
+    uint32_t _txMsgLen;
+    uint32_t _txMsgPos;
+    RdWebSocketTxProducerCB _txProducerCB;
+    uint32_t _txFragmentMaxBytes;
+    std::vector<uint8_t> _txFragmentBuffer;
+
     // Data to be sent
     String _wsUpgradeResponse;
 
+    // Compression
+    RdWebDeflate _deflate;
+    bool _deflateEnabled;
+    uint32_t _deflateWindowBits;
+    bool _deflateNoContextTakeover;
+    bool _deflateActive;
+    String _deflateRespParams;
+    bool _txMsgCompressed;
+    std::vector<uint8_t> _txDeflateBuffer;
+    static const uint32_t DEFLATE_MIN_MSG_BYTES = 32;
+
     // Active
     bool _isActive;
 
     // Mask sent data
     bool _maskSentData;
 
-    // Max message size
-    static const uint32_t MAX_WS_MESSAGE_SIZE = 5000;
+    // Default max size of fragments of sent messages
+    static const uint32_t DEFAULT_TX_FRAGMENT_MAX_BYTES = 1000;
 
     // Retry
     static const uint32_t MAX_WS_SEND_RETRY_MS = 0;
 
-    // Ping/Pong sending
+    // Close status codes (RFC6455 7.4.1)
+    static const uint16_t WEBSOCKET_CLOSE_PROTOCOL_ERROR = 1002;
+    static const uint16_t WEBSOCKET_CLOSE_INVALID_DATA = 1007;
+
+    // Max control frame payload
+    static const uint32_t MAX_WS_CONTROL_PAYLOAD_BYTES = 125;
+
+    // Ping/Pong sending - a ping is sent when nothing has been received for _pingIntervalMs plus a random
+    // jitter (up to 1/PING_JITTER_DIVISOR of the interval) so that pings on different links don't synchronise
     // Set _pingIntervalMs to 0 to disable pings from server
     uint32_t _pingIntervalMs;
+    uint32_t _pingJitterMs;
     uint32_t _pingTimeLastMs;
     uint32_t _pongRxLastMs;
+    uint32_t _rxLastMs;
     uint32_t _disconnIfNoPongMs;
     bool _warnNoPongShown = false;
+    static const uint32_t PING_JITTER_DIVISOR = 4;
+
+    // Ping round-trip time (last and smoothed)
+    bool _pingAwaitingPong;
+    uint32_t _pingRTTMs;
+    uint32_t _pingRTTAvgMs;
+    bool _pingRTTValid;
+    static const uint32_t PING_RTT_AVG_WEIGHT = 8;
+    void updatePingJitter();
     
     // Debug
     static const uint32_t MAX_DEBUG_TEXT_STR_LEN = 100;
@@ -120,6 +271,8 @@ private:
         WSHeaderInfo()
         {
             fin = false;
+            rsv1 = false;
+            msgCompressed = false;
             mask = 0;
             opcode = 0;
             len = 0;
@@ -134,11 +287,13 @@ private:
         // Returns length of block (0 indicates header not long enough)
         uint32_t extract(const uint8_t* pBuf, uint32_t bufLen)
         {
-            // First two bytes
+            // First two bytes - dataPos is 0 until the header is complete
             uint32_t pos = 0;
+            dataPos = 0;
             if (bufLen < pos + 2)
                 return 0;
             fin = (pBuf[pos] & 0x80) != 0;
+            rsv1 = (pBuf[pos] & 0x40) != 0;
             opcode = pBuf[pos] & 0x0f;
             pos += 1;
             mask = (pBuf[pos] & 0x80) != 0;
@@ -170,7 +325,7 @@ private:
             // Check for mask
             if (mask)
             {
-                if (bufLen < pos + 2)
+                if (bufLen < pos + WEB_SOCKET_MASK_KEY_BYTES)
                     return 0;
                 maskKey[0] = pBuf[pos++];
                 maskKey[1] = pBuf[pos++];
@@ -181,9 +336,13 @@ private:
             // Data pos
             dataPos = pos;
 
-            // Check if we should update first-frame opcode
-            if (opcode != WEBSOCKET_OPCODE_CONTINUE)
+            // Check if we should update first-frame opcode (control frames may be interleaved with fragments)
+            // RSV1 on the first frame indicates a compressed message
+            if ((opcode == WEBSOCKET_OPCODE_TEXT) || (opcode == WEBSOCKET_OPCODE_BINARY))
+            {
                 firstFrameOpcode = opcode;
+                msgCompressed = rsv1;
+            }
 
             // Check length
             return len;
@@ -191,30 +350,39 @@ private:
 
         // Header
         bool fin;
+        bool rsv1;
         bool mask;
         uint32_t opcode;
         uint64_t len;
-        static const uint32_t WEB_SOCKET_MASK_KEY_BYTES = 4;
+        static const uint32_t WEB_SOCKET_MASK_KEY_BYTES = RdWebSocketMask::MASK_KEY_BYTES;
         uint8_t maskKey[WEB_SOCKET_MASK_KEY_BYTES];
         uint32_t dataPos;
 
         // Receive state
         bool ignoreUntilFinal;
         uint32_t firstFrameOpcode;
+        bool msgCompressed;
     };
     WSHeaderInfo _wsHeader;
 
     // Helpers
-    uint32_t handleRxPacketData(const uint8_t* pBuf, uint32_t bufLen);
+    bool checkUpgradeReq(const uint8_t*& pBuf, uint32_t& bufLen);
+    void addToRxDataToProcess(const uint8_t* pBuf, uint32_t bufLen);
+    void processRxData(uint8_t* pBuf, uint32_t bufLen);
+    uint32_t handleRxPacketData(uint8_t* pBuf, uint32_t bufLen);
+    void failConnection(uint16_t closeCode);
+    uint32_t handleRxStreamData(uint8_t* pBuf, uint32_t bufLen);
     uint32_t extractWSHeaderInfo(const uint8_t* pBuf, uint32_t bufLen);
-    void unmaskData();
+    bool sendFrame(WebSocketOpCodes opCode, bool finalFrame, const uint8_t* pBuf, uint32_t bufLen,
+                bool compressed = false);
+    void serviceTxMsg();
+    void unmaskInPlace(uint8_t* pBuf, uint32_t len, uint32_t maskOffset = 0);
+    static uint32_t formFrameHeader(uint8_t* pHdr, WebSocketOpCodes opCode, bool finalFrame, bool compressed,
+                uint32_t payloadLen, const uint8_t* pMaskKey);
 
     // Form response to upgrade connection
     String formUpgradeResponse(const String& wsKey, const String& wsVersion, uint32_t bufMaxLen);
 
-    // Gen the hash required for response
-    String genMagicResponse(const String& wsKey, const String& wsVersion);
-
 };
 
 #endif
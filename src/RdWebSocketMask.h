@@ -0,0 +1,71 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// WebSocket masking - XOR of payload with a 4 byte key
+// Bytes are processed a machine word at a time once the destination is word aligned
+// maskOffset is the position in the payload of the first byte (so a payload can be processed in pieces)
+class RdWebSocketMask
+{
+public:
+    static const uint32_t MASK_KEY_BYTES = 4;
+
+    // Mask (or unmask) in place
+    static void maskInPlace(uint8_t* pBuf, uint32_t len, const uint8_t* pMaskKey, uint32_t maskOffset = 0)
+    {
+        maskCopy(pBuf, pBuf, len, pMaskKey, maskOffset);
+    }
+
+    // Mask (or unmask) from source to destination - pSrc may equal pDest
+    static void maskCopy(uint8_t* pDest, const uint8_t* pSrc, uint32_t len, const uint8_t* pMaskKey, uint32_t maskOffset = 0)
+    {
+        // Head bytes until destination is aligned
+        uint32_t pos = 0;
+        while ((pos < len) && (((uintptr_t)(pDest + pos)) % sizeof(MaskWord) != 0))
+        {
+            pDest[pos] = pSrc[pos] ^ pMaskKey[(maskOffset + pos) % MASK_KEY_BYTES];
+            pos++;
+        }
+
+        // Key replicated across a word starting at the current key position
+        if (len - pos >= sizeof(MaskWord))
+        {
+            uint8_t keyBytes[sizeof(MaskWord)];
+            for (uint32_t i = 0; i < sizeof(MaskWord); i++)
+                keyBytes[i] = pMaskKey[(maskOffset + pos + i) % MASK_KEY_BYTES];
+            MaskWord keyWord;
+            memcpy(&keyWord, keyBytes, sizeof(keyWord));
+
+            // Words - loaded and stored with memcpy to avoid type-punning (and as the source may not be
+            // aligned) - this compiles to a single load and store
+            uint32_t wordsEnd = pos + ((len - pos) / sizeof(MaskWord)) * sizeof(MaskWord);
+            for (; pos < wordsEnd; pos += sizeof(MaskWord))
+            {
+                MaskWord dataWord;
+                memcpy(&dataWord, pSrc + pos, sizeof(dataWord));
+                dataWord ^= keyWord;
+                memcpy(pDest + pos, &dataWord, sizeof(dataWord));
+            }
+        }
+
+        // Tail bytes
+        for (; pos < len; pos++)
+            pDest[pos] = pSrc[pos] ^ pMaskKey[(maskOffset + pos) % MASK_KEY_BYTES];
+    }
+
+private:
+#if defined(__SIZEOF_POINTER__) && (__SIZEOF_POINTER__ >= 8)
+    typedef uint64_t MaskWord;
+#else
+    typedef uint32_t MaskWord;
+#endif
+};
@@ -0,0 +1,240 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RdWebSocketMux.h"
+#include <Logger.h>
+
+// Warn
+#define WARN_WEBSOCKET_MUX_RX_INVALID
+
+#if defined(WARN_WEBSOCKET_MUX_RX_INVALID)
+static const char *MODULE_PREFIX = "RdWSMux";
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebSocketMux::RdWebSocketMux()
+{
+    _initialCredits = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketMux::setup(const std::vector<uint32_t>& channelIDs, uint32_t initialCredits)
+{
+    uint32_t numChannels = channelIDs.size() < MAX_VIRTUAL_CHANNELS ? channelIDs.size() : MAX_VIRTUAL_CHANNELS;
+    _initialCredits = initialCredits;
+    _channels.clear();
+    _channels.resize(numChannels);
+    _txCredits = std::vector<std::atomic<uint32_t>>(numChannels);
+    for (uint32_t i = 0; i < numChannels; i++)
+    {
+        _channels[i].channelID = channelIDs[i];
+        _channels[i].rxCredits = initialCredits;
+        _txCredits[i].store(initialCredits);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get channelIDs
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RdWebSocketMux::getChannelIDs(std::vector<uint32_t>& channelIDs) const
+{
+    for (const VirtChannel& virtChannel : _channels)
+    {
+        if (virtChannel.channelID != UINT32_MAX)
+            channelIDs.push_back(virtChannel.channelID);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get virtual channel index
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketMux::getVirtChanIdx(uint32_t channelID, uint32_t& virtChanIdx) const
+{
+    // There are only a few channels so a linear search is fine
+    for (uint32_t i = 0; i < _channels.size(); i++)
+    {
+        if (_channels[i].channelID == channelID)
+        {
+            virtChanIdx = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check if a message can be sent
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketMux::canSend(uint32_t channelID) const
+{
+    uint32_t virtChanIdx = 0;
+    if (!getVirtChanIdx(channelID, virtChanIdx))
+        return false;
+    return (_initialCredits == 0) || (_txCredits[virtChanIdx].load() > 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Account for a message to be sent
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketMux::txMsgStart(uint32_t channelID, uint32_t msgLen, uint32_t& virtChanIdx)
+{
+    if (!getVirtChanIdx(channelID, virtChanIdx))
+        return false;
+    VirtChannel& virtChannel = _channels[virtChanIdx];
+
+    // Take a credit (only the sender decrements so the check and decrement can't race)
+    if (_initialCredits != 0)
+    {
+        if (_txCredits[virtChanIdx].load() == 0)
+        {
+            virtChannel.txNoCredit++;
+            return false;
+        }
+        _txCredits[virtChanIdx].fetch_sub(1);
+    }
+    virtChannel.txMsgs++;
+    virtChannel.txBytes += msgLen;
+    return true;
+}
+
+void RdWebSocketMux::txMsgCancel(uint32_t virtChanIdx, uint32_t msgLen)
+{
+    if (virtChanIdx >= _channels.size())
+        return;
+    if (_initialCredits != 0)
+        _txCredits[virtChanIdx].fetch_add(1);
+    _channels[virtChanIdx].txMsgs--;
+    _channels[virtChanIdx].txBytes -= msgLen;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Handle received message
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RdWebSocketMux::MuxRxResult RdWebSocketMux::handleRxMsg(const uint8_t* pBuf, uint32_t bufLen,
+            uint32_t& channelID, const uint8_t*& pPayload, uint32_t& payloadLen)
+{
+    // Check header - the virtual channel must exist and have a channelID (it is unused otherwise)
+    if (!pBuf || (bufLen < MUX_HEADER_BYTES) || (pBuf[0] >= _channels.size()) || 
+                (_channels[pBuf[0]].channelID == UINT32_MAX))
+    {
+#ifdef WARN_WEBSOCKET_MUX_RX_INVALID
+        LOG_W(MODULE_PREFIX, "handleRxMsg invalid len %d virtChan %d", bufLen, pBuf && (bufLen > 0) ? pBuf[0] : -1);
+#endif
+        return MUX_RX_INVALID;
+    }
+    uint32_t virtChanIdx = pBuf[0];
+    VirtChannel& virtChannel = _channels[virtChanIdx];
+
+    // Handle message types
+    switch (pBuf[1])
+    {
+        case MUX_MSG_DATA:
+        {
+            // Check the sender had credit
+            if (_initialCredits != 0)
+            {
+                if (virtChannel.rxCredits == 0)
+                {
+                    virtChannel.rxDropped++;
+                    return MUX_RX_DROPPED;
+                }
+                virtChannel.rxCredits--;
+                virtChannel.rxCreditsDue++;
+            }
+            channelID = virtChannel.channelID;
+            pPayload = pBuf + MUX_HEADER_BYTES;
+            payloadLen = bufLen - MUX_HEADER_BYTES;
+            virtChannel.rxMsgs++;
+            virtChannel.rxBytes += payloadLen;
+            return MUX_RX_DATA;
+        }
+        case MUX_MSG_CREDIT:
+        {
+            if (bufLen < MUX_CREDIT_MSG_BYTES)
+                return MUX_RX_INVALID;
+
+            // Credit is ignored without flow control and can't take the window above the initial credits
+            // (the sender decrements concurrently so the clamped value is set with compare-exchange)
+            if (_initialCredits == 0)
+                return MUX_RX_CONTROL;
+            uint32_t creditAdd = (pBuf[2] << 8) | pBuf[3];
+            uint32_t curCredits = _txCredits[virtChanIdx].load();
+            uint32_t newCredits = 0;
+            do {
+                newCredits = (creditAdd > _initialCredits - curCredits) ? _initialCredits : curCredits + creditAdd;
+            } while (!_txCredits[virtChanIdx].compare_exchange_weak(curCredits, newCredits));
+#ifdef WARN_WEBSOCKET_MUX_RX_INVALID
+            if (newCredits != curCredits + creditAdd)
+                LOG_W(MODULE_PREFIX, "handleRxMsg credit %d exceeds window %d virtChan %d", 
+                            creditAdd, _initialCredits, virtChanIdx);
+#endif
+            return MUX_RX_CONTROL;
+        }
+        default:
+        {
+#ifdef WARN_WEBSOCKET_MUX_RX_INVALID
+            LOG_W(MODULE_PREFIX, "handleRxMsg unknown type %d virtChan %d", pBuf[1], virtChanIdx);
+#endif
+            return MUX_RX_INVALID;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get credit message for received messages
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RdWebSocketMux::getRxCreditMsg(uint8_t* pBuf, uint32_t bufLen)
+{
+    // Credit is returned in batches of half the initial credits
+    if (bufLen < MUX_CREDIT_MSG_BYTES)
+        return false;
+    uint32_t creditBatch = _initialCredits > 1 ? _initialCredits / 2 : 1;
+    for (uint32_t virtChanIdx = 0; virtChanIdx < _channels.size(); virtChanIdx++)
+    {
+        VirtChannel& virtChannel = _channels[virtChanIdx];
+        if (virtChannel.rxCreditsDue < creditBatch)
+            continue;
+        writeHeader(pBuf, virtChanIdx, MUX_MSG_CREDIT);
+        pBuf[2] = (virtChannel.rxCreditsDue >> 8) & 0xff;
+        pBuf[3] = virtChannel.rxCreditsDue & 0xff;
+        virtChannel.rxCredits += virtChannel.rxCreditsDue;
+        virtChannel.rxCreditsDue = 0;
+        return true;
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Stats for a channel
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String RdWebSocketMux::getStatsJSON(uint32_t channelID) const
+{
+    uint32_t virtChanIdx = 0;
+    if (!getVirtChanIdx(channelID, virtChanIdx))
+        return "{}";
+    const VirtChannel& virtChannel = _channels[virtChanIdx];
+    char jsonStr[200];
+    snprintf(jsonStr, sizeof(jsonStr),
+                R"({"vChan":%d,"txMsgs":%d,"txBytes":%d,"txNoCredit":%d,"txCredits":%d,"rxMsgs":%d,"rxBytes":%d,"rxDropped":%d})",
+                virtChanIdx, virtChannel.txMsgs, virtChannel.txBytes, virtChannel.txNoCredit,
+                _txCredits[virtChanIdx].load(), virtChannel.rxMsgs, virtChannel.rxBytes, virtChannel.rxDropped);
+    return jsonStr;
+}
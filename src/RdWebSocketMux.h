@@ -0,0 +1,112 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <WString.h>
+
+// Virtual channel multiplexing over a single websocket (the "rdmux" sub-protocol)
+// Each binary message starts with a header of the virtual channel index and the message type
+// DATA messages carry application data for the virtual channel and CREDIT messages (payload is a
+// 16 bit big-endian count) allow the receiver to send that many more DATA messages on the channel
+// Each side starts with the initial credits for each channel - if initial credits is 0 there is no
+// flow control - credit received can't take a channel's window above the initial credits
+class RdWebSocketMux
+{
+public:
+    enum MuxMsgType
+    {
+        MUX_MSG_DATA = 0,
+        MUX_MSG_CREDIT = 1
+    };
+    enum MuxRxResult
+    {
+        MUX_RX_DATA,
+        MUX_RX_CONTROL,
+        MUX_RX_DROPPED,
+        MUX_RX_INVALID
+    };
+    static const uint32_t MUX_HEADER_BYTES = 2;
+    static const uint32_t MUX_CREDIT_MSG_BYTES = MUX_HEADER_BYTES + 2;
+    static const uint32_t MAX_VIRTUAL_CHANNELS = 255;
+
+    RdWebSocketMux();
+
+    // Setup - channelIDs are the channelIDs of the virtual channels (in virtual channel index order)
+    void setup(const std::vector<uint32_t>& channelIDs, uint32_t initialCredits);
+
+    // Check enabled
+    bool isEnabled() const
+    {
+        return !_channels.empty();
+    }
+
+    // Get channelIDs
+    void getChannelIDs(std::vector<uint32_t>& channelIDs) const;
+
+    // Get virtual channel index from channelID
+    bool getVirtChanIdx(uint32_t channelID, uint32_t& virtChanIdx) const;
+
+    // Check if a DATA message can be sent (the channel exists and the receiver has given credit)
+    bool canSend(uint32_t channelID) const;
+
+    // Account for a DATA message to be sent - returns false (and the message must not be sent) if the
+    // channel doesn't exist or has no credit
+    bool txMsgStart(uint32_t channelID, uint32_t msgLen, uint32_t& virtChanIdx);
+
+    // Undo txMsgStart() for a message which couldn't be sent
+    void txMsgCancel(uint32_t virtChanIdx, uint32_t msgLen);
+
+    // Write a message header
+    static void writeHeader(uint8_t* pBuf, uint32_t virtChanIdx, MuxMsgType msgType)
+    {
+        pBuf[0] = virtChanIdx;
+        pBuf[1] = msgType;
+    }
+
+    // Handle a received message - for DATA messages channelID, pPayload and payloadLen are set
+    MuxRxResult handleRxMsg(const uint8_t* pBuf, uint32_t bufLen, uint32_t& channelID,
+                const uint8_t*& pPayload, uint32_t& payloadLen);
+
+    // Get a CREDIT message to send (for DATA messages that have been received) - returns false if
+    // no credit is due
+    bool getRxCreditMsg(uint8_t* pBuf, uint32_t bufLen);
+
+    // Stats for a channel
+    String getStatsJSON(uint32_t channelID) const;
+
+private:
+    // Virtual channels
+    class VirtChannel
+    {
+    public:
+        uint32_t channelID = UINT32_MAX;
+
+        // Rx credit (DATA messages the other side can still send) and credit to be returned
+        uint32_t rxCredits = 0;
+        uint32_t rxCreditsDue = 0;
+
+        // Stats
+        uint32_t txMsgs = 0;
+        uint32_t txBytes = 0;
+        uint32_t txNoCredit = 0;
+        uint32_t rxMsgs = 0;
+        uint32_t rxBytes = 0;
+        uint32_t rxDropped = 0;
+    };
+    std::vector<VirtChannel> _channels;
+
+    // Tx credits are taken by the sender and added on receipt of CREDIT messages
+    std::vector<std::atomic<uint32_t>> _txCredits;
+
+    // Initial credits (0 if no flow control)
+    uint32_t _initialCredits;
+};
@@ -0,0 +1,155 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RdWebSocketPlatform.h"
+#include <string.h>
+#if defined(ESP_PLATFORM) || defined(ESP8266)
+#include <mbedtls/sha1.h>
+#include <mbedtls/base64.h>
+#include "esp_system.h"
+#else
+#include <random>
+#endif
+
+#if defined(ESP_PLATFORM) || defined(ESP8266)
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Target - hardware RNG and mbedtls
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RdWebSocketPlatform::random32()
+{
+    return esp_random();
+}
+
+void RdWebSocketPlatform::sha1(const uint8_t* pBuf, uint32_t bufLen, uint8_t* pResult)
+{
+    mbedtls_sha1(pBuf, bufLen, pResult);
+}
+
+bool RdWebSocketPlatform::base64Encode(const uint8_t* pBuf, uint32_t bufLen, char* pOut, uint32_t outMaxLen, uint32_t& outLen)
+{
+    size_t encodedLen = 0;
+    if ((mbedtls_base64_encode((uint8_t*)pOut, outMaxLen, &encodedLen, pBuf, bufLen) != 0) || (encodedLen >= outMaxLen))
+        return false;
+    pOut[encodedLen] = '\0';
+    outLen = encodedLen;
+    return true;
+}
+
+#else
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Host - std::random_device and portable SHA-1 (FIPS 180-4) and base64 (RFC 4648)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RdWebSocketPlatform::random32()
+{
+    static std::random_device randomDevice;
+    return randomDevice();
+}
+
+static inline uint32_t sha1Rotl(uint32_t val, uint32_t bits)
+{
+    return (val << bits) | (val >> (32 - bits));
+}
+
+void RdWebSocketPlatform::sha1(const uint8_t* pBuf, uint32_t bufLen, uint8_t* pResult)
+{
+    uint32_t hash[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+    // Blocks of 64 bytes - the last is padded with 0x80, zeros and the length in bits (big-endian)
+    uint64_t bitLen = (uint64_t)bufLen * 8;
+    uint32_t paddedLen = ((bufLen + 8) / 64 + 1) * 64;
+    for (uint32_t blockPos = 0; blockPos < paddedLen; blockPos += 64)
+    {
+        uint8_t block[64];
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            uint32_t pos = blockPos + i;
+            if (pos < bufLen)
+                block[i] = pBuf[pos];
+            else if (pos == bufLen)
+                block[i] = 0x80;
+            else if (pos >= paddedLen - 8)
+                block[i] = (uint8_t)(bitLen >> ((paddedLen - 1 - pos) * 8));
+            else
+                block[i] = 0;
+        }
+        uint32_t w[80];
+        for (uint32_t i = 0; i < 16; i++)
+            w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+                        ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+        for (uint32_t i = 16; i < 80; i++)
+            w[i] = sha1Rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = hash[0], b = hash[1], c = hash[2], d = hash[3], e = hash[4];
+        for (uint32_t i = 0; i < 80; i++)
+        {
+            uint32_t f = 0, k = 0;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            uint32_t temp = sha1Rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = sha1Rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        hash[0] += a;
+        hash[1] += b;
+        hash[2] += c;
+        hash[3] += d;
+        hash[4] += e;
+    }
+    for (uint32_t i = 0; i < SHA1_RESULT_LEN; i++)
+        pResult[i] = (uint8_t)(hash[i / 4] >> (24 - (i % 4) * 8));
+}
+
+bool RdWebSocketPlatform::base64Encode(const uint8_t* pBuf, uint32_t bufLen, char* pOut, uint32_t outMaxLen, uint32_t& outLen)
+{
+    static const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t encodedLen = (bufLen + 2) / 3 * 4;
+    if (encodedLen >= outMaxLen)
+        return false;
+    char* pDest = pOut;
+    for (uint32_t i = 0; i < bufLen; i += 3)
+    {
+        uint32_t val = (uint32_t)pBuf[i] << 16;
+        if (i + 1 < bufLen)
+            val |= (uint32_t)pBuf[i + 1] << 8;
+        if (i + 2 < bufLen)
+            val |= pBuf[i + 2];
+        *pDest++ = BASE64_CHARS[(val >> 18) & 0x3f];
+        *pDest++ = BASE64_CHARS[(val >> 12) & 0x3f];
+        *pDest++ = i + 1 < bufLen ? BASE64_CHARS[(val >> 6) & 0x3f] : '=';
+        *pDest++ = i + 2 < bufLen ? BASE64_CHARS[val & 0x3f] : '=';
+    }
+    *pDest = '\0';
+    outLen = encodedLen;
+    return true;
+}
+
+#endif
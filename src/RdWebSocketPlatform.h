@@ -0,0 +1,43 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+// Sockets - lwip's BSD socket API on the target and the POSIX one on a host (for tests)
+#if defined(ESP_PLATFORM) || defined(ESP8266)
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// Platform functions used by the websocket link and client - esp_random() and mbedtls on the target
+// and portable versions on a host so the websocket code can be tested there
+class RdWebSocketPlatform
+{
+public:
+    // Random number (from the hardware RNG on the target)
+    static uint32_t random32();
+
+    // SHA-1 of data
+    static const uint32_t SHA1_RESULT_LEN = 20;
+    static void sha1(const uint8_t* pBuf, uint32_t bufLen, uint8_t* pResult);
+
+    // Base64 encode - the output is null terminated - returns false if outMaxLen is too small
+    static bool base64Encode(const uint8_t* pBuf, uint32_t bufLen, char* pOut, uint32_t outMaxLen, uint32_t& outLen);
+};
@@ -0,0 +1,117 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <WString.h>
+
+// Registry of publish/subscribe topics - each topic has a bitmap of the connection slots subscribed to it
+// so publishing only visits subscribers and connections with no subscriptions cost nothing
+// Not thread-safe - the owner must serialize access
+class RdWebTopics
+{
+public:
+    RdWebTopics()
+    {
+    }
+
+    // Setup (clears subscriptions - topics already added are kept)
+    void setup(uint32_t numConnSlots)
+    {
+        _wordsPerTopic = (numConnSlots + BITS_PER_WORD - 1) / BITS_PER_WORD;
+        _subscriberBits.assign(_topicNames.size() * _wordsPerTopic, 0);
+    }
+
+    // Add topic - returns the topic index (which is unchanged if the topic already exists)
+    uint32_t addTopic(const String& topicName)
+    {
+        uint32_t topicIdx = 0;
+        if (getTopicIdx(topicName, topicIdx))
+            return topicIdx;
+        _topicNames.push_back(topicName);
+        _subscriberBits.resize(_subscriberBits.size() + _wordsPerTopic, 0);
+        return _topicNames.size() - 1;
+    }
+
+    // Get topic index from name
+    bool getTopicIdx(const String& topicName, uint32_t& topicIdx) const
+    {
+        for (uint32_t i = 0; i < _topicNames.size(); i++)
+        {
+            if (_topicNames[i].equals(topicName))
+            {
+                topicIdx = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Topic index returned if a topic can't be added
+    static const uint32_t TOPIC_IDX_INVALID = UINT32_MAX;
+
+    // Get number of topics
+    uint32_t getNumTopics() const
+    {
+        return _topicNames.size();
+    }
+
+    // Subscribe (or unsubscribe) a connection slot - returns false if the topic doesn't exist
+    bool subscribe(const String& topicName, uint32_t connSlotIdx, bool subscribe)
+    {
+        uint32_t topicIdx = 0;
+        if (!getTopicIdx(topicName, topicIdx) || (connSlotIdx >= _wordsPerTopic * BITS_PER_WORD))
+            return false;
+        uint32_t& word = _subscriberBits[topicIdx * _wordsPerTopic + connSlotIdx / BITS_PER_WORD];
+        uint32_t bitMask = 1UL << (connSlotIdx % BITS_PER_WORD);
+        if (subscribe)
+            word |= bitMask;
+        else
+            word &= ~bitMask;
+        return true;
+    }
+
+    // Unsubscribe a connection slot from all topics
+    void unsubscribeAll(uint32_t connSlotIdx)
+    {
+        if (connSlotIdx >= _wordsPerTopic * BITS_PER_WORD)
+            return;
+        uint32_t bitMask = 1UL << (connSlotIdx % BITS_PER_WORD);
+        for (uint32_t i = connSlotIdx / BITS_PER_WORD; i < _subscriberBits.size(); i += _wordsPerTopic)
+            _subscriberBits[i] &= ~bitMask;
+    }
+
+    // Call fn(connSlotIdx) for each connection slot subscribed to a topic
+    template<typename Fn>
+    void forEachSubscriber(uint32_t topicIdx, Fn fn) const
+    {
+        if (topicIdx >= _topicNames.size())
+            return;
+        for (uint32_t wordIdx = 0; wordIdx < _wordsPerTopic; wordIdx++)
+        {
+            uint32_t word = _subscriberBits[topicIdx * _wordsPerTopic + wordIdx];
+            while (word)
+            {
+                uint32_t bitIdx = __builtin_ctz(word);
+                word &= word - 1;
+                fn(wordIdx * BITS_PER_WORD + bitIdx);
+            }
+        }
+    }
+
+private:
+    // Topic names (index is the topic index)
+    std::vector<String> _topicNames;
+
+    // Subscriber bitmaps - _wordsPerTopic words for each topic
+    std::vector<uint32_t> _subscriberBits;
+    uint32_t _wordsPerTopic = 0;
+    static const uint32_t BITS_PER_WORD = 32;
+};
@@ -0,0 +1,239 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <WString.h>
+#include <Utils.h>
+#include <ArduinoTime.h>
+#include "RdWebSPSCQueue.h"
+#include <functional>
+#ifndef ESP8266
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#else
+#include "ESP8266Utils.h"
+#endif
+
+// Policy applied when a message is put on a full tx queue
+enum RdWebTxQueuePolicy
+{
+    // Wait (up to a time limit) for space
+    TX_QUEUE_POLICY_BLOCK,
+    // Discard the new message
+    TX_QUEUE_POLICY_DROP_NEWEST,
+    // Discard the oldest queued message to make space
+    TX_QUEUE_POLICY_DROP_OLDEST,
+    // Remove a queued message with the same key (even if not full) and add the new message at the end so
+    // the queue stays in the order messages were put - if full with no message with the same key the
+    // oldest message (whatever its key) is dropped so the queue should be longer than the number of keys
+    TX_QUEUE_POLICY_LATEST_KEYED
+};
+
+// Bounded tx queue (single producer and single consumer) with a policy for when the consumer can't
+// keep up - block and drop-newest are lock-free while drop-oldest and latest-keyed modify queued
+// messages from the producer side so a lock is held by both sides
+// The block policy delays the producer task (up to blockMaxMs) so put() must not be called with a
+// lock held that the consumer or other unrelated senders need
+// A message put with a tag is passed to the removed callback (on the producer task) if it is later
+// dropped or replaced by the policy - so resources taken for it (e.g. flow control credit) can be returned
+template<typename T>
+class RdWebTxQueue
+{
+public:
+    typedef std::function<void(const T& item, uint32_t tag)> RemovedCB;
+
+    RdWebTxQueue(uint32_t maxLen = DEFAULT_MAX_LEN)
+        : _queue(maxLen)
+    {
+    }
+    virtual ~RdWebTxQueue()
+    {
+        if (_lock)
+            vSemaphoreDelete(_lock);
+    }
+
+    // Setup (must be called before the queue is used)
+    void setup(uint32_t maxLen, RdWebTxQueuePolicy policy, uint32_t blockMaxMs)
+    {
+        _queue.setMaxLen(maxLen);
+        _policy = policy;
+        _blockMaxMs = blockMaxMs;
+        _dropCount = 0;
+        _replaceCount = 0;
+        bool lockRequired = (policy == TX_QUEUE_POLICY_DROP_OLDEST) || (policy == TX_QUEUE_POLICY_LATEST_KEYED);
+        if (lockRequired && !_lock)
+            _lock = xSemaphoreCreateMutex();
+    }
+
+    // Set callback for queued messages with a tag which are dropped or replaced (called with the lock held)
+    void setRemovedCB(RemovedCB removedCB)
+    {
+        _removedCB = removedCB;
+    }
+
+    // Put a message (producer only) - the key is only used by the latest-keyed policy
+    // Returns false if the message is dropped (the removed callback isn't called for this message)
+    bool put(const T& item, uint32_t key = 0, uint32_t tag = 0)
+    {
+        Slot slot(item, key, tag);
+        switch (_policy)
+        {
+            case TX_QUEUE_POLICY_BLOCK:
+            {
+                uint32_t startMs = millis();
+                while (!_queue.put(slot))
+                {
+                    if (Utils::isTimeout(millis(), startMs, _blockMaxMs))
+                    {
+                        _dropCount++;
+                        return false;
+                    }
+                    vTaskDelay(1);
+                }
+                return true;
+            }
+            case TX_QUEUE_POLICY_DROP_OLDEST:
+            case TX_QUEUE_POLICY_LATEST_KEYED:
+            {
+                if (!_lock || (xSemaphoreTake(_lock, pdMS_TO_TICKS(LOCK_WAIT_MS)) != pdTRUE))
+                {
+                    _dropCount++;
+                    return false;
+                }
+                // Remove queued message with the same key (the new message goes at the end)
+                if ((_policy == TX_QUEUE_POLICY_LATEST_KEYED) &&
+                            _queue.removeQueued([this, key](const Slot& queued) {
+                                if (queued.key != key)
+                                    return false;
+                                slotRemoved(queued);
+                                return true;
+                            }))
+                    _replaceCount++;
+                if (!_queue.put(slot))
+                {
+                    // Make space by dropping the oldest
+                    Slot dropped;
+                    _queue.get(dropped);
+                    slotRemoved(dropped);
+                    _queue.put(slot);
+                    _dropCount++;
+                }
+                xSemaphoreGive(_lock);
+                return true;
+            }
+            default:
+            {
+                bool putOk = _queue.put(slot);
+                if (!putOk)
+                    _dropCount++;
+                return putOk;
+            }
+        }
+    }
+
+    // Get a message (consumer only)
+    bool get(T& item)
+    {
+        Slot slot;
+        bool getOk = false;
+        if (_lock)
+        {
+            // Don't wait as the consumer is serviced frequently
+            if (xSemaphoreTake(_lock, 0) != pdTRUE)
+                return false;
+            getOk = _queue.get(slot);
+            xSemaphoreGive(_lock);
+        }
+        else
+        {
+            getOk = _queue.get(slot);
+        }
+        if (getOk)
+            item = std::move(slot.item);
+        return getOk;
+    }
+
+    // Count
+    uint32_t count() const
+    {
+        return _queue.count();
+    }
+
+    // Max len
+    uint32_t maxLen() const
+    {
+        return _queue.maxLen();
+    }
+
+    // Number of messages dropped (not including those replaced)
+    uint32_t getDropCount() const
+    {
+        return _dropCount;
+    }
+
+    // Number of messages removed as a newer message with the same key was put
+    uint32_t getReplaceCount() const
+    {
+        return _replaceCount;
+    }
+
+    // Policy from string (as used in config)
+    static RdWebTxQueuePolicy getPolicyFromStr(const String& policyStr)
+    {
+        if (policyStr.equalsIgnoreCase("block"))
+            return TX_QUEUE_POLICY_BLOCK;
+        if (policyStr.equalsIgnoreCase("dropOldest"))
+            return TX_QUEUE_POLICY_DROP_OLDEST;
+        if (policyStr.equalsIgnoreCase("latest"))
+            return TX_QUEUE_POLICY_LATEST_KEYED;
+        return TX_QUEUE_POLICY_DROP_NEWEST;
+    }
+
+    static const uint32_t DEFAULT_MAX_LEN = 10;
+
+private:
+    // Queued message and its key
+    class Slot
+    {
+    public:
+        Slot()
+        {
+        }
+        Slot(const T& item, uint32_t key, uint32_t tag)
+            : item(item), key(key), tag(tag)
+        {
+        }
+        T item;
+        uint32_t key = 0;
+        uint32_t tag = 0;
+    };
+    RdWebSPSCQueue<Slot> _queue;
+
+    // Callback for tagged messages dropped or replaced
+    RemovedCB _removedCB;
+    void slotRemoved(const Slot& slot)
+    {
+        if (slot.tag && _removedCB)
+            _removedCB(slot.item, slot.tag);
+    }
+
+    // Policy
+    RdWebTxQueuePolicy _policy = TX_QUEUE_POLICY_DROP_NEWEST;
+    uint32_t _blockMaxMs = 0;
+
+    // Lock (only for policies which modify queued messages)
+    SemaphoreHandle_t _lock = nullptr;
+    static const uint32_t LOCK_WAIT_MS = 2;
+
+    // Stats
+    uint32_t _dropCount = 0;
+    uint32_t _replaceCount = 0;
+};
@@ -0,0 +1,208 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <atomic>
+#include <memory>
+#ifndef ESP8266
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include "ESP8266Utils.h"
+#endif
+
+// Slab of fixed-size blocks for tx frames - all memory is allocated by setup() so allocating and
+// freeing frames doesn't use the heap (and can't fragment it)
+// Frames larger than a block are held in a chain of blocks - each frame is reference counted (on its
+// first block) so it can be copied in and out of queues and the blocks are freed with the last copy
+class RdWebTxSlab
+{
+public:
+    static const uint16_t NO_BLOCK = 0xffff;
+
+    RdWebTxSlab()
+    {
+    }
+    virtual ~RdWebTxSlab()
+    {
+        if (_lock)
+            vSemaphoreDelete(_lock);
+    }
+
+    // Setup (must be called before the slab is used)
+    void setup(uint32_t blockSize, uint32_t numBlocks)
+    {
+        if (numBlocks >= NO_BLOCK)
+            numBlocks = NO_BLOCK - 1;
+        _blockSize = blockSize;
+        _numBlocks = numBlocks;
+        _blocks.reset(new uint8_t[blockSize * numBlocks]);
+        _nextBlock.assign(numBlocks, (uint16_t)NO_BLOCK);
+        _refCounts.reset(new std::atomic<uint8_t>[numBlocks]);
+        for (uint32_t i = 0; i < numBlocks; i++)
+        {
+            if (i + 1 < numBlocks)
+                _nextBlock[i] = i + 1;
+            _refCounts[i].store(0);
+        }
+        _freeHead = 0;
+        if (numBlocks == 0)
+            _freeHead = NO_BLOCK;
+        _freeCount = numBlocks;
+        if (!_lock)
+            _lock = xSemaphoreCreateMutex();
+    }
+
+    // Check if setup
+    bool isSetup() const
+    {
+        return _numBlocks > 0;
+    }
+
+    // Allocate a frame holding a header followed by data - returns false if there aren't enough free blocks
+    // The frame has a reference count of 1
+    bool alloc(const uint8_t* pHdr, uint32_t hdrLen, const uint8_t* pBuf, uint32_t bufLen, uint16_t& firstBlockIdx)
+    {
+        uint32_t frameLen = hdrLen + bufLen;
+        uint32_t blocksNeeded = frameLen > 0 ? (frameLen + _blockSize - 1) / _blockSize : 1;
+        if (!_lock || (xSemaphoreTake(_lock, pdMS_TO_TICKS(LOCK_WAIT_MS)) != pdTRUE))
+            return false;
+        if (blocksNeeded > _freeCount)
+        {
+            xSemaphoreGive(_lock);
+            return false;
+        }
+
+        // Take the chain from the head of the free list
+        firstBlockIdx = _freeHead;
+        uint16_t lastBlockIdx = _freeHead;
+        for (uint32_t i = 1; i < blocksNeeded; i++)
+            lastBlockIdx = _nextBlock[lastBlockIdx];
+        _freeHead = _nextBlock[lastBlockIdx];
+        _nextBlock[lastBlockIdx] = NO_BLOCK;
+        _freeCount -= blocksNeeded;
+        xSemaphoreGive(_lock);
+
+        // Copy the header and data into the chain
+        writeChain(firstBlockIdx, 0, pHdr, hdrLen);
+        writeChain(firstBlockIdx, hdrLen, pBuf, bufLen);
+        _refCounts[firstBlockIdx].store(1);
+        return true;
+    }
+
+    // Add a reference to a frame
+    void addRef(uint16_t firstBlockIdx)
+    {
+        _refCounts[firstBlockIdx].fetch_add(1);
+    }
+
+    // Release a reference to a frame - the blocks are freed when there are no references
+    void release(uint16_t firstBlockIdx)
+    {
+        if (_refCounts[firstBlockIdx].fetch_sub(1) != 1)
+            return;
+
+        // Return the chain to the head of the free list
+        uint32_t numBlocks = 1;
+        uint16_t lastBlockIdx = firstBlockIdx;
+        while (_nextBlock[lastBlockIdx] != NO_BLOCK)
+        {
+            lastBlockIdx = _nextBlock[lastBlockIdx];
+            numBlocks++;
+        }
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        _nextBlock[lastBlockIdx] = _freeHead;
+        _freeHead = firstBlockIdx;
+        _freeCount += numBlocks;
+        xSemaphoreGive(_lock);
+    }
+
+    // Get the first block of a frame (which is all of the frame if it is no larger than a block)
+    const uint8_t* getBlock(uint16_t blockIdx) const
+    {
+        return _blocks.get() + blockIdx * _blockSize;
+    }
+
+    // Check if a frame is held in a chain of blocks
+    bool isChained(uint16_t firstBlockIdx) const
+    {
+        return _nextBlock[firstBlockIdx] != NO_BLOCK;
+    }
+
+    // Copy part of a frame (starting at offset) - returns the number of bytes copied which is limited
+    // by maxLen and the end of the last block (the caller must limit maxLen to the frame length)
+    uint32_t copyData(uint16_t firstBlockIdx, uint32_t offset, uint8_t* pBuf, uint32_t maxLen) const
+    {
+        uint16_t blockIdx = firstBlockIdx;
+        while ((offset >= _blockSize) && (blockIdx != NO_BLOCK))
+        {
+            blockIdx = _nextBlock[blockIdx];
+            offset -= _blockSize;
+        }
+        uint32_t copied = 0;
+        while ((copied < maxLen) && (blockIdx != NO_BLOCK))
+        {
+            uint32_t copyLen = _blockSize - offset < maxLen - copied ? _blockSize - offset : maxLen - copied;
+            memcpy(pBuf + copied, getBlock(blockIdx) + offset, copyLen);
+            copied += copyLen;
+            offset = 0;
+            blockIdx = _nextBlock[blockIdx];
+        }
+        return copied;
+    }
+
+    // Block size and free blocks
+    uint32_t getBlockSize() const
+    {
+        return _blockSize;
+    }
+    uint32_t getFreeBlocks() const
+    {
+        return _freeCount;
+    }
+
+private:
+    // Blocks and the chain (or free list) links
+    std::unique_ptr<uint8_t[]> _blocks;
+    std::vector<uint16_t> _nextBlock;
+    std::unique_ptr<std::atomic<uint8_t>[]> _refCounts;
+    uint32_t _blockSize = 0;
+    uint32_t _numBlocks = 0;
+
+    // Free list
+    uint16_t _freeHead = NO_BLOCK;
+    uint32_t _freeCount = 0;
+
+    // Lock for the free list (frames are allocated and freed by different tasks)
+    SemaphoreHandle_t _lock = nullptr;
+    static const uint32_t LOCK_WAIT_MS = 2;
+
+    // Write into a chain of blocks at an offset
+    void writeChain(uint16_t firstBlockIdx, uint32_t offset, const uint8_t* pBuf, uint32_t bufLen)
+    {
+        uint16_t blockIdx = firstBlockIdx;
+        while ((offset >= _blockSize) && (blockIdx != NO_BLOCK))
+        {
+            blockIdx = _nextBlock[blockIdx];
+            offset -= _blockSize;
+        }
+        uint32_t written = 0;
+        while ((written < bufLen) && (blockIdx != NO_BLOCK))
+        {
+            uint32_t writeLen = _blockSize - offset < bufLen - written ? _blockSize - offset : bufLen - written;
+            memcpy(_blocks.get() + blockIdx * _blockSize + offset, pBuf + written, writeLen);
+            written += writeLen;
+            offset = 0;
+            blockIdx = _nextBlock[blockIdx];
+        }
+    }
+};
@@ -0,0 +1,342 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer - permessage-deflate test
+//
+// Decompresses zlib-produced raw deflate streams (fixed, dynamic and stored blocks, several window
+// sizes, with and without context takeover) and checks compressed output inflates with zlib - then
+// feeds truncated, corrupted and random input to the inflater (build with sanitizers to catch memory
+// errors - runHostTests.sh does)
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <zlib.h>
+#include "RdWebDeflate.h"
+
+static uint32_t testFailCount = 0;
+#define TEST_CHECK(cond, ...) do { if (!(cond)) { printf("deflateTest FAIL line %d: ", __LINE__); \
+            printf(__VA_ARGS__); printf("\n"); testFailCount++; } } while (0)
+
+typedef std::vector<uint8_t> Bytes;
+
+// Test data - compressible text, incompressible bytes and a mix
+static Bytes makeText(uint32_t len, uint32_t seed)
+{
+    static const char* words[] = {"temp", "humidity", "status", "ok", "sensor", "{\"value\":", "},", "\r\n", "21.5", "alarm"};
+    std::mt19937 rng(seed);
+    Bytes data;
+    while (data.size() < len)
+    {
+        const char* pWord = words[rng() % (sizeof(words) / sizeof(words[0]))];
+        data.insert(data.end(), pWord, pWord + strlen(pWord));
+    }
+    data.resize(len);
+    return data;
+}
+static Bytes makeRandom(uint32_t len, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    Bytes data(len);
+    for (uint8_t& byte : data)
+        byte = rng();
+    return data;
+}
+
+// zlib sender - a raw deflate stream per connection (context takeover) with a sync flush per message
+// and the trailer removed as RFC7692 requires
+class ZlibSender
+{
+public:
+    ZlibSender(int windowBits, int level, int strategy)
+    {
+        memset(&_strm, 0, sizeof(_strm));
+        deflateInit2(&_strm, level, Z_DEFLATED, -windowBits, 8, strategy);
+    }
+    ~ZlibSender()
+    {
+        deflateEnd(&_strm);
+    }
+    Bytes compressMsg(const Bytes& msg, bool fullFlushMidway = false)
+    {
+        Bytes out;
+        if (fullFlushMidway && (msg.size() > 1))
+        {
+            uint32_t halfLen = msg.size() / 2;
+            run(msg.data(), halfLen, Z_FULL_FLUSH, out);
+            run(msg.data() + halfLen, msg.size() - halfLen, Z_SYNC_FLUSH, out);
+        }
+        else
+        {
+            run(msg.data(), msg.size(), Z_SYNC_FLUSH, out);
+        }
+        if ((out.size() >= 4) && (memcmp(out.data() + out.size() - 4, "\x00\x00\xff\xff", 4) == 0))
+            out.resize(out.size() - 4);
+        return out;
+    }
+    void setParams(int level, int strategy)
+    {
+        deflateParams(&_strm, level, strategy);
+    }
+private:
+    z_stream _strm;
+    void run(const uint8_t* pData, uint32_t len, int flush, Bytes& out)
+    {
+        _strm.next_in = (Bytef*)pData;
+        _strm.avail_in = len;
+        uint8_t chunk[4096];
+        do
+        {
+            _strm.next_out = chunk;
+            _strm.avail_out = sizeof(chunk);
+            deflate(&_strm, flush);
+            out.insert(out.end(), chunk, chunk + sizeof(chunk) - _strm.avail_out);
+        } while (_strm.avail_out == 0);
+    }
+};
+
+// zlib receiver for checking compressed output
+class ZlibReceiver
+{
+public:
+    ZlibReceiver(int windowBits)
+    {
+        memset(&_strm, 0, sizeof(_strm));
+        inflateInit2(&_strm, -windowBits);
+    }
+    ~ZlibReceiver()
+    {
+        inflateEnd(&_strm);
+    }
+    bool decompressMsg(const Bytes& msg, Bytes& out)
+    {
+        Bytes in = msg;
+        in.insert(in.end(), {0x00, 0x00, 0xff, 0xff});
+        _strm.next_in = in.data();
+        _strm.avail_in = in.size();
+        out.clear();
+        uint8_t chunk[4096];
+        while (true)
+        {
+            _strm.next_out = chunk;
+            _strm.avail_out = sizeof(chunk);
+            int rslt = inflate(&_strm, Z_SYNC_FLUSH);
+            out.insert(out.end(), chunk, chunk + sizeof(chunk) - _strm.avail_out);
+            if ((rslt != Z_OK) && (rslt != Z_BUF_ERROR))
+                return false;
+            if ((_strm.avail_in == 0) && (_strm.avail_out != 0))
+                return true;
+        }
+    }
+private:
+    z_stream _strm;
+};
+
+// Negotiate a deflate instance with the given client (rx) params
+static void setupDeflate(RdWebDeflate& deflate, uint32_t windowBits, bool noContextTakeover)
+{
+    String offer = "permessage-deflate; client_max_window_bits=" + String(windowBits) + "; server_max_window_bits=" +
+                String(windowBits);
+    if (noContextTakeover)
+        offer += "; client_no_context_takeover; server_no_context_takeover";
+    String respParams;
+    bool negotiated = deflate.negotiate(offer, RdWebDeflate::MAX_WINDOW_BITS, false, respParams);
+    TEST_CHECK(negotiated, "negotiate %s", offer.c_str());
+}
+
+// Messages decompressed from zlib streams
+static void testInflateZlibStreams()
+{
+    struct StreamType
+    {
+        const char* name;
+        int level;
+        int strategy;
+    };
+    static const StreamType streamTypes[] = {
+        {"stored", 0, Z_DEFAULT_STRATEGY},
+        {"fixed", 6, Z_FIXED},
+        {"dynamic", 9, Z_DEFAULT_STRATEGY},
+        {"huffmanOnly", 6, Z_HUFFMAN_ONLY},
+        {"rle", 6, Z_RLE},
+    };
+    static const int windowBitsList[] = {9, 12, 15};
+    uint32_t numMsgs = 0;
+    for (const StreamType& streamType : streamTypes)
+    {
+        for (int windowBits : windowBitsList)
+        {
+            for (int noContextTakeover = 0; noContextTakeover < 2; noContextTakeover++)
+            {
+                RdWebDeflate deflate;
+                setupDeflate(deflate, windowBits, noContextTakeover);
+                ZlibSender* pSender = new ZlibSender(windowBits, streamType.level, streamType.strategy);
+                for (uint32_t msgIdx = 0; msgIdx < 12; msgIdx++)
+                {
+                    // Without context takeover each message is a new zlib stream
+                    if (noContextTakeover && (msgIdx > 0))
+                    {
+                        delete pSender;
+                        pSender = new ZlibSender(windowBits, streamType.level, streamType.strategy);
+                    }
+                    uint32_t msgLen = (msgIdx * 997) % 20000;
+                    Bytes msg = (msgIdx % 3 == 2) ? makeRandom(msgLen, msgIdx) : makeText(msgLen, msgIdx % 4);
+                    Bytes compressed = pSender->compressMsg(msg, msgIdx % 4 == 3);
+                    Bytes out;
+                    bool rslt = deflate.decompress(compressed.data(), compressed.size(), out, 100000);
+                    TEST_CHECK(rslt && (out == msg), "inflate %s window %d noTakeover %d msg %u len %u rslt %d outLen %u",
+                                streamType.name, windowBits, noContextTakeover, msgIdx, msgLen, rslt, (uint32_t)out.size());
+                    numMsgs++;
+                }
+                delete pSender;
+            }
+        }
+    }
+
+    // Block types changing within a stream (with context takeover)
+    {
+        RdWebDeflate deflate;
+        setupDeflate(deflate, 15, false);
+        ZlibSender sender(15, 0, Z_DEFAULT_STRATEGY);
+        for (uint32_t msgIdx = 0; msgIdx < 9; msgIdx++)
+        {
+            sender.setParams(msgIdx % 3 == 0 ? 0 : 9, msgIdx % 3 == 1 ? Z_FIXED : Z_DEFAULT_STRATEGY);
+            Bytes msg = makeText(3000 + msgIdx * 100, msgIdx % 2);
+            Bytes compressed = sender.compressMsg(msg);
+            Bytes out;
+            bool rslt = deflate.decompress(compressed.data(), compressed.size(), out, 100000);
+            TEST_CHECK(rslt && (out == msg), "inflate mixed block types msg %u", msgIdx);
+            numMsgs++;
+        }
+    }
+    printf("deflateTest inflate zlib streams %u messages\n", numMsgs);
+}
+
+// Compressed output inflated by zlib
+static void testDeflateToZlib()
+{
+    static const int windowBitsList[] = {9, 12, 15};
+    uint32_t numMsgs = 0;
+    for (int windowBits : windowBitsList)
+    {
+        for (int noContextTakeover = 0; noContextTakeover < 2; noContextTakeover++)
+        {
+            RdWebDeflate deflate;
+            setupDeflate(deflate, windowBits, noContextTakeover);
+            ZlibReceiver* pReceiver = new ZlibReceiver(windowBits);
+            for (uint32_t msgIdx = 0; msgIdx < 12; msgIdx++)
+            {
+                if (noContextTakeover && (msgIdx > 0))
+                {
+                    delete pReceiver;
+                    pReceiver = new ZlibReceiver(windowBits);
+                }
+
+                // Sent in fragments of varying size
+                uint32_t msgLen = (msgIdx * 1231) % 15000;
+                Bytes msg = (msgIdx % 3 == 2) ? makeRandom(msgLen, msgIdx) : makeText(msgLen, msgIdx % 4);
+                Bytes compressed;
+                uint32_t fragLen = 1 + msgIdx * 300;
+                uint32_t pos = 0;
+                do
+                {
+                    uint32_t len = pos + fragLen > msgLen ? msgLen - pos : fragLen;
+                    Bytes frag;
+                    deflate.compress(msg.data() + pos, len, pos + len >= msgLen, frag);
+                    TEST_CHECK(frag.size() <= len + RdWebDeflate::MAX_COMPRESS_OVERHEAD_BYTES,
+                                "deflate overhead len %u out %u", len, (uint32_t)frag.size());
+                    compressed.insert(compressed.end(), frag.begin(), frag.end());
+                    pos += len;
+                } while (pos < msgLen);
+                Bytes out;
+                bool rslt = pReceiver->decompressMsg(compressed, out);
+                TEST_CHECK(rslt && (out == msg), "deflate window %d noTakeover %d msg %u len %u", windowBits,
+                            noContextTakeover, msgIdx, msgLen);
+                numMsgs++;
+            }
+            delete pReceiver;
+        }
+    }
+    printf("deflateTest deflate to zlib %u messages\n", numMsgs);
+}
+
+// Truncated input must fail or give a prefix of the message - corrupt and random input must not
+// crash or exceed the output limit
+static void testBadInput()
+{
+    Bytes msg = makeText(8000, 1);
+    ZlibSender sender(15, 9, Z_DEFAULT_STRATEGY);
+    Bytes compressed = sender.compressMsg(msg);
+    uint32_t numTruncated = 0;
+    for (uint32_t len = 0; len < compressed.size(); len++)
+    {
+        RdWebDeflate deflate;
+        setupDeflate(deflate, 15, false);
+        Bytes out;
+        bool rslt = deflate.decompress(compressed.data(), len, out, 100000);
+        bool isPrefix = (out.size() <= msg.size()) && std::equal(out.begin(), out.end(), msg.begin());
+        TEST_CHECK(!rslt || isPrefix, "truncated len %u gave wrong output", len);
+        numTruncated++;
+    }
+
+    // Output limit
+    {
+        RdWebDeflate deflate;
+        setupDeflate(deflate, 15, false);
+        Bytes out;
+        bool rslt = deflate.decompress(compressed.data(), compressed.size(), out, msg.size() - 1);
+        TEST_CHECK(!rslt && (out.size() < msg.size()), "output limit not applied");
+    }
+
+    // Corrupted (bit flips) and random input
+    std::mt19937 rng(1234);
+    uint32_t numCorrupt = 0;
+    uint32_t numCorruptRejected = 0;
+    for (uint32_t i = 0; i < 20000; i++)
+    {
+        Bytes bad = compressed;
+        if (i % 2 == 0)
+        {
+            uint32_t numFlips = 1 + rng() % 4;
+            for (uint32_t flip = 0; flip < numFlips; flip++)
+                bad[rng() % bad.size()] ^= 1 << (rng() % 8);
+        }
+        else
+        {
+            bad = makeRandom(1 + rng() % 200, i);
+        }
+        RdWebDeflate deflate;
+        setupDeflate(deflate, 9 + i % 7, false);
+        Bytes out;
+        static const uint32_t MAX_OUT_LEN = 20000;
+        bool rslt = deflate.decompress(bad.data(), bad.size(), out, MAX_OUT_LEN);
+        TEST_CHECK(out.size() <= MAX_OUT_LEN, "corrupt input exceeded output limit %u", (uint32_t)out.size());
+        numCorrupt++;
+        if (!rslt)
+            numCorruptRejected++;
+    }
+    printf("deflateTest bad input truncated %u corrupt/random %u (%u rejected)\n", numTruncated, numCorrupt,
+                numCorruptRejected);
+}
+
+int runDeflateTest()
+{
+    testInflateZlibStreams();
+    testDeflateToZlib();
+    testBadInput();
+    printf("deflateTest %s\n", testFailCount == 0 ? "ok" : "FAILED");
+    return testFailCount == 0 ? 0 : 1;
+}
+
+#ifndef ESP_PLATFORM
+int main()
+{
+    return runDeflateTest();
+}
+#endif
@@ -0,0 +1,142 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer - virtual channel credit test
+//
+// Checks that a virtual channel's tx credit is returned when the tx queue policy drops or replaces a
+// queued message (the queue and mux are set up as RdWebResponderWS does) - on the host build with
+// test/host/runHostTests.sh - on the target call runMuxCreditTest() from app_main
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "RdWebSocketMux.h"
+#include "RdWebTxQueue.h"
+#include "RdWebDataFrame.h"
+
+#define TEST_CHECK(cond, ...) do { if (!(cond)) { printf("muxCreditTest FAIL line %d: ", __LINE__); \
+            printf(__VA_ARGS__); printf("\n"); return false; } } while (0)
+
+static const uint32_t MUX_CREDITS = 8;
+static const uint32_t TX_QUEUE_LEN = 4;
+
+// Mux and tx queue as in RdWebResponderWS
+class MuxSender
+{
+public:
+    MuxSender(RdWebTxQueuePolicy policy)
+    {
+        _mux.setup({10, 11}, MUX_CREDITS);
+        _txQueue.setup(TX_QUEUE_LEN, policy, 0);
+        _txQueue.setRemovedCB([this](const RdWebDataFrame& frame, uint32_t tag) {
+            uint32_t frameLen = frame.getLen();
+            _mux.txMsgCancel(tag - 1, frameLen > RdWebSocketMux::MUX_HEADER_BYTES ?
+                        frameLen - RdWebSocketMux::MUX_HEADER_BYTES : 0);
+        });
+    }
+
+    // As RdWebResponderWS::sendFrame - returns false if there is no credit or the message is dropped
+    bool sendFrame(const uint8_t* pBuf, uint32_t bufLen, uint32_t channelID, uint32_t key)
+    {
+        uint8_t muxHeader[RdWebSocketMux::MUX_HEADER_BYTES];
+        uint32_t virtChanIdx = 0;
+        if (!_mux.txMsgStart(channelID, bufLen, virtChanIdx))
+            return false;
+        RdWebSocketMux::writeHeader(muxHeader, virtChanIdx, RdWebSocketMux::MUX_MSG_DATA);
+        RdWebDataFrame frame(muxHeader, sizeof(muxHeader), pBuf, bufLen);
+        if (!_txQueue.put(frame, key, virtChanIdx + 1))
+        {
+            _mux.txMsgCancel(virtChanIdx, bufLen);
+            return false;
+        }
+        return true;
+    }
+
+    // Send all queued messages (the credit stays taken until the receiver returns it)
+    uint32_t drain()
+    {
+        uint32_t numSent = 0;
+        RdWebDataFrame frame;
+        while (_txQueue.get(frame))
+            numSent++;
+        return numSent;
+    }
+
+    // Number of credits available (taken until none are left and then returned)
+    uint32_t countCredits(uint32_t channelID)
+    {
+        uint32_t numCredits = 0;
+        uint32_t virtChanIdx = 0;
+        while ((numCredits <= MUX_CREDITS) && _mux.txMsgStart(channelID, 0, virtChanIdx))
+            numCredits++;
+        for (uint32_t i = 0; i < numCredits; i++)
+            _mux.txMsgCancel(virtChanIdx, 0);
+        return numCredits;
+    }
+
+    RdWebSocketMux _mux;
+    RdWebTxQueue<RdWebDataFrame> _txQueue;
+};
+
+static bool checkPolicy(RdWebTxQueuePolicy policy, const char* policyName)
+{
+    static const uint32_t NUM_MSGS = 100;
+    MuxSender sender(policy);
+    uint8_t msg[20] = {0};
+
+    // Without a refund the channel would have no credit after MUX_CREDITS messages dropped or replaced
+    // (drop-newest drops the new message which is cancelled by the sender)
+    uint32_t numQueued = 0;
+    for (uint32_t i = 0; i < NUM_MSGS; i++)
+    {
+        msg[0] = i;
+        bool sendOk = sender.sendFrame(msg, sizeof(msg), 10, i % 3);
+        TEST_CHECK(sendOk || (policy == TX_QUEUE_POLICY_DROP_NEWEST), "%s send %u failed", policyName, i);
+        if (sendOk)
+            numQueued++;
+    }
+    uint32_t numInQueue = sender._txQueue.count();
+    TEST_CHECK(sender.countCredits(10) == MUX_CREDITS - numInQueue, "%s credits %u queued %u", policyName,
+                sender.countCredits(10), numInQueue);
+    TEST_CHECK(sender.countCredits(11) == MUX_CREDITS, "%s other channel credits %u", policyName,
+                sender.countCredits(11));
+
+    // Sent messages keep their credit
+    uint32_t numSent = sender.drain();
+    TEST_CHECK(numSent == numInQueue, "%s sent %u queued %u", policyName, numSent, numInQueue);
+    TEST_CHECK(sender.countCredits(10) == MUX_CREDITS - numSent, "%s credits after send %u", policyName,
+                sender.countCredits(10));
+    printf("muxCreditTest %-10s sent %u of %u (dropped %u replaced %u) credits %u of %u\n", policyName,
+                numSent, NUM_MSGS, sender._txQueue.getDropCount(), sender._txQueue.getReplaceCount(),
+                sender.countCredits(10), MUX_CREDITS);
+    return true;
+}
+
+bool runMuxCreditTest()
+{
+    if (!checkPolicy(TX_QUEUE_POLICY_DROP_NEWEST, "dropNewest") ||
+                !checkPolicy(TX_QUEUE_POLICY_DROP_OLDEST, "dropOldest") ||
+                !checkPolicy(TX_QUEUE_POLICY_LATEST_KEYED, "latest"))
+        return false;
+
+    // Messages put without a tag aren't reported when dropped
+    uint32_t numRemoved = 0;
+    RdWebTxQueue<uint32_t> txQueue;
+    txQueue.setup(2, TX_QUEUE_POLICY_DROP_OLDEST, 0);
+    txQueue.setRemovedCB([&numRemoved](const uint32_t& item, uint32_t tag) { numRemoved++; });
+    for (uint32_t i = 0; i < 10; i++)
+        txQueue.put(i, 0, i & 1);
+    TEST_CHECK(numRemoved == 4, "untagged removed %u", numRemoved);
+    printf("muxCreditTest OK\n");
+    return true;
+}
+
+#ifndef ESP_PLATFORM
+int main()
+{
+    return runMuxCreditTest() ? 0 : 1;
+}
+#endif
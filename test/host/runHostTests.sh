@@ -0,0 +1,45 @@
+#!/bin/bash
+# Build and run the host tests and benchmarks (g++ on Linux)
+# Usage: test/host/runHostTests.sh [testName ...] - runs all tests if none are named
+set -e
+HOST_DIR="$(cd "$(dirname "$0")" && pwd)"
+SRC_DIR="$HOST_DIR/../../src"
+BUILD_DIR="${BUILD_DIR:-/tmp/rdwebserver_host_tests}"
+CXXFLAGS="-std=gnu++17 -O2 -Wall -I$SRC_DIR -I$HOST_DIR/stubs"
+mkdir -p "$BUILD_DIR"
+
+# Test name and the sources and libraries it needs
+declare -A TEST_SOURCES=(
+    [wsMaskTest]="wsMaskTest.cpp"
+    [deflateTest]="deflateTest.cpp ../../src/RdWebDeflate.cpp"
+    [txQueueBench]="txQueueBench.cpp"
+    [muxCreditTest]="muxCreditTest.cpp ../../src/RdWebSocketMux.cpp"
+    [sseFormatBench]="sseFormatBench.cpp"
+    [wsClientTest]="wsClientTest.cpp ../../src/RdWebSocketClient.cpp ../../src/RdWebSocketLink.cpp ../../src/RdWebSocketPlatform.cpp ../../src/RdWebDeflate.cpp"
+)
+declare -A TEST_LIBS=(
+    [deflateTest]="-lz"
+    [txQueueBench]="-pthread"
+    [wsClientTest]="-pthread"
+)
+
+# Tests parsing untrusted input are built with sanitizers (benchmarks are not) - the sources log sizes
+# with %d as they are 32-bit on the target so format warnings are off where they are built for 64-bit
+declare -A TEST_CXXFLAGS=(
+    [deflateTest]="-O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all"
+    [wsClientTest]="-O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all -Wno-format"
+)
+
+TESTS=("$@")
+if [ ${#TESTS[@]} -eq 0 ]; then
+    TESTS=($(echo "${!TEST_SOURCES[@]}" | tr ' ' '\n' | sort))
+fi
+for testName in "${TESTS[@]}"; do
+    echo "==== $testName"
+    sources=""
+    for src in ${TEST_SOURCES[$testName]}; do
+        sources="$sources $HOST_DIR/$src"
+    done
+    g++ $CXXFLAGS ${TEST_CXXFLAGS[$testName]} $sources -o "$BUILD_DIR/$testName" ${TEST_LIBS[$testName]}
+    "$BUILD_DIR/$testName"
+done
@@ -0,0 +1,250 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer - server-side event formatting test and benchmark
+//
+// Checks RdWebSSEvent::formatEvent gives the same message as the previous generateEventMessage (String
+// concatenation with a malloc per line) for content with LF, CR and CRLF line breaks and compares
+// events/sec - on the host build with test/host/runHostTests.sh - on the target call runSseFormatBench()
+// from app_main
+// The host String (stubs/WString.h) is a std::string which grows geometrically where Arduino's String
+// reallocates to the exact length on each concatenation so the host understates the previous cost
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <WString.h>
+#include "RdWebSSEvent.h"
+
+// Previous formatting (RdWebResponderSSEvents::generateEventMessage before formatEvent) - the event
+// line used an undefined pEvent which is eventStr here
+static String generateEventMessage(const String& msgStr, const String& eventStr, uint32_t id)
+{
+    String ev = "";
+
+    if (id)
+    {
+        ev += "id: ";
+        ev += String(id);
+        ev += "\r\n";
+    }
+
+    if (eventStr.length() > 0)
+    {
+        ev += "event: ";
+        ev += eventStr;
+        ev += "\r\n";
+    }
+
+    const char* pMsg = msgStr.c_str();
+    size_t messageLen = msgStr.length();
+    const char *lineStart = pMsg;
+    const char *lineEnd;
+    do
+    {
+        const char *nextN = strchr(lineStart, '\n');
+        const char *nextR = strchr(lineStart, '\r');
+        if (nextN == NULL && nextR == NULL)
+        {
+            size_t llen = (pMsg + messageLen) - lineStart;
+            char *ldata = (char*)malloc(llen + 1);
+            if (ldata != NULL)
+            {
+                memcpy(ldata, lineStart, llen);
+                ldata[llen] = 0;
+                ev += "data: ";
+                ev += ldata;
+                ev += "\r\n\r\n";
+                free(ldata);
+            }
+            lineStart = pMsg + messageLen;
+        }
+        else
+        {
+            const char *nextLine = NULL;
+            if (nextN != NULL && nextR != NULL)
+            {
+                if (nextR < nextN)
+                {
+                    lineEnd = nextR;
+                    if (nextN == (nextR + 1))
+                        nextLine = nextN + 1;
+                    else
+                        nextLine = nextR + 1;
+                }
+                else
+                {
+                    lineEnd = nextN;
+                    if (nextR == (nextN + 1))
+                        nextLine = nextR + 1;
+                    else
+                        nextLine = nextN + 1;
+                }
+            }
+            else if (nextN != NULL)
+            {
+                lineEnd = nextN;
+                nextLine = nextN + 1;
+            }
+            else
+            {
+                lineEnd = nextR;
+                nextLine = nextR + 1;
+            }
+
+            size_t llen = lineEnd - lineStart;
+            char *ldata = (char *)malloc(llen + 1);
+            if (ldata != NULL)
+            {
+                memcpy(ldata, lineStart, llen);
+                ldata[llen] = 0;
+                ev += "data: ";
+                ev += ldata;
+                ev += "\r\n";
+                free(ldata);
+            }
+            lineStart = nextLine;
+            if (lineStart == (pMsg + messageLen))
+                ev += "\r\n";
+        }
+    } while (lineStart < (pMsg + messageLen));
+
+    return ev;
+}
+
+// Content of the benchmark events
+static std::string makeLines(uint32_t numLines, uint32_t lineLen, const char* lineBreak)
+{
+    std::string content;
+    for (uint32_t i = 0; i < numLines; i++)
+    {
+        if (i > 0)
+            content += lineBreak;
+        for (uint32_t j = 0; j < lineLen; j++)
+            content += (char)('a' + (i + j) % 26);
+    }
+    return content;
+}
+
+static std::string formatNew(const std::string& content, const char* group, uint32_t id)
+{
+    RdWebDataFrame frame = RdWebSSEvent::formatEventFrame(content.c_str(), group, id);
+    return std::string((const char*)frame.getData(), frame.getLen());
+}
+
+static bool checkSameAsPrevious()
+{
+    static const char* CONTENTS[] = {"", "a", "a\n", "a\r", "a\r\n", "\n", "\r\n", "\n\n", "a\nb", "a\rb", "a\r\nb",
+                "a\r\rb", "a\n\nb", "a\r\n\r\nb", "line1\nline2\rline3\r\nline4", "{\"v\":1}\r\n"};
+    static const char* GROUPS[] = {"", "grp"};
+    static const uint32_t IDS[] = {0, 1, 4294967295u};
+    uint32_t numChecks = 0;
+    for (const char* content : CONTENTS)
+    {
+        for (const char* group : GROUPS)
+        {
+            for (uint32_t id : IDS)
+            {
+                std::string prevMsg = generateEventMessage(content, group, id).c_str();
+                std::string newMsg = formatNew(content, group, id);
+                if (prevMsg != newMsg)
+                {
+                    printf("sseFormatBench FAIL content \"%s\" group \"%s\" id %u\nprevious \"%s\"\nnew \"%s\"\n",
+                                content, group, id, prevMsg.c_str(), newMsg.c_str());
+                    return false;
+                }
+                numChecks++;
+            }
+        }
+    }
+
+    // The previous code took LF followed by CR as one line break - it is two (an empty line between)
+    if (formatNew("a\n\rb", "", 0) != "data: a\r\ndata: \r\ndata: b\r\n\r\n")
+    {
+        printf("sseFormatBench FAIL LF CR gave \"%s\"\n", formatNew("a\n\rb", "", 0).c_str());
+        return false;
+    }
+    printf("sseFormatBench formatEvent same as previous for %u cases\n", numChecks);
+    return true;
+}
+
+// Time formatting of an event - returns events/sec
+template<typename Format>
+static double benchEventsPerSec(Format format)
+{
+    static const double MIN_SECS = 0.2;
+    uint32_t numEvents = 0;
+    double elapsedSecs = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    while (elapsedSecs < MIN_SECS)
+    {
+        for (uint32_t i = 0; i < 1000; i++)
+            format(numEvents + i + 1);
+        numEvents += 1000;
+        elapsedSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    }
+    return numEvents / elapsedSecs;
+}
+
+bool runSseFormatBench()
+{
+    if (!checkSameAsPrevious())
+        return false;
+
+    // Content with each line break
+    struct BenchCase
+    {
+        const char* name;
+        std::string content;
+    };
+    std::vector<BenchCase> benchCases = {
+        {"1 line 60B", makeLines(1, 60, "")},
+        {"8 lines 40B LF", makeLines(8, 40, "\n")},
+        {"8 lines 40B CR", makeLines(8, 40, "\r")},
+        {"8 lines 40B CRLF", makeLines(8, 40, "\r\n")},
+        {"32 lines 30B CRLF", makeLines(32, 30, "\r\n")},
+    };
+    printf("sseFormatBench events/sec (best of 3)\n");
+    printf("%-20s %8s %14s %14s %14s %10s\n", "content", "len", "previous", "formatEvent", "formatFrame", "frame/prev");
+    std::vector<uint8_t> reuseBuf(4096);
+    static volatile uint32_t sink = 0;
+    for (BenchCase& benchCase : benchCases)
+    {
+        String contentStr = benchCase.content.c_str();
+        const char* pContent = benchCase.content.c_str();
+        uint32_t contentLen = benchCase.content.size();
+        double prevRate = 0, newRate = 0, frameRate = 0;
+        for (uint32_t run = 0; run < 3; run++)
+        {
+            double rate = benchEventsPerSec([&](uint32_t id) {
+                sink += generateEventMessage(contentStr, "grp", id).length();
+            });
+            prevRate = rate > prevRate ? rate : prevRate;
+            rate = benchEventsPerSec([&](uint32_t id) {
+                sink += RdWebSSEvent::formatEvent(reuseBuf.data(), reuseBuf.size(), pContent, contentLen, "grp", 3, id);
+            });
+            newRate = rate > newRate ? rate : newRate;
+            rate = benchEventsPerSec([&](uint32_t id) {
+                sink += RdWebSSEvent::formatEventFrame(pContent, "grp", id).getLen();
+            });
+            frameRate = rate > frameRate ? rate : frameRate;
+        }
+        printf("%-20s %8u %14.0f %14.0f %14.0f %9.1fx\n", benchCase.name, contentLen, prevRate, newRate, frameRate,
+                    frameRate / prevRate);
+    }
+    return true;
+}
+
+#ifndef ESP_PLATFORM
+int main()
+{
+    return runSseFormatBench() ? 0 : 1;
+}
+#endif
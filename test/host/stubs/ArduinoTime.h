@@ -0,0 +1,13 @@
+// Host stub of the Arduino time functions
+#pragma once
+#include <stdint.h>
+#include <chrono>
+inline uint64_t micros()
+{
+    static const auto startTime = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
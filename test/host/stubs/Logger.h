@@ -0,0 +1,8 @@
+// Host stub of the logger - warnings and errors are printed, info and debug are discarded
+#pragma once
+#include <stdio.h>
+#define LOG_E(tag, ...) do { printf("E %s: ", tag); printf(__VA_ARGS__); printf("\n"); } while (0)
+#define LOG_W(tag, ...) do { printf("W %s: ", tag); printf(__VA_ARGS__); printf("\n"); } while (0)
+#define LOG_I(tag, ...) do { if (0) printf(__VA_ARGS__); } while (0)
+#define LOG_D(tag, ...) do { if (0) printf(__VA_ARGS__); } while (0)
+#define LOG_V(tag, ...) do { if (0) printf(__VA_ARGS__); } while (0)
@@ -0,0 +1,42 @@
+// Host stub of Utils (only the functions used by the sources under test)
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <WString.h>
+class Utils
+{
+public:
+    static bool isTimeout(unsigned long curTime, unsigned long lastTime, unsigned long maxDuration)
+    {
+        return timeElapsed(curTime, lastTime) >= maxDuration;
+    }
+    static unsigned long timeElapsed(unsigned long curTime, unsigned long lastTime)
+    {
+        return curTime - lastTime;
+    }
+    static int findInBuf(const uint8_t* pBuf, uint32_t bufLen, const uint8_t* pToFind, uint32_t toFindLen)
+    {
+        for (uint32_t i = 0; i + toFindLen <= bufLen; i++)
+            if (memcmp(pBuf + i, pToFind, toFindLen) == 0)
+                return i;
+        return -1;
+    }
+    static void strFromBuffer(const uint8_t* pBuf, uint32_t bufLen, String& outStr, bool asciiOnly = true)
+    {
+        outStr = "";
+        for (uint32_t i = 0; i < bufLen; i++)
+            if (!asciiOnly || ((pBuf[i] >= 0x20) && (pBuf[i] < 0x7f)))
+                outStr += (char)pBuf[i];
+    }
+    static void getHexStrFromBytes(const uint8_t* pBuf, uint32_t bufLen, String& outStr)
+    {
+        outStr = "";
+        for (uint32_t i = 0; i < bufLen; i++)
+        {
+            char hexStr[3];
+            snprintf(hexStr, sizeof(hexStr), "%02x", pBuf[i]);
+            outStr += hexStr;
+        }
+    }
+};
@@ -0,0 +1,76 @@
+// Host stub of the Arduino String class (the subset used by the server) built on std::string
+#pragma once
+#include <string>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <strings.h>
+
+class String
+{
+public:
+    String() {}
+    String(const char* pStr) { if (pStr) _str = pStr; }
+    String(const std::string& str) : _str(str) {}
+    explicit String(char ch) : _str(1, ch) {}
+    String(int val) : _str(std::to_string(val)) {}
+    String(unsigned int val) : _str(std::to_string(val)) {}
+    String(long val) : _str(std::to_string(val)) {}
+    String(unsigned long val) : _str(std::to_string(val)) {}
+    String(long long val) : _str(std::to_string(val)) {}
+    String(unsigned long long val) : _str(std::to_string(val)) {}
+    String(double val) : _str(std::to_string(val)) {}
+    const char* c_str() const { return _str.c_str(); }
+    unsigned int length() const { return _str.length(); }
+    String substring(unsigned int from) const { return from >= _str.size() ? String() : String(_str.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        return (from >= _str.size()) || (to <= from) ? String() : String(_str.substr(from, to - from));
+    }
+    bool startsWith(const String& str) const { return _str.rfind(str._str, 0) == 0; }
+    bool endsWith(const String& str) const
+    {
+        return (_str.size() >= str._str.size()) && (_str.compare(_str.size() - str._str.size(), str._str.size(), str._str) == 0);
+    }
+    bool equals(const String& str) const { return _str == str._str; }
+    bool equalsIgnoreCase(const String& str) const
+    {
+        return (_str.size() == str._str.size()) && (strncasecmp(_str.c_str(), str._str.c_str(), _str.size()) == 0);
+    }
+    int indexOf(char ch, unsigned int from = 0) const { return toIdx(_str.find(ch, from)); }
+    int indexOf(const String& str, unsigned int from = 0) const { return toIdx(_str.find(str._str, from)); }
+    int lastIndexOf(char ch) const { return toIdx(_str.rfind(ch)); }
+    void trim()
+    {
+        size_t startPos = _str.find_first_not_of(" \t\r\n");
+        size_t endPos = _str.find_last_not_of(" \t\r\n");
+        _str = startPos == std::string::npos ? "" : _str.substr(startPos, endPos - startPos + 1);
+    }
+    void toLowerCase() { for (char& ch : _str) ch = tolower((unsigned char)ch); }
+    void toUpperCase() { for (char& ch : _str) ch = toupper((unsigned char)ch); }
+    void clear() { _str.clear(); }
+    bool concat(const String& str) { _str += str._str; return true; }
+    bool concat(const char* pStr, unsigned int len) { _str.append(pStr, len); return true; }
+    bool concat(char ch) { _str += ch; return true; }
+    bool reserve(unsigned int len) { _str.reserve(len); return true; }
+    void remove(unsigned int idx) { if (idx < _str.size()) _str.erase(idx); }
+    void remove(unsigned int idx, unsigned int len) { if (idx < _str.size()) _str.erase(idx, len); }
+    long toInt() const { return atol(_str.c_str()); }
+    char operator[](unsigned int idx) const { return _str[idx]; }
+    char& operator[](unsigned int idx) { return _str[idx]; }
+    char charAt(unsigned int idx) const { return _str[idx]; }
+    String& operator+=(const String& str) { _str += str._str; return *this; }
+    String& operator+=(const char* pStr) { _str += pStr; return *this; }
+    String& operator+=(char ch) { _str += ch; return *this; }
+    bool operator==(const String& str) const { return _str == str._str; }
+    bool operator!=(const String& str) const { return _str != str._str; }
+    bool operator<(const String& str) const { return _str < str._str; }
+    friend String operator+(const String& a, const String& b) { return String(a._str + b._str); }
+    friend String operator+(const char* a, const String& b) { return String(std::string(a) + b._str); }
+    friend String operator+(const String& a, const char* b) { return String(a._str + b); }
+
+private:
+    std::string _str;
+    static int toIdx(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+};
@@ -0,0 +1,14 @@
+// Host stub of FreeRTOS - mutexes are std::timed_mutex and a tick is 1ms
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <thread>
+#include <chrono>
+typedef std::timed_mutex* SemaphoreHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) (x)
@@ -0,0 +1,25 @@
+// Host stub of FreeRTOS semaphores (mutexes only)
+#pragma once
+#include "FreeRTOS.h"
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new std::timed_mutex();
+}
+inline void vSemaphoreDelete(SemaphoreHandle_t handle)
+{
+    delete handle;
+}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        handle->lock();
+        return pdTRUE;
+    }
+    return handle->try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    handle->unlock();
+    return pdTRUE;
+}
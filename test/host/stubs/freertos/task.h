@@ -0,0 +1,7 @@
+// Host stub of FreeRTOS tasks
+#pragma once
+#include "FreeRTOS.h"
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
@@ -0,0 +1,377 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer - tx queue send path test and benchmark
+//
+// Checks RdWebChannelTable and RdWebSendGate (including that the gate serializes producers to an
+// RdWebSPSCQueue) and compares the send path of RdWebConnManager for messages/sec:
+// - previous queue - a mutex-guarded queue as ThreadSafeQueue (one mutex per put and per get)
+// - previous fix - channel map mutex, per-slot send mutex and RdWebSPSCQueue
+// - current - lock-free channel table lookup, send gate compare-and-swap and RdWebSPSCQueue
+// On the host build with test/host/runHostTests.sh - on the target call runTxQueueBench() from app_main
+// (FreeRTOS mutexes are modelled by std::timed_mutex and a tick wait by a yield)
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+#include "RdWebSPSCQueue.h"
+#include "RdWebSendGate.h"
+#include "RdWebChannelTable.h"
+
+#define TEST_CHECK(cond, ...) do { if (!(cond)) { printf("txQueueBench FAIL line %d: ", __LINE__); \
+            printf(__VA_ARGS__); printf("\n"); return false; } } while (0)
+
+// Queued item - the payload is shared (as RdWebDataFrame) so a put copies a reference
+class BenchFrame
+{
+public:
+    std::shared_ptr<const std::vector<uint8_t>> pData;
+    uint32_t seq = 0;
+};
+
+static const uint32_t QUEUE_MAX_LEN = 30;
+static const uint32_t LOCK_WAIT_MS = 10;
+static const uint32_t NUM_CONN_SLOTS = 6;
+static const uint32_t BENCH_CHANNEL_ID = 3;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send paths
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Previous queue - as ThreadSafeQueue (a mutex taken with a timeout for each put and get)
+class PrevQueuePath
+{
+public:
+    bool send(uint32_t channelID, const BenchFrame& frame)
+    {
+        (void)channelID;
+        if (!_mutex.try_lock_for(std::chrono::milliseconds(LOCK_WAIT_MS)))
+            return false;
+        bool putOk = _queue.size() < QUEUE_MAX_LEN;
+        if (putOk)
+            _queue.push(frame);
+        _mutex.unlock();
+        return putOk;
+    }
+    bool get(BenchFrame& frame)
+    {
+        if (!_mutex.try_lock_for(std::chrono::milliseconds(LOCK_WAIT_MS)))
+            return false;
+        bool getOk = !_queue.empty();
+        if (getOk)
+        {
+            frame = std::move(_queue.front());
+            _queue.pop();
+        }
+        _mutex.unlock();
+        return getOk;
+    }
+private:
+    std::timed_mutex _mutex;
+    std::queue<BenchFrame> _queue;
+};
+
+// Previous fix - channel map mutex to find the slot then the slot's send mutex around the put
+class MutexSPSCPath
+{
+public:
+    MutexSPSCPath() : _queue(QUEUE_MAX_LEN)
+    {
+        for (uint32_t i = 0; i < NUM_CONN_SLOTS * 2; i++)
+            _channelIDToConnSlot[i] = i % NUM_CONN_SLOTS;
+    }
+    bool send(uint32_t channelID, const BenchFrame& frame)
+    {
+        if (!_channelMapMutex.try_lock_for(std::chrono::milliseconds(LOCK_WAIT_MS)))
+            return false;
+        auto it = _channelIDToConnSlot.find(channelID);
+        bool found = it != _channelIDToConnSlot.end();
+        uint32_t responderGen = _responderGen;
+        _channelMapMutex.unlock();
+        if (!found || !_sendMutex.try_lock_for(std::chrono::milliseconds(LOCK_WAIT_MS)))
+            return false;
+        bool putOk = (responderGen == _responderGen) && _queue.put(frame);
+        _sendMutex.unlock();
+        return putOk;
+    }
+    bool get(BenchFrame& frame)
+    {
+        return _queue.get(frame);
+    }
+private:
+    std::timed_mutex _channelMapMutex;
+    std::unordered_map<uint32_t, uint32_t> _channelIDToConnSlot;
+    std::timed_mutex _sendMutex;
+    uint32_t _responderGen = 0;
+    RdWebSPSCQueue<BenchFrame> _queue;
+};
+
+// Current - channel table lookup and send gate (as RdWebConnManager::lockChannelForSend)
+class GateSPSCPath
+{
+public:
+    GateSPSCPath() : _queue(QUEUE_MAX_LEN)
+    {
+        _channelTable.setup(NUM_CONN_SLOTS * 8);
+        for (uint32_t i = 0; i < NUM_CONN_SLOTS * 2; i++)
+            _channelTable.add(i, i % NUM_CONN_SLOTS, _sendGate.getGen());
+    }
+    bool send(uint32_t channelID, const BenchFrame& frame)
+    {
+        uint32_t connSlotIdx = 0, responderGen = 0;
+        if (!_channelTable.lookup(channelID, connSlotIdx, responderGen))
+            return false;
+        auto waitEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(LOCK_WAIT_MS);
+        while (true)
+        {
+            RdWebSendGate::AcquireResult acquireResult = _sendGate.tryAcquire(responderGen);
+            if (acquireResult == RdWebSendGate::GATE_ACQUIRED)
+                break;
+            if ((acquireResult == RdWebSendGate::GATE_GEN_CHANGED) || (std::chrono::steady_clock::now() > waitEnd))
+                return false;
+            std::this_thread::yield();
+        }
+        bool putOk = _queue.put(frame);
+        _sendGate.release();
+        return putOk;
+    }
+    bool get(BenchFrame& frame)
+    {
+        return _queue.get(frame);
+    }
+private:
+    RdWebChannelTable _channelTable;
+    RdWebSendGate _sendGate;
+    RdWebSPSCQueue<BenchFrame> _queue;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Checks
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool checkChannelTable()
+{
+    RdWebChannelTable channelTable;
+    uint32_t connSlotIdx = 0, gen = 0;
+    TEST_CHECK(!channelTable.lookup(1, connSlotIdx, gen), "lookup before setup");
+    TEST_CHECK(!channelTable.add(1, 0, 0), "add before setup");
+    channelTable.setup(10);
+
+    // Add, lookup, remove and re-add (to another slot with another generation)
+    TEST_CHECK(channelTable.add(100, 2, 7), "add");
+    TEST_CHECK(channelTable.lookup(100, connSlotIdx, gen) && (connSlotIdx == 2) && (gen == 7), "lookup");
+    TEST_CHECK(!channelTable.lookup(101, connSlotIdx, gen), "lookup missing");
+    channelTable.remove(100, 3);
+    TEST_CHECK(channelTable.lookup(100, connSlotIdx, gen), "remove from other slot removed");
+    channelTable.remove(100, 2);
+    TEST_CHECK(!channelTable.lookup(100, connSlotIdx, gen), "lookup removed");
+    TEST_CHECK(channelTable.add(100, 4, RdWebSendGate::GEN_MASK), "re-add");
+    TEST_CHECK(channelTable.lookup(100, connSlotIdx, gen) && (connSlotIdx == 4) && (gen == RdWebSendGate::GEN_MASK),
+                "lookup re-added");
+    TEST_CHECK(!channelTable.add(UINT32_MAX, 0, 0), "add reserved channelID");
+    TEST_CHECK(!channelTable.add(5, RdWebChannelTable::MAX_CONN_SLOTS, 0), "add slot out of range");
+
+    // Fill (capacity is 16) - channelIDs which collide are probed past
+    uint32_t numAdded = 0;
+    for (uint32_t channelID = 0; channelID < 100; channelID++)
+        if (channelTable.add(channelID * 16, channelID % 6, channelID))
+            numAdded++;
+    TEST_CHECK(numAdded == 15, "full table added %u", numAdded);
+    for (uint32_t channelID = 0; channelID < 15; channelID++)
+        TEST_CHECK(channelTable.lookup(channelID * 16, connSlotIdx, gen) && (connSlotIdx == channelID % 6) &&
+                    (gen == channelID), "lookup in full table %u", channelID);
+    TEST_CHECK(!channelTable.lookup(15 * 16, connSlotIdx, gen), "lookup not added to full table");
+    return true;
+}
+
+static bool checkSendGate()
+{
+    RdWebSendGate sendGate;
+    uint32_t gen = sendGate.getGen();
+    TEST_CHECK(sendGate.tryAcquire(gen) == RdWebSendGate::GATE_ACQUIRED, "acquire");
+    TEST_CHECK(sendGate.tryAcquire(gen) == RdWebSendGate::GATE_HELD, "acquire held");
+    TEST_CHECK(!sendGate.tryAdvanceGen(), "advance while held");
+    sendGate.release();
+    TEST_CHECK(sendGate.tryAdvanceGen(), "advance");
+    TEST_CHECK(sendGate.tryAcquire(gen) == RdWebSendGate::GATE_GEN_CHANGED, "acquire old gen");
+    TEST_CHECK(sendGate.tryAcquire(gen + 1) == RdWebSendGate::GATE_ACQUIRED, "acquire new gen");
+    sendGate.release();
+
+    // Generation wraps
+    for (uint32_t i = 0; i < RdWebSendGate::GEN_MASK; i++)
+        sendGate.tryAdvanceGen();
+    TEST_CHECK(sendGate.getGen() == gen, "gen wrap %u", sendGate.getGen());
+
+    // Producers on several threads with a consumer - the gate must keep the queue single producer
+    // (each producer's items arrive in order and none are lost or duplicated)
+    static const uint32_t NUM_PRODUCERS = 3;
+    static const uint32_t ITEMS_PER_PRODUCER = 200000;
+    RdWebSPSCQueue<uint32_t> queue(QUEUE_MAX_LEN);
+    std::vector<std::thread> producers;
+    for (uint32_t producerIdx = 0; producerIdx < NUM_PRODUCERS; producerIdx++)
+    {
+        producers.emplace_back([&, producerIdx]() {
+            for (uint32_t seq = 0; seq < ITEMS_PER_PRODUCER; )
+            {
+                if (sendGate.tryAcquire(gen) != RdWebSendGate::GATE_ACQUIRED)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                bool putOk = queue.put((producerIdx << 24) | seq);
+                sendGate.release();
+                if (putOk)
+                    seq++;
+                else
+                    std::this_thread::yield();
+            }
+        });
+    }
+    std::vector<uint32_t> nextSeq(NUM_PRODUCERS, 0);
+    uint32_t numGot = 0;
+    bool orderOk = true;
+    while (numGot < NUM_PRODUCERS * ITEMS_PER_PRODUCER)
+    {
+        uint32_t item = 0;
+        if (!queue.get(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        uint32_t producerIdx = item >> 24;
+        if ((producerIdx >= NUM_PRODUCERS) || ((item & 0xffffff) != nextSeq[producerIdx]))
+            orderOk = false;
+        else
+            nextSeq[producerIdx]++;
+        numGot++;
+    }
+    for (std::thread& producer : producers)
+        producer.join();
+    TEST_CHECK(orderOk, "items lost, duplicated or out of order");
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Benchmark
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Send numMsgs from each producer thread with a consumer thread draining - returns msgs/sec
+template<typename SendPath>
+static double benchThreads(uint32_t numProducers, uint32_t numMsgs, uint32_t& numRetries)
+{
+    SendPath sendPath;
+    BenchFrame frame;
+    frame.pData = std::make_shared<const std::vector<uint8_t>>(64, 0x55);
+    std::atomic<uint32_t> retries(0);
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (uint32_t producerIdx = 0; producerIdx < numProducers; producerIdx++)
+    {
+        producers.emplace_back([&]() {
+            BenchFrame msg = frame;
+            for (uint32_t i = 0; i < numMsgs; )
+            {
+                msg.seq = i;
+                if (sendPath.send(BENCH_CHANNEL_ID, msg))
+                {
+                    i++;
+                    continue;
+                }
+                retries++;
+                std::this_thread::yield();
+            }
+        });
+    }
+    BenchFrame got;
+    for (uint32_t numGot = 0; numGot < numProducers * numMsgs; )
+    {
+        if (sendPath.get(got))
+            numGot++;
+        else
+            std::this_thread::yield();
+    }
+    for (std::thread& producer : producers)
+        producer.join();
+    double elapsedSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    numRetries = retries;
+    return numProducers * numMsgs / elapsedSecs;
+}
+
+// Send and drain on one thread (no contention) - returns ns per send
+template<typename SendPath>
+static double benchUncontended(uint32_t numMsgs)
+{
+    SendPath sendPath;
+    BenchFrame frame;
+    frame.pData = std::make_shared<const std::vector<uint8_t>>(64, 0x55);
+    BenchFrame got;
+    double sendSecs = 0;
+    for (uint32_t i = 0; i < numMsgs; i += QUEUE_MAX_LEN)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        for (uint32_t j = 0; j < QUEUE_MAX_LEN; j++)
+            sendPath.send(BENCH_CHANNEL_ID, frame);
+        sendSecs += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        while (sendPath.get(got))
+            ;
+    }
+    return sendSecs * 1e9 / numMsgs;
+}
+
+template<typename SendPath>
+static void benchSendPath(const char* name)
+{
+    static const uint32_t NUM_MSGS = 1000000;
+    static const uint32_t BEST_OF = 3;
+    double bestNs = 0, bestOneProducer = 0, bestTwoProducers = 0;
+    uint32_t retriesOne = 0, retriesTwo = 0;
+    for (uint32_t run = 0; run < BEST_OF; run++)
+    {
+        double ns = benchUncontended<SendPath>(NUM_MSGS);
+        if ((run == 0) || (ns < bestNs))
+            bestNs = ns;
+        uint32_t retries = 0;
+        double rate = benchThreads<SendPath>(1, NUM_MSGS, retries);
+        if (rate > bestOneProducer)
+        {
+            bestOneProducer = rate;
+            retriesOne = retries;
+        }
+        rate = benchThreads<SendPath>(2, NUM_MSGS / 2, retries);
+        if (rate > bestTwoProducers)
+        {
+            bestTwoProducers = rate;
+            retriesTwo = retries;
+        }
+    }
+    printf("%-34s %9.1f ns/send  1 producer %6.2f M msgs/s (%u retries)  2 producers %6.2f M msgs/s (%u retries)\n",
+                name, bestNs, bestOneProducer / 1e6, retriesOne, bestTwoProducers / 1e6, retriesTwo);
+}
+
+bool runTxQueueBench()
+{
+    if (!checkChannelTable() || !checkSendGate())
+        return false;
+    printf("txQueueBench channel table and send gate checks OK (%u hardware threads)\n",
+                std::thread::hardware_concurrency());
+    benchSendPath<PrevQueuePath>("previous ThreadSafeQueue");
+    benchSendPath<MutexSPSCPath>("map mutex + send mutex + SPSC");
+    benchSendPath<GateSPSCPath>("channel table + send gate + SPSC");
+    return true;
+}
+
+#ifndef ESP_PLATFORM
+int main()
+{
+    return runTxQueueBench() ? 0 : 1;
+}
+#endif
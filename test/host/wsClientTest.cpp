@@ -0,0 +1,392 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer - websocket client loopback test
+//
+// Runs RdWebSocketClient against a minimal server on the loopback interface and checks the upgrade
+// (request, Sec-WebSocket-Accept check, frames arriving with the response and masked client frames),
+// that bad upgrade responses and refused connections are rejected and the reconnect backoff (doubling
+// from the minimum up to the maximum with up to 25% jitter, reset on connecting) - on the host build with
+// test/host/runHostTests.sh (the client uses RdWebSocketPlatform's POSIX sockets there)
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <poll.h>
+#include "RdWebSocketClient.h"
+#include "RdWebSocketPlatform.h"
+
+#define TEST_CHECK(cond, ...) do { if (!(cond)) { printf("wsClientTest FAIL line %d: ", __LINE__); \
+            printf(__VA_ARGS__); printf("\n"); return false; } } while (0)
+
+static const uint32_t RECONNECT_MIN_MS = 40;
+static const uint32_t RECONNECT_MAX_MS = 320;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Loopback server - accepts connections and answers the upgrade request as set by the mode
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class LoopbackServer
+{
+public:
+    enum Mode
+    {
+        MODE_UPGRADE_OK,
+        MODE_BAD_ACCEPT,
+        MODE_NO_UPGRADE_HEADER,
+        MODE_NOT_SWITCHING
+    };
+
+    LoopbackServer(Mode mode)
+        : _mode(mode)
+    {
+        _listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t addrLen = sizeof(addr);
+        if ((bind(_listenSocket, (struct sockaddr*)&addr, sizeof(addr)) == 0) && (listen(_listenSocket, 4) == 0) &&
+                    (getsockname(_listenSocket, (struct sockaddr*)&addr, &addrLen) == 0))
+            _port = ntohs(addr.sin_port);
+        _thread = std::thread(&LoopbackServer::run, this);
+    }
+    ~LoopbackServer()
+    {
+        _stop = true;
+        _thread.join();
+        ::close(_listenSocket);
+    }
+
+    uint16_t getPort() const
+    {
+        return _port;
+    }
+    uint32_t getNumAccepted()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _acceptMs.size();
+    }
+    std::vector<uint64_t> getAcceptMs()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _acceptMs;
+    }
+    std::string getRequest()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _request;
+    }
+    std::string getRxMsg()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _rxMsg;
+    }
+    bool wasRxMasked()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _rxMasked;
+    }
+
+    static const char* SERVER_MSG;
+
+private:
+    Mode _mode;
+    int _listenSocket = -1;
+    uint16_t _port = 0;
+    std::atomic<bool> _stop{false};
+    std::thread _thread;
+    std::mutex _mutex;
+    std::vector<uint64_t> _acceptMs;
+    std::string _request;
+    std::string _rxMsg;
+    bool _rxMasked = false;
+
+    // Wait for a socket to be readable
+    bool waitReadable(int sock, int timeoutMs)
+    {
+        struct pollfd pollFd = {sock, POLLIN, 0};
+        return poll(&pollFd, 1, timeoutMs) > 0;
+    }
+
+    void run()
+    {
+        while (!_stop)
+        {
+            if (!waitReadable(_listenSocket, 5))
+                continue;
+            int connSocket = accept(_listenSocket, nullptr, nullptr);
+            if (connSocket < 0)
+                continue;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _acceptMs.push_back(millis());
+            }
+            handleConn(connSocket);
+            ::close(connSocket);
+        }
+    }
+
+    void handleConn(int connSocket)
+    {
+        // Request
+        std::string request;
+        char rxBuf[1024];
+        while (!_stop && (request.find("\r\n\r\n") == std::string::npos))
+        {
+            if (!waitReadable(connSocket, 5))
+                continue;
+            int rxLen = recv(connSocket, rxBuf, sizeof(rxBuf), 0);
+            if (rxLen <= 0)
+                return;
+            request.append(rxBuf, rxLen);
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _request = request;
+        }
+
+        // Accept value for the key
+        static const char KEY_HEADER[] = "Sec-WebSocket-Key: ";
+        size_t keyPos = request.find(KEY_HEADER);
+        std::string key = keyPos == std::string::npos ? "" :
+                    request.substr(keyPos + sizeof(KEY_HEADER) - 1, request.find("\r\n", keyPos) - keyPos - sizeof(KEY_HEADER) + 1);
+        std::string accept = RdWebSocketLink::genMagicResponse(key.c_str(), "13").c_str();
+        if (_mode == MODE_BAD_ACCEPT)
+            accept[0] = accept[0] == 'A' ? 'B' : 'A';
+
+        // Response - header names and values in mixed case - on success a frame follows in the same write
+        std::string response = _mode == MODE_NOT_SWITCHING ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 101 Switching Protocols\r\n";
+        if (_mode != MODE_NO_UPGRADE_HEADER)
+            response += "upgrade: WebSocket\r\n";
+        response += "Connection: keep-alive, Upgrade\r\nsec-websocket-accept: " + accept + "\r\n\r\n";
+        if (_mode == MODE_UPGRADE_OK)
+        {
+            response += (char)(0x80 | WEBSOCKET_OPCODE_TEXT);
+            response += (char)strlen(SERVER_MSG);
+            response += SERVER_MSG;
+        }
+        send(connSocket, response.data(), response.size(), 0);
+        if (_mode != MODE_UPGRADE_OK)
+            return;
+
+        // Receive a frame from the client (client frames must be masked)
+        std::vector<uint8_t> frame;
+        while (!_stop)
+        {
+            if (waitReadable(connSocket, 5))
+            {
+                int rxLen = recv(connSocket, rxBuf, sizeof(rxBuf), 0);
+                if (rxLen <= 0)
+                    return;
+                frame.insert(frame.end(), rxBuf, rxBuf + rxLen);
+            }
+            if ((frame.size() >= 2) && (frame.size() >= 2 + 4 + (uint32_t)(frame[1] & 0x7f)))
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _rxMasked = (frame[1] & 0x80) != 0;
+                uint32_t payloadLen = frame[1] & 0x7f;
+                _rxMsg.clear();
+                for (uint32_t i = 0; i < payloadLen; i++)
+                    _rxMsg += (char)(frame[6 + i] ^ frame[2 + i % 4]);
+                frame.clear();
+            }
+        }
+    }
+};
+
+const char* LoopbackServer::SERVER_MSG = "hello from server";
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Client helpers
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ClientEvents
+{
+public:
+    uint32_t numConnects = 0;
+    uint32_t numDisconnects = 0;
+    std::string rxText;
+    void onEvent(RdWebSocketEventCode eventCode, const uint8_t* pBuf, uint32_t bufLen)
+    {
+        if (eventCode == WEBSOCKET_EVENT_CONNECT)
+            numConnects++;
+        else if ((eventCode == WEBSOCKET_EVENT_DISCONNECT_EXTERNAL) || (eventCode == WEBSOCKET_EVENT_DISCONNECT_ERROR))
+            numDisconnects++;
+        else if (eventCode == WEBSOCKET_EVENT_TEXT)
+            rxText.assign((const char*)pBuf, bufLen);
+    }
+};
+
+// Service the client until done() returns true or the timeout
+template<typename Done>
+static bool serviceUntil(RdWebSocketClient& client, uint32_t timeoutMs, Done done)
+{
+    uint64_t startMs = millis();
+    while (!done())
+    {
+        if (millis() - startMs > timeoutMs)
+            return false;
+        client.service();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Get a value from the client's stats JSON
+static uint32_t getStat(RdWebSocketClient& client, const char* name)
+{
+    std::string statsStr = client.getStatsJSON().c_str();
+    std::string nameStr = std::string("\"") + name + "\":";
+    size_t pos = statsStr.find(nameStr);
+    return pos == std::string::npos ? UINT32_MAX : strtoul(statsStr.c_str() + pos + nameStr.size(), nullptr, 10);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Checks
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool checkPlatform()
+{
+    // RFC 6455 section 1.3 example and FIPS 180 / RFC 4648 test vectors
+    TEST_CHECK(RdWebSocketLink::genMagicResponse("dGhlIHNhbXBsZSBub25jZQ==", "13") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=",
+                "accept value %s", RdWebSocketLink::genMagicResponse("dGhlIHNhbXBsZSBub25jZQ==", "13").c_str());
+    uint8_t sha1Result[RdWebSocketPlatform::SHA1_RESULT_LEN];
+    static const char SHA1_MSG[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    static const uint8_t SHA1_EXPECTED[] = {0x84, 0x98, 0x3e, 0x44, 0x1c, 0x3b, 0xd2, 0x6e, 0xba, 0xae,
+                0x4a, 0xa1, 0xf9, 0x51, 0x29, 0xe5, 0xe5, 0x46, 0x70, 0xf1};
+    RdWebSocketPlatform::sha1((const uint8_t*)SHA1_MSG, strlen(SHA1_MSG), sha1Result);
+    TEST_CHECK(memcmp(sha1Result, SHA1_EXPECTED, sizeof(sha1Result)) == 0, "sha1");
+    static const char* BASE64_IN[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    static const char* BASE64_OUT[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+    for (uint32_t i = 0; i < sizeof(BASE64_IN) / sizeof(BASE64_IN[0]); i++)
+    {
+        char outStr[16];
+        uint32_t outLen = 0;
+        TEST_CHECK(RdWebSocketPlatform::base64Encode((const uint8_t*)BASE64_IN[i], strlen(BASE64_IN[i]), outStr,
+                    sizeof(outStr), outLen) && (strcmp(outStr, BASE64_OUT[i]) == 0) && (outLen == strlen(BASE64_OUT[i])),
+                    "base64 %s gave %s", BASE64_IN[i], outStr);
+    }
+    char shortStr[8];
+    uint32_t outLen = 0;
+    TEST_CHECK(!RdWebSocketPlatform::base64Encode((const uint8_t*)"foobar", 6, shortStr, sizeof(shortStr), outLen),
+                "base64 output too short");
+    return true;
+}
+
+static bool checkUpgradeOk()
+{
+    // Name resolution (localhost) as well as the upgrade
+    LoopbackServer server(LoopbackServer::MODE_UPGRADE_OK);
+    ClientEvents events;
+    RdWebSocketClient client;
+    String url = "ws://localhost:" + String(server.getPort()) + "/test/path";
+    TEST_CHECK(client.setup(url, std::bind(&ClientEvents::onEvent, &events, std::placeholders::_1,
+                std::placeholders::_2, std::placeholders::_3), 0, 0, 10, RECONNECT_MIN_MS, RECONNECT_MAX_MS), "setup");
+    TEST_CHECK(serviceUntil(client, 2000, [&]() { return events.numConnects > 0; }), "not connected");
+    TEST_CHECK(client.isConnected(), "isConnected");
+    TEST_CHECK(serviceUntil(client, 2000, [&]() { return !events.rxText.empty(); }), "frame with response not received");
+    TEST_CHECK(events.rxText == LoopbackServer::SERVER_MSG, "received %s", events.rxText.c_str());
+    std::string request = server.getRequest();
+    TEST_CHECK(request.find("GET /test/path HTTP/1.1\r\n") == 0, "request line %s", request.c_str());
+    TEST_CHECK(request.find("\r\nHost: localhost:" + std::to_string(server.getPort()) + "\r\n") != std::string::npos,
+                "host header");
+    TEST_CHECK(request.find("\r\nSec-WebSocket-Version: 13\r\n") != std::string::npos, "version header");
+    TEST_CHECK(client.sendText("hello from client"), "sendText");
+    TEST_CHECK(serviceUntil(client, 2000, [&]() { return !server.getRxMsg().empty(); }), "client frame not received");
+    TEST_CHECK(server.getRxMsg() == "hello from client", "server received %s", server.getRxMsg().c_str());
+    TEST_CHECK(server.wasRxMasked(), "client frame not masked");
+    TEST_CHECK(getStat(client, "connects") == 1, "connects %u", getStat(client, "connects"));
+    TEST_CHECK(getStat(client, "backoffMs") == RECONNECT_MIN_MS, "backoff after connect %u", getStat(client, "backoffMs"));
+    client.close();
+    return true;
+}
+
+// The server rejects (or isn't there) - check each attempt waits for the backoff which doubles up to the max
+static bool checkRejected(LoopbackServer::Mode mode, const char* modeName)
+{
+    static const uint32_t NUM_ATTEMPTS = 6;
+    LoopbackServer server(mode);
+    ClientEvents events;
+    RdWebSocketClient client;
+    String url = "ws://127.0.0.1:" + String(server.getPort());
+    TEST_CHECK(client.setup(url, std::bind(&ClientEvents::onEvent, &events, std::placeholders::_1,
+                std::placeholders::_2, std::placeholders::_3), 0, 0, 10, RECONNECT_MIN_MS, RECONNECT_MAX_MS), "setup");
+    TEST_CHECK(serviceUntil(client, 5000, [&]() { return server.getNumAccepted() >= NUM_ATTEMPTS; }),
+                "%s attempts %u", modeName, server.getNumAccepted());
+    TEST_CHECK(events.numConnects == 0, "%s connected", modeName);
+    TEST_CHECK(!client.isConnected(), "%s isConnected", modeName);
+    std::vector<uint64_t> acceptMs = server.getAcceptMs();
+    uint32_t delayMs = RECONNECT_MIN_MS;
+    String intervalsStr;
+    for (uint32_t i = 1; i < NUM_ATTEMPTS; i++)
+    {
+        uint32_t intervalMs = acceptMs[i] - acceptMs[i - 1];
+        intervalsStr += String(intervalMs) + " ";
+        TEST_CHECK((intervalMs >= delayMs) && (intervalMs <= delayMs + delayMs / 4 + 50),
+                    "%s attempt %u interval %ums backoff %ums", modeName, i, intervalMs, delayMs);
+        delayMs = delayMs * 2 < RECONNECT_MAX_MS ? delayMs * 2 : RECONNECT_MAX_MS;
+    }
+    TEST_CHECK(getStat(client, "fails") >= NUM_ATTEMPTS - 1, "%s fails %u", modeName, getStat(client, "fails"));
+    printf("wsClientTest %-16s rejected %u attempts intervals (ms) %s\n", modeName, NUM_ATTEMPTS, intervalsStr.c_str());
+    client.close();
+    return true;
+}
+
+static bool checkRefused()
+{
+    // Get a port with no listener
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    bind(sock, (struct sockaddr*)&addr, sizeof(addr));
+    getsockname(sock, (struct sockaddr*)&addr, &addrLen);
+    ::close(sock);
+
+    // Failures back off
+    ClientEvents events;
+    RdWebSocketClient client;
+    String url = "ws://127.0.0.1:" + String(ntohs(addr.sin_port));
+    TEST_CHECK(client.setup(url, std::bind(&ClientEvents::onEvent, &events, std::placeholders::_1,
+                std::placeholders::_2, std::placeholders::_3), 0, 0, 10, RECONNECT_MIN_MS, RECONNECT_MAX_MS), "setup");
+    TEST_CHECK(serviceUntil(client, 5000, [&]() { return getStat(client, "fails") >= 4; }), "refused fails %u",
+                getStat(client, "fails"));
+    TEST_CHECK(getStat(client, "backoffMs") == RECONNECT_MAX_MS, "refused backoff %u", getStat(client, "backoffMs"));
+    TEST_CHECK(events.numConnects == 0, "refused connected");
+    printf("wsClientTest refused          fails %u backoffMs %u\n", getStat(client, "fails"), getStat(client, "backoffMs"));
+    return true;
+}
+
+bool runWsClientTest()
+{
+    if (!checkPlatform() || !checkUpgradeOk() ||
+                !checkRejected(LoopbackServer::MODE_BAD_ACCEPT, "badAccept") ||
+                !checkRejected(LoopbackServer::MODE_NO_UPGRADE_HEADER, "noUpgradeHeader") ||
+                !checkRejected(LoopbackServer::MODE_NOT_SWITCHING, "notSwitching") ||
+                !checkRefused())
+        return false;
+    printf("wsClientTest OK\n");
+    return true;
+}
+
+#ifndef ESP_PLATFORM
+int main()
+{
+    return runWsClientTest() ? 0 : 1;
+}
+#endif
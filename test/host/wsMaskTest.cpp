@@ -0,0 +1,138 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RdWebServer - WebSocket mask test and benchmark
+//
+// Checks RdWebSocketMask against a bytewise reference for all lengths, key offsets and alignments and
+// measures MB/s for both - on the host build with test/host/runHostTests.sh - on the target call
+// runWsMaskTest() from app_main (the source only needs RdWebSocketMask.h)
+//
+// Rob Dobson 2020
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include "RdWebSocketMask.h"
+
+// Bytewise reference (as the previous unmaskData and sendMsg loops)
+static void maskBytewise(uint8_t* pDest, const uint8_t* pSrc, uint32_t len, const uint8_t* pMaskKey, uint32_t maskOffset)
+{
+    for (uint32_t i = 0; i < len; i++)
+        pDest[i] = pSrc[i] ^ pMaskKey[(maskOffset + i) % 4];
+}
+
+static bool checkEquivalence()
+{
+    static const uint8_t maskKey[4] = {0x37, 0xfa, 0x21, 0x3d};
+    static const uint32_t MAX_LEN = 300;
+    static const uint32_t MAX_ALIGN = 16;
+    std::vector<uint8_t> src(MAX_LEN + MAX_ALIGN), ref(MAX_LEN + MAX_ALIGN), out(MAX_LEN + MAX_ALIGN);
+    for (uint32_t i = 0; i < src.size(); i++)
+        src[i] = (uint8_t)(i * 131 + 7);
+    uint32_t numChecks = 0;
+    for (uint32_t len = 0; len <= MAX_LEN; len++)
+    {
+        for (uint32_t maskOffset = 0; maskOffset < 8; maskOffset++)
+        {
+            for (uint32_t srcAlign = 0; srcAlign < MAX_ALIGN; srcAlign += 3)
+            {
+                for (uint32_t destAlign = 0; destAlign < MAX_ALIGN; destAlign++)
+                {
+                    maskBytewise(ref.data() + destAlign, src.data() + srcAlign, len, maskKey, maskOffset);
+                    RdWebSocketMask::maskCopy(out.data() + destAlign, src.data() + srcAlign, len, maskKey, maskOffset);
+                    if (memcmp(ref.data() + destAlign, out.data() + destAlign, len) != 0)
+                    {
+                        printf("wsMaskTest FAIL maskCopy len %u offset %u srcAlign %u destAlign %u\n",
+                                    len, maskOffset, srcAlign, destAlign);
+                        return false;
+                    }
+                    memcpy(out.data() + destAlign, src.data() + srcAlign, len);
+                    RdWebSocketMask::maskInPlace(out.data() + destAlign, len, maskKey, maskOffset);
+                    if (memcmp(ref.data() + destAlign, out.data() + destAlign, len) != 0)
+                    {
+                        printf("wsMaskTest FAIL maskInPlace len %u offset %u align %u\n", len, maskOffset, destAlign);
+                        return false;
+                    }
+                    numChecks++;
+                }
+            }
+        }
+    }
+
+    // A payload masked in pieces is the same as masked in one go
+    std::vector<uint8_t> whole(1000), pieces(1000);
+    maskBytewise(whole.data(), src.data(), 300, maskKey, 0);
+    memcpy(pieces.data(), src.data(), 300);
+    for (uint32_t pos = 0, pieceLen = 1; pos < 300; pos += pieceLen, pieceLen = pieceLen % 13 + 1)
+    {
+        uint32_t len = pos + pieceLen > 300 ? 300 - pos : pieceLen;
+        RdWebSocketMask::maskInPlace(pieces.data() + pos, len, maskKey, pos);
+    }
+    if (memcmp(whole.data(), pieces.data(), 300) != 0)
+    {
+        printf("wsMaskTest FAIL masking in pieces\n");
+        return false;
+    }
+    printf("wsMaskTest equivalence ok (%u cases)\n", numChecks);
+    return true;
+}
+
+template<typename Fn>
+static double benchMBps(uint32_t bufLen, uint32_t align, Fn fn)
+{
+    std::vector<uint8_t> buf(bufLen + 16, 0x5a);
+    uint8_t* pBuf = buf.data() + align;
+    uint64_t totalBytes = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    double elapsedSecs = 0;
+    while (elapsedSecs < 0.5)
+    {
+        for (uint32_t i = 0; i < 64; i++)
+            fn(pBuf, bufLen);
+        totalBytes += (uint64_t)bufLen * 64;
+        elapsedSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    }
+    // Stop the compiler discarding the work
+    volatile uint8_t sink = pBuf[bufLen / 2];
+    (void)sink;
+    return totalBytes / elapsedSecs / 1e6;
+}
+
+static void runBenchmark()
+{
+    static const uint8_t maskKey[4] = {0x37, 0xfa, 0x21, 0x3d};
+    static const uint32_t benchLens[] = {125, 1024, 16384};
+    printf("wsMaskTest benchmark MB/s (in place)\n");
+    printf("%8s %6s %12s %12s %8s\n", "len", "align", "bytewise", "word", "ratio");
+    for (uint32_t bufLen : benchLens)
+    {
+        for (uint32_t align = 0; align < 2; align++)
+        {
+            double byteMBps = benchMBps(bufLen, align, [](uint8_t* pBuf, uint32_t len) {
+                maskBytewise(pBuf, pBuf, len, maskKey, 1);
+            });
+            double wordMBps = benchMBps(bufLen, align, [](uint8_t* pBuf, uint32_t len) {
+                RdWebSocketMask::maskInPlace(pBuf, len, maskKey, 1);
+            });
+            printf("%8u %6u %12.1f %12.1f %7.1fx\n", bufLen, align, byteMBps, wordMBps, wordMBps / byteMBps);
+        }
+    }
+}
+
+int runWsMaskTest()
+{
+    if (!checkEquivalence())
+        return 1;
+    runBenchmark();
+    return 0;
+}
+
+#ifndef ESP_PLATFORM
+int main()
+{
+    return runWsMaskTest();
+}
+#endif